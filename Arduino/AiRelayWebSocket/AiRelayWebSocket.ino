@@ -12,8 +12,23 @@
 #include "globals.h"
 #include "audio_utils.h"
 #include "chat_utils.h"
+#include "chat_history.h"
 #include "tts.h"
+#include "tts_pipeline.h"
+#include "tts_cache.h"
+#include "reply_cache.h"
+#include "filler.h"
+#include "intent.h"
+#include "net_pool.h"
+#include "dialog_task.h"
+#include "turn_timeline.h"
+#include "mic_capture.h"
+#include "agc.h"
+#include "aec.h"
+#include "ns.h"
+#include "audio_out.h"
 #include "stt.h"
+#include "flac_encoder.h"
 #include "recording.h"
 #include "led_task.h"
 #include "DAZI-AI-main/src/mp3_decoder/mp3_decoder.h"
@@ -50,7 +65,7 @@ String commandBuffer = "";
 const char* assemblyai_api_key = ASSEMBLYAI_API_KEY;
 const char* stt_ws_host = "streaming.assemblyai.com";
 const uint16_t stt_ws_port = 443;
-String stt_ws_path = "/v3/ws?sample_rate=16000&encoding=pcm_s16le&format_turns=true"
+String stt_ws_path = "/v3/ws?sample_rate=16000&encoding=" STT_UPLINK_ENCODING "&format_turns=true"
                      "&speech_model=universal-streaming-multilingual&language_detection=true"
                      "&end_of_turn_confidence_threshold=0.6"
                      "&min_end_of_turn_silence_when_confident=800"
@@ -58,7 +73,11 @@ String stt_ws_path = "/v3/ws?sample_rate=16000&encoding=pcm_s16le&format_turns=t
 
 // Audio calibration (use M/V/I serial commands to tune)
 int outputVolumePercent = 33;
+#if MIC_AGC
+int silenceThreshold = AGC_SILENCE_LEVEL;  // mean |sample| after the AGC, same on every board
+#else
 int silenceThreshold = 20;
+#endif
 int micTestVolumeShift = 2;
 
 TtsProvider ttsProvider = TTS_GOOGLE;
@@ -82,7 +101,7 @@ volatile bool ledRecording = false;
 volatile bool ledWaiting = false;
 
 bool wsConnected = false;
-bool isProcessing = false;
+std::atomic<bool> isProcessing(false);
 String lastFinalTranscript = "";
 unsigned long lastFinalMs = 0;
 unsigned long lastWsActivityMs = 0;  // Track last WS activity for keep-alive
@@ -92,16 +111,10 @@ unsigned long lastMicSendMs = 0;     // Track when we last sent audio
 // Mic test mode state (micTestVolumeShift is in AUDIO CALIBRATION section)
 bool micTestMode = false;
 bool listeningEnabled = true;
-bool ttsPlaying = false;
+std::atomic<bool> ttsPlaying(false);
 unsigned long ttsCooldownUntilMs = 0;
 int lastTurnOrderHandled = -1;
 
-// ChatMessage struct and extern declarations in globals.h
-
-ChatMessage chatHistory[HISTORY_MAX];
-uint8_t historyCount = 0;
-
-int32_t mic_buffer[FRAME_SAMPLES];
 int16_t pcm_frame[FRAME_SAMPLES];
 
 // ======================= SETUP =======================
@@ -127,6 +140,7 @@ void setup() {
   digitalWrite(PIN_RED, HIGH); 
   digitalWrite(PIN_GREEN, HIGH); // START OFF
 
+#if !STT_UPLOAD_STREAMING
   // Allocate memory (Safe malloc)
   recording_buffer = (uint8_t*)malloc(bufferSize);
   if(recording_buffer == NULL) {
@@ -134,6 +148,7 @@ void setup() {
       while(1);
   }
   Serial.println("RAM Allocated");
+#endif
 
   // WiFi connection with timeout and retry
   WiFi.mode(WIFI_STA);           // Explicit STA mode (required on some ESP32-S3)
@@ -210,6 +225,10 @@ void setup() {
   
   i2s_driver_install(I2S_NUM_1, &spk_config, 0, NULL);
   i2s_set_pin(I2S_NUM_1, &spk_pins);
+#if ECHO_CANCEL
+  aecBegin();  // before either side starts feeding it
+#endif
+  audioOutBegin();
 
   // --- MIC SETUP (32-BIT MODE) ---
   // INMP441 requires 32-bit clocks
@@ -232,8 +251,30 @@ void setup() {
     .data_in_num = I2S_MIC_SD
   };
   
-  i2s_driver_install(I2S_NUM_0, &mic_config, 0, NULL);
+  // Event queue reports DMA overruns to the capture task
+  QueueHandle_t micI2sEvents = NULL;
+  i2s_driver_install(I2S_NUM_0, &mic_config, 8, &micI2sEvents);
   i2s_set_pin(I2S_NUM_0, &mic_pins);
+#if NOISE_SUPPRESS
+  nsBegin();
+#endif
+  micCaptureBegin(micI2sEvents);
+
+  netPoolBegin();
+  chatHistoryBegin();
+#if TTS_CACHE
+  ttsCacheBegin();
+#endif
+#if REPLY_CACHE
+  replyCacheBegin();
+#endif
+#if FILLER_AUDIO
+  fillerBegin();
+#endif
+#if TTS_PIPELINE
+  ttsPipelineBegin();
+#endif
+  dialogTaskBegin();
 
   client.setInsecure();
   
@@ -253,7 +294,8 @@ void setup() {
   Serial.print("TTS provider: ");
   Serial.println(ttsProvider == TTS_GOOGLE ? "Google" : "Groq");
   Serial.print("LLM model: ");
-  Serial.println(llm_model == llm_model_8b ? "llama-3.1-8b-instant" : "llama-3.3-70b-versatile");
+  Serial.println(llmRouterAuto() ? "auto (8b/70b per question)"
+                 : llm_model == llm_model_8b ? "llama-3.1-8b-instant" : "llama-3.3-70b-versatile");
   if (requireWakeEndWords) {
     Serial.printf("Wake/end words: '%s'...'%s'\n", wake_word, end_word);
   } else {
@@ -265,6 +307,28 @@ void setup() {
   xTaskCreate(ledTask, "ledTask", 2048, NULL, 1, NULL);
 }
 
+// Rest of a serial command line ("on" after B, "clear" after K/Q/F, "json" after L),
+// trimmed and lowercased. Waits up to 300 ms for the line to arrive.
+static String readSerialArgs() {
+  String rest = "";
+  unsigned long start = millis();
+  while (millis() - start < 300) {
+    while (Serial.available() > 0) {
+      char d = Serial.read();
+      if (d == '\n' || d == '\r') {
+        rest.trim();
+        rest.toLowerCase();
+        return rest;
+      }
+      rest += d;
+    }
+    delay(5);
+  }
+  rest.trim();
+  rest.toLowerCase();
+  return rest;
+}
+
 void loop() {
   while (Serial.available() > 0) {
     char c = Serial.read();
@@ -284,13 +348,25 @@ void loop() {
       rest.trim();
       rest.toLowerCase();
       if (rest == "ogglellm") {
-        if (llm_model == llm_model_8b) {
+        // auto (router) -> 8b -> 70b -> auto
+        if (llmRouterAuto()) {
+          llmRouterSetAuto(false);
+          llm_model = llm_model_8b;
+          Serial.println("LLM model: llama-3.1-8b-instant (fast)");
+        } else if (llm_model == llm_model_8b) {
           llm_model = llm_model_70b;
           Serial.println("LLM model: llama-3.3-70b-versatile (advanced)");
         } else {
+#if LLM_ROUTER
+          llmRouterSetAuto(true);
+          Serial.println("LLM model: auto (8b/70b per question)");
+#else
           llm_model = llm_model_8b;
           Serial.println("LLM model: llama-3.1-8b-instant (fast)");
+#endif
         }
+      } else if (rest == "tsstats") {
+        ttsPipelinePrintStats();
       } else {
         // Test TTS with fixed phrase
         String testPhrase = "Hello, this is a test of the text to speech system.";
@@ -326,23 +402,8 @@ void loop() {
           }
           inputLine.trim();
           Serial.println("You said: " + inputLine);
-          if (inputLine.length() > 0 && !isProcessing && !ttsPlaying) {
-            isProcessing = true;
-            ledWaiting = true;
-            String reply = getChatResponse(inputLine);
-            if (reply.length() > 0) {
-              Serial.print("AI says: ");
-              Serial.println(reply);
-              if (ttsProvider == TTS_GOOGLE) {
-                speakGoogleTTS(reply);
-              } else {
-                speakGroqTTS(reply);
-              }
-            }
-            addHistory("user", inputLine);
-            addHistory("assistant", reply);
-            isProcessing = false;
-            ledWaiting = false;
+          if (inputLine.length() > 0 && !ttsPlaying) {
+            if (!dialogSubmit(inputLine)) Serial.println("Busy, try again when the reply is done");
           } else if (inputLine.length() == 0) {
             Serial.println("say [text] - type text after 'say ' to send as voice input");
           }
@@ -387,13 +448,12 @@ void loop() {
         Serial.println(getCurrentPromptFirstLine());
         Serial.printf("Prompt index: %d/%d\n", currentPromptIndex, PROMPT_COUNT - 1);
       } else if (rest == "romptnext") {
-        // Cycle to next prompt and reset history
-        currentPromptIndex = (currentPromptIndex + 1) % PROMPT_COUNT;
-        clearChatHistory();
-        Serial.printf("Switched to prompt %d/%d\n", currentPromptIndex, PROMPT_COUNT - 1);
-        Serial.print("New prompt: ");
-        Serial.println(getCurrentPromptFirstLine());
-        Serial.println("Chat history cleared.");
+        // Cycle to next prompt and reset history (between turns, on the dialog task)
+        int next = (currentPromptIndex + 1) % PROMPT_COUNT;
+        if (dialogSwitchPersona(next)) {
+          Serial.printf("Switching to prompt %d/%d (%s), chat history will be cleared\n", next,
+                        PROMPT_COUNT - 1, getPromptName(next));
+        }
       } else {
         // No "rompt" command, toggle TTS provider (original P command)
         if (ttsProvider == TTS_GROQ) {
@@ -457,12 +517,22 @@ void loop() {
         Serial.printf("Current volume: %d%%\n", outputVolumePercent);
       }
     } else if (c == 'W' || c == 'w') {
-      // Toggle wake/end word requirement
-      requireWakeEndWords = !requireWakeEndWords;
-      if (requireWakeEndWords) {
-        Serial.printf("Wake/end word mode: ON (say '%s'...command...'%s')\n", wake_word, end_word);
+      // "whisper" (one question through the Groq Whisper upload) vs plain W (wake/end words)
+      String rest = readSerialArgs();
+      if (rest == "hisper") {
+        if (isProcessing || ttsPlaying) {
+          Serial.println("Busy, try again when the reply is done");
+        } else {
+          RecordAudio(false);
+          wsResetPumpClock();  // the wait for the transcript isn't a WS pump stall
+        }
       } else {
-        Serial.println("Wake/end word mode: OFF (every final transcript sent to LLM)");
+        requireWakeEndWords = !requireWakeEndWords;
+        if (requireWakeEndWords) {
+          Serial.printf("Wake/end word mode: ON (say '%s'...command...'%s')\n", wake_word, end_word);
+        } else {
+          Serial.println("Wake/end word mode: OFF (every final transcript sent to LLM)");
+        }
       }
     } else if (c == 'X' || c == 'x') {
       // Toggle mic test mode
@@ -473,7 +543,7 @@ void loop() {
         Serial.printf("  Output volume: %d%%\n", outputVolumePercent);
         digitalWrite(PIN_GREEN, HIGH); // Turn off green
         // Set speaker to 16kHz mono
-        i2s_set_clk(I2S_NUM_1, 16000, I2S_BITS_PER_SAMPLE_16BIT, I2S_CHANNEL_MONO);
+        audioOutSetFormat(16000, 1);
       } else {
         Serial.println("MIC TEST MODE: OFF - returning to normal operation");
         digitalWrite(PIN_GREEN, LOW);
@@ -517,13 +587,12 @@ void loop() {
         Serial.println(getCurrentPromptFirstLine());
         Serial.printf("Prompt index: %d/%d\n", currentPromptIndex, PROMPT_COUNT - 1);
       } else if (rest == "romptnext") {
-        // Cycle to next prompt and reset history
-        currentPromptIndex = (currentPromptIndex + 1) % PROMPT_COUNT;
-        clearChatHistory();
-        Serial.printf("Switched to prompt %d/%d\n", currentPromptIndex, PROMPT_COUNT - 1);
-        Serial.print("New prompt: ");
-        Serial.println(getCurrentPromptFirstLine());
-        Serial.println("Chat history cleared.");
+        // Cycle to next prompt and reset history (between turns, on the dialog task)
+        int next = (currentPromptIndex + 1) % PROMPT_COUNT;
+        if (dialogSwitchPersona(next)) {
+          Serial.printf("Switching to prompt %d/%d (%s), chat history will be cleared\n", next,
+                        PROMPT_COUNT - 1, getPromptName(next));
+        }
       } else {
         // No "rompt" command, toggle TTS provider (original P command)
         if (ttsProvider == TTS_GROQ) {
@@ -534,11 +603,111 @@ void loop() {
           Serial.println("TTS provider: Groq");
         }
       }
+    } else if (c == 'N' || c == 'n') {
+      // Connection pool stats (handshakes avoided, DNS cache)
+      netPrintStats();
+    } else if (c == 'A' || c == 'a') {
+      // Audio output stats (underruns/overruns, ring watermarks)
+      audioOutPrintStats();
+    } else if (c == 'C' || c == 'c') {
+      // Mic capture stats (DMA overruns, per-reader overruns and frame age), AGC gain
+      micCapturePrintStats();
+      agcPrintStats();
+    } else if (c == 'E' || c == 'e') {
+      // Echo canceller stats (CPU per block vs AEC_BUDGET_US, bulk delay, ERLE)
+#if ECHO_CANCEL
+      aecPrintStats();
+#else
+      Serial.println("Echo canceller disabled (ECHO_CANCEL 0)");
+#endif
+    } else if (c == 'B' || c == 'b') {
+      // Noise suppression: B = stats (cycles per block vs budget, attenuation), Bon / Boff
+      String rest = readSerialArgs();
+#if NOISE_SUPPRESS
+      if (rest == "on" || rest == "off") {
+        nsSetEnabled(rest == "on");
+        Serial.printf("Noise suppression %s\n", nsEnabled() ? "ON" : "OFF");
+      } else {
+        nsPrintStats();
+      }
+#else
+      Serial.println("Noise suppression disabled (NOISE_SUPPRESS 0)");
+#endif
+    } else if (c == 'D' || c == 'd') {
+      // Dialog task and WebSocket pump stats (callback dwell, ws.loop() starvation)
+      dialogPrintStats();
+      wsPrintStats();
+#if INTENT_FAST_PATH
+      intentPrintStats();
+#endif
+    } else if (c == 'U' || c == 'u') {
+      // Uplink VAD stats (speech bursts, audio skipped), codec and endpointer latency;
+      // FLAC compression of the Whisper uploads
+      uplinkPrintStats();
+#if STT_UPLOAD_FLAC
+      flacPrintStats();
+#endif
+    } else if (c == 'L' || c == 'l') {
+      // Turn latency timeline: L = table, Ljson = one-line JSON, Lreset = clear windows, Lroute = LLM router
+      String rest = readSerialArgs();
+      if (rest == "json") {
+        timelinePrintJson();
+      } else if (rest == "route") {
+        llmRouterPrintStats();
+      } else if (rest == "reset") {
+        timelineReset();
+        Serial.println("Turn timeline cleared");
+      } else {
+        timelinePrint();
+      }
+    } else if (c == 'K' || c == 'k') {
+      // TTS flash cache: K = stats (hit ratio, ms saved), Kclear = delete all clips
+      String rest = readSerialArgs();
+#if TTS_CACHE
+      if (rest == "clear") {
+        ttsCacheClear();
+        Serial.println("TTS cache cleared");
+      } else {
+        ttsCachePrintStats();
+      }
+#else
+      Serial.println("TTS cache disabled (TTS_CACHE 0)");
+#endif
+    } else if (c == 'Q' || c == 'q') {
+      // Reply cache: Q = stats (hits, LLM ms saved, entries), Qclear = forget all replies
+      String rest = readSerialArgs();
+#if REPLY_CACHE
+      if (rest == "clear") {
+        replyCacheClear();
+        Serial.println("Reply cache cleared");
+      } else {
+        replyCachePrintStats();
+      }
+#else
+      Serial.println("Reply cache disabled (REPLY_CACHE 0)");
+#endif
+    } else if (c == 'F' || c == 'f') {
+      // Filler audio: F = stats (started, cut, not ready), Fclear = delete rendered lines
+      String rest = readSerialArgs();
+#if FILLER_AUDIO
+      if (rest == "clear") {
+        fillerClear();
+        Serial.println("Filler lines deleted; they are rendered again while idle");
+      } else {
+        fillerPrintStats();
+      }
+#else
+      Serial.println("Filler audio disabled (FILLER_AUDIO 0)");
+#endif
+    } else if (c == 'R' || c == 'r') {
+      // Chat history (messages, token budget, arena use)
+      chatHistoryPrintStats();
     } else if (c == 'H' || c == 'h' || c == '?') {
       // Help - list all commands
       Serial.println("\n=== Serial Commands ===");
       Serial.println("T      - Test current TTS provider");
-      Serial.println("toggleLLM - Toggle LLM (8b fast <-> 70b advanced)");
+      Serial.println("toggleLLM - Cycle LLM: auto (routed per question) -> 8b fast -> 70b advanced");
+      Serial.println("ttsStats - Per-sentence TTS fetch/decode/play timings of last reply");
       Serial.println("P      - Toggle TTS provider (Groq <-> Google)");
       Serial.println("G      - Test Groq TTS (free, unlimited)");
       Serial.println("say [text] - Send as voice input: LLM + TTS (e.g. say What time is it?)");
@@ -549,9 +718,24 @@ void loop() {
       Serial.println("V      - Show volume");
       Serial.println("V###   - Set volume 0-100 (e.g. V50)");
       Serial.println("W      - Toggle wake/end word mode");
+      Serial.println("whisper - Ask one question through Groq Whisper (records from speech onset to VAD end)");
       Serial.println("X      - Toggle mic test mode (hear mic on speaker)");
       Serial.println("I      - Show mic input gain (test mode)");
       Serial.println("I#     - Set mic input gain shift (0=loud, 4=medium, 6=quiet)");
+      Serial.println("N      - Show HTTPS connection pool stats (reuse, handshakes, DNS)");
+      Serial.println("A      - Show audio output stats (underruns, overruns, ring watermarks)");
+      Serial.println("C      - Show mic capture stats (DMA/reader overruns, frame age) and AGC gain");
+      Serial.println("E      - Show echo canceller stats (CPU per block vs budget, bulk delay, ERLE)");
+      Serial.println("B      - Show noise suppression stats (cycles per block vs budget, attenuation); Bon/Boff");
+      Serial.println("D      - Show dialog task + WebSocket pump stats (callback dwell, starvation), voice commands");
+      Serial.println("U      - Show uplink VAD, codec + endpointer stats (KB skipped/sent, end-of-turn latency), FLAC ratio");
+      Serial.println("L      - Show turn latency timeline (p50/p95 per phase and provider)");
+      Serial.println("Ljson  - Turn latency timeline as one line of JSON (Lreset clears it)");
+      Serial.println("Lroute - LLM router: decisions, latency EWMA vs SLO per model");
+      Serial.println("K      - Show TTS flash cache stats (hit ratio, ms saved); Kclear empties it");
+      Serial.println("Q      - Show reply cache stats (hits, LLM ms saved); Qclear empties it");
+      Serial.println("F      - Show filler audio stats (started, cut by reply); Fclear re-renders");
+      Serial.println("R      - Show chat history (messages, ~tokens vs budget, evictions)");
       Serial.println("prompt - Show first line of current prompt");
       Serial.println("promptNext - Switch to next prompt and reset chat history");
       Serial.println("H/?    - Show this help");
@@ -564,7 +748,8 @@ void loop() {
       Serial.printf("  Volume: %d%%\n", outputVolumePercent);
       Serial.printf("  Wake/end words: %s\n", requireWakeEndWords ? "Required" : "Disabled");
       Serial.printf("  Mic test mode: %s\n", micTestMode ? "ON" : "OFF");
-      Serial.printf("  LLM model: %s\n", llm_model == llm_model_8b ? "llama-3.1-8b-instant" : "llama-3.3-70b-versatile");
+      Serial.printf("  LLM model: %s\n", llmRouterAuto() ? "auto (8b/70b per question)"
+                    : llm_model == llm_model_8b ? "llama-3.1-8b-instant" : "llama-3.3-70b-versatile");
       Serial.printf("  Current prompt: %d/%d - %s\n", currentPromptIndex, PROMPT_COUNT - 1, getCurrentPromptFirstLine().c_str());
       Serial.println("=======================\n");
     }
@@ -573,9 +758,10 @@ void loop() {
   // Handle mic test mode or normal operation
   if (micTestMode) {
     runMicTest();
+    wsResetPumpClock();
     // Skip WS operations in test mode but allow serial commands above
   } else {
-    ws.loop();
+    wsPump();
     streamMicFrame();
   }
   
@@ -0,0 +1,382 @@
+#include "aec.h"
+#include "vad.h"
+#include "config.h"
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+
+// Reference ring on the mic's sample clock; a power of two so absolute positions wrap cleanly.
+static const uint32_t REF_RING = 16384;
+static const uint32_t REF_MASK = REF_RING - 1;
+// Envelope resolution of the delay estimate and how much of it is correlated
+static const uint32_t ENV_SUB = 40;  // 2.5 ms
+static const uint32_t MAX_LAG = AEC_MAX_DELAY_MS * SAMPLE_RATE / 1000 / ENV_SUB;
+static const uint32_t ENV_WINDOW = 96;  // 240 ms
+static const uint32_t ENV_HIST = 256;   // >= ENV_WINDOW + MAX_LAG, power of two
+static const uint32_t DELAY_EVERY_BLOCKS = 4;
+static const uint8_t DELAY_CONFIRM = 3;  // same lag this many estimates in a row
+static const int32_t MIN_ENV_SPREAD_Q8 = 256;  // reference envelope must vary by ~3 dB (std dev)
+static const float MIN_CORRELATION = 0.5f;
+// Reference older than this is never read again and is cleared, so a stale lap can't come back
+static const uint32_t REF_KEEP = MAX_LAG * ENV_SUB + AEC_TAPS + MIC_BLOCK_SAMPLES;
+// The audio out task can't legitimately be more than its DMA queue ahead of the mic
+static const uint32_t REF_MAX_LEAD = REF_RING / 2;
+static const uint32_t WINDOW = AEC_TAPS - 1 + MIC_BLOCK_SAMPLES;
+// Regularization of the NLMS step: a reference window at ~32 rms
+static const int64_t POWER_DELTA = (int64_t)AEC_TAPS * 32 * 32;
+static const uint16_t DT_HOLD_BLOCKS = AEC_DT_HOLD_MS / MIC_BLOCK_MS;
+
+struct AecStats {
+  uint32_t blocks;
+  uint32_t activeBlocks;   // reference in the filter window: echo cancelled
+  uint32_t usMax;
+  uint64_t usTotal;        // active blocks
+  uint32_t overBudget;     // active blocks over AEC_BUDGET_US
+  uint32_t nearEndBlocks;
+  uint32_t frozenBlocks;   // reference loud enough, adaptation held by double talk
+  uint32_t anchors;        // reference (re)started on the mic clock
+  uint32_t refDropped;     // reference samples too far ahead of the mic
+  uint32_t delayChanges;
+};
+
+static int16_t* refRing = nullptr;
+static volatile uint32_t refPos = 0;          // next reference sample (mic sample index)
+static volatile uint32_t refActiveUntil = 0;  // end of the newest non-silent reference
+static volatile bool refSeen = false;
+static volatile bool refBreak = true;
+static volatile uint32_t micPos = 0;          // next mic block
+static uint32_t rsPhase = 0;                  // resampler, Q16 input frames
+static int16_t rsPrev = 0;
+
+static int32_t weights[AEC_TAPS];   // Q31; weights[AEC_TAPS - 1] applies to the newest sample
+static int16_t taps16[AEC_TAPS];    // Q15 view the filter runs on
+static int16_t window[WINDOW];
+
+static int16_t micEnv[ENV_HIST];
+static int16_t refEnv[ENV_HIST];
+static uint32_t envCount = 0;
+static int lag = -1;                // confirmed lag in envelope steps (-1 = none yet)
+static int candidate = -1;
+static uint8_t candidateRuns = 0;
+static uint32_t delaySamples = (uint32_t)AEC_DELAY_INIT_MS * SAMPLE_RATE / 1000;
+
+static int32_t erlQ8 = AEC_ERL_INIT_Q8;  // echo level relative to the reference (log2, Q8)
+static int32_t erleQ8 = 0;               // echo removed by the filter, smoothed over adapting blocks
+static int32_t noiseQ8 = 0;              // mic noise floor
+static uint16_t dtHold = 0;
+static volatile uint32_t nearEndRun = 0;  // consecutive near-end blocks
+static AecStats stats;
+
+static void readRef(uint32_t from, int16_t* out, size_t n) {
+  uint32_t start = from & REF_MASK;
+  size_t first = REF_RING - start;
+  if (first > n) first = n;
+  memcpy(out, refRing + start, first * sizeof(int16_t));
+  if (first < n) memcpy(out + first, refRing, (n - first) * sizeof(int16_t));
+}
+
+static void zeroRef(uint32_t from, size_t n) {
+  uint32_t start = from & REF_MASK;
+  size_t first = REF_RING - start;
+  if (first > n) first = n;
+  memset(refRing + start, 0, first * sizeof(int16_t));
+  if (first < n) memset(refRing, 0, (n - first) * sizeof(int16_t));
+}
+
+static int32_t energyQ8(const int16_t* x, size_t n) {
+  uint64_t e = 0;
+  for (size_t i = 0; i < n; i++) e += (uint32_t)((int32_t)x[i] * x[i]);
+  return log2Q8(e / n + 1);
+}
+
+static int16_t sat16(int32_t v) {
+  return v > 32767 ? 32767 : (v < -32768 ? -32768 : (int16_t)v);
+}
+
+static void resetFilter() {
+  memset(weights, 0, sizeof(weights));
+  memset(taps16, 0, sizeof(taps16));
+}
+
+bool aecBegin() {
+  if (refRing) return true;
+  size_t bytes = REF_RING * sizeof(int16_t);
+  if (psramFound()) refRing = (int16_t*)heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM);
+  if (!refRing) refRing = (int16_t*)malloc(bytes);
+  if (!refRing) {
+    Serial.println("AEC: reference ring alloc failed");
+    return false;
+  }
+  memset(refRing, 0, bytes);
+  resetFilter();
+  Serial.printf("AEC: %u taps (%u ms), delay search 0-%u ms, budget %u us per %u ms block\n",
+                (unsigned)AEC_TAPS, (unsigned)(AEC_TAPS * 1000 / SAMPLE_RATE), (unsigned)AEC_MAX_DELAY_MS,
+                (unsigned)AEC_BUDGET_US, (unsigned)MIC_BLOCK_MS);
+  return true;
+}
+
+static int16_t inputFrame(const int16_t* pcm, uint32_t i, uint16_t channels) {
+  if (!pcm) return 0;
+  if (channels == 2) return (int16_t)(((int32_t)pcm[2 * i] + pcm[2 * i + 1]) >> 1);
+  return pcm[i];
+}
+
+void aecReference(const int16_t* pcm, size_t frames, uint32_t sampleRate, uint16_t channels) {
+  if (!refRing || frames == 0 || sampleRate == 0) return;
+  uint32_t mic = __atomic_load_n(&micPos, __ATOMIC_ACQUIRE);
+  uint32_t pos = refPos;
+  if (refBreak || (int32_t)(pos - mic) < 0) {
+    // Output (re)started or fell behind the mic: line it up with the next mic block,
+    // the delay estimate finds where the sound actually lands
+    pos = mic;
+    rsPhase = 0;
+    rsPrev = 0;
+    refBreak = false;
+    stats.anchors++;
+  }
+  if ((int32_t)(pos - mic) > (int32_t)REF_MAX_LEAD) {
+    stats.refDropped += (uint32_t)((uint64_t)frames * SAMPLE_RATE / sampleRate);
+    return;
+  }
+  // Linear interpolation to SAMPLE_RATE; output k sits between input frames floor(p) - 1 and floor(p)
+  uint32_t step = (uint32_t)(((uint64_t)sampleRate << 16) / SAMPLE_RATE);
+  uint64_t phase = rsPhase;
+  bool audible = false;
+  while ((phase >> 16) < frames) {
+    uint32_t i = (uint32_t)(phase >> 16);
+    int32_t a = i ? inputFrame(pcm, i - 1, channels) : rsPrev;
+    int32_t b = inputFrame(pcm, i, channels);
+    int32_t s = a + (int32_t)(((int64_t)(b - a) * (int32_t)(phase & 0xFFFF)) >> 16);
+    refRing[pos & REF_MASK] = (int16_t)s;
+    audible = audible || s != 0;
+    pos++;
+    phase += step;
+  }
+  rsPhase = (uint32_t)(phase - ((uint64_t)frames << 16));
+  rsPrev = inputFrame(pcm, frames - 1, channels);
+  __atomic_store_n(&refPos, pos, __ATOMIC_RELEASE);
+  if (audible) {
+    refActiveUntil = pos;
+    refSeen = true;
+  }
+}
+
+void aecReferenceBreak() {
+  refBreak = true;
+}
+
+// Cross-correlate the mic envelope with the reference envelope at each lag; a lag
+// that wins DELAY_CONFIRM estimates in a row moves the filter there.
+static void estimateDelay() {
+  if (envCount < ENV_HIST) return;
+  uint32_t newest = envCount - 1;
+  uint32_t loud = 0;
+  for (uint32_t i = 0; i < ENV_WINDOW + MAX_LAG; i++) {
+    if (refEnv[(newest - i) & (ENV_HIST - 1)] >= AEC_REF_MIN_Q8) loud++;
+  }
+  if (loud < ENV_WINDOW / 2) return;  // not enough playback to see in the mic
+
+  int32_t mic[ENV_WINDOW];
+  int32_t mean = 0;
+  for (uint32_t i = 0; i < ENV_WINDOW; i++) {
+    mic[i] = micEnv[(newest - i) & (ENV_HIST - 1)];
+    mean += mic[i];
+  }
+  mean /= (int32_t)ENV_WINDOW;
+  for (uint32_t i = 0; i < ENV_WINDOW; i++) mic[i] -= mean;
+
+  int64_t best = 0;
+  int bestLag = -1;
+  for (uint32_t l = 0; l <= MAX_LAG; l++) {
+    int64_t c = 0;
+    for (uint32_t i = 0; i < ENV_WINDOW; i++) {
+      c += mic[i] * (int32_t)refEnv[(newest - i - l) & (ENV_HIST - 1)];
+    }
+    if (c > best) {
+      best = c;
+      bestLag = (int)l;
+    }
+  }
+  if (bestLag < 0) return;
+  // Normalized correlation at the peak: flat envelopes (steady noise) give no usable lag
+  int32_t refMean = 0;
+  for (uint32_t i = 0; i < ENV_WINDOW; i++) refMean += refEnv[(newest - i - bestLag) & (ENV_HIST - 1)];
+  refMean /= (int32_t)ENV_WINDOW;
+  int64_t micVar = 0;
+  int64_t refVar = 0;
+  for (uint32_t i = 0; i < ENV_WINDOW; i++) {
+    int32_t r = refEnv[(newest - i - bestLag) & (ENV_HIST - 1)] - refMean;
+    micVar += mic[i] * mic[i];
+    refVar += r * r;
+  }
+  if (refVar < (int64_t)ENV_WINDOW * MIN_ENV_SPREAD_Q8 * MIN_ENV_SPREAD_Q8) return;
+  float rho = (float)best / sqrtf((float)micVar * (float)refVar + 1.0f);
+  if (rho < MIN_CORRELATION) return;
+  if (bestLag == candidate) {
+    if (candidateRuns < 255) candidateRuns++;
+  } else {
+    candidate = bestLag;
+    candidateRuns = 1;
+  }
+  // A neighbouring step is still inside the AEC_PRE_SAMPLES margin: keep the converged filter
+  if (candidateRuns < DELAY_CONFIRM || candidate == lag) return;
+  if (lag >= 0 && abs(candidate - lag) <= 1) return;
+  lag = candidate;
+  uint32_t d = (uint32_t)lag * ENV_SUB;
+  delaySamples = d > AEC_PRE_SAMPLES ? d - AEC_PRE_SAMPLES : 0;
+  resetFilter();
+  erlQ8 = AEC_ERL_INIT_Q8;
+  erleQ8 = 0;
+  stats.delayChanges++;
+}
+
+static int32_t echoEstimate(const int16_t* x) {
+  int64_t acc = 0;
+  for (uint32_t j = 0; j < AEC_TAPS; j++) acc += (int32_t)taps16[j] * x[j];
+  return (int32_t)(acc >> 15);
+}
+
+// One block of NLMS: d[] is replaced by the residual. window[n .. n + AEC_TAPS) is the
+// reference for sample n; power = its energy for n = 0, slid along the block.
+// w += mu * e * x / (|x|^2 + delta), in Q31.
+static void nlms(int16_t* d, bool adapt, int64_t power) {
+  for (uint32_t n = 0; n < MIC_BLOCK_SAMPLES; n++) {
+    const int16_t* x = window + n;
+    int32_t e = d[n] - echoEstimate(x);
+    d[n] = sat16(e);
+    if (!adapt) continue;
+    int64_t g = ((int64_t)AEC_MU_Q15 * e * 65536) / (power + POWER_DELTA);
+    if (g > (1 << 30)) g = 1 << 30;
+    if (g < -(1 << 30)) g = -(1 << 30);
+    int32_t g32 = (int32_t)g;
+    for (uint32_t j = 0; j < AEC_TAPS; j++) {
+      int64_t w = (int64_t)weights[j] + (int64_t)g32 * x[j];
+      if (w > INT32_MAX) w = INT32_MAX;
+      if (w < -INT32_MAX) w = -INT32_MAX;
+      weights[j] = (int32_t)w;
+      taps16[j] = (int16_t)(w >> 16);
+    }
+    if (n + 1 < MIC_BLOCK_SAMPLES) {
+      power += (int32_t)x[AEC_TAPS] * x[AEC_TAPS] - (int32_t)x[0] * x[0];
+    }
+  }
+}
+
+// Follows the quietest blocks: down at once, up by ~3 dB over a few seconds
+static void trackNoise(int32_t levelQ8) {
+  if (noiseQ8 == 0 || levelQ8 < noiseQ8) noiseQ8 = levelQ8;
+  else noiseQ8 += (levelQ8 - noiseQ8) / 256 + 1;
+}
+
+void aecProcess(int16_t* block, uint32_t pos) {
+  if (!refRing) return;
+  uint32_t startUs = micros();
+  stats.blocks++;
+  zeroRef(pos - REF_KEEP, MIC_BLOCK_SAMPLES);
+
+  // Envelopes for the delay estimate: raw mic, reference as anchored (no delay)
+  int16_t ref[MIC_BLOCK_SAMPLES];
+  readRef(pos, ref, MIC_BLOCK_SAMPLES);
+  for (uint32_t s = 0; s < MIC_BLOCK_SAMPLES; s += ENV_SUB) {
+    micEnv[envCount & (ENV_HIST - 1)] = (int16_t)energyQ8(block + s, ENV_SUB);
+    refEnv[envCount & (ENV_HIST - 1)] = (int16_t)energyQ8(ref + s, ENV_SUB);
+    envCount++;
+  }
+  if (stats.blocks % DELAY_EVERY_BLOCKS == 0) estimateDelay();
+
+  uint32_t start = pos - delaySamples - (AEC_TAPS - 1);
+  if (!refSeen || (int32_t)(refActiveUntil - start) <= 0) {
+    // Nothing playing within reach of the filter: no echo, anything heard is near-end
+    trackNoise(energyQ8(block, MIC_BLOCK_SAMPLES));
+    if (nearEndRun < UINT16_MAX) nearEndRun++;
+    dtHold = 0;
+    __atomic_store_n(&micPos, pos + MIC_BLOCK_SAMPLES, __ATOMIC_RELEASE);
+    return;
+  }
+
+  readRef(start, window, WINDOW);
+  int64_t power = 0;
+  for (uint32_t j = 0; j < AEC_TAPS; j++) power += (int32_t)window[j] * window[j];
+  // Loudest 2.5 ms of reference the filter can see (Geigel-style: onsets and decays
+  // both stay covered), against the mic block
+  int32_t exQ8 = 0;
+  for (uint32_t j = 0; j + ENV_SUB <= WINDOW; j += ENV_SUB) {
+    int32_t q8 = energyQ8(window + j, ENV_SUB);
+    if (q8 > exQ8) exQ8 = q8;
+  }
+  int32_t edQ8 = energyQ8(block, MIC_BLOCK_SAMPLES);
+  trackNoise(edQ8);
+
+  // Residual with the weights as they stand, on every 4th sample: a cheap look ahead,
+  // so near-end speech stops adaptation before it can pull the filter off
+  uint64_t eSum = 0;
+  for (uint32_t n = 0; n < MIC_BLOCK_SAMPLES; n += 4) {
+    int32_t e = block[n] - echoEstimate(window + n);
+    eSum += (uint64_t)((int64_t)e * e);
+  }
+  int32_t eeQ8 = log2Q8(eSum / (MIC_BLOCK_SAMPLES / 4) + 1);
+
+  // Double talk: the mic is well above the echo this reference can produce, or a
+  // converged filter suddenly removes much less than it usually does. Neither counts
+  // near the noise floor, where a quiet echo can't be cancelled below it.
+  bool refLoud = exQ8 >= AEC_REF_MIN_Q8;
+  int32_t echoQ8 = exQ8 + erlQ8;
+  int32_t leftQ8 = edQ8 - erleQ8;
+  if (echoQ8 < noiseQ8) echoQ8 = noiseQ8;
+  if (leftQ8 < noiseQ8) leftQ8 = noiseQ8;
+  bool nearEnd = edQ8 > echoQ8 + AEC_DT_MARGIN_Q8 ||
+                 (erleQ8 > AEC_DT_MARGIN_Q8 && eeQ8 > leftQ8 + AEC_DT_MARGIN_Q8);
+  if (nearEnd) {
+    dtHold = DT_HOLD_BLOCKS;
+    if (nearEndRun < UINT16_MAX) nearEndRun++;
+    stats.nearEndBlocks++;
+  } else {
+    // Gaps shorter than the hold (between syllables) don't end a near-end run
+    if (dtHold > 0) dtHold--;
+    else nearEndRun = 0;
+    if (refLoud && lag >= 0) {
+      // Upper envelope of the coupling: up quickly, down slowly (echo tails and pauses
+      // read low). Not before the delay is known, a misaligned window reads as no echo.
+      int32_t diff = edQ8 - exQ8 - erlQ8;
+      erlQ8 += diff > 0 ? diff / 2 : diff / 64;
+    }
+  }
+  bool adapt = refLoud && dtHold == 0;
+  if (refLoud && !adapt) stats.frozenBlocks++;
+  nlms(block, adapt, power);
+  if (adapt) {
+    int32_t outQ8 = energyQ8(block, MIC_BLOCK_SAMPLES);
+    erleQ8 += (edQ8 - outQ8 - erleQ8) / 16;
+  }
+  __atomic_store_n(&micPos, pos + MIC_BLOCK_SAMPLES, __ATOMIC_RELEASE);
+
+  uint32_t us = micros() - startUs;
+  stats.activeBlocks++;
+  stats.usTotal += us;
+  if (us > stats.usMax) stats.usMax = us;
+  if (us > AEC_BUDGET_US) stats.overBudget++;
+}
+
+uint32_t aecNearEndMs() {
+  return nearEndRun * MIC_BLOCK_MS;
+}
+
+// log2 energy in Q8 -> dB (10 * log10(2) = 3.01)
+static int q8ToDb(int32_t q8) {
+  return (int)(q8 * 301 / 25600);
+}
+
+void aecPrintStats() {
+  AecStats s = stats;
+  Serial.println("\n=== Echo canceller ===");
+  Serial.printf("  Blocks: %u, with echo: %u; CPU per block avg %u us, max %u us, over %u us budget: %u\n",
+                (unsigned)s.blocks, (unsigned)s.activeBlocks,
+                (unsigned)(s.activeBlocks ? s.usTotal / s.activeBlocks : 0), (unsigned)s.usMax,
+                (unsigned)AEC_BUDGET_US, (unsigned)s.overBudget);
+  Serial.printf("  Bulk delay: %u ms (%s), changes: %u, reference anchors: %u, dropped: %u samples\n",
+                (unsigned)(lag >= 0 ? lag * ENV_SUB * 1000 / SAMPLE_RATE : AEC_DELAY_INIT_MS),
+                lag >= 0 ? "estimated" : "initial guess", (unsigned)s.delayChanges,
+                (unsigned)s.anchors, (unsigned)s.refDropped);
+  Serial.printf("  Echo vs reference: %d dB, ERLE: %d dB, near-end blocks: %u, adaptation held: %u\n",
+                q8ToDb(erlQ8), q8ToDb(erleQ8), (unsigned)s.nearEndBlocks, (unsigned)s.frozenBlocks);
+  Serial.println("======================\n");
+}
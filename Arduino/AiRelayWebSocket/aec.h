@@ -0,0 +1,32 @@
+#ifndef AI_RELAY_WEBSOCKET_AEC_H
+#define AI_RELAY_WEBSOCKET_AEC_H
+
+#include <Arduino.h>
+
+// Acoustic echo canceller. The audio out task hands over every buffer it gives
+// to I2S_NUM_1 (after volume); it is mixed to mono, resampled to SAMPLE_RATE and
+// placed in a reference ring on the mic's sample clock. The mic capture task
+// then removes the echo from each MIC_BLOCK_SAMPLES block before any reader
+// sees it: a fixed-point NLMS filter of AEC_TAPS taps, placed at a bulk delay
+// found by correlating 2.5 ms energy envelopes of mic and reference (the DMA
+// latency on both sides isn't known up front). Adaptation stops while the mic
+// is well above the echo predicted from the reference (double talk).
+bool aecBegin();
+
+// Audio out task: frames just written to I2S_NUM_1; pcm == nullptr means silence.
+void aecReference(const int16_t* pcm, size_t frames, uint32_t sampleRate, uint16_t channels);
+// Audio out task: output was flushed, stopped or reclocked; the next buffer is re-anchored.
+void aecReferenceBreak();
+
+// Mic capture task: cancel the echo in one MIC_BLOCK_SAMPLES block in place.
+// pos = absolute sample index of the block's first sample.
+void aecProcess(int16_t* block, uint32_t pos);
+
+// How long the mic has been well above the predicted echo (0 = not now).
+// While nothing is playing every block counts; the VAD decides if it's speech.
+uint32_t aecNearEndMs();
+
+// CPU per block vs AEC_BUDGET_US, bulk delay, echo return loss and enhancement.
+void aecPrintStats();
+
+#endif
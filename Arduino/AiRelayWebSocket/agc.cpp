@@ -0,0 +1,122 @@
+#include "agc.h"
+#include "vad.h"
+#include "config.h"
+#include <Arduino.h>
+
+// I2S words carry the INMP441's 24 bits left-aligned
+static const int RAW_SHIFT = 8;
+static const int OUT_SHIFT = MIC_PRE_SHIFT - RAW_SHIFT;
+static_assert(OUT_SHIFT > 0, "MIC_PRE_SHIFT must drop more than the 8 padding bits");
+static const int32_t UNITY_Q12 = 4096;
+
+struct AgcStats {
+  uint32_t blocks;
+  uint32_t heldBlocks;     // under AGC_GATE_LEVEL: gain held, noise isn't pumped up
+  uint32_t limitedBlocks;  // gain cut so the peak stays under AGC_LIMIT
+  int32_t gainMinQ12;
+  int32_t gainMaxQ12;
+};
+
+static int32_t dcX1 = 0;
+static int64_t dcAcc = 0;  // DC blocker output, Q16
+static uint32_t envelope = AGC_TARGET_LEVEL;  // mean |sample| of the input, attack/release
+static int32_t gainQ12 = UNITY_Q12;           // gain at the end of the last block
+static AgcStats stats = {0, 0, 0, UNITY_Q12, UNITY_Q12};
+
+uint32_t pcmSumAbs(const int16_t* x, size_t n) {
+  uint32_t sum = 0;
+  for (size_t i = 0; i < n; i++) {
+    int32_t s = x[i];
+    int32_t m = s >> 31;
+    sum += (uint32_t)((s ^ m) - m);
+  }
+  return sum;
+}
+
+uint32_t pcmMeanAbs(const int16_t* x, size_t n) {
+  return n ? pcmSumAbs(x, n) / n : 0;
+}
+
+uint32_t pcmPeakAbs(const int16_t* x, size_t n) {
+  int32_t peak = 0;
+  for (size_t i = 0; i < n; i++) {
+    int32_t s = x[i];
+    int32_t m = s >> 31;
+    int32_t a = (s ^ m) - m;
+    peak = a > peak ? a : peak;
+  }
+  return (uint32_t)peak;
+}
+
+// One-pole DC blocker, y = x - x1 + (1 - 2^-MIC_DC_POLE_SHIFT) * y1, at full 24-bit
+// precision; the state keeps 16 fraction bits so the pole doesn't stall on small values.
+void agcInput(const int32_t* raw, int16_t* out, size_t samples) {
+  for (size_t i = 0; i < samples; i++) {
+    int32_t x = raw[i] >> RAW_SHIFT;
+    dcAcc += ((int64_t)(x - dcX1) << 16) - (dcAcc >> MIC_DC_POLE_SHIFT);
+    dcX1 = x;
+    int32_t y = (int32_t)(dcAcc >> 16);
+    int32_t s = (y + (1 << (OUT_SHIFT - 1))) >> OUT_SHIFT;
+    out[i] = s > 32767 ? 32767 : (s < -32768 ? -32768 : (int16_t)s);
+  }
+}
+
+void agcProcess(int16_t* block, size_t samples) {
+  if (samples == 0) return;
+  stats.blocks++;
+  uint32_t level = pcmMeanAbs(block, samples);
+  if (level < AGC_GATE_LEVEL) {
+    stats.heldBlocks++;
+  } else if (level > envelope) {
+    envelope += (level - envelope) >> AGC_ATTACK_SHIFT;
+  } else {
+    envelope -= (envelope - level) >> AGC_RELEASE_SHIFT;
+  }
+  if (envelope == 0) envelope = 1;
+  int32_t target = (int32_t)(((int64_t)AGC_TARGET_LEVEL * UNITY_Q12) / envelope);
+  if (target > AGC_MAX_GAIN_Q12) target = AGC_MAX_GAIN_Q12;
+  if (target < AGC_MIN_GAIN_Q12) target = AGC_MIN_GAIN_Q12;
+
+  // Limiter: no sample of this block may end up over AGC_LIMIT
+  int32_t start = gainQ12;
+  uint32_t peak = pcmPeakAbs(block, samples);
+  if (peak > 0 && (int64_t)peak * target > (int64_t)AGC_LIMIT * UNITY_Q12) {
+    target = (int32_t)(((int64_t)AGC_LIMIT * UNITY_Q12) / peak);
+    if (start > target) start = target;
+    stats.limitedBlocks++;
+  }
+
+  // Ramp from the last block's gain to this one's: no steps in the waveform
+  // (Q20 while ramping, so the block ends on the target gain)
+  int32_t step = ((target - start) << 8) / (int32_t)samples;
+  int32_t g = start << 8;
+  for (size_t i = 0; i < samples; i++) {
+    g += step;
+    int32_t s = (block[i] * (g >> 8) + UNITY_Q12 / 2) >> 12;
+    block[i] = s > 32767 ? 32767 : (s < -32768 ? -32768 : (int16_t)s);
+  }
+  gainQ12 = target;
+  if (target < stats.gainMinQ12) stats.gainMinQ12 = target;
+  if (target > stats.gainMaxQ12) stats.gainMaxQ12 = target;
+}
+
+// Gain Q12 -> dB: 20 * log10(g / 4096) = 10 * log10(g^2 / 4096^2)
+static int gainDb(int32_t q12) {
+  int32_t q8 = log2Q8((uint64_t)q12 * q12) - log2Q8((uint64_t)UNITY_Q12 * UNITY_Q12);
+  return (int)(q8 * 301 / 25600);
+}
+
+void agcPrintStats() {
+  AgcStats s = stats;
+  Serial.println("\n=== Mic level ===");
+  Serial.printf("  Input: >> %d, DC blocker pole 1 - 2^-%d\n", (int)MIC_PRE_SHIFT, (int)MIC_DC_POLE_SHIFT);
+#if MIC_AGC
+  Serial.printf("  AGC gain %d dB now (range %d..%d dB), input level %u, target %u\n", gainDb(gainQ12),
+                gainDb(s.gainMinQ12), gainDb(s.gainMaxQ12), (unsigned)envelope, (unsigned)AGC_TARGET_LEVEL);
+  Serial.printf("  Blocks: %u, held (quiet): %u, limited: %u\n", (unsigned)s.blocks,
+                (unsigned)s.heldBlocks, (unsigned)s.limitedBlocks);
+#else
+  Serial.println("  AGC disabled (MIC_AGC 0)");
+#endif
+  Serial.println("=================\n");
+}
@@ -0,0 +1,26 @@
+#ifndef AI_RELAY_WEBSOCKET_AGC_H
+#define AI_RELAY_WEBSOCKET_AGC_H
+
+#include <Arduino.h>
+
+// Mic level, both ends of the capture chain (mic capture task):
+//   agcInput()   32-bit I2S words -> DC blocker -> >> MIC_PRE_SHIFT. Fixed and
+//                linear, so the echo canceller can model the echo path.
+//   agcProcess() after the echo canceller and noise suppressor: a level
+//                envelope (fast attack, slow release) sets a gain towards
+//                AGC_TARGET_LEVEL, ramped across the block, with a peak limiter.
+// Every ring reader gets the normalized signal, so silenceThreshold and the
+// VAD levels mean the same on every board and mic.
+void agcInput(const int32_t* raw, int16_t* out, size_t samples);
+void agcProcess(int16_t* block, size_t samples);
+
+// Gain now and its range, blocks held (too quiet) and limited.
+void agcPrintStats();
+
+// Level kernels: no branches or table lookups in the loop, 32-bit accumulators
+// (n <= 65536), so the compiler can unroll and pipeline them.
+uint32_t pcmSumAbs(const int16_t* x, size_t n);
+uint32_t pcmMeanAbs(const int16_t* x, size_t n);
+uint32_t pcmPeakAbs(const int16_t* x, size_t n);
+
+#endif
@@ -0,0 +1,390 @@
+#include "audio_out.h"
+#include "aec.h"
+#include "audio_utils.h"
+#include "config.h"
+#include "globals.h"
+#include "turn_timeline.h"
+#include <Arduino.h>
+#include <driver/i2s.h>
+#include <esp_heap_caps.h>
+
+enum AudioOutCmd {
+  AOUT_CMD_NONE = 0,
+  AOUT_CMD_DRAIN,
+  AOUT_CMD_FORMAT,  // drain, then reclock
+  AOUT_CMD_FLUSH,
+  AOUT_CMD_FADE,
+};
+
+static const size_t SCRATCH = 2048;
+// Enough zeros to push the last real samples out of all DMA buffers (8 x 512 frames).
+static const size_t SILENCE_TAIL = 8 * 512 * 2;
+// Give up feeding silence after this long without data; the producer is gone.
+static const uint32_t STARVED_IDLE_MS = 500;
+
+static uint8_t* ring = nullptr;
+static uint8_t* scratch = nullptr;
+static size_t ringSize = 0;
+static size_t ringHead = 0;   // producer side
+static size_t ringTail = 0;   // output task side
+static volatile size_t ringCount = 0;
+static portMUX_TYPE ringMux = portMUX_INITIALIZER_UNLOCKED;
+
+static TaskHandle_t outTask = nullptr;
+static SemaphoreHandle_t writeMutex = nullptr;  // one producer at a time
+static SemaphoreHandle_t cmdMutex = nullptr;
+static SemaphoreHandle_t cmdDone = nullptr;
+static SemaphoreHandle_t spaceFreed = nullptr;
+static volatile AudioOutCmd cmd = AOUT_CMD_NONE;
+static uint32_t cmdRate = 0;
+static uint16_t cmdChannels = 0;
+static uint32_t cmdFadeMs = 0;
+
+static uint32_t currentRate = 0;
+static uint16_t currentChannels = 1;
+static size_t prebufferBytes = 0;
+static volatile bool playing = false;
+static volatile bool discarding = false;  // audioOutCancel() until the next session
+
+static AudioOutStats totals;
+static AudioOutStats session;
+static unsigned long sessionStartMs = 0;
+static volatile TurnPhase sessionPhase = TL_TTS_FIRST_SAMPLE;
+
+static void countStat(uint32_t AudioOutStats::*field, uint32_t n) {
+  totals.*field += n;
+  session.*field += n;
+}
+
+static size_t takeFromRing(uint8_t* dst, size_t maxBytes) {
+  portENTER_CRITICAL(&ringMux);
+  size_t n = ringCount & ~(size_t)1;
+  portEXIT_CRITICAL(&ringMux);
+  if (n > maxBytes) n = maxBytes;
+  if (n == 0) return 0;
+  size_t first = ringSize - ringTail;
+  if (first > n) first = n;
+  memcpy(dst, ring + ringTail, first);
+  if (n > first) memcpy(dst + first, ring, n - first);
+  ringTail = (ringTail + n) % ringSize;
+  portENTER_CRITICAL(&ringMux);
+  ringCount -= n;
+  portEXIT_CRITICAL(&ringMux);
+  return n;
+}
+
+static size_t dropRing() {
+  portENTER_CRITICAL(&ringMux);
+  size_t n = ringCount;
+  ringTail = (ringTail + n) % ringSize;
+  ringCount = 0;
+  portEXIT_CRITICAL(&ringMux);
+  return n;
+}
+
+static void writeSilence(size_t bytes) {
+  memset(scratch, 0, SCRATCH);
+  while (bytes > 0) {
+    size_t n = bytes < SCRATCH ? bytes : SCRATCH;
+    size_t written = 0;
+    i2s_write(I2S_NUM_1, scratch, n, &written, portMAX_DELAY);
+#if ECHO_CANCEL
+    aecReference(nullptr, written / 2 / currentChannels, currentRate, currentChannels);
+#endif
+    bytes -= n;
+  }
+}
+
+// Played out: push zeros through DMA and reset the peripheral so it doesn't hiss while idle.
+static void settleOutput() {
+  writeSilence(SILENCE_TAIL);
+  i2s_zero_dma_buffer(I2S_NUM_1);
+  i2s_stop(I2S_NUM_1);
+  vTaskDelay(pdMS_TO_TICKS(10));
+  i2s_start(I2S_NUM_1);
+#if ECHO_CANCEL
+  aecReferenceBreak();
+#endif
+}
+
+static void applyFormat(uint32_t rate, uint16_t channels) {
+  currentRate = rate;
+  currentChannels = channels;
+  i2s_set_clk(I2S_NUM_1, rate, I2S_BITS_PER_SAMPLE_16BIT,
+              channels == 2 ? I2S_CHANNEL_STEREO : I2S_CHANNEL_MONO);
+  i2s_zero_dma_buffer(I2S_NUM_1);
+  prebufferBytes = (size_t)rate * channels * 2 * AUDIO_OUT_PREBUFFER_MS / 1000;
+  if (prebufferBytes > ringSize / 2) prebufferBytes = ringSize / 2;
+#if ECHO_CANCEL
+  aecReferenceBreak();
+#endif
+}
+
+static void finishCommand() {
+  cmd = AOUT_CMD_NONE;
+  xSemaphoreGive(cmdDone);
+}
+
+static void audioOutTask(void*) {
+  bool starved = false;
+  unsigned long starvedSinceMs = 0;
+  uint32_t fadeTotal = 0;
+  uint32_t fadeLeft = 0;
+  for (;;) {
+    AudioOutCmd c = cmd;
+    if (c == AOUT_CMD_FLUSH) {
+      countStat(&AudioOutStats::droppedBytes, dropRing());
+      if (playing) i2s_zero_dma_buffer(I2S_NUM_1);
+#if ECHO_CANCEL
+      aecReferenceBreak();
+#endif
+      playing = false;
+      starved = false;
+      fadeLeft = fadeTotal = 0;
+      finishCommand();
+      continue;
+    }
+    if (c == AOUT_CMD_FADE && fadeTotal == 0) {
+      fadeTotal = (uint32_t)((uint64_t)currentRate * currentChannels * cmdFadeMs / 1000);
+      if (!playing || fadeTotal == 0) {
+        countStat(&AudioOutStats::droppedBytes, dropRing());
+        playing = false;
+        fadeTotal = 0;
+        finishCommand();
+        continue;
+      }
+      fadeLeft = fadeTotal;
+    }
+
+    portENTER_CRITICAL(&ringMux);
+    size_t count = ringCount;
+    portEXIT_CRITICAL(&ringMux);
+    bool draining = (c == AOUT_CMD_DRAIN || c == AOUT_CMD_FORMAT);
+
+    if (!playing) {
+      if (count >= 2 && (count >= prebufferBytes || draining)) {
+        playing = true;
+        starved = false;
+      } else if (draining && count < 2) {
+        if (c == AOUT_CMD_FORMAT) applyFormat(cmdRate, cmdChannels);
+        finishCommand();
+        continue;
+      } else {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(20));
+        continue;
+      }
+    }
+
+    size_t n = takeFromRing(scratch, SCRATCH);
+    if (n == 0) {
+      if (draining || fadeTotal > 0) {
+        // Played out; running dry mid-fade ends the fade just the same
+        fadeTotal = 0;
+        settleOutput();
+        playing = false;
+        if (c == AOUT_CMD_FORMAT) applyFormat(cmdRate, cmdChannels);
+        finishCommand();
+        continue;
+      }
+      if (!starved) {
+        starved = true;
+        starvedSinceMs = millis();
+        countStat(&AudioOutStats::underruns, 1);
+      } else if (millis() - starvedSinceMs > STARVED_IDLE_MS) {
+        settleOutput();
+        playing = false;
+        continue;
+      }
+      // Keep DMA fed with zeros so it doesn't loop stale audio while we wait
+      writeSilence(currentRate * currentChannels * 2 / 100);
+      continue;
+    }
+    starved = false;
+    if (!draining) {  // a drain empties the ring by design
+      if (count - n < session.lowWater) session.lowWater = count - n;
+      if (count - n < totals.lowWater) totals.lowWater = count - n;
+    }
+    xSemaphoreGive(spaceFreed);
+
+    applyVolumeToPcm16(scratch, n);
+    if (fadeTotal > 0) {
+      int16_t* s = (int16_t*)scratch;
+      for (size_t i = 0; i < n / 2; i++) {
+        s[i] = (int16_t)((int32_t)s[i] * (int32_t)fadeLeft / (int32_t)fadeTotal);
+        if (fadeLeft > 0) fadeLeft--;
+      }
+    }
+    size_t written = 0;
+    i2s_write(I2S_NUM_1, scratch, n, &written, portMAX_DELAY);
+#if ECHO_CANCEL
+    aecReference((const int16_t*)scratch, written / 2 / currentChannels, currentRate, currentChannels);
+#endif
+    if (session.firstAudioMs == 0 && written > 0) {
+      session.firstAudioMs = millis() - sessionStartMs;
+      if (session.firstAudioMs == 0) session.firstAudioMs = 1;
+      timelineMark(sessionPhase);
+    }
+    countStat(&AudioOutStats::bytesPlayed, written);
+
+    if (fadeTotal > 0 && fadeLeft == 0) {
+      countStat(&AudioOutStats::droppedBytes, dropRing());
+      settleOutput();
+      playing = false;
+      fadeTotal = 0;
+      finishCommand();
+    }
+  }
+}
+
+bool audioOutBegin() {
+  if (ring) return true;
+  size_t bytes = AUDIO_OUT_RING_BYTES & ~(size_t)3;
+  uint8_t* mem = nullptr;
+  if (psramFound()) mem = (uint8_t*)heap_caps_malloc(bytes + SCRATCH, MALLOC_CAP_SPIRAM);
+  if (!mem) mem = (uint8_t*)malloc(bytes + SCRATCH);
+  if (!mem) {
+    Serial.println("Audio out: ring alloc failed");
+    return false;
+  }
+  ring = mem;
+  ringSize = bytes;
+  scratch = mem + bytes;
+  writeMutex = xSemaphoreCreateMutex();
+  cmdMutex = xSemaphoreCreateMutex();
+  cmdDone = xSemaphoreCreateBinary();
+  spaceFreed = xSemaphoreCreateBinary();
+  totals.lowWater = session.lowWater = ringSize;
+  applyFormat(24000, 1);
+  xTaskCreatePinnedToCore(audioOutTask, "audioOut", 4096, NULL, AUDIO_OUT_TASK_PRIORITY, &outTask, AUDIO_OUT_CORE);
+  Serial.printf("Audio out: %u KB ring, %u ms prebuffer\n", (unsigned)(ringSize / 1024),
+                (unsigned)AUDIO_OUT_PREBUFFER_MS);
+  return true;
+}
+
+static bool runCommand(AudioOutCmd c, uint32_t timeoutMs) {
+  if (!ring) return false;
+  xSemaphoreTake(cmdMutex, portMAX_DELAY);
+  xSemaphoreTake(cmdDone, 0);
+  cmd = c;
+  xTaskNotifyGive(outTask);
+  bool done = xSemaphoreTake(cmdDone, pdMS_TO_TICKS(timeoutMs)) == pdTRUE;
+  if (!done) {
+    // Leave nothing half-applied for the next caller
+    cmd = AOUT_CMD_NONE;
+    Serial.println("Audio out: command timed out");
+  }
+  xSemaphoreGive(cmdMutex);
+  return done;
+}
+
+void audioOutSetFormat(uint32_t sampleRate, uint16_t channels) {
+  if (sampleRate == currentRate && channels == currentChannels) return;
+  cmdRate = sampleRate;
+  cmdChannels = channels;
+  runCommand(AOUT_CMD_FORMAT, 30000);
+}
+
+size_t audioOutWrite(const uint8_t* pcm, size_t len, uint32_t waitMs) {
+  if (!ring || len == 0) return 0;
+  xSemaphoreTake(writeMutex, portMAX_DELAY);
+  unsigned long startMs = millis();
+  bool waited = false;
+  size_t done = 0;
+  while (done < len && !discarding) {
+    portENTER_CRITICAL(&ringMux);
+    size_t space = ringSize - ringCount;
+    portEXIT_CRITICAL(&ringMux);
+    if (space == 0) {
+      if (!waited) {
+        waited = true;
+        countStat(&AudioOutStats::overruns, 1);
+      }
+      if (millis() - startMs >= waitMs) break;
+      xTaskNotifyGive(outTask);
+      xSemaphoreTake(spaceFreed, pdMS_TO_TICKS(10));
+      continue;
+    }
+    size_t n = (len - done) < space ? (len - done) : space;
+    // [ringHead, ringHead + space) is never touched by the output task, so copy outside the lock
+    size_t first = ringSize - ringHead;
+    if (first > n) first = n;
+    memcpy(ring + ringHead, pcm + done, first);
+    if (n > first) memcpy(ring, pcm + done + first, n - first);
+    ringHead = (ringHead + n) % ringSize;
+    portENTER_CRITICAL(&ringMux);
+    ringCount += n;
+    size_t fill = ringCount;
+    portEXIT_CRITICAL(&ringMux);
+    if (fill > session.highWater) session.highWater = fill;
+    if (fill > totals.highWater) totals.highWater = fill;
+    done += n;
+    if (!playing) xTaskNotifyGive(outTask);
+  }
+  if (done < len) countStat(&AudioOutStats::droppedBytes, len - done);
+  xSemaphoreGive(writeMutex);
+  return done;
+}
+
+bool audioOutDrain(uint32_t timeoutMs) {
+  return runCommand(AOUT_CMD_DRAIN, timeoutMs);
+}
+
+void audioOutFlush() {
+  runCommand(AOUT_CMD_FLUSH, 1000);
+}
+
+void audioOutFadeOut(uint32_t fadeMs) {
+  cmdFadeMs = fadeMs;
+  runCommand(AOUT_CMD_FADE, fadeMs + 1000);
+}
+
+void audioOutCancel(uint32_t fadeMs) {
+  discarding = true;
+  audioOutFadeOut(fadeMs);
+}
+
+bool audioOutCancelled() {
+  return discarding;
+}
+
+size_t audioOutBuffered() {
+  portENTER_CRITICAL(&ringMux);
+  size_t n = ringCount;
+  portEXIT_CRITICAL(&ringMux);
+  return n;
+}
+
+bool audioOutPlaying() {
+  return playing;
+}
+
+void audioOutSessionBegin(TurnPhase firstSample) {
+  memset(&session, 0, sizeof(session));
+  discarding = false;
+  sessionPhase = firstSample;
+  session.lowWater = ringSize;
+  sessionStartMs = millis();
+}
+
+void audioOutSessionStats(AudioOutStats* out) {
+  *out = session;
+  if (out->lowWater > out->highWater) out->lowWater = out->highWater;
+}
+
+size_t audioOutRingSize() {
+  return ringSize;
+}
+
+void audioOutPrintStats() {
+  AudioOutStats t = totals;
+  Serial.println("\n=== Audio out ===");
+  Serial.printf("  Format: %u Hz %s, ring %u/%u bytes, %s\n", (unsigned)currentRate,
+                currentChannels == 2 ? "stereo" : "mono", (unsigned)audioOutBuffered(),
+                (unsigned)ringSize, playing ? "playing" : "idle");
+  Serial.printf("  Played: %u bytes, underruns: %u, overruns: %u, dropped: %u bytes\n",
+                (unsigned)t.bytesPlayed, (unsigned)t.underruns, (unsigned)t.overruns,
+                (unsigned)t.droppedBytes);
+  Serial.printf("  Watermarks: high %u, low %u (while playing)\n", (unsigned)t.highWater,
+                (unsigned)(t.lowWater > t.highWater ? t.highWater : t.lowWater));
+  Serial.println("=================\n");
+}
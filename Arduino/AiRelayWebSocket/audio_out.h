@@ -0,0 +1,51 @@
+#ifndef AI_RELAY_WEBSOCKET_AUDIO_OUT_H
+#define AI_RELAY_WEBSOCKET_AUDIO_OUT_H
+
+#include <Arduino.h>
+#include "turn_timeline.h"
+
+// Audio output task: the only code that touches I2S_NUM_1 during normal
+// operation. Producers (TTS streams, pipeline, file players) queue 16-bit PCM
+// into a PSRAM ring and return immediately while there is room, so a network
+// download never waits on the DMA and vice versa. Volume is applied here.
+bool audioOutBegin();
+
+// Format of the PCM queued next. If it differs, queued audio plays out first.
+void audioOutSetFormat(uint32_t sampleRate, uint16_t channels);
+
+// Queue PCM; waits up to waitMs for ring space. Returns bytes queued.
+size_t audioOutWrite(const uint8_t* pcm, size_t len, uint32_t waitMs);
+
+// Wait until everything queued has been played (followed by a silence tail).
+bool audioOutDrain(uint32_t timeoutMs);
+// Drop all queued audio now (barge-in).
+void audioOutFlush();
+// Ramp the output to silence over fadeMs, then flush.
+void audioOutFadeOut(uint32_t fadeMs);
+// Barge-in: fade out, and drop whatever producers still write until the next
+// audioOutSessionBegin(), so a reply that is still downloading stays silent.
+void audioOutCancel(uint32_t fadeMs);
+bool audioOutCancelled();
+
+size_t audioOutBuffered();
+bool audioOutPlaying();
+
+struct AudioOutStats {
+  uint32_t underruns;     // ring ran dry while playing
+  uint32_t overruns;      // writes that found the ring full and had to wait
+  uint32_t droppedBytes;  // write timeouts + flushed audio
+  uint32_t bytesPlayed;
+  size_t highWater;       // peak ring fill
+  size_t lowWater;        // lowest ring fill while playing
+  uint32_t firstAudioMs;  // session start -> first PCM handed to DMA
+};
+
+// A session is one clip or reply; its stats are kept separately from the totals.
+// Its first sample played stamps firstSample on the turn timeline.
+void audioOutSessionBegin(TurnPhase firstSample = TL_TTS_FIRST_SAMPLE);
+void audioOutSessionStats(AudioOutStats* out);
+size_t audioOutRingSize();
+
+void audioOutPrintStats();
+
+#endif
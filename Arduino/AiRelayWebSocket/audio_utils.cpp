@@ -1,9 +1,9 @@
 #include "audio_utils.h"
+#include "audio_out.h"
 #include "config.h"
 #include "globals.h"
 #include <Arduino.h>
 #include <SPIFFS.h>
-#include <driver/i2s.h>
 #include "DAZI-AI-main/src/mp3_decoder/mp3_decoder.h"
 
 void updateSpeakerFormat(uint32_t sampleRate, uint16_t channels, uint16_t bitsPerSample) {
@@ -11,8 +11,7 @@ void updateSpeakerFormat(uint32_t sampleRate, uint16_t channels, uint16_t bitsPe
     Serial.println("Unsupported bits per sample for speaker");
     return;
   }
-  i2s_set_clk(I2S_NUM_1, sampleRate, I2S_BITS_PER_SAMPLE_16BIT,
-              (channels == 2) ? I2S_CHANNEL_STEREO : I2S_CHANNEL_MONO);
+  audioOutSetFormat(sampleRate, channels);
 }
 
 void applyVolumeToPcm16(uint8_t* buffer, size_t bytes) {
@@ -27,17 +26,33 @@ void applyVolumeToPcm16(uint8_t* buffer, size_t bytes) {
   }
 }
 
+// Let queued audio finish; the output task then pushes silence and resets I2S.
 void stopSpeakerNoise() {
-  static uint8_t silence[1024] = {0};
-  size_t bytes_written = 0;
-  for (int i = 0; i < 8; i++) {
-    i2s_write(I2S_NUM_1, silence, sizeof(silence), &bytes_written, 50);
+  audioOutDrain(60000);
+}
+
+bool parseWavHeader(const uint8_t* buf, size_t len, WavInfo* info) {
+  if (len < 12 || buf[0] != 'R' || buf[1] != 'I' || buf[2] != 'F' || buf[3] != 'F') return false;
+  info->sampleRate = 24000;
+  info->channels = 1;
+  info->dataOffset = 0;
+  info->dataSize = 0;
+  size_t pos = 12;
+  while (pos + 8 <= len && pos < 200) {
+    uint32_t chunkLen = buf[pos+4] | (buf[pos+5] << 8) | (buf[pos+6] << 16) | ((uint32_t)buf[pos+7] << 24);
+    if (memcmp(buf + pos, "fmt ", 4) == 0 && pos + 16 <= len) {
+      info->channels = buf[pos+10] | (buf[pos+11] << 8);
+      info->sampleRate = buf[pos+12] | (buf[pos+13] << 8) | (buf[pos+14] << 16) | ((uint32_t)buf[pos+15] << 24);
+    }
+    if (memcmp(buf + pos, "data", 4) == 0) {
+      info->dataOffset = pos + 8;
+      info->dataSize = chunkLen;
+      return true;
+    }
+    pos += 8 + chunkLen;
+    if (chunkLen & 1) pos++;
   }
-  vTaskDelay(pdMS_TO_TICKS(30));
-  i2s_zero_dma_buffer(I2S_NUM_1);
-  i2s_stop(I2S_NUM_1);
-  vTaskDelay(pdMS_TO_TICKS(10));
-  i2s_start(I2S_NUM_1);
+  return false;
 }
 
 void createWavHeader(uint8_t* header, int waveDataSize) {
@@ -88,20 +103,18 @@ void playWavFile(const char* filename) {
     return;
   }
   Serial.printf("Playing: %d Hz, %s\n", sampleRate, (channels == 2) ? "Stereo" : "Mono");
-  i2s_set_clk(I2S_NUM_1, sampleRate, I2S_BITS_PER_SAMPLE_16BIT, (channels == 2) ? I2S_CHANNEL_STEREO : I2S_CHANNEL_MONO);
+  audioOutSessionBegin();
+  audioOutSetFormat(sampleRate, channels);
   uint8_t buffer[1024];
   size_t bytes_read = 0;
-  size_t bytes_written = 0;
   while (file.available()) {
     bytes_read = file.read(buffer, sizeof(buffer));
     if (bytes_read > 0) {
-      applyVolumeToPcm16(buffer, bytes_read);
-      i2s_write(I2S_NUM_1, buffer, bytes_read, &bytes_written, portMAX_DELAY);
+      audioOutWrite(buffer, bytes_read, portMAX_DELAY);
     }
   }
-  uint8_t silence[512] = {0};
-  i2s_write(I2S_NUM_1, silence, 512, &bytes_written, 100);
   file.close();
+  audioOutDrain(60000);
   Serial.println("Playback done");
 }
 
@@ -141,11 +154,10 @@ void playMp3File(const char* filename) {
   uint8_t* readPtr = mp3Data;
   int32_t bytesLeft = fileSize;
   int16_t outBuffer[2304];
-  size_t bytes_written = 0;
   bool firstFrame = true;
   int framesDecoded = 0;
   size_t totalSamples = 0;
-  i2s_zero_dma_buffer(I2S_NUM_1);
+  audioOutSessionBegin();
   int errorCount = 0;
   while (bytesLeft > 0) {
     int32_t offset = MP3FindSyncWord(readPtr, bytesLeft);
@@ -165,16 +177,12 @@ void playMp3File(const char* filename) {
         int sampleRate = MP3GetSampRate();
         int channels = MP3GetChannels();
         Serial.printf("MP3: %d Hz, %d ch\n", sampleRate, channels);
-        i2s_set_clk(I2S_NUM_1, sampleRate, I2S_BITS_PER_SAMPLE_16BIT,
-                    channels == 2 ? I2S_CHANNEL_STEREO : I2S_CHANNEL_MONO);
+        audioOutSetFormat(sampleRate, channels);
         firstFrame = false;
       }
       int outputSamps = MP3GetOutputSamps();
       totalSamples += outputSamps;
-      for (int i = 0; i < outputSamps; i++) {
-        outBuffer[i] = (int16_t)((int32_t)outBuffer[i] * outputVolumePercent / 100);
-      }
-      i2s_write(I2S_NUM_1, outBuffer, outputSamps * 2, &bytes_written, portMAX_DELAY);
+      audioOutWrite((const uint8_t*)outBuffer, outputSamps * 2, portMAX_DELAY);
       errorCount = 0;
     } else if (result == ERR_MP3_INDATA_UNDERFLOW) {
       if (bytesLeft < 1024) break;
@@ -194,7 +202,6 @@ void playMp3File(const char* filename) {
   Serial.printf("MP3: %d frames, %u samples, %d bytes remaining\n", framesDecoded, (unsigned)totalSamples, bytesLeft);
   free(mp3Data);
   MP3Decoder_FreeBuffers();
-  uint8_t silence[512] = {0};
-  i2s_write(I2S_NUM_1, silence, 512, &bytes_written, 100);
+  audioOutDrain(60000);
   Serial.println("MP3 playback done");
 }
@@ -9,6 +9,14 @@ void applyVolumeToPcm16(uint8_t* buffer, size_t bytes);
 void stopSpeakerNoise();
 
 // WAV header and playback
+struct WavInfo {
+  uint32_t sampleRate;
+  uint16_t channels;
+  size_t dataOffset;   // first PCM byte
+  size_t dataSize;     // PCM bytes announced by the "data" chunk
+};
+// Walk RIFF chunks in buf; true once the "data" chunk header has been found.
+bool parseWavHeader(const uint8_t* buf, size_t len, WavInfo* info);
 void createWavHeader(uint8_t* header, int waveDataSize);
 void playWavFile(const char* filename);
 void playMp3File(const char* filename);
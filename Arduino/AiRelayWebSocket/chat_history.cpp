@@ -0,0 +1,188 @@
+#include "chat_history.h"
+#include "config.h"
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+
+struct Record {
+  uint32_t offset;
+  uint16_t length;
+  uint16_t tokens;
+  bool user;
+};
+
+static char* arena = nullptr;
+static uint32_t arenaSize = 0;
+static uint32_t head = 0;        // where the next text goes
+static Record records[HISTORY_MAX];
+static uint8_t first = 0;        // oldest record
+static uint8_t count = 0;
+static uint32_t tokens = 0;
+static char* summary = nullptr;  // HISTORY_SUMMARY_MAX_BYTES after the arena
+static uint16_t summaryLength = 0;
+static uint32_t generation = 0;
+
+static uint32_t appended = 0;
+static uint32_t evicted = 0;
+static uint32_t truncated = 0;
+static uint32_t tokensHigh = 0;
+static uint32_t compactions = 0;
+static uint32_t summarized = 0;
+
+uint16_t chatHistoryEstimateTokens(size_t textBytes) {
+  return (uint16_t)((textBytes + 3) / 4 + HISTORY_TOKENS_PER_MESSAGE);
+}
+
+bool chatHistoryBegin() {
+  if (arena) return true;
+  uint32_t bytes = HISTORY_ARENA_BYTES;
+  if (psramFound()) arena = (char*)heap_caps_malloc(bytes + HISTORY_SUMMARY_MAX_BYTES, MALLOC_CAP_SPIRAM);
+  if (!arena) arena = (char*)malloc(bytes + HISTORY_SUMMARY_MAX_BYTES);
+  if (!arena) {
+    Serial.println("History: arena alloc failed");
+    return false;
+  }
+  arenaSize = bytes;
+  summary = arena + bytes;
+  chatHistoryClear();
+  return true;
+}
+
+void chatHistoryClear() {
+  first = 0;
+  count = 0;
+  head = 0;
+  tokens = 0;
+  summaryLength = 0;
+  generation++;
+}
+
+static void evictOldest() {
+  tokens -= records[first].tokens;
+  first = (first + 1) % HISTORY_MAX;
+  count--;
+  evicted++;
+  if (count == 0) head = 0;
+}
+
+// Offset where `len` bytes fit contiguously without overwriting live texts, or -1.
+static int32_t findRoom(uint32_t len) {
+  if (count == 0) return len <= arenaSize ? 0 : -1;
+  uint32_t tail = records[first].offset;
+  if (head > tail) {
+    if (len <= arenaSize - head) return (int32_t)head;
+    return len <= tail ? 0 : -1;  // wrap; the end of the arena stays unused this lap
+  }
+  // Live texts wrap around: the gap is [head, tail); head == tail means full
+  return head < tail && len <= tail - head ? (int32_t)head : -1;
+}
+
+// Cut to `maxBytes` without splitting a UTF-8 sequence.
+static size_t utf8Cut(const char* text, size_t len, size_t maxBytes) {
+  if (len <= maxBytes) return len;
+  size_t n = maxBytes;
+  while (n > 0 && ((uint8_t)text[n] & 0xC0) == 0x80) n--;
+  return n;
+}
+
+bool chatHistoryAppend(bool user, const char* text, size_t len) {
+  if (!arena && !chatHistoryBegin()) return false;
+  if (len == 0) return false;
+
+  size_t maxBytes = (size_t)(HISTORY_TOKEN_BUDGET / 2 - HISTORY_TOKENS_PER_MESSAGE) * 4;
+  if (maxBytes > arenaSize / 2) maxBytes = arenaSize / 2;
+  if (maxBytes > 0xFFFF) maxBytes = 0xFFFF;
+  if (len > maxBytes) {
+    len = utf8Cut(text, len, maxBytes);
+    truncated++;
+  }
+  uint16_t cost = chatHistoryEstimateTokens(len);
+
+  while (count > 0 && (count >= HISTORY_MAX || tokens + cost > HISTORY_TOKEN_BUDGET ||
+                       findRoom(len) < 0)) {
+    evictOldest();
+  }
+  // Never leave a reply without the question it answers at the front
+  while (count > 0 && !records[first].user) evictOldest();
+  int32_t at = findRoom(len);
+  if (at < 0) return false;  // only if len > arenaSize, which maxBytes rules out
+
+  memcpy(arena + at, text, len);
+  head = (uint32_t)at + len;
+  Record& r = records[(first + count) % HISTORY_MAX];
+  r.offset = (uint32_t)at;
+  r.length = (uint16_t)len;
+  r.tokens = cost;
+  r.user = user;
+  count++;
+  tokens += cost;
+  appended++;
+  if (tokens > tokensHigh) tokensHigh = tokens;
+  return true;
+}
+
+void chatHistoryCompact(uint8_t n, const char* text, size_t len) {
+  if (!arena) return;
+  if (n > count) n = count;
+  for (uint8_t i = 0; i < n; i++) evictOldest();
+  evicted -= n;
+  summarized += n;
+  summaryLength = (uint16_t)utf8Cut(text, len, HISTORY_SUMMARY_MAX_BYTES);
+  memcpy(summary, text, summaryLength);
+  compactions++;
+}
+
+bool chatHistoryGetSummary(HistoryMessage* out) {
+  if (summaryLength == 0) return false;
+  out->text = summary;
+  out->length = summaryLength;
+  out->tokens = chatHistoryEstimateTokens(summaryLength);
+  out->user = false;
+  return true;
+}
+
+uint32_t chatHistoryGeneration() {
+  return generation;
+}
+
+uint8_t chatHistoryCount() {
+  return count;
+}
+
+bool chatHistoryGet(uint8_t i, HistoryMessage* out) {
+  if (i >= count) return false;
+  const Record& r = records[(first + i) % HISTORY_MAX];
+  out->text = arena + r.offset;
+  out->length = r.length;
+  out->tokens = r.tokens;
+  out->user = r.user;
+  return true;
+}
+
+uint32_t chatHistoryTokens() {
+  return tokens;
+}
+
+void chatHistoryPrintStats() {
+  uint32_t bytes = 0;
+  for (uint8_t i = 0; i < count; i++) bytes += records[(first + i) % HISTORY_MAX].length;
+  Serial.println("\n=== Chat history ===");
+  Serial.printf("  Messages: %u/%u, ~%u/%u tokens (peak %u), %u/%u bytes of arena\n",
+                (unsigned)count, (unsigned)HISTORY_MAX, (unsigned)tokens,
+                (unsigned)HISTORY_TOKEN_BUDGET, (unsigned)tokensHigh, (unsigned)bytes,
+                (unsigned)arenaSize);
+  Serial.printf("  Appended: %u, evicted: %u, truncated: %u\n", (unsigned)appended,
+                (unsigned)evicted, (unsigned)truncated);
+  Serial.printf("  Summary: %u bytes (~%u tok), %u compactions folded %u messages\n",
+                (unsigned)summaryLength, summaryLength ? (unsigned)chatHistoryEstimateTokens(summaryLength) : 0,
+                (unsigned)compactions, (unsigned)summarized);
+  if (summaryLength > 0) {
+    Serial.printf("  Memory: %.*s\n", (int)summaryLength, summary);
+  }
+  for (uint8_t i = 0; i < count; i++) {
+    const Record& r = records[(first + i) % HISTORY_MAX];
+    Serial.printf("  %2u %-9s ~%3u tok  %.*s%s\n", (unsigned)i, r.user ? "user" : "assistant",
+                  (unsigned)r.tokens, r.length > 48 ? 48 : (int)r.length, arena + r.offset,
+                  r.length > 48 ? "..." : "");
+  }
+  Serial.println("====================\n");
+}
@@ -0,0 +1,43 @@
+#ifndef AI_RELAY_WEBSOCKET_CHAT_HISTORY_H
+#define AI_RELAY_WEBSOCKET_CHAT_HISTORY_H
+
+#include <Arduino.h>
+
+// Chat history kept for the LLM context. Message texts are stored back to back
+// in one arena (PSRAM when present) used as a ring, with a small ring of records
+// pointing into it: appending and evicting are O(1) and never touch the heap.
+// The history is bounded by an estimated token count (HISTORY_TOKEN_BUDGET) and
+// by HISTORY_MAX messages; the oldest messages go first, a user message together
+// with the reply that followed it. Only the dialog task appends and compacts.
+struct HistoryMessage {
+  const char* text;  // not NUL-terminated; valid until the next append or clear
+  uint16_t length;
+  uint16_t tokens;   // estimate, including per-message overhead
+  bool user;         // else assistant
+};
+
+bool chatHistoryBegin();
+void chatHistoryClear();
+// Copies text into the arena, evicting old messages as needed. A message longer
+// than half the budget is cut (at a UTF-8 boundary) so the last exchange always fits.
+bool chatHistoryAppend(bool user, const char* text, size_t len);
+
+// Rolling summary (see HISTORY_SUMMARY): the `n` oldest messages are replaced by
+// `summary`, which must already cover the previous summary. The summary has its
+// own HISTORY_SUMMARY_MAX_BYTES and does not count against the token budget.
+void chatHistoryCompact(uint8_t n, const char* summary, size_t len);
+bool chatHistoryGetSummary(HistoryMessage* out);
+// Changes on every clear, so a summary of a history that is gone can be discarded.
+uint32_t chatHistoryGeneration();
+
+uint8_t chatHistoryCount();
+// i = 0 is the oldest message.
+bool chatHistoryGet(uint8_t i, HistoryMessage* out);
+uint32_t chatHistoryTokens();
+
+// ~4 bytes per token plus the role/framing overhead of one message.
+uint16_t chatHistoryEstimateTokens(size_t textBytes);
+
+void chatHistoryPrintStats();
+
+#endif
@@ -1,7 +1,13 @@
 #include "chat_utils.h"
 #include "config.h"
 #include "globals.h"
+#include "chat_history.h"
 #include "prompts.h"
+#include "sse_parser.h"
+#include "net_pool.h"
+#include "http_reader.h"
+#include "json_body.h"
+#include "turn_timeline.h"
 #include <Arduino.h>
 #include <HTTPClient.h>
 #include <WiFiClientSecure.h>
@@ -62,67 +68,543 @@ String processWakeAndEndWords(const String& finalTranscript) {
 }
 
 void clearChatHistory() {
-  historyCount = 0;
+  chatHistoryClear();
 }
 
 void addHistory(const char* role, const String& content) {
   if (content.length() == 0) return;
-  if (historyCount >= HISTORY_MAX) {
-    for (uint8_t i = 1; i < HISTORY_MAX; i++) {
-      chatHistory[i - 1] = chatHistory[i];
+  chatHistoryAppend(strcmp(role, "user") == 0, content.c_str(), content.length());
+}
+
+static bool routerAuto = LLM_ROUTER;
+
+void llmRouterSetAuto(bool on) {
+  routerAuto = on;
+}
+
+bool llmRouterAuto() {
+  return routerAuto;
+}
+
+#if LLM_ROUTER
+// Per-model latency and routing counters; index 0 = 8b, 1 = 70b
+struct ModelRoute {
+  uint32_t ewmaMs;            // first token (streaming) or whole reply
+  unsigned long lastSampleMs;
+  uint32_t turns;
+  uint32_t samples;
+  uint32_t totalMs;
+  uint32_t maxMs;
+  uint32_t overSlo;
+  uint32_t failures;
+};
+
+struct RouterStats {
+  uint32_t byScore[2];        // model the score asked for
+  uint32_t rerouted;          // moved to the other model for latency
+  uint32_t forcedHard;        // hard question kept on 70b despite its latency
+  uint32_t scoreTotal;
+  uint32_t decisions;
+};
+
+static ModelRoute routes[2];
+static RouterStats routerStats;
+static int routedModel = -1;  // model of the request in flight
+static const uint32_t ROUTER_SLO_MS[2] = {LLM_ROUTER_SLO_8B_MS, LLM_ROUTER_SLO_70B_MS};
+static const char* const ROUTER_NAMES[2] = {"8b", "70b"};
+
+// Each one found adds to the score
+static const char* const REASONING_WORDS[] = {
+  "why", "explain", "prove", "proof", "derive", "calculate", "solve", "equation", "theorem",
+  "formula", "compare", "difference", "fraction", "percent", "percentage", "probability",
+  "area", "volume", "angle", "triangle", "circle", "root", "squared", "multiply", "divide",
+  "divided", "times", "plus", "minus", "step", "steps"};
+// A short question with one of these is small talk
+static const char* const CHITCHAT_WORDS[] = {
+  "hi", "hello", "hey", "thanks", "thank", "bye", "goodbye", "morning", "night", "cool",
+  "nice", "great", "okay", "ok", "yes", "no", "who", "name"};
+// Points back at the conversation; deeper conversations make these harder
+static const char* const FOLLOWUP_WORDS[] = {
+  "it", "that", "this", "they", "those", "then", "and", "but", "again", "more", "else"};
+
+static bool wordIn(const char* word, const char* const* list, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    if (strcmp(word, list[i]) == 0) return true;
+  }
+  return false;
+}
+
+struct ComplexityScore {
+  int score;
+  uint8_t words;
+  uint8_t reasoning;
+  uint8_t numbers;
+  bool operators;
+  bool chitchat;
+  bool followUp;
+};
+
+// 0 (small talk) .. 100 (multi-step reasoning) from the question text and history depth
+static ComplexityScore scoreQuestion(const String& input) {
+  ComplexityScore c = {};
+  char word[24];
+  size_t len = 0;
+  bool inNumber = false;
+  size_t n = input.length();
+  for (size_t i = 0; i <= n; i++) {
+    char ch = i < n ? input[i] : ' ';
+    if (ch >= 'A' && ch <= 'Z') ch = ch - 'A' + 'a';
+    bool digit = ch >= '0' && ch <= '9';
+    if (digit && !inNumber) c.numbers++;
+    inNumber = digit;
+    if (ch == '+' || ch == '*' || ch == '/' || ch == '=' || ch == '^') c.operators = true;
+    if ((ch >= 'a' && ch <= 'z') || digit) {
+      if (len < sizeof(word) - 1) word[len++] = ch;
+      continue;
     }
-    historyCount = HISTORY_MAX - 1;
+    if (ch == '\'') continue;
+    if (len == 0) continue;
+    word[len] = '\0';
+    len = 0;
+    if (c.words < 255) c.words++;
+    if (wordIn(word, REASONING_WORDS, sizeof(REASONING_WORDS) / sizeof(REASONING_WORDS[0]))) c.reasoning++;
+    if (wordIn(word, CHITCHAT_WORDS, sizeof(CHITCHAT_WORDS) / sizeof(CHITCHAT_WORDS[0]))) c.chitchat = true;
+    if (wordIn(word, FOLLOWUP_WORDS, sizeof(FOLLOWUP_WORDS) / sizeof(FOLLOWUP_WORDS[0]))) c.followUp = true;
   }
-  chatHistory[historyCount].role = role;
-  chatHistory[historyCount].content = content;
-  historyCount++;
+  int score = 0;
+  if (c.words > 8) score += c.words > 23 ? 30 : 2 * (c.words - 8);
+  score += c.reasoning > 4 ? 48 : 12 * c.reasoning;
+  if (c.numbers >= 2) score += 15;
+  if (c.operators) score += 15;
+  uint8_t exchanges = chatHistoryCount() / 2;
+  if (c.followUp) score += 4 * (exchanges > 5 ? 5 : exchanges);
+  if (c.chitchat && c.words <= 6 && c.reasoning == 0) score -= 30;
+  c.score = constrain(score, 0, 100);
+  return c;
 }
 
-String getChatResponse(String input) {
-  Serial.println("Sending to Groq (LLM)...");
-  
+static bool routeFresh(int m) {
+  return routes[m].samples > 0 && millis() - routes[m].lastSampleMs < LLM_ROUTER_STALE_MS;
+}
+
+// Pick llm_model for this turn
+static void routeModel(const String& input) {
+  if (!routerAuto) {
+    routedModel = (llm_model == llm_model_8b) ? 0 : 1;
+    routes[routedModel].turns++;
+    return;
+  }
+  ComplexityScore c = scoreQuestion(input);
+  int wanted = c.score >= LLM_ROUTER_COMPLEX_SCORE ? 1 : 0;
+  int chosen = wanted;
+  const char* why = "score";
+  int other = 1 - wanted;
+  if (c.score >= LLM_ROUTER_HARD_SCORE) {
+    if (routeFresh(1) && routes[1].ewmaMs > ROUTER_SLO_MS[1]) {
+      routerStats.forcedHard++;
+      why = "hard, over SLO";
+    }
+  } else if (routeFresh(wanted) && routes[wanted].ewmaMs > ROUTER_SLO_MS[wanted] &&
+             (!routeFresh(other) || routes[other].ewmaMs < routes[wanted].ewmaMs)) {
+    // Over its SLO and the other model isn't known to be slower
+    chosen = other;
+    routerStats.rerouted++;
+    why = "latency";
+  }
+  routerStats.byScore[wanted]++;
+  routerStats.scoreTotal += c.score;
+  routerStats.decisions++;
+  routes[chosen].turns++;
+  routedModel = chosen;
+  llm_model = chosen ? llm_model_70b : llm_model_8b;
+  Serial.printf("LLM router: score %d (%u words, %u reasoning, %u numbers%s%s%s) -> %s [%s; ewma 8b %u ms, 70b %u ms]\n",
+                c.score, (unsigned)c.words, (unsigned)c.reasoning, (unsigned)c.numbers,
+                c.operators ? ", operators" : "", c.followUp ? ", follow-up" : "",
+                c.chitchat ? ", small talk" : "", ROUTER_NAMES[chosen], why,
+                (unsigned)(routeFresh(0) ? routes[0].ewmaMs : 0),
+                (unsigned)(routeFresh(1) ? routes[1].ewmaMs : 0));
+}
+
+// Latency of the request just made; a failure counts as twice the SLO
+static void routeRecord(uint32_t ms, bool ok) {
+  if (routedModel < 0) return;
+  ModelRoute& r = routes[routedModel];
+  uint32_t slo = ROUTER_SLO_MS[routedModel];
+  if (!ok) {
+    r.failures++;
+    ms = 2 * slo;
+  } else {
+    r.totalMs += ms;
+    if (ms > r.maxMs) r.maxMs = ms;
+    if (ms > slo) r.overSlo++;
+  }
+  if (!routeFresh(routedModel)) {
+    r.ewmaMs = ms;
+  } else {
+    r.ewmaMs += ((int32_t)ms - (int32_t)r.ewmaMs) >> LLM_ROUTER_EWMA_SHIFT;
+  }
+  r.samples++;
+  r.lastSampleMs = millis();
+  if (routerAuto) {
+    Serial.printf("LLM router: %s %s %u ms (ewma %u ms, SLO %u ms)\n", ROUTER_NAMES[routedModel],
+                  ok ? "answered in" : "failed, counted as", (unsigned)ms, (unsigned)r.ewmaMs,
+                  (unsigned)slo);
+  }
+  routedModel = -1;
+}
+#else
+static void routeModel(const String&) {}
+static void routeRecord(uint32_t, bool) {}
+#endif
+
+void llmRouterPrintStats() {
+  Serial.println("\n=== LLM router ===");
+#if LLM_ROUTER
+  RouterStats s = routerStats;
+  Serial.printf("  Mode: %s, complex >= %u, hard >= %u\n", routerAuto ? "auto" : "fixed",
+                (unsigned)LLM_ROUTER_COMPLEX_SCORE, (unsigned)LLM_ROUTER_HARD_SCORE);
+  Serial.printf("  Decisions: %u (avg score %u), by score 8b %u / 70b %u, rerouted for latency %u, hard over SLO %u\n",
+                (unsigned)s.decisions, (unsigned)(s.decisions ? s.scoreTotal / s.decisions : 0),
+                (unsigned)s.byScore[0], (unsigned)s.byScore[1], (unsigned)s.rerouted,
+                (unsigned)s.forcedHard);
+  for (int m = 0; m < 2; m++) {
+    const ModelRoute& r = routes[m];
+    uint32_t ok = r.samples - r.failures;
+    Serial.printf("  %-3s turns %u, ewma %u ms%s, avg %u ms, max %u ms, over SLO (%u ms) %u, failed %u\n",
+                  ROUTER_NAMES[m], (unsigned)r.turns, (unsigned)r.ewmaMs,
+                  routeFresh(m) ? "" : " (stale)", (unsigned)(ok ? r.totalMs / ok : 0),
+                  (unsigned)r.maxMs, (unsigned)ROUTER_SLO_MS[m], (unsigned)r.overSlo,
+                  (unsigned)r.failures);
+  }
+#else
+  Serial.println("  Disabled (LLM_ROUTER 0)");
+#endif
+  Serial.println("==================\n");
+}
+
+// Pieces buildChatBody() adds at most: model + prompt head (4), memory (2), two per
+// history message, question + close (3). A dropped piece would be invalid JSON.
+static const size_t CHAT_BODY_MAX_PIECES = 4 + 2 + 2 * HISTORY_MAX + 3;
+static_assert(CHAT_BODY_MAX_PIECES <= JSON_BODY_MAX_PIECES, "JSON_BODY_MAX_PIECES too small for buildChatBody()");
+
+// Chat request body as pieces: the prompt was escaped at build time, history and
+// input are escaped while HTTPClient sends them. Nothing is copied.
+// False if the body didn't fit (it must not be sent).
+static bool buildChatBody(JsonBodyStream* body, const String& input, bool stream) {
+  size_t promptLen;
+  const char* prompt = getCurrentPromptJson(&promptLen);
+  body->addRaw("{\"model\":\"");
+  body->addRaw(llm_model);
+  body->addRaw(stream ? "\",\"stream\":true,\"messages\":[{\"role\":\"system\",\"content\":\""
+                      : "\",\"messages\":[{\"role\":\"system\",\"content\":\"");
+  body->addRaw(prompt, promptLen);
+  HistoryMessage m;
+  if (chatHistoryGetSummary(&m)) {
+    body->addRaw("\"},{\"role\":\"system\",\"content\":\"Memory of the conversation so far: ");
+    body->addEscaped(m.text, m.length);
+  }
+  for (uint8_t i = 0; chatHistoryGet(i, &m); i++) {
+    body->addRaw(m.user ? "\"},{\"role\":\"user\",\"content\":\""
+                        : "\"},{\"role\":\"assistant\",\"content\":\"");
+    body->addEscaped(m.text, m.length);
+  }
+  body->addRaw("\"},{\"role\":\"user\",\"content\":\"");
+  body->addEscaped(input.c_str(), input.length());
+  body->addRaw("\"}]}");
+  if (body->overflowed()) {
+    Serial.printf("LLM: request body over %u pieces, not sent\n", (unsigned)JSON_BODY_MAX_PIECES);
+    return false;
+  }
+  return true;
+}
+
+static const char* GROQ_CHAT_URL = "https://api.groq.com/openai/v1/chat/completions";
+
+static void addChatHeaders(HTTPClient& http, bool stream) {
+  http.addHeader("Content-Type", "application/json");
+  if (stream) http.addHeader("Accept", "text/event-stream");
+  http.addHeader("Authorization", "Bearer " + String(groq_api_key));
+}
+
+// Non-streamed chat completion: POST the body, return choices[0].message.content.
+static String requestChatCompletion(JsonBodyStream* body) {
   if (WiFi.status() != WL_CONNECTED) {
     Serial.println("LLM: WiFi not connected!");
     return "";
   }
   
-  // Use the original approach - HTTPClient handles HTTPS automatically
-  HTTPClient http;
-  http.setTimeout(20000);
-  http.setReuse(false); // Don't reuse connections
-  
+  // Pooled keep-alive connection (see net_pool)
   Serial.println("LLM: Connecting...");
-  http.begin("https://api.groq.com/openai/v1/chat/completions");
-  
-  http.addHeader("Content-Type", "application/json");
-  http.addHeader("Authorization", "Bearer " + String(groq_api_key));
-  JsonDocument doc;
-  doc["model"] = llm_model;
-  JsonArray messages = doc["messages"].to<JsonArray>();
-  JsonObject sysMsg = messages.add<JsonObject>();
-  sysMsg["role"] = "system";
-  sysMsg["content"] = getCurrentPrompt();
-  for (uint8_t i = 0; i < historyCount; i++) {
-    JsonObject histMsg = messages.add<JsonObject>();
-    histMsg["role"] = chatHistory[i].role;
-    histMsg["content"] = chatHistory[i].content;
-  }
-  JsonObject userMsg = messages.add<JsonObject>();
-  userMsg["role"] = "user";
-  userMsg["content"] = input;
-  String payload;
-  serializeJson(doc, payload);
+  NetLease lease;
+  if (!netBeginHttp(NET_HOST_GROQ, &lease, GROQ_CHAT_URL)) {
+    Serial.println("LLM: connection failed");
+    return "";
+  }
+  const char* headerKeys[] = {"Transfer-Encoding"};
+  HTTPClient& http = netHttp(lease);
+  http.setTimeout(20000);
+  http.collectHeaders(headerKeys, 1);
+  addChatHeaders(http, false);
   
-  Serial.println("LLM: Sending POST...");
-  int httpCode = http.POST(payload);
+  Serial.printf("LLM: Sending POST (%u bytes)...\n", (unsigned)body->size());
+  timelineMark(TL_LLM_SENT);
+  int httpCode = http.sendRequest("POST", body, body->size());
+  if (netRetryStale(&lease, httpCode, GROQ_CHAT_URL)) {
+    netHttp(lease).collectHeaders(headerKeys, 1);
+    addChatHeaders(netHttp(lease), false);
+    body->rewind();
+    httpCode = netHttp(lease).sendRequest("POST", body, body->size());
+  }
   String result = "";
+  bool keepAlive = false;
   if (httpCode == 200) {
+    timelineMark(TL_LLM_FIRST_BYTE);
     Serial.println("LLM: Success!");
-    String response = http.getString();
+    // Parse straight off the socket; only the reply text is kept
+    static JsonDocument filter;
+    if (filter.isNull()) {
+      filter["choices"][0]["message"]["content"] = true;
+    }
+    HTTPClient& resp = netHttp(lease);
+    HttpBodyReader reply(resp.getStreamPtr(), 20000);
+    reply.beginBody(resp.getSize(), resp.header("Transfer-Encoding").equalsIgnoreCase("chunked"));
     JsonDocument resDoc;
-    deserializeJson(resDoc, response);
+    DeserializationError err = deserializeJson(resDoc, reply, DeserializationOption::Filter(filter));
+    reply.skipRest();
+    if (err) {
+      Serial.printf("LLM: bad JSON response (%s)\n", err.c_str());
+    }
     result = resDoc["choices"][0]["message"]["content"].as<String>();
+    keepAlive = reply.complete() && !reply.closeAfter();
   } else {
+    Serial.printf("LLM Error: %d\n", httpCode);
+    if (httpCode > 0) {
+      Serial.println(netHttp(lease).getString());
+    } else {
+      Serial.printf("Connection failed. WiFi status: %d\n", WiFi.status());
+      Serial.printf("Free heap: %u\n", ESP.getFreeHeap());
+    }
+  }
+  netEndHttp(&lease, keepAlive);
+  timelineMark(TL_LLM_DONE);
+  return result;
+}
+
+String getChatResponse(String input) {
+  Serial.println("Sending to Groq (LLM)...");
+  routeModel(input);
+  JsonBodyStream body;
+  if (!buildChatBody(&body, input, false)) {
+    routeRecord(0, false);
+    return "";
+  }
+  unsigned long startMs = millis();
+  String reply = requestChatCompletion(&body);
+  routeRecord(millis() - startMs, reply.length() > 0);
+  return reply;
+}
+
+#if HISTORY_SUMMARY
+bool historySummaryDue() {
+  return chatHistoryTokens() > HISTORY_SUMMARY_TRIGGER_TOKENS &&
+         chatHistoryCount() > HISTORY_SUMMARY_KEEP_MESSAGES;
+}
+
+// The summary request is written by hand on the pooled connection (like the STT
+// upload) rather than through HTTPClient, whose sendRequest() blocks until the
+// response headers arrive: here the wait is polled, and `abort` can give it up.
+// An abandoned request closes its connection, since the reply would still come in.
+static String requestSummary(JsonBodyStream* body, bool (*abort)(), bool* aborted) {
+  String head = String("POST /openai/v1/chat/completions HTTP/1.1\r\nHost: api.groq.com\r\nAuthorization: Bearer ") +
+                groq_api_key + "\r\nContent-Type: application/json\r\nContent-Length: " + body->size() +
+                "\r\n\r\n";
+  for (int attempt = 0; attempt < 2; attempt++) {
+    NetLease lease;
+    if (!netAcquire(NET_HOST_GROQ, &lease)) {
+      Serial.println("History: connection failed");
+      return "";
+    }
+    if (abort && abort()) {
+      // Connected but nothing sent: the connection is still good for the turn
+      netRelease(&lease, true);
+      *aborted = true;
+      return "";
+    }
+    WiFiClientSecure& client = netClient(lease);
+    client.setTimeout(15000);
+    body->rewind();
+    bool sent = client.write((const uint8_t*)head.c_str(), head.length()) == head.length();
+    uint8_t buf[256];
+    size_t n;
+    while (sent && (n = body->readBytes((char*)buf, sizeof(buf))) > 0) sent = client.write(buf, n) == n;
+
+    unsigned long sentMs = millis();
+    while (sent && !client.available() && client.connected() && millis() - sentMs < 20000) {
+      if (abort && abort()) {
+        netRelease(&lease, false);
+        *aborted = true;
+        return "";
+      }
+      delay(10);
+    }
+    HttpBodyReader reply(&client, 20000);
+    int status = sent ? reply.readHeaders() : -1;
+    if (status < 0 && lease.reused) {
+      netRelease(&lease, false);
+      Serial.println("History: kept-alive connection was closed, reconnecting");
+      continue;
+    }
+    String result = "";
+    if (status == 200) {
+      static JsonDocument filter;
+      if (filter.isNull()) {
+        filter["choices"][0]["message"]["content"] = true;
+      }
+      JsonDocument doc;
+      DeserializationError err = deserializeJson(doc, reply, DeserializationOption::Filter(filter));
+      if (err) Serial.printf("History: bad JSON response (%s)\n", err.c_str());
+      result = doc["choices"][0]["message"]["content"].as<String>();
+    } else {
+      Serial.printf("History: summary request failed (%d)\n", status);
+    }
+    if (status >= 0) reply.skipRest();
+    netRelease(&lease, status >= 0 && reply.complete() && !reply.closeAfter());
+    return result;
+  }
+  return "";
+}
+
+bool summarizeHistory(bool (*abort)(), bool* aborted) {
+  bool abandoned = false;
+  if (!aborted) aborted = &abandoned;
+  *aborted = false;
+  if (!historySummaryDue() || WiFi.status() != WL_CONNECTED) return false;
+  // Fold everything but the newest messages; the kept part must start with a question
+  uint8_t n = chatHistoryCount() - HISTORY_SUMMARY_KEEP_MESSAGES;
+  HistoryMessage m;
+  while (n > 0 && chatHistoryGet(n, &m) && !m.user) n--;
+  if (n == 0) return false;
+
+  // One user message holding the old memory and the transcript to fold into it
+  JsonBodyStream body;
+  char maxTokens[48];
+  snprintf(maxTokens, sizeof(maxTokens), "\",\"temperature\":0.2,\"max_tokens\":%u,",
+           (unsigned)HISTORY_SUMMARY_MAX_TOKENS);
+  body.addRaw("{\"model\":\"");
+  body.addRaw(llm_model_8b);
+  body.addRaw(maxTokens);
+  body.addRaw("\"messages\":[{\"role\":\"system\",\"content\":\"You keep the memory of a spoken "
+              "conversation between a user and a voice assistant. Merge the earlier memory and the new "
+              "transcript into one short memory in the third person: facts about the user, names, "
+              "preferences, open questions and promises. No greetings, no commentary, at most 80 words.\"},"
+              "{\"role\":\"user\",\"content\":\"");
+  if (chatHistoryGetSummary(&m)) {
+    body.addRaw("Earlier memory: ");
+    body.addEscaped(m.text, m.length);
+    body.addRaw("\\n\\n");
+  }
+  body.addRaw("Transcript:");
+  for (uint8_t i = 0; i < n && chatHistoryGet(i, &m); i++) {
+    body.addRaw(m.user ? "\\nUser: " : "\\nAssistant: ");
+    body.addEscaped(m.text, m.length);
+  }
+  body.addRaw("\"}]}");
+  if (body.overflowed()) return false;
+
+  uint32_t generation = chatHistoryGeneration();
+  uint32_t before = chatHistoryTokens();
+  unsigned long startMs = millis();
+  Serial.printf("History: summarizing %u of %u messages (~%u tok)...\n", (unsigned)n,
+                (unsigned)chatHistoryCount(), (unsigned)before);
+  String memory = trimCopy(requestSummary(&body, abort, aborted));
+  if (*aborted) {
+    Serial.printf("History: summary given up after %lu ms, a turn came first\n", millis() - startMs);
+    return false;
+  }
+  if (memory.length() == 0 || generation != chatHistoryGeneration()) {
+    Serial.println("History: summary dropped");
+    return false;
+  }
+  chatHistoryCompact(n, memory.c_str(), memory.length());
+  Serial.printf("History: ~%u -> ~%u tok + %u byte memory in %lu ms\n", (unsigned)before,
+                (unsigned)chatHistoryTokens(), (unsigned)memory.length(), millis() - startMs);
+  return true;
+}
+#endif
+
+// SSE event -> choices[0].delta.content
+struct ChatStreamState {
+  ChatDeltaCallback onDelta;
+  void* ctx;
+  String* result;
+  unsigned long startMs;
+  unsigned long firstDeltaMs;
+};
+
+static void onChatSseEvent(const char* data, size_t len, void* ctx) {
+  ChatStreamState* st = (ChatStreamState*)ctx;
+  static JsonDocument filter;
+  if (filter.isNull()) {
+    filter["choices"][0]["delta"]["content"] = true;
+  }
+  JsonDocument doc;
+  DeserializationError err = deserializeJson(doc, data, len, DeserializationOption::Filter(filter));
+  if (err) {
+    Serial.printf("LLM stream: bad event (%s)\n", err.c_str());
+    return;
+  }
+  const char* delta = doc["choices"][0]["delta"]["content"] | "";
+  size_t n = strlen(delta);
+  if (n == 0) return;
+  if (st->firstDeltaMs == 0) {
+    st->firstDeltaMs = millis();
+    timelineMark(TL_LLM_FIRST_BYTE);
+    Serial.printf("LLM: first token after %lu ms\n", st->firstDeltaMs - st->startMs);
+  }
+  st->result->concat(delta, n);
+  if (st->onDelta) st->onDelta(delta, n, st->ctx);
+}
+
+String getChatResponseStreaming(const String& input, ChatDeltaCallback onDelta, void* ctx,
+                                bool* complete) {
+  Serial.println("Sending to Groq (LLM, streaming)...");
+  if (complete) *complete = false;
+
+  if (WiFi.status() != WL_CONNECTED) {
+    Serial.println("LLM: WiFi not connected!");
+    return "";
+  }
+
+  Serial.println("LLM: Connecting...");
+  NetLease lease;
+  if (!netBeginHttp(NET_HOST_GROQ, &lease, GROQ_CHAT_URL)) {
+    Serial.println("LLM: connection failed");
+    return "";
+  }
+  const char* headerKeys[] = {"Transfer-Encoding"};
+  netHttp(lease).setTimeout(20000);
+  netHttp(lease).collectHeaders(headerKeys, 1);
+  addChatHeaders(netHttp(lease), true);
+  routeModel(input);
+  JsonBodyStream body;
+  if (!buildChatBody(&body, input, true)) {
+    routeRecord(0, false);
+    netEndHttp(&lease, true);
+    return "";
+  }
+
+  Serial.printf("LLM: Sending POST (stream, %u bytes)...\n", (unsigned)body.size());
+  unsigned long startMs = millis();
+  timelineMark(TL_LLM_SENT);
+  int httpCode = netHttp(lease).sendRequest("POST", &body, body.size());
+  if (netRetryStale(&lease, httpCode, GROQ_CHAT_URL)) {
+    netHttp(lease).collectHeaders(headerKeys, 1);
+    addChatHeaders(netHttp(lease), true);
+    body.rewind();
+    httpCode = netHttp(lease).sendRequest("POST", &body, body.size());
+  }
+  HTTPClient& http = netHttp(lease);
+  if (httpCode != 200) {
     Serial.printf("LLM Error: %d\n", httpCode);
     if (httpCode > 0) {
       Serial.println(http.getString());
@@ -130,7 +612,71 @@ String getChatResponse(String input) {
       Serial.printf("Connection failed. WiFi status: %d\n", WiFi.status());
       Serial.printf("Free heap: %u\n", ESP.getFreeHeap());
     }
+    routeRecord(0, false);
+    netEndHttp(&lease, httpCode > 0);
+    return "";
+  }
+
+  WiFiClient* stream = http.getStreamPtr();
+  if (!stream) {
+    Serial.println("LLM: no response stream");
+    routeRecord(0, false);
+    netEndHttp(&lease, false);
+    return "";
+  }
+
+  String result = "";
+  ChatStreamState st = {onDelta, ctx, &result, startMs, 0};
+  SseParser parser(onChatSseEvent, &st);
+  // HttpBodyReader removes the chunked framing and reads the trailer, so a
+  // finished body leaves nothing on the socket for the next request. Its
+  // timeout covers each wait for data, so time spent in onDelta (e.g.
+  // speaking) doesn't count.
+  HttpBodyReader reader(stream, 20000);
+  reader.beginBody(http.getSize(), http.header("Transfer-Encoding").equalsIgnoreCase("chunked"));
+
+  uint8_t buf[512];
+  int c;
+  while (!parser.sawDoneMarker() && (c = reader.read()) >= 0) {
+    // Whatever else of this chunk is already buffered, without waiting for more
+    buf[0] = (uint8_t)c;
+    size_t n = 1;
+    int more = reader.available();
+    if (more > 0) {
+      size_t want = (size_t)more < sizeof(buf) - 1 ? (size_t)more : sizeof(buf) - 1;
+      n += reader.readBytes((char*)buf + 1, want);
+    }
+    parser.feed(buf, n);
+  }
+  // Past [DONE]: the final 0-size chunk and trailer (nothing to wait for on an until-close body)
+  if (parser.sawDoneMarker() && !reader.closeAfter()) reader.skipRest();
+  if (!parser.sawDoneMarker()) {
+    Serial.println("LLM stream: ended without [DONE]");
   }
-  http.end();
+  if (complete) *complete = parser.sawDoneMarker();
+  if (parser.overflowCount() > 0) {
+    Serial.printf("LLM stream: %u oversized lines dropped\n", (unsigned)parser.overflowCount());
+  }
+  Serial.printf("LLM: streamed %u chars in %u events (%lu ms)\n",
+                (unsigned)result.length(), (unsigned)parser.eventCount(), millis() - startMs);
+  timelineMark(TL_LLM_DONE);
+  routeRecord(st.firstDeltaMs ? st.firstDeltaMs - startMs : 0, st.firstDeltaMs != 0);
+  // Only a fully consumed body leaves the connection clean for reuse
+  netEndHttp(&lease, reader.complete() && !reader.closeAfter());
   return result;
 }
+
+int findSentenceEnd(const String& text, int from) {
+  int len = text.length();
+  if (from < 0) from = 0;
+  for (int i = from; i < len - 1; i++) {
+    char c = text[i];
+    char next = text[i + 1];
+    bool boundary = (c == '.' || c == '!' || c == '?' || c == '\n') &&
+                    (next == ' ' || next == '\n' || next == '\r' || next == '\t');
+    if (!boundary) continue;
+    if (i + 1 - from < LLM_MIN_SENTENCE_CHARS) continue;
+    return i + 1;
+  }
+  return -1;
+}
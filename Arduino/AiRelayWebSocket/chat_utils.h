@@ -14,8 +14,29 @@ String processWakeAndEndWords(const String& finalTranscript);
 // Chat history
 void clearChatHistory();
 void addHistory(const char* role, const String& content);
+// Rolling summary (HISTORY_SUMMARY): fold the oldest turns into one memory message
+// with the 8b model. The dialog task calls it between turns; it blocks, but
+// abort (optional) is polled while waiting for the reply, and returning true
+// gives the request up (*aborted set) so a new turn doesn't wait behind it.
+bool historySummaryDue();
+bool summarizeHistory(bool (*abort)() = nullptr, bool* aborted = nullptr);
 
 // LLM
 String getChatResponse(String input);
 
+// Model routing (LLM_ROUTER): getChatResponse*() set llm_model per turn from the
+// question's complexity and each model's recent latency. Off = keep llm_model as set.
+void llmRouterSetAuto(bool on);
+bool llmRouterAuto();
+void llmRouterPrintStats();
+
+// Streaming LLM: onDelta gets each text fragment as it arrives; returns the full reply.
+// complete (optional): the stream reached [DONE], i.e. the reply wasn't cut off.
+typedef void (*ChatDeltaCallback)(const char* delta, size_t len, void* ctx);
+String getChatResponseStreaming(const String& input, ChatDeltaCallback onDelta, void* ctx,
+                                bool* complete = nullptr);
+
+// Index just past the first complete sentence in text[from..], or -1 if none yet.
+int findSentenceEnd(const String& text, int from);
+
 #endif
@@ -18,10 +18,116 @@
 // ======================= AUDIO =======================
 #define SAMPLE_RATE 16000
 #define RECORD_TIME_SECONDS 3
+// Whisper path (RecordAudio, serial "whisper"): stream the upload from speech onset to VAD end
+// instead of recording RECORD_TIME_SECONDS into a buffer first.
+#define STT_UPLOAD_STREAMING 1
+#define RECORD_WAIT_MS 5000         // give up if no speech starts within this
+#define RECORD_MAX_SECONDS 15
+#define RECORD_MAX_READ_FAILURES 25  // consecutive empty mic reads that end a recording (capture stalled)
+#define STT_UPLOAD_CHUNK_MS 100     // audio per HTTP chunk
 #define STT_RESPONSE_TIMEOUT_MS 20000
-#define FRAME_MS 200
+// Whisper upload as audio.flac (see flac_encoder.h): lossless, frames encoded as the
+// audio is captured. 0 uploads WAV (buffered recording only: the streaming
+// upload needs FLAC, its length isn't known up front).
+#define STT_UPLOAD_FLAC 1
+// Copy of a streamed upload kept while it goes out on a reused connection, to
+// resend it if that connection was already closed. 15 s of FLAC is ~250 KB.
+#define STT_REPLAY_BYTES (320 * 1024)
+#define FLAC_BLOCK_SAMPLES (SAMPLE_RATE / 10)  // 100 ms frames
+#define FLAC_MAX_LPC_ORDER 8
+#define FLAC_QLP_PRECISION 12                  // bits per quantized LPC coefficient
+#define FLAC_MAX_PARTITION_ORDER 4             // up to 16 Rice partitions per frame
+#define FRAME_MS 200  // WS uplink frame: 20, 40, 100 or 200 ms
 #define FRAME_SAMPLES (SAMPLE_RATE * FRAME_MS / 1000)
 #define FRAME_BYTES (FRAME_SAMPLES * 2)
+// WS uplink wire format (see uplink_codec.h): 1 = G.711 mu-law, 128 kbit/s instead of
+// 256, for weak Wi-Fi. Sets encoding= in stt_ws_path.
+#define STT_UPLINK_MULAW 0
+#if STT_UPLINK_MULAW
+#define STT_UPLINK_ENCODING "pcm_mulaw"
+#else
+#define STT_UPLINK_ENCODING "pcm_s16le"
+#endif
+
+// Mic capture task: I2S_NUM_0 is drained in MIC_BLOCK_MS blocks into a PSRAM ring
+// that readers pull frames from (see mic_capture.h).
+#define MIC_BLOCK_MS 10
+#define MIC_BLOCK_SAMPLES (SAMPLE_RATE * MIC_BLOCK_MS / 1000)
+#define MIC_FRAME_SAMPLES(ms) (SAMPLE_RATE * (ms) / 1000)
+#define MIC_RING_MS 2000  // multiple of MIC_BLOCK_MS; covers a reconnect delay() with room to spare
+#define MIC_CAPTURE_CORE 1
+#define MIC_MAX_READERS 5  // ws, vad, micTest and the Whisper recorder's two (stats only)
+// Mic level (see agc.h): DC blocker and a fixed shift in front of the echo canceller,
+// AGC + limiter after the noise suppressor. C command shows the gain.
+#define MIC_PRE_SHIFT 14              // 24-bit INMP441 -> 16 bits; linear, ahead of the AEC
+#define MIC_DC_POLE_SHIFT 8           // pole 1 - 2^-8: corner ~10 Hz
+#define MIC_AGC 1
+#define AGC_TARGET_LEVEL 1500         // mean |sample| of the loud syllables (~-22 dBFS)
+#define AGC_GATE_LEVEL 20             // quieter blocks (~4x the mic's noise) hold the gain
+#define AGC_MAX_GAIN_Q12 (8 * 4096)   // +18 dB
+#define AGC_MIN_GAIN_Q12 (4096 / 4)   // -12 dB
+#define AGC_ATTACK_SHIFT 1            // level envelope: up by 1/2 of the difference per block
+#define AGC_RELEASE_SHIFT 6           // down by 1/64 per block (~0.6 s)
+#define AGC_LIMIT 29000               // peak after the gain
+#define AGC_SILENCE_LEVEL 80          // default silenceThreshold on the normalized scale
+
+// ======================= VAD / UPLINK GATING =======================
+// Only speech plus some context is streamed to AssemblyAI (see vad.h).
+#define VAD_GATE_UPLINK 1
+#define VAD_SNR_Q8 (2 * 256)          // ~6 dB over the noise floor (log2, Q8)
+#define VAD_MIN_BAND_SHARE_Q8 128     // >= 50% of the energy inside 200-3400 Hz
+#define VAD_MAX_ZCR_PER_BLOCK 60      // zero crossings per 10 ms; above that looks like noise
+#define VAD_ONSET_BLOCKS 2
+#define VAD_HANGOVER_MS 300
+#define VAD_PREROLL_MS 300            // audio before the onset that is sent with it
+// Keep streaming after speech so the server still hears its end-of-turn silence
+// (max_turn_silence=1500 in stt_ws_path).
+#define VAD_TRAILING_MS 1700
+#define VAD_KEEPALIVE_MS 10000        // one silent frame this often while gated
+#define VAD_KEEPALIVE_FRAME_MS 100
+
+// ======================= LOCAL ENDPOINTING =======================
+// Force-finalize the AssemblyAI turn once the mic is quiet and the partial is stable
+// (see endpointer.h). max_turn_silence in stt_ws_path stays as the fallback.
+#define ENDPOINT_LOCAL 1
+#define ENDPOINT_MIN_WORDS 1
+#define ENDPOINT_CONFIDENT 0.6f              // same as end_of_turn_confidence_threshold in stt_ws_path
+#define ENDPOINT_SILENCE_CONFIDENT_MS 500
+#define ENDPOINT_SILENCE_MS 1000
+#define ENDPOINT_CONTINUATION_EXTRA_MS 400   // partial ends in "and", "the", "um", ...
+#define ENDPOINT_STABLE_MS 250               // partial unchanged this long
+
+// ======================= ECHO CANCELLATION / BARGE-IN =======================
+// NLMS echo canceller on the capture path, referenced to the speaker feed (see aec.h).
+#define ECHO_CANCEL 1
+#define AEC_TAPS 256                  // 16 ms of echo path after the bulk delay
+#define AEC_PRE_SAMPLES 64            // taps ahead of the estimated delay (+-1 step of the 2.5 ms envelope)
+#define AEC_MAX_DELAY_MS 320          // bulk delay search range: both 8 x 512-frame DMA queues + acoustics
+#define AEC_DELAY_INIT_MS 180         // used until the first estimate is confirmed
+#define AEC_MU_Q15 16384              // NLMS step size 0.5
+#define AEC_REF_MIN_Q8 (12 * 256)     // reference quieter than this (log2 energy) isn't adapted on
+#define AEC_ERL_INIT_Q8 (4 * 256)     // assume echo up to 12 dB above the reference until learned
+#define AEC_DT_MARGIN_Q8 (2 * 256)    // mic 6 dB over the predicted echo = near-end talk
+#define AEC_DT_HOLD_MS 50             // adaptation stays frozen this long after near-end talk
+// Per MIC_BLOCK_MS block on MIC_CAPTURE_CORE: 256 taps x 160 samples, filter + update
+// ~1.5 ms at 240 MHz. Blocks over the budget are counted (E command).
+#define AEC_BUDGET_US 2000
+// Keep listening (echo-cancelled) while a reply plays; near-end speech cuts it off.
+// Needs ECHO_CANCEL and VAD_GATE_UPLINK. Replaces the post-reply mic cooldown.
+#define BARGE_IN 1
+#define BARGE_IN_MS 200               // VAD active and mic above the echo this long
+#define BARGE_IN_FADE_MS 40
+
+// ======================= NOISE SUPPRESSION =======================
+// Spectral subtraction on the capture path, after the echo canceller (see ns.h).
+// Adds MIC_BLOCK_MS of latency. B command: stats, Bon / Boff to compare by ear (X mode).
+#define NOISE_SUPPRESS 1
+#define NS_FLOOR_Q15 6554             // strongest attenuation: 0.2 = -14 dB
+#define NS_OVERSUB_Q8 768             // subtract 3x the noise estimate
+#define NS_NOISE_BIAS_Q8 256          // minimum of the smoothed log power reads ~3 dB under the mean
+#define NS_NOISE_RISE_Q8 2            // per block: the noise estimate climbs ~2.3 dB/s
+// Per MIC_BLOCK_MS block on MIC_CAPTURE_CORE: two 256-point complex FFTs + 257 bins.
+#define NS_BUDGET_CYCLES 150000       // 0.6 ms at 240 MHz
 
 // ======================= TTS PROVIDER =======================
 enum TtsProvider {
@@ -29,12 +135,107 @@ enum TtsProvider {
   TTS_GOOGLE = 1
 };
 
+// Synthesize replies sentence by sentence; sentence N+1 downloads while N plays.
+#define TTS_PIPELINE 1
+#define TTS_PIPELINE_MAX_SENTENCES 16
+// After a playback timeout the reply is cancelled; wait this long for the
+// fetcher/player to wind down before the next reply may reopen the output.
+#define TTS_PIPELINE_CANCEL_WAIT_MS 15000
+
+// On-flash TTS cache (SPIFFS, IMA ADPCM). Only texts up to TTS_CACHE_MAX_CHARS
+// that missed twice are written.
+#define TTS_CACHE 1
+#define TTS_CACHE_MAX_BYTES (384 * 1024)
+#define TTS_CACHE_MAX_ENTRIES 64
+#define TTS_CACHE_MAX_CHARS 80
+#define TTS_CACHE_RECENT_MISSES 32   // keys remembered for the second-miss rule
+
+// Filler audio: a short per-persona line ("Hmm, let me think") rendered once to SPIFFS
+// and played from PSRAM while the LLM works; faded out when the reply's first clip is ready.
+#define FILLER_AUDIO 1
+#define FILLER_MAX_MS 1500     // longer renders are cut
+#define FILLER_FADE_MS 60
+
+// Audio output task: owns I2S_NUM_1 and drains a PSRAM ring that all playback goes through.
+#define AUDIO_OUT_RING_BYTES (128 * 1024)  // ~2.7 s of 24 kHz mono
+#define AUDIO_OUT_PREBUFFER_MS 150         // buffered before playback starts
+#define AUDIO_OUT_CORE 1
+#define AUDIO_OUT_TASK_PRIORITY 4
+
 // ======================= TIMING =======================
 #define WS_KEEPALIVE_MS 30000
 #define WS_RECONNECT_MS 60000
+// ws.loop() gaps longer than this are counted as WS starvation (a mic frame is 200 ms).
+#define WS_STARVATION_MS 500
+
+// ======================= DIALOG TASK =======================
+// LLM -> TTS turns run on their own task so ws.loop() keeps pumping during a reply.
+#define DIALOG_TASK_CORE 0
+#define DIALOG_TASK_STACK 12288
+#define DIALOG_QUEUE_DEPTH 2
+// Turns kept per provider for the latency timeline's p50/p95 (2 bytes per interval each).
+#define TIMELINE_WINDOW 32
+
+// ======================= CONNECTION POOL =======================
+// Keep-alive TLS connections per host (each open one costs ~40 KB of heap).
+#define NET_POOL_GROQ_SLOTS 2      // LLM stream + Groq TTS can overlap
+#define NET_POOL_GOOGLE_SLOTS 1
+#define NET_DNS_TTL_MS 300000
+#define NET_PREWARM_MIN_INTERVAL_MS 2000
+// Socket read buffer of HttpBodyReader (on the caller's stack).
+#define HTTP_READER_BUF_BYTES 512
 
 // ======================= CHAT HISTORY =======================
-#define HISTORY_MAX 8
+// Most messages kept (record slots); the token budget usually binds first.
+#define HISTORY_MAX 16
+// Estimated tokens of history sent with each request (~4 bytes per token).
+#define HISTORY_TOKEN_BUDGET 1200
+#define HISTORY_TOKENS_PER_MESSAGE 4
+// Text arena (PSRAM); twice the budget in bytes leaves room for wrap-around waste.
+#define HISTORY_ARENA_BYTES (2 * 4 * HISTORY_TOKEN_BUDGET)
+// Rolling summary: once the messages pass the trigger, the oldest ones are folded into
+// one "memory" message by the 8b model, between turns (dialog task idle).
+#define HISTORY_SUMMARY 1
+#define HISTORY_SUMMARY_TRIGGER_TOKENS 600
+#define HISTORY_SUMMARY_KEEP_MESSAGES 4   // newest messages always kept verbatim
+#define HISTORY_SUMMARY_MAX_TOKENS 160    // max_tokens of the summary request
+#define HISTORY_SUMMARY_MAX_BYTES 1024
+// Pieces of a streamed chat request body: head + prompt (4), memory (2), 2 per history
+// entry, question + close (3), one spare. chat_utils.cpp checks it against buildChatBody().
+#define JSON_BODY_MAX_PIECES (10 + 2 * HISTORY_MAX)
+
+// ======================= LLM =======================
+// Stream chat completions (SSE) so TTS can start on the first sentence.
+#define LLM_STREAM_RESPONSES 1
+// Shortest text treated as a sentence when splitting a streamed reply.
+#define LLM_MIN_SENTENCE_CHARS 12
+
+// Route each turn to the 8b or 70b model: a complexity score of the question picks the
+// model, a smoothed first-token latency over its SLO moves the turn to the other model
+// when that one is currently faster. toggleLLM / voice commands choose a fixed model.
+#define LLM_ROUTER 1
+#define LLM_ROUTER_COMPLEX_SCORE 40    // score 0-100; at or above -> 70b
+#define LLM_ROUTER_HARD_SCORE 70       // at or above -> 70b whatever the latency
+#define LLM_ROUTER_SLO_8B_MS 800       // first token (streaming) or whole reply
+#define LLM_ROUTER_SLO_70B_MS 1500
+#define LLM_ROUTER_EWMA_SHIFT 2        // new sample weight 1/4
+#define LLM_ROUTER_STALE_MS 120000     // older latency is forgotten, so a slow model gets retried
+
+// Spoken device commands ("volume up", "switch to Euclid") are matched against a grammar
+// table on the final transcript and run locally, confirmed from the TTS flash cache.
+#define INTENT_FAST_PATH 1
+#define INTENT_MAX_WORDS 8        // longer transcripts go straight to the LLM
+#define INTENT_VOLUME_STEP 15
+#define INTENT_VOLUME_MIN 10      // by voice; the confirmation has to stay audible
+
+// Question -> reply cache per persona: repeated stand-alone questions skip the LLM.
+#define REPLY_CACHE 1
+#define REPLY_CACHE_ENTRIES 48
+#define REPLY_CACHE_MAX_REPLY 768          // bytes; longer replies aren't cached (PSRAM slot size)
+#define REPLY_CACHE_TTL_MS (24UL * 3600 * 1000)
+#define REPLY_CACHE_MATCH_PERCENT 75       // word-set similarity for a fuzzy hit (100 = same words)
+#define REPLY_CACHE_PERSIST 1              // keep the cache on SPIFFS across reboots
+#define REPLY_CACHE_FLUSH_DELAY_MS 60000   // write the file once this long after the last store
 
 // Set to 1 to print raw Google TTS HTTP response (first 512 bytes). Uses more RAM when on.
 #define DEBUG_GOOGLE_TTS_RESPONSE 1
@@ -0,0 +1,359 @@
+#include "dialog_task.h"
+#include "chat_utils.h"
+#include "tts.h"
+#include "tts_pipeline.h"
+#include "audio_out.h"
+#include "net_pool.h"
+#include "turn_timeline.h"
+#include "reply_cache.h"
+#include "filler.h"
+#include "intent.h"
+#include "prompts.h"
+#include "stt.h"
+#include "config.h"
+#include "globals.h"
+#include <Arduino.h>
+
+enum DialogJobKind : uint8_t {
+  JOB_TURN,
+  JOB_SWITCH_PERSONA,
+};
+
+struct DialogJob {
+  DialogJobKind kind;
+  uint8_t persona;  // JOB_SWITCH_PERSONA
+  char* text;       // JOB_TURN
+  unsigned long queuedMs;
+  unsigned long speechEndMs;
+};
+
+struct DialogCounters {
+  uint32_t turns;
+  uint32_t dropped;         // queue full or out of memory
+  uint32_t cancelled;       // cut off by the user talking over the reply
+  uint32_t queueWaitMaxMs;
+  uint32_t lastTurnMs;
+  uint32_t maxTurnMs;
+  uint32_t totalTurnMs;
+  uint32_t summaries;
+  uint32_t summaryMaxMs;
+  uint32_t summaryTotalMs;
+  uint32_t summaryBlocked;  // turns that arrived while a summary was running
+  uint32_t summaryAborted;  // summaries given up for a turn or speech
+};
+
+static QueueHandle_t dialogQueue = nullptr;
+static DialogCounters counters;
+static volatile bool turnCancelled = false;  // set by dialogCancelTurn(), cleared per turn
+
+static void speakReply(const String& text) {
+#if FILLER_AUDIO
+  fillerStop();
+#endif
+  if (ttsProvider == TTS_GOOGLE) {
+    speakGoogleTTS(text);
+  } else {
+    speakGroqTTS(text);
+  }
+}
+
+static void speakSentence(const String& sentence) {
+  if (turnCancelled) return;
+#if TTS_PIPELINE
+  ttsPipelineEnqueue(sentence);
+#else
+  speakReply(sentence);
+#endif
+}
+
+#if LLM_STREAM_RESPONSES
+// Speak each sentence of a streamed reply as soon as it is complete.
+struct StreamedReply {
+  String pending;
+  unsigned long startMs;
+  int sentences;
+};
+
+static void onReplyDelta(const char* delta, size_t len, void* ctx) {
+  StreamedReply* r = (StreamedReply*)ctx;
+  if (turnCancelled) return;  // the stream runs to its end; nothing more is spoken
+  r->pending.concat(delta, len);
+  int end;
+  while ((end = findSentenceEnd(r->pending, 0)) > 0) {
+    String sentence = trimCopy(r->pending.substring(0, end));
+    r->pending = r->pending.substring(end);
+    if (r->sentences == 0) {
+      Serial.printf("LLM: first sentence ready after %lu ms\n", millis() - r->startMs);
+    }
+    r->sentences++;
+    speakSentence(sentence);
+  }
+}
+#endif
+
+// Question and answer go into the history as a pair, or not at all: a failed or
+// barged-in turn would leave a question without its reply.
+static void recordExchange(const String& command, const String& reply) {
+  if (reply.length() == 0) return;
+  addHistory("user", command);
+  addHistory("assistant", reply);
+}
+
+#if REPLY_CACHE
+// Same question asked before to this persona: speak the stored reply, no LLM.
+static bool speakCachedReply(const String& command) {
+  String reply;
+  if (!replyCacheLookup(currentPromptIndex, command, &reply)) return false;
+  timelineMarkCachedReply();
+  Serial.print("AI says (cached): ");
+  Serial.println(reply);
+  netTurnBegin();
+#if TTS_PIPELINE
+  ttsPipelineSpeak(reply);
+#else
+  speakReply(reply);
+#endif
+  netTurnEnd();
+  if (!turnCancelled) recordExchange(command, reply);
+  return true;
+}
+#endif
+
+// Background work for idle time: loading/rendering filler lines, pre-rendering
+// command confirmations, writing the reply cache. One step per call, each at most
+// one TTS request.
+static bool idleWorkPending() {
+  bool pending = false;
+#if FILLER_AUDIO
+  pending = pending || fillerNeedsPrepare();
+#endif
+#if INTENT_FAST_PATH
+  pending = pending || intentNeedsPrepare();
+#endif
+#if REPLY_CACHE
+  pending = pending || replyCacheFlushPending();
+#endif
+  return pending;
+}
+
+static void idleWorkStep() {
+#if FILLER_AUDIO
+  if (fillerNeedsPrepare()) {
+    fillerPrepare();
+    return;
+  }
+#endif
+#if INTENT_FAST_PATH
+  if (intentNeedsPrepare()) {
+    intentPrepare();
+    return;
+  }
+#endif
+#if REPLY_CACHE
+  if (replyCacheFlushDue()) replyCacheFlush();
+#endif
+}
+
+static void runTurn(const String& command) {
+#if INTENT_FAST_PATH
+  if (intentHandle(command)) return;
+#endif
+#if REPLY_CACHE
+  if (speakCachedReply(command)) return;
+  unsigned long llmStartMs = millis();
+#endif
+  netTurnBegin();
+#if FILLER_AUDIO
+  fillerStart();
+#endif
+#if LLM_STREAM_RESPONSES
+#if TTS_PIPELINE
+  ttsPipelineStartReply();
+#endif
+  StreamedReply streamed = {"", millis(), 0};
+  bool complete = false;
+  String reply = getChatResponseStreaming(command, onReplyDelta, &streamed, &complete);
+#if REPLY_CACHE
+  uint32_t llmMs = millis() - llmStartMs;
+#endif
+  String tail = trimCopy(streamed.pending);
+  if (tail.length() > 0) speakSentence(tail);
+#if TTS_PIPELINE
+  ttsPipelineEndReply();
+  ttsPipelineWait(120000);
+#endif
+  if (reply.length() > 0) {
+    Serial.print("AI says: ");
+    Serial.println(reply);
+  }
+#else
+  String reply = getChatResponse(command);
+  bool complete = reply.length() > 0;  // the whole JSON response was parsed
+#if REPLY_CACHE
+  uint32_t llmMs = millis() - llmStartMs;
+#endif
+  if (reply.length() > 0) {
+    Serial.print("AI says: ");
+    Serial.println(reply);
+#if TTS_PIPELINE
+    ttsPipelineSpeak(reply);
+#else
+    speakReply(reply);
+#endif
+  }
+#endif
+#if FILLER_AUDIO
+  fillerStop();  // no reply audio (LLM or TTS failed)
+#endif
+  netTurnEnd();
+#if REPLY_CACHE
+  // Only a reply that was heard in full, and not cut off, is worth replaying
+  if (!turnCancelled && complete) replyCacheStore(currentPromptIndex, command, reply, llmMs);
+#endif
+  if (!turnCancelled) recordExchange(command, reply);
+}
+
+#if HISTORY_SUMMARY
+// The user is talking or a turn is queued: a summary in flight is given up
+// rather than keep the turn waiting behind the 8b request.
+static bool summaryShouldAbort() {
+  return uxQueueMessagesWaiting(dialogQueue) > 0 || sttSpeechActive();
+}
+#endif
+
+// isProcessing stays set while anything is queued. Cleared first, then the queue
+// is checked: a turn submitted meanwhile either sees the flag clear and claims
+// it, or is already in the queue.
+static void releaseProcessing() {
+  isProcessing = false;
+  if (uxQueueMessagesWaiting(dialogQueue) > 0) isProcessing = true;
+}
+
+static void dialogTask(void*) {
+  for (;;) {
+    DialogJob job;
+    // With idle work left, do one step at a time but check the queue every second
+    TickType_t wait = idleWorkPending() ? pdMS_TO_TICKS(1000) : portMAX_DELAY;
+    if (xQueueReceive(dialogQueue, &job, wait) != pdTRUE) {
+      idleWorkStep();
+      continue;
+    }
+    if (job.kind == JOB_SWITCH_PERSONA) {
+      currentPromptIndex = job.persona;
+      clearChatHistory();
+      Serial.printf("Dialog: prompt %d, chat history cleared\n", currentPromptIndex);
+      releaseProcessing();
+      continue;
+    }
+    String command(job.text);
+    free(job.text);
+    isProcessing = true;
+    ledWaiting = true;
+    unsigned long startMs = millis();
+    uint32_t waitMs = startMs - job.queuedMs;
+    if (waitMs > counters.queueWaitMaxMs) counters.queueWaitMaxMs = waitMs;
+
+    turnCancelled = false;
+    timelineTurnBegin(job.speechEndMs, job.queuedMs);
+    runTurn(command);
+    timelineTurnEnd();
+
+    uint32_t turnMs = millis() - startMs;
+    counters.turns++;
+    counters.lastTurnMs = turnMs;
+    counters.totalTurnMs += turnMs;
+    if (turnMs > counters.maxTurnMs) counters.maxTurnMs = turnMs;
+    // The STT session was silent while we spoke; restart its idle clock now.
+    lastWsActivityMs = millis();
+    releaseProcessing();
+    ledWaiting = false;
+
+#if HISTORY_SUMMARY
+    // Compact between turns, never with another turn waiting or the user talking;
+    // either one arriving meanwhile makes summarizeHistory() give up
+    if (!summaryShouldAbort() && historySummaryDue()) {
+      unsigned long summaryStartMs = millis();
+      bool aborted = false;
+      if (summarizeHistory(summaryShouldAbort, &aborted)) {
+        uint32_t ms = millis() - summaryStartMs;
+        counters.summaries++;
+        counters.summaryTotalMs += ms;
+        if (ms > counters.summaryMaxMs) counters.summaryMaxMs = ms;
+      }
+      if (aborted) {
+        counters.summaryAborted++;
+      } else if (uxQueueMessagesWaiting(dialogQueue) > 0) {
+        counters.summaryBlocked++;
+      }
+    }
+#endif
+  }
+}
+
+void dialogTaskBegin() {
+  if (dialogQueue) return;
+  dialogQueue = xQueueCreate(DIALOG_QUEUE_DEPTH, sizeof(DialogJob));
+  xTaskCreatePinnedToCore(dialogTask, "dialog", DIALOG_TASK_STACK, NULL, 1, NULL, DIALOG_TASK_CORE);
+}
+
+bool dialogSubmit(const String& command, unsigned long speechEndMs, bool behindCancelled) {
+  if (!dialogQueue) return false;
+  bool idle = false;
+  bool claimed = isProcessing.compare_exchange_strong(idle, true);
+  if (!claimed && !(behindCancelled && turnCancelled)) return false;
+  DialogJob job = {JOB_TURN, 0, strdup(command.c_str()), millis(), speechEndMs};
+  if (!job.text || xQueueSend(dialogQueue, &job, 0) != pdTRUE) {
+    free(job.text);
+    if (claimed) releaseProcessing();
+    counters.dropped++;
+    Serial.println("Dialog: queue full, turn dropped");
+    return false;
+  }
+  return true;
+}
+
+bool dialogSwitchPersona(int persona) {
+  if (!dialogQueue) {
+    // No dialog task yet, so nothing to race with
+    currentPromptIndex = persona;
+    clearChatHistory();
+    return true;
+  }
+  DialogJob job = {JOB_SWITCH_PERSONA, (uint8_t)persona, nullptr, millis(), 0};
+  if (xQueueSend(dialogQueue, &job, 0) != pdTRUE) {
+    Serial.println("Dialog: queue full, prompt not switched");
+    return false;
+  }
+  return true;
+}
+
+bool dialogCancelTurn() {
+  if (!isProcessing || turnCancelled) return false;
+  turnCancelled = true;
+  counters.cancelled++;
+#if FILLER_AUDIO
+  fillerStop();
+#endif
+  audioOutCancel(BARGE_IN_FADE_MS);
+  return true;
+}
+
+bool dialogTurnCancelled() {
+  return turnCancelled;
+}
+
+void dialogPrintStats() {
+  DialogCounters c = counters;
+  Serial.println("\n=== Dialog task ===");
+  Serial.printf("  Turns: %u, dropped: %u, cancelled: %u, queue wait max: %u ms\n",
+                (unsigned)c.turns, (unsigned)c.dropped, (unsigned)c.cancelled,
+                (unsigned)c.queueWaitMaxMs);
+  Serial.printf("  Turn time: last %u ms, avg %u ms, max %u ms\n", (unsigned)c.lastTurnMs,
+                (unsigned)(c.turns ? c.totalTurnMs / c.turns : 0), (unsigned)c.maxTurnMs);
+#if HISTORY_SUMMARY
+  Serial.printf("  History summaries: %u, avg %u ms, max %u ms, given up: %u, turns kept waiting: %u\n",
+                (unsigned)c.summaries, (unsigned)(c.summaries ? c.summaryTotalMs / c.summaries : 0),
+                (unsigned)c.summaryMaxMs, (unsigned)c.summaryAborted, (unsigned)c.summaryBlocked);
+#endif
+  Serial.println("===================\n");
+}
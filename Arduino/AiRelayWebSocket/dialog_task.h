@@ -0,0 +1,30 @@
+#ifndef AI_RELAY_WEBSOCKET_DIALOG_TASK_H
+#define AI_RELAY_WEBSOCKET_DIALOG_TASK_H
+
+#include <Arduino.h>
+
+// Dialog task: runs LLM -> TTS turns off the WebSocket callback so ws.loop()
+// keeps pumping (pings, transcripts) while a reply is generated and spoken.
+void dialogTaskBegin();
+
+// Queue a final transcript (or typed "say" input) for a turn. Sets isProcessing
+// (atomically, so two callers can't both start a turn); the dialog task clears
+// it when the last queued turn ends. False if a turn is already queued or
+// running, unless behindCancelled and that turn was barged in on: then this one
+// waits behind it. speechEndMs: when the user stopped talking (0 = unknown).
+bool dialogSubmit(const String& command, unsigned long speechEndMs = 0, bool behindCancelled = false);
+
+// Persona switch from loop(): the dialog task sets currentPromptIndex and clears
+// the chat history between turns, so a running turn never sees half of it.
+bool dialogSwitchPersona(int persona);
+
+// Barge-in: cut the running turn's audio off (fade, drop the rest). The LLM
+// stream finishes in the background but speaks nothing more. False if no turn
+// is running (or it was already cancelled).
+bool dialogCancelTurn();
+bool dialogTurnCancelled();
+
+// Turn counters, queue wait and turn duration.
+void dialogPrintStats();
+
+#endif
@@ -0,0 +1,104 @@
+#include "endpointer.h"
+#include "config.h"
+#include <Arduino.h>
+
+// Trailing words after which people usually keep talking
+static const char* const CONTINUATION_WORDS[] = {
+  "and", "or", "but", "so", "because", "the", "a", "an", "to", "of", "with",
+  "my", "your", "is", "um", "uh", "like", "if", "that", "what"
+};
+
+void Endpointer::reset() {
+  partial_ = "";
+  partialWords_ = 0;
+  confidence_ = 0;
+  lastVoiceMs_ = 0;
+  lastChangeMs_ = 0;
+  forcedAtMs_ = 0;
+  resumedAfterForce_ = false;
+}
+
+void Endpointer::onVoice(unsigned long nowMs) {
+  lastVoiceMs_ = nowMs;
+  if (forcedAtMs_ != 0) resumedAfterForce_ = true;
+}
+
+void Endpointer::onPartial(const String& transcript, float endOfTurnConfidence, unsigned long nowMs) {
+  confidence_ = endOfTurnConfidence;
+  if (transcript == partial_) return;
+  partial_ = transcript;
+  partialWords_ = countWords(transcript);
+  lastChangeMs_ = nowMs;
+  if (lastVoiceMs_ == 0) lastVoiceMs_ = nowMs;  // no VAD feed yet: the words are the voice
+}
+
+bool Endpointer::shouldForce(unsigned long nowMs) {
+  if (forcedAtMs_ != 0 || partialWords_ < ENDPOINT_MIN_WORDS || lastVoiceMs_ == 0) return false;
+  unsigned long silence = nowMs - lastVoiceMs_;
+  unsigned long needed = confidence_ >= ENDPOINT_CONFIDENT ? ENDPOINT_SILENCE_CONFIDENT_MS : ENDPOINT_SILENCE_MS;
+  if (endsWithContinuation(partial_)) needed += ENDPOINT_CONTINUATION_EXTRA_MS;
+  if (silence < needed || nowMs - lastChangeMs_ < ENDPOINT_STABLE_MS) return false;
+  forcedAtMs_ = nowMs;
+  resumedAfterForce_ = false;
+  return true;
+}
+
+void Endpointer::onEndOfTurn(const String& transcript, unsigned long nowMs) {
+  uint32_t latency = lastVoiceMs_ != 0 ? (uint32_t)(nowMs - lastVoiceMs_) : 0;
+  stats_.turns++;
+  if (forcedAtMs_ != 0) {
+    stats_.forced++;
+    stats_.forcedLatencyTotalMs += latency;
+    if (latency > stats_.forcedLatencyMaxMs) stats_.forcedLatencyMaxMs = latency;
+    uint32_t rtt = (uint32_t)(nowMs - forcedAtMs_);
+    if (rtt > stats_.forceRttMaxMs) stats_.forceRttMaxMs = rtt;
+    if (resumedAfterForce_ || countWords(transcript) > partialWords_) {
+      stats_.falseCuts++;
+      Serial.printf("Endpoint: possible early cut (\"%s\" -> \"%s\")\n", partial_.c_str(), transcript.c_str());
+    }
+  } else {
+    stats_.serverTurns++;
+    stats_.serverLatencyTotalMs += latency;
+    if (latency > stats_.serverLatencyMaxMs) stats_.serverLatencyMaxMs = latency;
+  }
+  reset();
+}
+
+uint16_t Endpointer::countWords(const String& s) {
+  uint16_t n = 0;
+  bool inWord = false;
+  for (size_t i = 0; i < s.length(); i++) {
+    bool alnum = isalnum((unsigned char)s[i]) || (s[i] & 0x80);  // UTF-8 letters count as word chars
+    if (alnum && !inWord) n++;
+    inWord = alnum;
+  }
+  return n;
+}
+
+bool Endpointer::endsWithContinuation(const String& s) {
+  int end = s.length();
+  while (end > 0 && !isalnum((unsigned char)s[end - 1])) end--;
+  int start = end;
+  while (start > 0 && isalnum((unsigned char)s[start - 1])) start--;
+  if (start == end || end - start > 8) return false;
+  char word[9];
+  for (int i = start; i < end; i++) word[i - start] = (char)tolower((unsigned char)s[i]);
+  word[end - start] = '\0';
+  for (const char* w : CONTINUATION_WORDS) {
+    if (strcmp(word, w) == 0) return true;
+  }
+  return false;
+}
+
+void Endpointer::printStats() const {
+  Stats s = stats_;
+  Serial.println("\n=== Endpointer ===");
+  Serial.printf("  Turns: %u, forced locally: %u, ended by server: %u, possible early cuts: %u\n",
+                (unsigned)s.turns, (unsigned)s.forced, (unsigned)s.serverTurns, (unsigned)s.falseCuts);
+  Serial.printf("  Last speech -> end_of_turn: forced avg %u ms (max %u), server avg %u ms (max %u)\n",
+                (unsigned)(s.forced ? s.forcedLatencyTotalMs / s.forced : 0), (unsigned)s.forcedLatencyMaxMs,
+                (unsigned)(s.serverTurns ? s.serverLatencyTotalMs / s.serverTurns : 0),
+                (unsigned)s.serverLatencyMaxMs);
+  Serial.printf("  ForceEndpoint -> end_of_turn max %u ms\n", (unsigned)s.forceRttMaxMs);
+  Serial.println("==================\n");
+}
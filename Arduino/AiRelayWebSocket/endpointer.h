@@ -0,0 +1,56 @@
+#ifndef AI_RELAY_WEBSOCKET_ENDPOINTER_H
+#define AI_RELAY_WEBSOCKET_ENDPOINTER_H
+
+#include <Arduino.h>
+
+// Local end-of-turn detector. The server waits up to max_turn_silence before
+// it sends end_of_turn; we already know when the mic went quiet (VAD) and when
+// the partial transcript stopped changing, so when both agree we ask the server
+// to finalize now (ForceEndpoint). Times are millis(); one instance per WS session.
+class Endpointer {
+ public:
+  Endpointer() { reset(); }
+
+  // New session: drops the open turn, keeps the stats.
+  void reset();
+  // Mic block judged as speech.
+  void onVoice(unsigned long nowMs);
+  // Partial (not end_of_turn) transcript update.
+  void onPartial(const String& transcript, float endOfTurnConfidence, unsigned long nowMs);
+  // True once per turn when the turn should be force-finalized.
+  bool shouldForce(unsigned long nowMs);
+  // end_of_turn arrived; records latency and whether a forced cut was premature.
+  void onEndOfTurn(const String& transcript, unsigned long nowMs);
+
+  struct Stats {
+    uint32_t turns;
+    uint32_t forced;
+    uint32_t falseCuts;        // speech resumed or words were added after we forced
+    uint32_t forcedLatencyMaxMs;
+    uint64_t forcedLatencyTotalMs;  // last speech -> end_of_turn
+    uint32_t serverTurns;
+    uint32_t serverLatencyMaxMs;
+    uint64_t serverLatencyTotalMs;
+    uint32_t forceRttMaxMs;    // ForceEndpoint sent -> end_of_turn
+  };
+  // Last speech block of the open turn (0 = none); read before onEndOfTurn().
+  unsigned long lastVoiceMs() const { return lastVoiceMs_; }
+
+  const Stats& stats() const { return stats_; }
+  void printStats() const;
+
+ private:
+  static uint16_t countWords(const String& s);
+  static bool endsWithContinuation(const String& s);
+
+  String partial_;
+  uint16_t partialWords_;
+  float confidence_;
+  unsigned long lastVoiceMs_;
+  unsigned long lastChangeMs_;
+  unsigned long forcedAtMs_;   // 0 = not forced this turn
+  bool resumedAfterForce_;
+  Stats stats_ = {};
+};
+
+#endif
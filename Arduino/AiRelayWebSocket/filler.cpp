@@ -0,0 +1,243 @@
+#include "filler.h"
+#include "audio_out.h"
+#include "audio_utils.h"
+#include "tts.h"
+#include "prompts.h"
+#include "turn_timeline.h"
+#include "config.h"
+#include "globals.h"
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include <WiFi.h>
+#include <esp_heap_caps.h>
+
+// Files: /fill/<g|c><persona>_<n>.wav (g = Groq, c = Google Cloud), plain 16-bit mono WAV
+static const char* FILLER_DIR = "/fill/";
+static const uint32_t RENDER_RETRY_MS = 60000;
+
+struct FillerClip {
+  uint8_t* wav;        // whole file, PSRAM
+  const uint8_t* pcm;
+  size_t bytes;
+  uint32_t sampleRate;
+};
+
+struct FillerStats {
+  uint32_t started;
+  uint32_t notReady;     // turn began before this persona's lines were rendered
+  uint32_t cut;          // faded out by the reply's first clip
+  uint32_t playedOut;    // finished before the reply had audio
+  uint32_t renders;
+  uint32_t renderFailures;
+  uint32_t startUsMax;
+};
+
+static FillerClip clips[PROMPT_FILLER_COUNT];
+static int loadedPersona = -1;
+static int loadedProvider = -1;
+static uint8_t nextClip = 0;
+static volatile bool active = false;
+static portMUX_TYPE activeMux = portMUX_INITIALIZER_UNLOCKED;
+static unsigned long renderRetryAtMs = 0;
+static FillerStats stats;
+
+static String clipPath(uint8_t persona, TtsProvider provider, uint8_t n) {
+  char name[32];
+  snprintf(name, sizeof(name), "%s%c%u_%u.wav", FILLER_DIR, provider == TTS_GOOGLE ? 'c' : 'g',
+           (unsigned)persona, (unsigned)n);
+  return String(name);
+}
+
+static void freeClip(FillerClip* c) {
+  if (c->wav) free(c->wav);
+  memset(c, 0, sizeof(*c));
+}
+
+static bool loadClip(uint8_t n) {
+  freeClip(&clips[n]);
+  String path = clipPath(currentPromptIndex, ttsProvider, n);
+  if (!SPIFFS.exists(path)) return false;
+  File f = SPIFFS.open(path, FILE_READ);
+  if (!f) return false;
+  size_t len = f.size();
+  uint8_t* wav = nullptr;
+  if (psramFound()) wav = (uint8_t*)heap_caps_malloc(len, MALLOC_CAP_SPIRAM);
+  if (!wav) wav = (uint8_t*)malloc(len);
+  WavInfo info;
+  bool ok = wav && f.read(wav, len) == len && parseWavHeader(wav, len, &info) && info.channels == 1;
+  f.close();
+  if (!ok) {
+    if (wav) free(wav);
+    Serial.printf("Filler: %s unreadable, dropped\n", path.c_str());
+    SPIFFS.remove(path);
+    return false;
+  }
+  size_t bytes = info.dataSize;
+  if (info.dataOffset + bytes > len) bytes = len - info.dataOffset;
+  clips[n] = {wav, wav + info.dataOffset, bytes & ~(size_t)1, info.sampleRate};
+  return true;
+}
+
+static void loadBank() {
+  uint8_t loaded = 0;
+  for (uint8_t n = 0; n < PROMPT_FILLER_COUNT; n++) loaded += loadClip(n);
+  loadedPersona = currentPromptIndex;
+  loadedProvider = ttsProvider;
+  nextClip = 0;
+  Serial.printf("Filler: %u/%u lines loaded for prompt %u\n", (unsigned)loaded,
+                (unsigned)PROMPT_FILLER_COUNT, (unsigned)currentPromptIndex);
+}
+
+static bool bankCurrent() {
+  return loadedPersona == currentPromptIndex && loadedProvider == ttsProvider;
+}
+
+static int missingClip() {
+  for (uint8_t n = 0; n < PROMPT_FILLER_COUNT; n++) {
+    if (!clips[n].wav) return n;
+  }
+  return -1;
+}
+
+// One TTS request for line n of the current persona, written to flash (cut to FILLER_MAX_MS)
+static bool renderClip(uint8_t n) {
+  String text = getPromptFiller(currentPromptIndex, n);
+  if (text.length() == 0) return false;
+  TtsAudio audio = {};
+  bool ok = ttsProvider == TTS_GOOGLE ? fetchGoogleTTSAudio(text, &audio) : fetchGroqTTSAudio(text, &audio);
+  WavInfo info;
+  ok = ok && parseWavHeader(audio.data, audio.len, &info) && info.channels == 1;
+  if (ok) {
+    size_t bytes = info.dataSize;
+    if (info.dataOffset + bytes > audio.len) bytes = audio.len - info.dataOffset;
+    size_t maxBytes = (size_t)info.sampleRate * 2 * FILLER_MAX_MS / 1000;
+    if (bytes > maxBytes) bytes = maxBytes;
+    bytes &= ~(size_t)1;
+    uint8_t header[44];
+    createWavHeader(header, (int)bytes);
+    // createWavHeader writes 16 kHz; patch in the clip's rate
+    uint32_t byteRate = info.sampleRate * 2;
+    memcpy(header + 24, &info.sampleRate, 4);
+    memcpy(header + 28, &byteRate, 4);
+    String path = clipPath(currentPromptIndex, ttsProvider, n);
+    File f = SPIFFS.open(path, FILE_WRITE);
+    ok = f && f.write(header, sizeof(header)) == sizeof(header) &&
+         f.write(audio.data + info.dataOffset, bytes) == bytes;
+    if (f) f.close();
+    if (!ok) SPIFFS.remove(path);
+    if (ok) Serial.printf("Filler: rendered \"%s\" (%u ms)\n", text.c_str(), (unsigned)(bytes * 500 / info.sampleRate));
+  }
+  freeTtsAudio(&audio);
+  return ok && loadClip(n);
+}
+
+bool fillerBegin() {
+  loadBank();
+  return true;
+}
+
+bool fillerNeedsPrepare() {
+  if (!bankCurrent()) return true;
+  if (missingClip() < 0) return false;
+  return WiFi.status() == WL_CONNECTED && (long)(millis() - renderRetryAtMs) >= 0;
+}
+
+void fillerPrepare() {
+  if (!bankCurrent()) {
+    loadBank();
+    return;
+  }
+  int n = missingClip();
+  if (n < 0) return;
+  if (renderClip(n)) {
+    stats.renders++;
+  } else {
+    // Offline or quota: don't keep the dialog task busy with retries
+    stats.renderFailures++;
+    renderRetryAtMs = millis() + RENDER_RETRY_MS;
+    Serial.println("Filler: render failed, retrying later");
+  }
+}
+
+bool fillerStart() {
+  uint32_t startUs = micros();
+  // Rotate through the lines that are ready
+  const FillerClip* c = nullptr;
+  for (uint8_t i = 0; i < PROMPT_FILLER_COUNT && !c && bankCurrent(); i++) {
+    uint8_t n = (nextClip + i) % PROMPT_FILLER_COUNT;
+    if (clips[n].wav) {
+      c = &clips[n];
+      nextClip = n + 1;
+    }
+  }
+  if (!c) {
+    stats.notReady++;
+    return false;
+  }
+  audioOutSessionBegin(TL_FILLER_FIRST_SAMPLE);
+  audioOutSetFormat(c->sampleRate, 1);
+  portENTER_CRITICAL(&activeMux);
+  active = true;
+  portEXIT_CRITICAL(&activeMux);
+  // The ring is idle at the start of a turn, so this doesn't wait
+  audioOutWrite(c->pcm, c->bytes, 0);
+  uint32_t us = micros() - startUs;
+  if (us > stats.startUsMax) stats.startUsMax = us;
+  stats.started++;
+  return true;
+}
+
+void fillerStop() {
+  portENTER_CRITICAL(&activeMux);
+  bool wasActive = active;
+  active = false;
+  portEXIT_CRITICAL(&activeMux);
+  if (!wasActive) return;
+  if (audioOutPlaying() || audioOutBuffered() > 0) {
+    audioOutFadeOut(FILLER_FADE_MS);
+    stats.cut++;
+  } else {
+    stats.playedOut++;
+  }
+  audioOutSessionBegin();
+}
+
+bool fillerActive() {
+  return active;
+}
+
+void fillerClear() {
+  File root = SPIFFS.open("/");
+  if (root) {
+    for (File f = root.openNextFile(); f; f = root.openNextFile()) {
+      String path = f.path();
+      f.close();
+      if (path.startsWith(FILLER_DIR)) SPIFFS.remove(path);
+    }
+    root.close();
+  }
+  for (uint8_t n = 0; n < PROMPT_FILLER_COUNT; n++) freeClip(&clips[n]);
+  loadedPersona = -1;
+  renderRetryAtMs = millis();
+}
+
+void fillerPrintStats() {
+  FillerStats s = stats;
+  uint8_t ready = 0;
+  size_t bytes = 0;
+  for (uint8_t n = 0; n < PROMPT_FILLER_COUNT; n++) {
+    if (!clips[n].wav) continue;
+    ready++;
+    bytes += clips[n].bytes;
+  }
+  Serial.println("\n=== Filler audio ===");
+  Serial.printf("  Prompt %d (%s): %u/%u lines ready, %u KB PSRAM\n", loadedPersona,
+                loadedProvider == TTS_GOOGLE ? "Google" : "Groq", (unsigned)ready,
+                (unsigned)PROMPT_FILLER_COUNT, (unsigned)(bytes / 1024));
+  Serial.printf("  Started: %u, not ready: %u, cut by reply: %u, played out: %u\n",
+                (unsigned)s.started, (unsigned)s.notReady, (unsigned)s.cut, (unsigned)s.playedOut);
+  Serial.printf("  Start: max %u us; renders: %u, failed: %u\n", (unsigned)s.startUsMax,
+                (unsigned)s.renders, (unsigned)s.renderFailures);
+  Serial.println("  (filler_audio vs first_audio in L shows the gap it covers)");
+  Serial.println("====================\n");
+}
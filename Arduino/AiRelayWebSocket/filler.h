@@ -0,0 +1,28 @@
+#ifndef AI_RELAY_WEBSOCKET_FILLER_H
+#define AI_RELAY_WEBSOCKET_FILLER_H
+
+#include <Arduino.h>
+
+// Filler audio: the current persona's PROMPT_FILLER_COUNT lines, rendered once per
+// TTS provider to SPIFFS (/fill/) and kept in PSRAM, so a turn can start talking
+// the moment the transcript arrives. The reply's first clip fades the filler out.
+// Filler samples stamp TL_FILLER_FIRST_SAMPLE, not TL_TTS_FIRST_SAMPLE.
+bool fillerBegin();
+
+// Dialog task, between turns: load the bank after a persona/provider change, or
+// render one missing line (one TTS request). NeedsPrepare says whether there's work.
+bool fillerNeedsPrepare();
+void fillerPrepare();
+
+// Queue a filler for the current persona; false if none is ready yet.
+bool fillerStart();
+// Fade out whatever is left of the filler and open the reply's audio session.
+// No-op when no filler is active; safe from the dialog and TTS player tasks.
+void fillerStop();
+bool fillerActive();
+
+// Delete the rendered lines (they are rendered again while idle).
+void fillerClear();
+void fillerPrintStats();
+
+#endif
@@ -0,0 +1,487 @@
+#include "flac_encoder.h"
+#include "config.h"
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+
+static const int BLOCK = FLAC_BLOCK_SAMPLES;
+static const int MAX_FRAME_BYTES = BLOCK * 2 + 32;  // verbatim subframe + frame header/footer
+static const int MIN_PREDICT_SAMPLES = 32;          // shorter (last) blocks go verbatim
+static const int MAX_PARTITIONS = 1 << FLAC_MAX_PARTITION_ORDER;
+static const uint32_t RICE_MAX_PARAM = 14;           // 4-bit parameter, 15 is the escape code
+static const int COEF_FRAC = 24;                     // Levinson coefficients, Q24
+static_assert(BLOCK >= MIN_PREDICT_SAMPLES && BLOCK <= 8192, "FLAC_BLOCK_SAMPLES: the decoders here take up to 8192");
+static_assert(FLAC_MAX_LPC_ORDER >= 1 && FLAC_MAX_LPC_ORDER <= 8, "FLAC_MAX_LPC_ORDER: 1-8");
+// |coefficient| < 2^(precision-1), |sample| <= 2^15, order <= 8: the predictor sum fits 32 bits
+static_assert(FLAC_QLP_PRECISION >= 5 && FLAC_QLP_PRECISION <= 13, "FLAC_QLP_PRECISION: 5-13");
+
+struct FlacStats {
+  uint32_t streams;
+  uint32_t frames;
+  uint64_t pcmBytes;
+  uint64_t flacBytes;  // headers included
+  uint32_t constant;
+  uint32_t verbatim;
+  uint32_t fixed;
+  uint32_t lpc;
+  uint32_t lpcOrderSum;
+  uint64_t cyclesTotal;
+  uint32_t cyclesMax;
+};
+
+static int32_t* resFixed = nullptr;
+static int32_t* resLpc = nullptr;  // also the windowed block during the LPC analysis
+static int16_t* block = nullptr;
+static uint8_t* frameBuf = nullptr;
+static size_t fill = 0;
+static uint32_t frameNumber = 0;
+static uint8_t crc8Table[256];
+static uint16_t crc16Table[256];
+static FlacStats stats = {};
+
+struct BitWriter {
+  uint8_t* out;
+  size_t pos;
+  uint64_t acc;
+  int bits;  // pending bits in acc, < 8 between calls
+
+  void put(uint32_t v, int n) {  // n <= 32
+    if (n == 0) return;
+    acc = (acc << n) | (n == 32 ? v : (v & ((1u << n) - 1)));
+    bits += n;
+    while (bits >= 8) {
+      bits -= 8;
+      out[pos++] = (uint8_t)(acc >> bits);
+    }
+  }
+  void align() {
+    if (bits) put(0, 8 - bits);
+  }
+};
+
+// Rice residuals: per partition, a parameter from its |residual| sum
+struct RicePlan {
+  int order;
+  uint8_t param[MAX_PARTITIONS];
+  uint32_t bits;  // upper bound, residual header included
+};
+
+static void buildCrcTables() {
+  for (int i = 0; i < 256; i++) {
+    uint8_t c8 = (uint8_t)i;
+    uint16_t c16 = (uint16_t)(i << 8);
+    for (int b = 0; b < 8; b++) {
+      c8 = (c8 & 0x80) ? (uint8_t)((c8 << 1) ^ 0x07) : (uint8_t)(c8 << 1);
+      c16 = (c16 & 0x8000) ? (uint16_t)((c16 << 1) ^ 0x8005) : (uint16_t)(c16 << 1);
+    }
+    crc8Table[i] = c8;
+    crc16Table[i] = c16;
+  }
+}
+
+bool flacEncoderBegin() {
+  if (block) return true;
+  size_t bytes = BLOCK * (2 * sizeof(int32_t) + sizeof(int16_t)) + MAX_FRAME_BYTES;
+  uint8_t* mem = nullptr;
+  if (psramFound()) mem = (uint8_t*)heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM);
+  if (!mem) mem = (uint8_t*)malloc(bytes);
+  if (!mem) {
+    Serial.println("FLAC: buffer alloc failed");
+    return false;
+  }
+  resFixed = (int32_t*)mem;
+  resLpc = resFixed + BLOCK;
+  block = (int16_t*)(resLpc + BLOCK);
+  frameBuf = (uint8_t*)(block + BLOCK);
+  buildCrcTables();
+  Serial.printf("FLAC: %u-sample frames, LPC up to order %u, %u-bit coefficients\n", (unsigned)BLOCK,
+                (unsigned)FLAC_MAX_LPC_ORDER, (unsigned)FLAC_QLP_PRECISION);
+  return true;
+}
+
+// log2(v) in Q8: the MSB position, plus the 8 bits below it as the fraction
+static int32_t log2Q8Bits(uint64_t v) {
+  if (v == 0) return 0;
+  int p = 63 - __builtin_clzll(v);
+  uint32_t frac = p >= 8 ? (uint32_t)(v >> (p - 8)) & 0xFF : (uint32_t)(v << (8 - p)) & 0xFF;
+  return p * 256 + (int32_t)frac;
+}
+
+static inline uint32_t zigzag(int32_t r) {
+  return ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+}
+
+// Bits for one partition with its best parameter. The sum >> k term bounds the
+// quotient bits from above, so the frame can never outgrow a verbatim one;
+// the parameter is picked with the usual -cnt/2 correction for the floor.
+static uint32_t partitionBits(uint64_t sum, uint32_t cnt, uint8_t* paramOut) {
+  uint64_t mean = sum / cnt;
+  uint32_t k0 = mean ? 63 - __builtin_clzll(mean) : 0;
+  uint32_t bestK = 0;
+  uint64_t bestEst = UINT64_MAX;
+  for (uint32_t k = k0 ? k0 - 1 : 0; k <= k0 + 1 && k <= RICE_MAX_PARAM; k++) {
+    uint64_t quotients = sum >> k;
+    uint64_t floorCorrection = k ? cnt / 2 : 0;
+    if (floorCorrection > quotients) floorCorrection = quotients;
+    uint64_t est = (uint64_t)cnt * (k + 1) + quotients - floorCorrection;
+    if (est < bestEst) {
+      bestEst = est;
+      bestK = k;
+    }
+  }
+  *paramOut = (uint8_t)bestK;
+  uint64_t bound = 4 + (uint64_t)cnt * (bestK + 1) + (sum >> bestK);
+  return bound > UINT32_MAX / 2 ? UINT32_MAX / 2 : (uint32_t)bound;
+}
+
+// Partition order 0..FLAC_MAX_PARTITION_ORDER with the fewest bits: sums at the
+// finest order, then pairs merged level by level.
+static void planRice(const int32_t* res, size_t n, int predOrder, RicePlan* plan) {
+  int maxOrder = FLAC_MAX_PARTITION_ORDER;
+  while (maxOrder > 0 && ((n & ((1u << maxOrder) - 1)) || (n >> maxOrder) <= (size_t)predOrder)) maxOrder--;
+  uint64_t sums[MAX_PARTITIONS];
+  size_t size = n >> maxOrder;
+  for (int p = 0; p < (1 << maxOrder); p++) {
+    uint64_t sum = 0;
+    for (size_t i = p ? p * size : predOrder; i < (p + 1) * size; i++) sum += zigzag(res[i]);
+    sums[p] = sum;
+  }
+  plan->bits = UINT32_MAX;
+  for (int order = maxOrder; order >= 0; order--) {
+    int parts = 1 << order;
+    if (order < maxOrder) {
+      for (int p = 0; p < parts; p++) sums[p] = sums[2 * p] + sums[2 * p + 1];
+    }
+    size = n >> order;
+    uint8_t params[MAX_PARTITIONS];
+    uint32_t bits = 2 + 4;  // coding method, partition order
+    for (int p = 0; p < parts; p++) {
+      uint32_t cnt = (uint32_t)(p ? size : size - predOrder);
+      bits += partitionBits(sums[p], cnt, &params[p]);
+    }
+    if (bits < plan->bits) {
+      plan->bits = bits;
+      plan->order = order;
+      memcpy(plan->param, params, parts);
+    }
+  }
+}
+
+static void writeResidual(BitWriter& bw, const int32_t* res, size_t n, int predOrder, const RicePlan& plan) {
+  bw.put(0, 2);  // partitioned Rice, 4-bit parameters
+  bw.put(plan.order, 4);
+  size_t size = n >> plan.order;
+  for (int p = 0; p < (1 << plan.order); p++) {
+    uint32_t k = plan.param[p];
+    uint32_t low = (1u << k) - 1;
+    bw.put(k, 4);
+    for (size_t i = p ? p * size : predOrder; i < (p + 1) * size; i++) {
+      uint32_t u = zigzag(res[i]);
+      uint32_t q = u >> k;
+      if (q + 1 + k <= 32) {
+        bw.put((1u << k) | (u & low), q + 1 + k);  // q zeros, stop bit, k low bits
+      } else {
+        for (; q >= 32; q -= 32) bw.put(0, 32);
+        bw.put(0, q);
+        bw.put(1, 1);
+        bw.put(u & low, k);
+      }
+    }
+  }
+}
+
+// Fixed predictor order with the smallest |residual| sum (one pass, all orders).
+static int bestFixedOrder(const int16_t* x, size_t n) {
+  uint64_t err[5] = {0, 0, 0, 0, 0};
+  int32_t last0 = x[3];
+  int32_t last1 = x[3] - x[2];
+  int32_t last2 = last1 - (x[2] - x[1]);
+  int32_t last3 = last2 - ((x[2] - x[1]) - (x[1] - x[0]));
+  for (size_t i = 4; i < n; i++) {
+    int32_t e0 = x[i];
+    int32_t e1 = e0 - last0;
+    int32_t e2 = e1 - last1;
+    int32_t e3 = e2 - last2;
+    int32_t e4 = e3 - last3;
+    err[0] += abs(e0);
+    err[1] += abs(e1);
+    err[2] += abs(e2);
+    err[3] += abs(e3);
+    err[4] += abs(e4);
+    last0 = e0;
+    last1 = e1;
+    last2 = e2;
+    last3 = e3;
+  }
+  int best = 0;
+  for (int o = 1; o <= 4; o++) {
+    if (err[o] < err[best]) best = o;
+  }
+  return best;
+}
+
+static void fixedResidual(const int16_t* x, size_t n, int order, int32_t* res) {
+  for (size_t i = order; i < n; i++) {
+    int32_t s = x[i];
+    switch (order) {
+      case 1: s -= x[i - 1]; break;
+      case 2: s -= 2 * x[i - 1] - x[i - 2]; break;
+      case 3: s -= 3 * x[i - 1] - 3 * x[i - 2] + x[i - 3]; break;
+      case 4: s -= 4 * x[i - 1] - 6 * x[i - 2] + 4 * x[i - 3] - x[i - 4]; break;
+      default: break;
+    }
+    res[i] = s;
+  }
+}
+
+// Welch-windowed autocorrelation -> Levinson-Durbin in Q24 -> the order with the
+// lowest estimated size -> coefficients quantized to FLAC_QLP_PRECISION bits.
+// Returns the order, 0 if LPC doesn't apply (silence, unstable or too-large
+// coefficients). w: BLOCK scratch.
+static int lpcAnalyze(const int16_t* x, size_t n, int32_t* w, int32_t* qlp, int* shiftOut) {
+  // w(i) = 1 - ((2i - (n-1)) / (n-1))^2, Q15
+  uint64_t inv = ((uint64_t)1 << 46) / ((uint64_t)(n - 1) * (n - 1));
+  for (size_t i = 0; i < n; i++) {
+    int32_t d = 2 * (int32_t)i - (int32_t)(n - 1);
+    int32_t win = 32768 - (int32_t)(((uint64_t)((uint32_t)(d * d)) * inv) >> 31);
+    w[i] = (x[i] * win) >> 15;
+  }
+  int64_t r[FLAC_MAX_LPC_ORDER + 1];
+  for (int lag = 0; lag <= FLAC_MAX_LPC_ORDER; lag++) {
+    int64_t sum = 0;
+    for (size_t i = lag; i < n; i++) sum += (int64_t)w[i] * w[i - lag];
+    r[lag] = sum;
+  }
+  if (r[0] <= 0) return 0;
+  // r[0] -> ~2^24: coefficient x autocorrelation products stay well inside 64 bits
+  int norm = 64 - __builtin_clzll((uint64_t)r[0]) - 24;
+  if (norm > 0) {
+    for (int lag = 0; lag <= FLAC_MAX_LPC_ORDER; lag++) r[lag] >>= norm;
+  } else {
+    for (int lag = 0; lag <= FLAC_MAX_LPC_ORDER; lag++) r[lag] <<= -norm;
+  }
+  r[0] += r[0] >> 12;  // -36 dB noise floor keeps the recursion well conditioned
+
+  const int64_t ONE = (int64_t)1 << COEF_FRAC;
+  int64_t c[FLAC_MAX_LPC_ORDER + 1] = {0};  // x[i] ~ sum c[j] x[i-j], Q24
+  int64_t coefs[FLAC_MAX_LPC_ORDER + 1][FLAC_MAX_LPC_ORDER + 1];
+  int64_t err = r[0];
+  int order = 0;
+  int64_t bestCost = INT64_MAX;
+  for (int i = 1; i <= FLAC_MAX_LPC_ORDER; i++) {
+    int64_t acc = r[i] << COEF_FRAC;
+    for (int j = 1; j < i; j++) acc -= c[j] * r[i - j];
+    int64_t k = acc / err;
+    if (k >= ONE || k <= -ONE) break;
+    int64_t next[FLAC_MAX_LPC_ORDER + 1];
+    for (int j = 1; j < i; j++) next[j] = c[j] - ((k * c[i - j]) >> COEF_FRAC);
+    next[i] = k;
+    memcpy(c + 1, next + 1, i * sizeof(int64_t));
+    err -= (((k * k) >> COEF_FRAC) * err) >> COEF_FRAC;
+    if (err <= 0) break;
+    // ~ half a bit per sample per doubling of the error, plus warm-up and coefficients
+    int64_t cost = (int64_t)(n - i) * log2Q8Bits((uint64_t)err) / 2 + (int64_t)i * (16 + FLAC_QLP_PRECISION) * 256;
+    memcpy(coefs[i], c, sizeof(c));
+    if (cost < bestCost) {
+      bestCost = cost;
+      order = i;
+    }
+  }
+  if (order == 0) return 0;
+
+  int64_t cmax = 0;
+  for (int j = 1; j <= order; j++) {
+    int64_t a = coefs[order][j] < 0 ? -coefs[order][j] : coefs[order][j];
+    if (a > cmax) cmax = a;
+  }
+  if (cmax == 0) return 0;
+  int magnitude = 64 - __builtin_clzll((uint64_t)cmax) - COEF_FRAC;  // cmax < 2^magnitude
+  int shift = FLAC_QLP_PRECISION - 1 - magnitude;
+  if (shift > 15) shift = 15;
+  if (shift < 0) return 0;  // a negative shift isn't decodable everywhere
+  const int32_t qmax = (1 << (FLAC_QLP_PRECISION - 1)) - 1;
+  const int32_t qmin = -(1 << (FLAC_QLP_PRECISION - 1));
+  int64_t carry = 0;  // rounding error fed into the next coefficient
+  for (int j = 1; j <= order; j++) {
+    int64_t v = (coefs[order][j] << shift) + carry;
+    int64_t q = (v + (ONE >> 1)) >> COEF_FRAC;
+    if (q > qmax) q = qmax;
+    if (q < qmin) q = qmin;
+    carry = v - (q << COEF_FRAC);
+    qlp[j - 1] = (int32_t)q;
+  }
+  *shiftOut = shift;
+  return order;
+}
+
+static void lpcResidual(const int16_t* x, size_t n, const int32_t* qlp, int order, int shift, int32_t* res) {
+  for (size_t i = order; i < n; i++) {
+    int32_t sum = 0;
+    for (int j = 0; j < order; j++) sum += qlp[j] * x[i - 1 - j];
+    res[i] = x[i] - (sum >> shift);
+  }
+}
+
+static uint8_t sampleRateCode() {
+  switch (SAMPLE_RATE) {
+    case 8000: return 4;
+    case 16000: return 5;
+    case 22050: return 6;
+    case 24000: return 7;
+    case 32000: return 8;
+    case 44100: return 9;
+    case 48000: return 10;
+    default: return 0;  // from STREAMINFO
+  }
+}
+
+// Frame number, UTF-8 style (1-6 bytes)
+static void putFrameNumber(BitWriter& bw, uint32_t v) {
+  if (v < 0x80) {
+    bw.put(v, 8);
+    return;
+  }
+  int extra = v < 0x800 ? 1 : v < 0x10000 ? 2 : v < 0x200000 ? 3 : v < 0x4000000 ? 4 : 5;
+  uint32_t lead = (0xFF00u >> (extra + 1)) & 0xFF;
+  bw.put(lead | (v >> (6 * extra)), 8);
+  for (int i = extra - 1; i >= 0; i--) bw.put(0x80 | ((v >> (6 * i)) & 0x3F), 8);
+}
+
+static size_t encodeBlock(const int16_t* x, size_t n) {
+  uint32_t startCycles = ESP.getCycleCount();
+  BitWriter bw = {frameBuf, 0, 0, 0};
+
+  bw.put(0x3FFE, 14);  // sync
+  bw.put(0, 1);
+  bw.put(0, 1);        // fixed block size: the header carries the frame number
+  bw.put(n <= 256 ? 6 : 7, 4);
+  bw.put(sampleRateCode(), 4);
+  bw.put(0, 4);        // mono
+  bw.put(4, 3);        // 16 bits per sample
+  bw.put(0, 1);
+  putFrameNumber(bw, frameNumber++);
+  bw.put((uint32_t)(n - 1), n <= 256 ? 8 : 16);
+  uint8_t crc8 = 0;
+  for (size_t i = 0; i < bw.pos; i++) crc8 = crc8Table[crc8 ^ frameBuf[i]];
+  bw.put(crc8, 8);
+
+  bool constant = true;
+  for (size_t i = 1; i < n && constant; i++) constant = x[i] == x[0];
+
+  uint32_t verbatimBits = 8 + 16 * (uint32_t)n;
+  int fixedOrder = -1, lpcOrder = 0, lpcShift = 0;
+  uint32_t fixedBits = UINT32_MAX, lpcBits = UINT32_MAX;
+  RicePlan fixedPlan, lpcPlan;
+  int32_t qlp[FLAC_MAX_LPC_ORDER];
+  if (!constant && n >= (size_t)MIN_PREDICT_SAMPLES) {
+    fixedOrder = bestFixedOrder(x, n);
+    fixedResidual(x, n, fixedOrder, resFixed);
+    planRice(resFixed, n, fixedOrder, &fixedPlan);
+    fixedBits = 8 + 16 * fixedOrder + fixedPlan.bits;
+    lpcOrder = lpcAnalyze(x, n, resLpc, qlp, &lpcShift);
+    if (lpcOrder > 0) {
+      lpcResidual(x, n, qlp, lpcOrder, lpcShift, resLpc);
+      planRice(resLpc, n, lpcOrder, &lpcPlan);
+      lpcBits = 8 + 16 * lpcOrder + 4 + 5 + lpcOrder * FLAC_QLP_PRECISION + lpcPlan.bits;
+    }
+  }
+
+  if (constant) {
+    bw.put(0, 8);  // zero pad, type 000000, no wasted bits
+    bw.put((uint16_t)x[0], 16);
+    stats.constant++;
+  } else if (lpcBits < fixedBits && lpcBits < verbatimBits) {
+    bw.put(0x40 | ((lpcOrder - 1) << 1), 8);  // type 1xxxxx = order - 1
+    for (int i = 0; i < lpcOrder; i++) bw.put((uint16_t)x[i], 16);
+    bw.put(FLAC_QLP_PRECISION - 1, 4);
+    bw.put((uint32_t)lpcShift, 5);
+    for (int j = 0; j < lpcOrder; j++) bw.put((uint32_t)qlp[j], FLAC_QLP_PRECISION);
+    writeResidual(bw, resLpc, n, lpcOrder, lpcPlan);
+    stats.lpc++;
+    stats.lpcOrderSum += lpcOrder;
+  } else if (fixedBits < verbatimBits) {
+    bw.put(0x10 | (fixedOrder << 1), 8);  // type 001xxx = order
+    for (int i = 0; i < fixedOrder; i++) bw.put((uint16_t)x[i], 16);
+    writeResidual(bw, resFixed, n, fixedOrder, fixedPlan);
+    stats.fixed++;
+  } else {
+    bw.put(0x02, 8);  // type 000001
+    for (size_t i = 0; i < n; i++) bw.put((uint16_t)x[i], 16);
+    stats.verbatim++;
+  }
+
+  bw.align();
+  uint16_t crc16 = 0;
+  for (size_t i = 0; i < bw.pos; i++) crc16 = (uint16_t)((crc16 << 8) ^ crc16Table[(crc16 >> 8) ^ frameBuf[i]]);
+  bw.put(crc16, 16);
+
+  uint32_t cycles = ESP.getCycleCount() - startCycles;
+  stats.frames++;
+  stats.pcmBytes += n * 2;
+  stats.flacBytes += bw.pos;
+  stats.cyclesTotal += cycles;
+  if (cycles > stats.cyclesMax) stats.cyclesMax = cycles;
+  return bw.pos;
+}
+
+size_t flacStreamBegin(uint8_t* out) {
+  if (!flacEncoderBegin()) return 0;
+  fill = 0;
+  frameNumber = 0;
+  stats.streams++;
+  stats.flacBytes += FLAC_HEADER_BYTES;
+  BitWriter bw = {out, 0, 0, 0};
+  bw.put(0x664C6143, 32);  // "fLaC"
+  bw.put(0x80, 8);         // last metadata block, STREAMINFO
+  bw.put(34, 24);
+  bw.put(BLOCK, 16);       // min / max block size (the last block may be shorter)
+  bw.put(BLOCK, 16);
+  bw.put(0, 24);           // min / max frame size: unknown
+  bw.put(0, 24);
+  bw.put(SAMPLE_RATE, 20);
+  bw.put(0, 3);            // channels - 1
+  bw.put(15, 5);           // bits per sample - 1
+  bw.put(0, 4);            // total samples (36 bits): unknown
+  bw.put(0, 32);
+  for (int i = 0; i < 4; i++) bw.put(0, 32);  // MD5: not computed
+  return bw.pos;
+}
+
+bool flacEncode(const int16_t* pcm, size_t samples, FlacFrameSink sink, void* ctx) {
+  if (!block) return false;
+  while (samples > 0) {
+    size_t take = BLOCK - fill;
+    if (take > samples) take = samples;
+    memcpy(block + fill, pcm, take * sizeof(int16_t));
+    fill += take;
+    pcm += take;
+    samples -= take;
+    if (fill == (size_t)BLOCK) {
+      size_t len = encodeBlock(block, fill);
+      fill = 0;
+      if (!sink(frameBuf, len, ctx)) return false;
+    }
+  }
+  return true;
+}
+
+bool flacStreamFinish(FlacFrameSink sink, void* ctx) {
+  if (!block || fill == 0) return true;
+  size_t len = encodeBlock(block, fill);
+  fill = 0;
+  return sink(frameBuf, len, ctx);
+}
+
+void flacPrintStats() {
+  FlacStats s = stats;
+  Serial.println("\n=== FLAC upload ===");
+  uint32_t ratio100 = s.flacBytes ? (uint32_t)(s.pcmBytes * 100 / s.flacBytes) : 0;
+  Serial.printf("  Streams: %u, frames: %u, PCM %u KB -> FLAC %u KB (ratio %u.%02u)\n",
+                (unsigned)s.streams, (unsigned)s.frames, (unsigned)(s.pcmBytes / 1024),
+                (unsigned)(s.flacBytes / 1024), (unsigned)(ratio100 / 100), (unsigned)(ratio100 % 100));
+  Serial.printf("  Subframes: LPC %u (avg order %u), fixed %u, verbatim %u, constant %u\n",
+                (unsigned)s.lpc, (unsigned)(s.lpc ? s.lpcOrderSum / s.lpc : 0), (unsigned)s.fixed,
+                (unsigned)s.verbatim, (unsigned)s.constant);
+  Serial.printf("  Cycles per %u-sample frame: avg %u, max %u\n", (unsigned)BLOCK,
+                (unsigned)(s.frames ? s.cyclesTotal / s.frames : 0), (unsigned)s.cyclesMax);
+  Serial.println("===================\n");
+}
@@ -0,0 +1,33 @@
+#ifndef AI_RELAY_WEBSOCKET_FLAC_ENCODER_H
+#define AI_RELAY_WEBSOCKET_FLAC_ENCODER_H
+
+#include <Arduino.h>
+
+// Streaming FLAC encoder for the Whisper upload: mono, 16-bit, SAMPLE_RATE,
+// FLAC_BLOCK_SAMPLES per frame. Each block is coded as the smallest of a
+// constant, verbatim, fixed (order 0-4) or LPC subframe (order up to
+// FLAC_MAX_LPC_ORDER, picked from the Levinson error), with partitioned Rice
+// residuals. Integer arithmetic only, the LPC analysis included, so a host
+// build writes the same bytes as the device.
+//
+// Allocates the frame buffers (~20 KB, PSRAM first). flacStreamBegin() calls it,
+// so nothing is allocated until the first Whisper upload.
+bool flacEncoderBegin();
+
+// Starts a stream: writes "fLaC" + STREAMINFO to out (FLAC_HEADER_BYTES).
+// Total samples and MD5 stay 0 ("unknown"): the length isn't known up front.
+// Returns 0 if the buffers can't be allocated.
+#define FLAC_HEADER_BYTES 42
+size_t flacStreamBegin(uint8_t* out);
+
+// Buffers samples; every completed block goes to the sink as one frame
+// (valid until the next call). A false from the sink stops the stream.
+typedef bool (*FlacFrameSink)(const uint8_t* frame, size_t len, void* ctx);
+bool flacEncode(const int16_t* pcm, size_t samples, FlacFrameSink sink, void* ctx);
+// Codes the last, shorter block.
+bool flacStreamFinish(FlacFrameSink sink, void* ctx);
+
+// Compression ratio, subframe types, cycles per frame.
+void flacPrintStats();
+
+#endif
@@ -2,6 +2,7 @@
 #define AI_RELAY_WEBSOCKET_GLOBALS_H
 
 #include <Arduino.h>
+#include <atomic>
 #include <WiFiClientSecure.h>
 #include <WebSocketsClient.h>
 #include "config.h"
@@ -14,6 +15,8 @@ extern const char* tts_model;
 extern const char* tts_voice;
 extern const char* stt_model;
 extern const char* llm_model;
+extern const char* llm_model_8b;
+extern const char* llm_model_70b;
 extern const char* wake_word;
 extern const char* end_word;
 extern bool requireWakeEndWords;
@@ -41,27 +44,18 @@ extern uint8_t* recording_buffer;
 extern volatile bool ledRecording;
 extern volatile bool ledWaiting;
 extern bool wsConnected;
-extern bool isProcessing;
+extern std::atomic<bool> isProcessing;  // a turn is queued or running; owned by dialog_task
 extern String lastFinalTranscript;
 extern unsigned long lastFinalMs;
 extern unsigned long lastWsActivityMs;
 extern unsigned long lastMicSendMs;
 extern bool micTestMode;
 extern bool listeningEnabled;
-extern bool ttsPlaying;
+extern std::atomic<bool> ttsPlaying;
 extern unsigned long ttsCooldownUntilMs;
 extern int lastTurnOrderHandled;
 
-// ======================= Chat history (defined in .ino) =======================
-struct ChatMessage {
-  const char* role;
-  String content;
-};
-extern ChatMessage chatHistory[HISTORY_MAX];
-extern uint8_t historyCount;
-
 // ======================= Streaming audio buffers (defined in .ino) =======================
-extern int32_t mic_buffer[FRAME_SAMPLES];
 extern int16_t pcm_frame[FRAME_SAMPLES];
 
 #endif
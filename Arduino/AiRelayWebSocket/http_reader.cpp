@@ -0,0 +1,173 @@
+#include "http_reader.h"
+#include "config.h"
+#include <Arduino.h>
+
+HttpBodyReader::HttpBodyReader(Client* client, uint32_t timeoutMs)
+    : client_(client), timeoutMs_(timeoutMs) {}
+
+// Refill the buffer from the socket; waits up to timeoutMs_ for data.
+// Bulk reads may take bytes past the end of the body only if the server sent
+// them, which doesn't happen without request pipelining.
+bool HttpBodyReader::fill() {
+  if (head_ < tail_) return true;
+  head_ = tail_ = 0;
+  if (!client_) return false;
+  unsigned long startMs = millis();
+  for (;;) {
+    int avail = client_->available();
+    if (avail > 0) {
+      size_t want = (size_t)avail < sizeof(buf_) ? (size_t)avail : sizeof(buf_);
+      if (state_ == STATE_LENGTH && want > remaining_) want = remaining_;
+      int n = client_->read(buf_, want);
+      if (n > 0) {
+        tail_ = (size_t)n;
+        return true;
+      }
+    } else if (!client_->connected()) {
+      return false;
+    }
+    if (millis() - startMs >= timeoutMs_) return false;
+    delay(1);
+  }
+}
+
+int HttpBodyReader::rawByte() {
+  if (!fill()) return -1;
+  return buf_[head_++];
+}
+
+// Reads one CRLF-terminated line; overlong lines are truncated.
+bool HttpBodyReader::readLine(char* line, size_t size) {
+  size_t n = 0;
+  for (;;) {
+    int c = rawByte();
+    if (c < 0) return false;
+    if (c == '\n') break;
+    if (c != '\r' && n + 1 < size) line[n++] = (char)c;
+  }
+  line[n] = '\0';
+  return true;
+}
+
+int HttpBodyReader::readHeaders() {
+  char line[128];
+  if (!readLine(line, sizeof(line))) return -1;
+  // "HTTP/1.1 200 OK"
+  const char* sp = strchr(line, ' ');
+  int status = sp ? atoi(sp + 1) : -1;
+  int contentLength = -1;
+  bool chunked = false;
+  while (readLine(line, sizeof(line))) {
+    if (line[0] == '\0') {
+      beginBody(contentLength, chunked);
+      return status;
+    }
+    char* colon = strchr(line, ':');
+    if (!colon) continue;
+    *colon = '\0';
+    const char* value = colon + 1;
+    while (*value == ' ') value++;
+    if (strcasecmp(line, "Content-Length") == 0) {
+      contentLength = atoi(value);
+    } else if (strcasecmp(line, "Transfer-Encoding") == 0) {
+      chunked = strcasestr(value, "chunked") != nullptr;
+    } else if (strcasecmp(line, "Connection") == 0) {
+      if (strcasestr(value, "close")) closeAfter_ = true;
+    }
+  }
+  return -1;
+}
+
+void HttpBodyReader::beginBody(int contentLength, bool chunked) {
+  bodyBytes_ = 0;
+  if (chunked) {
+    state_ = STATE_CHUNK_SIZE;
+  } else if (contentLength >= 0) {
+    remaining_ = (uint32_t)contentLength;
+    state_ = remaining_ ? STATE_LENGTH : STATE_DONE;
+  } else {
+    state_ = STATE_UNTIL_CLOSE;
+    closeAfter_ = true;
+  }
+}
+
+bool HttpBodyReader::toData() {
+  for (;;) {
+    switch (state_) {
+      case STATE_LENGTH:
+      case STATE_CHUNK_DATA:
+        if (remaining_ == 0) {
+          state_ = state_ == STATE_LENGTH ? STATE_DONE : STATE_CHUNK_CRLF;
+          continue;
+        }
+        return fill();
+      case STATE_UNTIL_CLOSE:
+        if (fill()) return true;
+        state_ = STATE_DONE;
+        return false;
+      case STATE_CHUNK_SIZE: {
+        char line[24];
+        if (!readLine(line, sizeof(line))) return false;
+        remaining_ = (uint32_t)strtoul(line, nullptr, 16);  // stops at ";ext"
+        state_ = remaining_ ? STATE_CHUNK_DATA : STATE_TRAILER;
+        continue;
+      }
+      case STATE_CHUNK_CRLF: {
+        char line[4];
+        if (!readLine(line, sizeof(line))) return false;
+        state_ = STATE_CHUNK_SIZE;
+        continue;
+      }
+      case STATE_TRAILER: {
+        char line[64];
+        if (!readLine(line, sizeof(line))) return false;
+        if (line[0] == '\0') state_ = STATE_DONE;
+        continue;
+      }
+      case STATE_HEADERS:
+      case STATE_DONE:
+      default:
+        return false;
+    }
+  }
+}
+
+int HttpBodyReader::available() {
+  if (state_ == STATE_DONE || state_ == STATE_HEADERS) return 0;
+  size_t n = tail_ - head_;
+  if (state_ != STATE_UNTIL_CLOSE && n > remaining_) n = remaining_;
+  return (int)n;
+}
+
+int HttpBodyReader::peek() {
+  if (!toData()) return -1;
+  return buf_[head_];
+}
+
+int HttpBodyReader::read() {
+  if (!toData()) return -1;
+  if (state_ != STATE_UNTIL_CLOSE) remaining_--;
+  bodyBytes_++;
+  return buf_[head_++];
+}
+
+size_t HttpBodyReader::readBytes(char* buffer, size_t length) {
+  size_t copied = 0;
+  while (copied < length && toData()) {
+    size_t n = tail_ - head_;
+    if (state_ != STATE_UNTIL_CLOSE && n > remaining_) n = remaining_;
+    if (n > length - copied) n = length - copied;
+    memcpy(buffer + copied, buf_ + head_, n);
+    head_ += n;
+    if (state_ != STATE_UNTIL_CLOSE) remaining_ -= n;
+    copied += n;
+  }
+  bodyBytes_ += copied;
+  return copied;
+}
+
+void HttpBodyReader::skipRest() {
+  char scratch[64];
+  while (readBytes(scratch, sizeof(scratch)) > 0) {
+  }
+}
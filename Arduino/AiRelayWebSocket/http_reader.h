@@ -0,0 +1,65 @@
+#ifndef AI_RELAY_WEBSOCKET_HTTP_READER_H
+#define AI_RELAY_WEBSOCKET_HTTP_READER_H
+
+#include <Arduino.h>
+#include <Client.h>
+#include "config.h"
+
+// Buffered HTTP/1.1 response body reader. Bulk-reads the socket into a fixed
+// buffer, removes Content-Length / chunked framing, and exposes the body as a
+// Stream so ArduinoJson can parse it in place with a filter (no String copy of
+// the response). Stops exactly at the end of the body, so a fully read
+// response leaves the connection reusable.
+class HttpBodyReader : public Stream {
+ public:
+  explicit HttpBodyReader(Client* client, uint32_t timeoutMs = 10000);
+
+  // Raw socket: parse status line and headers. Returns the status code, -1 on failure.
+  int readHeaders();
+  // Headers already consumed elsewhere (HTTPClient); contentLength -1 = unknown.
+  void beginBody(int contentLength, bool chunked);
+
+  // Discard the rest of the body (so the connection can be reused).
+  void skipRest();
+  bool complete() const { return state_ == STATE_DONE; }
+  // Server sent "Connection: close" (or no framing): don't keep the connection.
+  bool closeAfter() const { return closeAfter_; }
+  uint32_t bodyBytes() const { return bodyBytes_; }
+
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t readBytes(char* buffer, size_t length) override;
+  using Stream::readBytes;
+  size_t write(uint8_t) override { return 0; }
+
+ private:
+  enum State : uint8_t {
+    STATE_HEADERS,
+    STATE_LENGTH,      // Content-Length body
+    STATE_UNTIL_CLOSE, // no framing: body ends when the server closes
+    STATE_CHUNK_SIZE,
+    STATE_CHUNK_DATA,
+    STATE_CHUNK_CRLF,  // CRLF after chunk data
+    STATE_TRAILER,
+    STATE_DONE
+  };
+
+  bool fill();
+  int rawByte();
+  bool readLine(char* line, size_t size);
+  // Advances framing until body data is available; false at end of body.
+  bool toData();
+
+  Client* client_;
+  uint32_t timeoutMs_;
+  uint8_t buf_[HTTP_READER_BUF_BYTES];
+  size_t head_ = 0;
+  size_t tail_ = 0;
+  State state_ = STATE_HEADERS;
+  uint32_t remaining_ = 0;  // bytes left in the body (LENGTH) or chunk (CHUNK_DATA)
+  uint32_t bodyBytes_ = 0;
+  bool closeAfter_ = false;
+};
+
+#endif
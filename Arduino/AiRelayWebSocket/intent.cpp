@@ -0,0 +1,445 @@
+#include "intent.h"
+#include "audio_out.h"
+#include "audio_utils.h"
+#include "chat_utils.h"
+#include "prompts.h"
+#include "tts.h"
+#include "tts_cache.h"
+#include "config.h"
+#include "globals.h"
+#include <Arduino.h>
+#include <WiFi.h>
+
+enum IntentAction : uint8_t {
+  INTENT_VOLUME_UP,
+  INTENT_VOLUME_DOWN,
+  INTENT_VOLUME_SET,
+  INTENT_MUTE,
+  INTENT_PROMPT_SWITCH,
+  INTENT_PROMPT_NEXT,
+  INTENT_TTS_GOOGLE,
+  INTENT_TTS_GROQ,
+  INTENT_LLM_FAST,
+  INTENT_LLM_SMART,
+  INTENT_LLM_AUTO,
+  INTENT_ACTION_COUNT
+};
+
+struct IntentActionInfo {
+  const char* name;
+  const char* confirmation;  // "%s" = persona name
+  bool applyFirst;           // volume: confirm at the new level; the rest confirm in the old voice
+};
+
+static const IntentActionInfo ACTIONS[INTENT_ACTION_COUNT] = {
+  {"volume_up", "Okay, louder.", true},
+  {"volume_down", "Okay, quieter.", true},
+  {"volume_set", "Volume set.", true},
+  {"mute", "Okay, I will stop listening.", false},
+  {"prompt_switch", "Okay, here is %s.", false},
+  {"prompt_next", "Okay, here is %s.", false},
+  {"tts_google", "Switching to the Google voice.", false},
+  {"tts_groq", "Switching to the Groq voice.", false},
+  {"llm_fast", "Okay, fast mode.", false},
+  {"llm_smart", "Okay, I will think harder.", false},
+  {"llm_auto", "Okay, I will pick the model myself.", false},
+};
+
+// Pattern tokens, space separated: "a|b" one of the words, "?a|b" optional,
+// "#" a number (digits or a number word), "@" a persona name (full or first word).
+// The whole utterance has to match, so "what is the volume of a cone" never does.
+struct IntentRule {
+  IntentAction action;
+  const char* pattern;
+};
+
+static const IntentRule GRAMMAR[] = {
+  {INTENT_VOLUME_UP, "volume|sound up"},
+  {INTENT_VOLUME_UP, "turn|speak ?it|volume|sound up"},
+  {INTENT_VOLUME_UP, "turn up ?volume|sound"},
+  {INTENT_VOLUME_UP, "?speak|talk|little louder"},
+  {INTENT_VOLUME_UP, "increase|raise volume|sound"},
+  {INTENT_VOLUME_DOWN, "volume|sound down"},
+  {INTENT_VOLUME_DOWN, "turn ?it|volume|sound down"},
+  {INTENT_VOLUME_DOWN, "turn down ?volume|sound"},
+  {INTENT_VOLUME_DOWN, "?speak|talk|little quieter|softer"},
+  {INTENT_VOLUME_DOWN, "decrease|lower|reduce volume|sound"},
+  {INTENT_VOLUME_SET, "?set|change|turn volume|sound ?to # ?percent"},
+  {INTENT_MUTE, "mute ?microphone|mic|yourself"},
+  {INTENT_MUTE, "stop listening"},
+  {INTENT_MUTE, "turn ?microphone|mic off ?microphone|mic"},
+  {INTENT_PROMPT_SWITCH, "switch|change|go ?back to @"},
+  {INTENT_PROMPT_SWITCH, "?i ?want|like|wanna|let ?me ?to talk|speak to|with @"},
+  {INTENT_PROMPT_NEXT, "next persona|prompt|character|tutor|teacher"},
+  {INTENT_PROMPT_NEXT, "switch|change persona|prompt|character|tutor|teacher"},
+  {INTENT_TTS_GOOGLE, "use|switch ?to google ?voice"},
+  {INTENT_TTS_GROQ, "use|switch ?to groq|grok|grog ?voice"},
+  {INTENT_LLM_FAST, "use|switch ?to fast|faster|small|quick model|mode|brain"},
+  {INTENT_LLM_SMART, "use|switch ?to smart|smarter|big|bigger|advanced model|mode|brain"},
+  {INTENT_LLM_AUTO, "use|switch ?to auto|automatic model|mode|brain"},
+};
+static const int RULE_COUNT = sizeof(GRAMMAR) / sizeof(GRAMMAR[0]);
+
+// Politeness and articles, dropped before matching ("can you please turn the volume up")
+static const char* const IGNORED_WORDS[] = {
+  "please", "hey", "ok", "okay", "can", "could", "would", "you", "the", "a", "just",
+  "now", "so", "um", "uh", "your", "bit"};
+
+struct NumberWord {
+  const char* word;
+  uint8_t value;
+};
+static const NumberWord NUMBER_WORDS[] = {
+  {"zero", 0}, {"ten", 10}, {"twenty", 20}, {"thirty", 30}, {"forty", 40}, {"fifty", 50},
+  {"sixty", 60}, {"seventy", 70}, {"eighty", 80}, {"ninety", 90}, {"hundred", 100},
+  {"half", 50}, {"max", 100}, {"maximum", 100}};
+
+static const uint8_t WORD_CHARS = 16;
+static const uint32_t PREPARE_RETRY_MS = 60000;
+
+struct Words {
+  char w[INTENT_MAX_WORDS][WORD_CHARS];
+  uint8_t n;
+};
+
+struct Match {
+  int number;
+  int persona;
+};
+
+struct IntentStats {
+  uint32_t checked;
+  uint32_t handled[INTENT_ACTION_COUNT];
+  uint32_t matchUsTotal;
+  uint32_t matchUsMax;
+  uint32_t confirmCached;
+  uint32_t confirmFetched;
+  uint32_t confirmFailed;
+  uint32_t confirmMsLast;   // transcript -> first confirmation sample
+  uint32_t confirmMsMax;
+  uint32_t confirmMsTotal;
+  uint32_t prepared;
+};
+
+static IntentStats stats;
+static unsigned long prepareRetryAtMs = 0;
+
+static bool ignored(const char* word) {
+  for (size_t i = 0; i < sizeof(IGNORED_WORDS) / sizeof(IGNORED_WORDS[0]); i++) {
+    if (strcmp(word, IGNORED_WORDS[i]) == 0) return true;
+  }
+  return false;
+}
+
+// Lowercase words without punctuation; false if it's too long to be a command.
+static bool toWords(const String& text, Words* out) {
+  out->n = 0;
+  char word[WORD_CHARS];
+  size_t len = 0;
+  size_t n = text.length();
+  for (size_t i = 0; i <= n; i++) {
+    char c = i < n ? text[i] : ' ';
+    if (c >= 'A' && c <= 'Z') c = c - 'A' + 'a';
+    if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')) {
+      if (len >= WORD_CHARS - 1) return false;  // no command word is this long
+      word[len++] = c;
+      continue;
+    }
+    if (c == '\'') continue;  // "i'd" -> "id"
+    if (len == 0) continue;
+    word[len] = '\0';
+    len = 0;
+    if (ignored(word)) continue;
+    if (out->n >= INTENT_MAX_WORDS) return false;
+    memcpy(out->w[out->n++], word, WORD_CHARS);
+  }
+  return out->n > 0;
+}
+
+static int numberValue(const char* word) {
+  if (word[0] >= '0' && word[0] <= '9') {
+    if (strlen(word) > 3) return -1;
+    for (const char* p = word; *p; p++) {
+      if (*p < '0' || *p > '9') return -1;
+    }
+    return atoi(word);
+  }
+  for (size_t i = 0; i < sizeof(NUMBER_WORDS) / sizeof(NUMBER_WORDS[0]); i++) {
+    if (strcmp(word, NUMBER_WORDS[i].word) == 0) return NUMBER_WORDS[i].value;
+  }
+  return -1;
+}
+
+// word equals one of the '|'-separated alternatives in [tok, end)
+static bool alternativeMatches(const char* tok, const char* end, const char* word) {
+  size_t wordLen = strlen(word);
+  while (tok < end) {
+    const char* bar = tok;
+    while (bar < end && *bar != '|') bar++;
+    if ((size_t)(bar - tok) == wordLen && strncmp(tok, word, wordLen) == 0) return true;
+    tok = bar + 1;
+  }
+  return false;
+}
+
+// Words of persona p's name at words[i...]: all of them, or just the first. 0 = no match.
+static uint8_t nameMatch(uint8_t p, const Words& words, uint8_t i) {
+  const char* name = getPromptName(p);
+  uint8_t consumed = 0;
+  while (*name) {
+    while (*name == ' ') name++;
+    const char* end = name;
+    while (*end && *end != ' ') end++;
+    if (end == name) break;
+    if (i + consumed >= words.n) return consumed;
+    const char* w = words.w[i + consumed];
+    size_t len = end - name;
+    if (strlen(w) != len || strncasecmp(name, w, len) != 0) return consumed;
+    consumed++;
+    name = end;
+  }
+  return consumed;
+}
+
+static bool matchFrom(const char* p, const Words& words, uint8_t i, Match* m) {
+  while (*p == ' ') p++;
+  if (*p == '\0') return i == words.n;
+  const char* end = p;
+  while (*end && *end != ' ') end++;
+  bool optional = *p == '?';
+  const char* tok = optional ? p + 1 : p;
+  if (optional && matchFrom(end, words, i, m)) return true;
+  if (i >= words.n) return false;
+  if (*tok == '#') {
+    int v = numberValue(words.w[i]);
+    if (v < 0 || !matchFrom(end, words, i + 1, m)) return false;
+    m->number = v;
+    return true;
+  }
+  if (*tok == '@') {
+    for (uint8_t persona = 0; persona < PROMPT_COUNT; persona++) {
+      uint8_t k = nameMatch(persona, words, i);
+      if (k > 0 && matchFrom(end, words, i + k, m)) {
+        m->persona = persona;
+        return true;
+      }
+    }
+    return false;
+  }
+  return alternativeMatches(tok, end, words.w[i]) && matchFrom(end, words, i + 1, m);
+}
+
+static String confirmationText(IntentAction action, int persona) {
+  char text[64];
+  snprintf(text, sizeof(text), ACTIONS[action].confirmation, persona >= 0 ? getPromptName(persona) : "");
+  return String(text);
+}
+
+static bool fetchConfirmation(const String& text, TtsAudio* audio) {
+  return ttsProvider == TTS_GOOGLE ? fetchGoogleTTSAudio(text, audio) : fetchGroqTTSAudio(text, audio);
+}
+
+// Play the confirmation; from the TTS cache when it's there, else fetched once and kept.
+static void speakConfirmation(const String& text, unsigned long startMs) {
+  TtsAudio audio = {};
+  bool cached = false;
+  uint32_t fetchMs = 0;
+#if TTS_CACHE
+  uint64_t key = ttsCacheKey(ttsProvider, text);
+  cached = ttsCacheLoad(key, &audio);
+#endif
+  if (!cached) {
+    unsigned long fetchStartMs = millis();
+    if (!fetchConfirmation(text, &audio)) audio.len = 0;
+    fetchMs = millis() - fetchStartMs;
+  }
+  WavInfo wav;
+  if (audio.len == 0 || !parseWavHeader(audio.data, audio.len, &wav)) {
+    stats.confirmFailed++;
+    freeTtsAudio(&audio);
+    return;
+  }
+  digitalWrite(PIN_RED, LOW);
+  ttsPlaying = true;
+  unsigned long queuedMs = millis();
+  audioOutSessionBegin();
+  audioOutSetFormat(wav.sampleRate, wav.channels);
+  audioOutWrite(audio.data + wav.dataOffset, (audio.len - wav.dataOffset) & ~(size_t)1, portMAX_DELAY);
+  audioOutDrain(10000);
+  AudioOutStats out;
+  audioOutSessionStats(&out);
+  digitalWrite(PIN_RED, HIGH);
+  ttsPlaying = false;
+  ttsCooldownUntilMs = millis() + 500;
+
+  uint32_t ms = (queuedMs - startMs) + out.firstAudioMs;
+  stats.confirmMsLast = ms;
+  stats.confirmMsTotal += ms;
+  if (ms > stats.confirmMsMax) stats.confirmMsMax = ms;
+  if (cached) stats.confirmCached++;
+  else stats.confirmFetched++;
+  Serial.printf("Intent: confirmed after %u ms (%s)\n", (unsigned)ms, cached ? "flash" : "network");
+#if TTS_CACHE
+  // Played already, so the flash write costs no latency
+  if (!cached) ttsCacheStore(key, audio.data, audio.len, fetchMs);
+#endif
+  freeTtsAudio(&audio);
+}
+
+static void setVolume(int percent) {
+  if (percent > 100) percent = 100;
+  if (percent < INTENT_VOLUME_MIN) percent = INTENT_VOLUME_MIN;
+  outputVolumePercent = percent;
+  Serial.printf("Volume set to %d%%\n", outputVolumePercent);
+}
+
+static void apply(IntentAction action, const Match& m) {
+  switch (action) {
+    case INTENT_VOLUME_UP:
+      setVolume(outputVolumePercent + INTENT_VOLUME_STEP);
+      break;
+    case INTENT_VOLUME_DOWN:
+      setVolume(outputVolumePercent - INTENT_VOLUME_STEP);
+      break;
+    case INTENT_VOLUME_SET:
+      setVolume(m.number);
+      break;
+    case INTENT_MUTE:
+      listeningEnabled = false;
+      ledRecording = false;
+      ledWaiting = false;
+      Serial.println("Listening: OFF (type 'mute' to turn it back on)");
+      break;
+    case INTENT_PROMPT_SWITCH:
+    case INTENT_PROMPT_NEXT:
+      if (m.persona != currentPromptIndex) {
+        currentPromptIndex = m.persona;
+        clearChatHistory();
+      }
+      Serial.printf("Switched to prompt %d/%d (%s)\n", currentPromptIndex, PROMPT_COUNT - 1,
+                    getPromptName(currentPromptIndex));
+      break;
+    case INTENT_TTS_GOOGLE:
+      ttsProvider = TTS_GOOGLE;
+      Serial.println("TTS provider: Google");
+      break;
+    case INTENT_TTS_GROQ:
+      ttsProvider = TTS_GROQ;
+      Serial.println("TTS provider: Groq");
+      break;
+    case INTENT_LLM_FAST:
+      llmRouterSetAuto(false);
+      llm_model = llm_model_8b;
+      Serial.println("LLM model: llama-3.1-8b-instant (fast)");
+      break;
+    case INTENT_LLM_SMART:
+      llmRouterSetAuto(false);
+      llm_model = llm_model_70b;
+      Serial.println("LLM model: llama-3.3-70b-versatile (advanced)");
+      break;
+    case INTENT_LLM_AUTO:
+      llmRouterSetAuto(LLM_ROUTER);
+      Serial.println(LLM_ROUTER ? "LLM model: auto (8b/70b per question)" : "LLM router disabled (LLM_ROUTER 0)");
+      break;
+    default:
+      break;
+  }
+}
+
+bool intentHandle(const String& transcript) {
+  unsigned long startMs = millis();
+  uint32_t startUs = micros();
+  stats.checked++;
+  Words words;
+  int rule = -1;
+  Match m = {-1, -1};
+  if (toWords(transcript, &words)) {
+    for (int r = 0; r < RULE_COUNT && rule < 0; r++) {
+      m = {-1, -1};
+      if (matchFrom(GRAMMAR[r].pattern, words, 0, &m)) rule = r;
+    }
+  }
+  uint32_t us = micros() - startUs;
+  stats.matchUsTotal += us;
+  if (us > stats.matchUsMax) stats.matchUsMax = us;
+  if (rule < 0) return false;
+
+  IntentAction action = GRAMMAR[rule].action;
+  if (action == INTENT_PROMPT_NEXT) m.persona = (currentPromptIndex + 1) % PROMPT_COUNT;
+  stats.handled[action]++;
+  Serial.printf("Intent: %s (\"%s\"), matched in %u us, no LLM\n", ACTIONS[action].name,
+                transcript.c_str(), (unsigned)us);
+  String confirmation = confirmationText(action, m.persona);
+  if (ACTIONS[action].applyFirst) apply(action, m);
+  speakConfirmation(confirmation, startMs);
+  if (!ACTIONS[action].applyFirst) apply(action, m);
+  return true;
+}
+
+#if TTS_CACHE
+// First confirmation of the current voice that isn't on flash yet
+static bool missingConfirmation(String* text) {
+  for (int a = 0; a < INTENT_ACTION_COUNT; a++) {
+    bool perPersona = strstr(ACTIONS[a].confirmation, "%s") != nullptr;
+    if (a == INTENT_PROMPT_NEXT) continue;  // same lines as prompt_switch
+    for (int p = 0; p < (perPersona ? PROMPT_COUNT : 1); p++) {
+      String t = confirmationText((IntentAction)a, perPersona ? p : -1);
+      if (!ttsCacheContains(ttsCacheKey(ttsProvider, t))) {
+        *text = t;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+#endif
+
+bool intentNeedsPrepare() {
+#if TTS_CACHE
+  if (WiFi.status() != WL_CONNECTED || (long)(millis() - prepareRetryAtMs) < 0) return false;
+  String text;
+  return missingConfirmation(&text);
+#else
+  return false;
+#endif
+}
+
+void intentPrepare() {
+#if TTS_CACHE
+  String text;
+  if (!missingConfirmation(&text)) return;
+  TtsAudio audio = {};
+  unsigned long startMs = millis();
+  bool ok = fetchConfirmation(text, &audio) &&
+            ttsCacheStore(ttsCacheKey(ttsProvider, text), audio.data, audio.len, millis() - startMs);
+  freeTtsAudio(&audio);
+  if (ok) {
+    stats.prepared++;
+  } else {
+    // Offline, quota or a full cache: don't keep the dialog task busy with retries
+    prepareRetryAtMs = millis() + PREPARE_RETRY_MS;
+    Serial.printf("Intent: couldn't pre-render \"%s\", retrying later\n", text.c_str());
+  }
+#endif
+}
+
+void intentPrintStats() {
+  IntentStats s = stats;
+  uint32_t handled = 0;
+  for (int a = 0; a < INTENT_ACTION_COUNT; a++) handled += s.handled[a];
+  uint32_t confirmed = s.confirmCached + s.confirmFetched;
+  Serial.println("\n=== Voice commands ===");
+  Serial.printf("  Transcripts checked: %u, commands: %u, match avg %u us, max %u us\n",
+                (unsigned)s.checked, (unsigned)handled,
+                (unsigned)(s.checked ? s.matchUsTotal / s.checked : 0), (unsigned)s.matchUsMax);
+  for (int a = 0; a < INTENT_ACTION_COUNT; a++) {
+    if (s.handled[a] > 0) Serial.printf("    %-14s %u\n", ACTIONS[a].name, (unsigned)s.handled[a]);
+  }
+  Serial.printf("  Confirmations: %u from flash, %u fetched, %u failed; %u pre-rendered\n",
+                (unsigned)s.confirmCached, (unsigned)s.confirmFetched, (unsigned)s.confirmFailed,
+                (unsigned)s.prepared);
+  Serial.printf("  Transcript -> confirmation audio: last %u ms, avg %u ms, max %u ms\n",
+                (unsigned)s.confirmMsLast, (unsigned)(confirmed ? s.confirmMsTotal / confirmed : 0),
+                (unsigned)s.confirmMsMax);
+  Serial.println("======================\n");
+}
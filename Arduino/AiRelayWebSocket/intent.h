@@ -0,0 +1,22 @@
+#ifndef AI_RELAY_WEBSOCKET_INTENT_H
+#define AI_RELAY_WEBSOCKET_INTENT_H
+
+#include <Arduino.h>
+
+// On-device fast path for spoken device commands (volume, mute, persona, TTS
+// provider, LLM model). The final transcript is normalized to words and matched
+// against a grammar table; a whole-utterance match runs the command locally and
+// speaks a short confirmation, with no LLM round trip. Confirmations are kept in
+// the TTS flash cache (TTS_CACHE), pre-rendered for the current voice while idle.
+
+// Dialog task, before the LLM: true if the transcript was a command (handled).
+bool intentHandle(const String& transcript);
+
+// Dialog task, between turns: render one missing confirmation into the TTS cache.
+bool intentNeedsPrepare();
+void intentPrepare();
+
+// Commands handled per intent, match time and confirmation latency.
+void intentPrintStats();
+
+#endif
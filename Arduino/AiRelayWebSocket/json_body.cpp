@@ -0,0 +1,107 @@
+#include "json_body.h"
+#include <Arduino.h>
+
+bool JsonBodyStream::add(const char* text, size_t len, bool escape, size_t encodedLen) {
+  if (len == 0) return true;
+  if (count_ >= JSON_BODY_MAX_PIECES) {
+    overflow_ = true;
+    return false;
+  }
+  pieces_[count_++] = {text, (uint32_t)len, escape};
+  size_ += encodedLen;
+  return true;
+}
+
+bool JsonBodyStream::addRaw(const char* text, size_t len) {
+  return add(text, len, false, len);
+}
+
+bool JsonBodyStream::addEscaped(const char* text, size_t len) {
+  size_t encoded = 0;
+  for (size_t i = 0; i < len; i++) encoded += jsonEscapedCharLength(text[i]);
+  return add(text, len, true, encoded);
+}
+
+void JsonBodyStream::rewind() {
+  sent_ = 0;
+  piece_ = 0;
+  offset_ = 0;
+  pendingLen_ = pendingPos_ = 0;
+}
+
+int JsonBodyStream::available() {
+  return (int)(size_ - sent_);
+}
+
+// Returns a run of bytes that can be copied as is: either a raw stretch of the
+// current piece, or the escape sequence of one character (via pending_).
+size_t JsonBodyStream::nextRun(const char** run) {
+  if (pendingPos_ < pendingLen_) {
+    *run = pending_ + pendingPos_;
+    return pendingLen_ - pendingPos_;
+  }
+  while (piece_ < count_ && offset_ >= pieces_[piece_].len) {
+    piece_++;
+    offset_ = 0;
+  }
+  if (piece_ >= count_) return 0;
+  const Piece& p = pieces_[piece_];
+  const char* start = p.text + offset_;
+  if (!p.escape) {
+    *run = start;
+    return p.len - offset_;
+  }
+  // Longest stretch that needs no escaping
+  size_t n = 0;
+  while (offset_ + n < p.len && jsonEscapedCharLength(start[n]) == 1) n++;
+  if (n > 0) {
+    *run = start;
+    return n;
+  }
+  char c = *start;
+  offset_++;
+  char esc = jsonEscapeLetter(c);
+  if (esc) {
+    pending_[0] = '\\';
+    pending_[1] = esc;
+    pendingLen_ = 2;
+  } else {
+    static const char hex[] = "0123456789abcdef";
+    memcpy(pending_, "\\u00", 4);
+    pending_[4] = hex[(c >> 4) & 0xF];
+    pending_[5] = hex[c & 0xF];
+    pendingLen_ = 6;
+  }
+  pendingPos_ = 0;
+  *run = pending_;
+  return pendingLen_;
+}
+
+size_t JsonBodyStream::readBytes(char* buffer, size_t length) {
+  size_t copied = 0;
+  while (copied < length) {
+    const char* run;
+    size_t n = nextRun(&run);
+    if (n == 0) break;
+    if (n > length - copied) n = length - copied;
+    memcpy(buffer + copied, run, n);
+    copied += n;
+    if (run >= pending_ && run < pending_ + sizeof(pending_)) {
+      pendingPos_ += n;
+    } else {
+      offset_ += n;
+    }
+  }
+  sent_ += copied;
+  return copied;
+}
+
+int JsonBodyStream::read() {
+  char c;
+  return readBytes(&c, 1) == 1 ? (unsigned char)c : -1;
+}
+
+int JsonBodyStream::peek() {
+  const char* run;
+  return nextRun(&run) > 0 ? (unsigned char)*run : -1;
+}
@@ -0,0 +1,106 @@
+#ifndef AI_RELAY_WEBSOCKET_JSON_BODY_H
+#define AI_RELAY_WEBSOCKET_JSON_BODY_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ---- Compile-time JSON string escaping (for constant texts like the prompts) ----
+
+// Letter after the backslash for characters with a short escape, else 0.
+constexpr char jsonEscapeLetter(char c) {
+  return c == '"' ? '"' : c == '\\' ? '\\' : c == '\n' ? 'n' : c == '\r' ? 'r' : c == '\t' ? 't' : c == '\b' ? 'b' : c == '\f' ? 'f' : 0;
+}
+
+// Bytes a character takes inside a JSON string (other control chars become \u00XX).
+constexpr size_t jsonEscapedCharLength(char c) {
+  return jsonEscapeLetter(c) ? 2 : ((unsigned char)c < 0x20) ? 6 : 1;
+}
+
+constexpr size_t jsonEscapedLength(const char* s) {
+  size_t n = 0;
+  for (; *s; s++) n += jsonEscapedCharLength(*s);
+  return n;
+}
+
+template <size_t N>
+struct JsonEscaped {
+  char text[N + 1];
+  constexpr size_t length() const { return N; }
+};
+
+// JsonEscaped<jsonEscapedLength(s)> with the escaped text of s (no surrounding quotes).
+template <size_t N>
+constexpr JsonEscaped<N> jsonEscaped(const char* s) {
+  JsonEscaped<N> out = {};
+  size_t o = 0;
+  for (; *s; s++) {
+    char c = *s;
+    char esc = jsonEscapeLetter(c);
+    if (esc) {
+      out.text[o++] = '\\';
+      out.text[o++] = esc;
+    } else if ((unsigned char)c < 0x20) {
+      const char* hex = "0123456789abcdef";
+      out.text[o++] = '\\';
+      out.text[o++] = 'u';
+      out.text[o++] = '0';
+      out.text[o++] = '0';
+      out.text[o++] = hex[(c >> 4) & 0xF];
+      out.text[o++] = hex[c & 0xF];
+    } else {
+      out.text[o++] = c;
+    }
+  }
+  out.text[o] = '\0';
+  return out;
+}
+
+// ---- Request body streamed from its pieces ----
+
+// A JSON request body kept as a list of pieces (literal text, or strings that are
+// escaped while being read), exposed as a Stream for HTTPClient::sendRequest().
+// The body is never built in RAM; its length is known up front for Content-Length.
+// The pieces must stay valid until the request has been sent.
+class JsonBodyStream : public Stream {
+ public:
+  // Already valid JSON text (including pre-escaped strings).
+  bool addRaw(const char* text, size_t len);
+  bool addRaw(const char* text) { return addRaw(text, strlen(text)); }
+  // String contents, escaped on the fly (no quotes added).
+  bool addEscaped(const char* text, size_t len);
+
+  size_t size() const { return size_; }
+  bool overflowed() const { return overflow_; }
+  // Start over from the first byte (resend after a stale connection).
+  void rewind();
+
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t readBytes(char* buffer, size_t length) override;
+  using Stream::readBytes;
+  size_t write(uint8_t) override { return 0; }
+
+ private:
+  struct Piece {
+    const char* text;
+    uint32_t len;
+    bool escape;
+  };
+  bool add(const char* text, size_t len, bool escape, size_t encodedLen);
+  // Moves the next bytes into pending_ (one escaped char) or returns a raw run.
+  size_t nextRun(const char** run);
+
+  Piece pieces_[JSON_BODY_MAX_PIECES];
+  uint8_t count_ = 0;
+  bool overflow_ = false;
+  size_t size_ = 0;
+  size_t sent_ = 0;
+  uint8_t piece_ = 0;
+  uint32_t offset_ = 0;
+  char pending_[6];
+  uint8_t pendingLen_ = 0;
+  uint8_t pendingPos_ = 0;
+};
+
+#endif
@@ -0,0 +1,167 @@
+#include "mic_capture.h"
+#include "agc.h"
+#include "aec.h"
+#include "ns.h"
+#include "config.h"
+#include "globals.h"
+#include <Arduino.h>
+#include <driver/i2s.h>
+#include <esp_heap_caps.h>
+#include <esp_timer.h>
+
+#define MIC_RING_SAMPLES ((uint32_t)MIC_FRAME_SAMPLES(MIC_RING_MS))
+#define MIC_RING_BLOCKS (MIC_RING_SAMPLES / MIC_BLOCK_SAMPLES)
+
+struct MicCaptureStats {
+  uint32_t blocks;
+  uint32_t dmaOverruns;    // I2S_EVENT_RX_Q_OVF: DMA buffers overwritten before being read
+  uint32_t shortReads;
+  uint32_t maxBlockGapUs;  // longest time between two completed blocks
+};
+
+static int16_t* ring = nullptr;
+static uint64_t blockUs[MIC_RING_BLOCKS];
+static volatile uint32_t writePos = 0;  // absolute sample count, published after the block is written
+static QueueHandle_t eventQueue = nullptr;
+static MicCaptureStats stats;
+static MicReader* readers[MIC_MAX_READERS];
+static int readerCount = 0;
+
+static uint32_t loadWritePos() { return __atomic_load_n(&writePos, __ATOMIC_ACQUIRE); }
+
+static void micCaptureTask(void*) {
+  int32_t raw[MIC_BLOCK_SAMPLES];
+  uint64_t lastBlockUs = 0;
+  for (;;) {
+    size_t bytesRead = 0;
+    i2s_read(I2S_NUM_0, raw, sizeof(raw), &bytesRead, portMAX_DELAY);
+    if (bytesRead < sizeof(raw)) {
+      stats.shortReads++;
+      continue;
+    }
+    uint64_t now = esp_timer_get_time();
+    uint32_t pos = writePos;
+    int16_t* dst = ring + (pos % MIC_RING_SAMPLES);  // ring is a whole number of blocks
+    // Conditioned before the block is published; readers only ever see the result
+    int16_t block[MIC_BLOCK_SAMPLES];
+    agcInput(raw, block, MIC_BLOCK_SAMPLES);
+#if ECHO_CANCEL
+    aecProcess(block, pos);
+#endif
+#if NOISE_SUPPRESS
+    nsProcess(block);
+#endif
+#if MIC_AGC
+    agcProcess(block, MIC_BLOCK_SAMPLES);
+#endif
+    memcpy(dst, block, sizeof(block));
+    blockUs[(pos / MIC_BLOCK_SAMPLES) % MIC_RING_BLOCKS] = now;
+    __atomic_store_n(&writePos, pos + MIC_BLOCK_SAMPLES, __ATOMIC_RELEASE);
+
+    stats.blocks++;
+    if (lastBlockUs != 0 && now - lastBlockUs > stats.maxBlockGapUs) {
+      stats.maxBlockGapUs = (uint32_t)(now - lastBlockUs);
+    }
+    lastBlockUs = now;
+    if (eventQueue) {
+      i2s_event_t ev;
+      while (xQueueReceive(eventQueue, &ev, 0) == pdTRUE) {
+        if (ev.type == I2S_EVENT_RX_Q_OVF) stats.dmaOverruns++;
+      }
+    }
+  }
+}
+
+bool micCaptureBegin(QueueHandle_t i2sEvents) {
+  if (ring) return true;
+  size_t bytes = MIC_RING_SAMPLES * sizeof(int16_t);
+  if (psramFound()) ring = (int16_t*)heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM);
+  if (!ring) ring = (int16_t*)malloc(bytes);
+  if (!ring) {
+    Serial.println("Mic capture: ring alloc failed");
+    return false;
+  }
+  memset(ring, 0, bytes);
+  eventQueue = i2sEvents;
+  xTaskCreatePinnedToCore(micCaptureTask, "micCapture", 6144, NULL, 5, NULL, MIC_CAPTURE_CORE);
+  Serial.printf("Mic capture: %u ms ring, %u ms blocks\n", (unsigned)MIC_RING_MS, (unsigned)MIC_BLOCK_MS);
+  return true;
+}
+
+void micReaderAttach(MicReader* r, const char* name) {
+  bool known = false;
+  for (int i = 0; i < readerCount; i++) {
+    if (readers[i] == r) known = true;
+  }
+  if (!known && readerCount < MIC_MAX_READERS) readers[readerCount++] = r;
+  r->name = name;
+  r->pos = loadWritePos();
+}
+
+void micReaderSkip(MicReader* r) {
+  r->pos = loadWritePos();
+}
+
+void micReaderAdvance(MicReader* r, uint32_t samples) {
+  uint32_t n = loadWritePos() - r->pos;
+  r->pos += samples < n ? samples : n;
+}
+
+size_t micAvailable(const MicReader* r) {
+  uint32_t n = loadWritePos() - r->pos;
+  return n < MIC_RING_SAMPLES ? n : MIC_RING_SAMPLES;  // lapped readers hold at most one ring
+}
+
+bool micReadFrame(MicReader* r, int16_t* out, size_t samples, uint64_t* timestampUs, uint32_t waitMs) {
+  if (!ring || samples == 0 || samples > MIC_RING_SAMPLES - MIC_BLOCK_SAMPLES) return false;
+  unsigned long startMs = millis();
+  uint32_t w = loadWritePos();
+  while (w - r->pos < samples) {
+    if (millis() - startMs >= waitMs) return false;
+    delay(MIC_BLOCK_MS / 2);
+    w = loadWritePos();
+  }
+  // The block being written next overwrites the oldest MIC_BLOCK_SAMPLES, so that much is off limits.
+  if (w - r->pos > MIC_RING_SAMPLES - MIC_BLOCK_SAMPLES) {
+    r->overruns++;
+    r->lostSamples += (w - r->pos) - samples;
+    r->pos = w - samples;
+  }
+  uint32_t start = r->pos % MIC_RING_SAMPLES;
+  size_t first = MIC_RING_SAMPLES - start;
+  if (first > samples) first = samples;
+  memcpy(out, ring + start, first * sizeof(int16_t));
+  if (first < samples) memcpy(out + first, ring, (samples - first) * sizeof(int16_t));
+  uint32_t lastSample = r->pos + samples - 1;
+  uint64_t stamp = blockUs[(lastSample / MIC_BLOCK_SAMPLES) % MIC_RING_BLOCKS];
+
+  // Writer may have lapped us while copying; the frame would be torn.
+  uint32_t w2 = loadWritePos();
+  if (w2 + MIC_BLOCK_SAMPLES - r->pos > MIC_RING_SAMPLES) {
+    r->overruns++;
+    r->lostSamples += w2 - r->pos;
+    r->pos = w2;
+    return false;
+  }
+  r->pos += samples;
+  r->frames++;
+  uint64_t age = esp_timer_get_time() - stamp;
+  if (age > r->maxAgeUs) r->maxAgeUs = (uint32_t)age;
+  if (timestampUs) *timestampUs = stamp;
+  return true;
+}
+
+void micCapturePrintStats() {
+  MicCaptureStats s = stats;
+  Serial.println("\n=== Mic capture ===");
+  Serial.printf("  Blocks: %u (%u ms each), DMA overruns: %u, short reads: %u, max block gap: %u us\n",
+                (unsigned)s.blocks, (unsigned)MIC_BLOCK_MS, (unsigned)s.dmaOverruns,
+                (unsigned)s.shortReads, (unsigned)s.maxBlockGapUs);
+  for (int i = 0; i < readerCount; i++) {
+    MicReader* r = readers[i];
+    Serial.printf("  Reader %s: %u frames, %u overruns (%u samples lost), max frame age %u ms, %u buffered\n",
+                  r->name, (unsigned)r->frames, (unsigned)r->overruns, (unsigned)r->lostSamples,
+                  (unsigned)(r->maxAgeUs / 1000), (unsigned)micAvailable(r));
+  }
+  Serial.println("===================\n");
+}
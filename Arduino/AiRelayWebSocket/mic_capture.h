@@ -0,0 +1,37 @@
+#ifndef AI_RELAY_WEBSOCKET_MIC_CAPTURE_H
+#define AI_RELAY_WEBSOCKET_MIC_CAPTURE_H
+
+#include <Arduino.h>
+#include <driver/i2s.h>
+
+// Mic capture task: drains I2S_NUM_0 continuously in MIC_BLOCK_MS blocks,
+// converts 32 -> 16 bit and writes into a PSRAM ring. One writer, any number
+// of readers (WS streamer, recorder, mic test); each reader has its own
+// cursor, so none of them can stall the DMA or each other.
+bool micCaptureBegin(QueueHandle_t i2sEvents);
+
+struct MicReader {
+  const char* name;
+  uint32_t pos;          // absolute sample index of the next sample to read
+  uint32_t frames;
+  uint32_t overruns;     // times the writer lapped this reader
+  uint32_t lostSamples;
+  uint32_t maxAgeUs;     // oldest frame handed out (capture -> read)
+};
+
+// Register a reader (once) and start it at the newest audio.
+void micReaderAttach(MicReader* r, const char* name);
+// Drop everything buffered for this reader (e.g. while muted) without counting an overrun.
+void micReaderSkip(MicReader* r);
+// Move the cursor forward by up to `samples` without copying (not past the newest audio).
+void micReaderAdvance(MicReader* r, uint32_t samples);
+size_t micAvailable(const MicReader* r);
+
+// Copy the next `samples` 16-bit samples (MIC_FRAME_SAMPLES(20/40/100/200)).
+// Waits up to waitMs for them; timestampUs = esp_timer time the frame's last block left DMA.
+bool micReadFrame(MicReader* r, int16_t* out, size_t samples, uint64_t* timestampUs, uint32_t waitMs);
+
+// Blocks, DMA overruns and per-reader overruns/latency.
+void micCapturePrintStats();
+
+#endif
@@ -0,0 +1,306 @@
+#include "net_pool.h"
+#include "config.h"
+#include "globals.h"
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+#include <HTTPClient.h>
+
+struct NetSlot {
+  WiFiClientSecure client;
+  HTTPClient http;
+  bool busy;
+  unsigned long lastUsedMs;
+};
+
+struct NetHostState {
+  const char* name;
+  int slotCount;
+  NetSlot* slots;
+  IPAddress ip;               // DNS cache
+  unsigned long resolvedMs;   // 0 = not resolved
+  uint32_t handshakeEwmaMs;   // typical full TLS handshake, used to estimate savings
+};
+
+struct NetCounters {
+  uint32_t requests;
+  uint32_t handshakes;
+  uint32_t reused;
+  uint32_t handshakeMs;
+  uint32_t savedMs;
+  uint32_t dnsLookups;
+  uint32_t dnsHits;
+  uint32_t dnsMs;
+  uint32_t prewarmed;
+  uint32_t failures;
+};
+
+static NetSlot groqSlots[NET_POOL_GROQ_SLOTS];
+static NetSlot googleSlots[NET_POOL_GOOGLE_SLOTS];
+static NetHostState hosts[NET_HOST_COUNT] = {
+  {"api.groq.com", NET_POOL_GROQ_SLOTS, groqSlots, IPAddress(), 0, 600},
+  {"texttospeech.googleapis.com", NET_POOL_GOOGLE_SLOTS, googleSlots, IPAddress(), 0, 600},
+};
+
+static SemaphoreHandle_t poolMutex = nullptr;
+static TaskHandle_t prewarmTaskHandle = nullptr;
+static NetCounters totals;
+static NetCounters turn;
+static bool turnActive = false;
+static unsigned long lastPrewarmMs = 0;
+
+static void lockPool() { xSemaphoreTake(poolMutex, portMAX_DELAY); }
+static void unlockPool() { xSemaphoreGive(poolMutex); }
+
+// Both the running totals and the current turn are updated under poolMutex.
+#define NET_COUNT(field, n) do { totals.field += (n); if (turnActive) turn.field += (n); } while (0)
+
+static bool resolveHost(NetHostState& h, IPAddress* ip) {
+  lockPool();
+  bool cached = h.resolvedMs != 0 && millis() - h.resolvedMs < NET_DNS_TTL_MS;
+  if (cached) {
+    *ip = h.ip;
+    NET_COUNT(dnsHits, 1);
+  }
+  unlockPool();
+  if (cached) return true;
+
+  unsigned long startMs = millis();
+  IPAddress resolved;
+  bool ok = WiFi.hostByName(h.name, resolved) == 1;
+  uint32_t elapsed = millis() - startMs;
+  lockPool();
+  NET_COUNT(dnsLookups, 1);
+  NET_COUNT(dnsMs, elapsed);
+  if (ok) {
+    h.ip = resolved;
+    h.resolvedMs = millis();
+  }
+  unlockPool();
+  if (!ok) {
+    Serial.printf("Net: DNS lookup failed for %s\n", h.name);
+    return false;
+  }
+  *ip = resolved;
+  return true;
+}
+
+static bool connectSlot(NetHostState& h, NetSlot& slot, uint32_t* elapsedMs) {
+  IPAddress ip;
+  unsigned long startMs = millis();
+  if (!resolveHost(h, &ip)) return false;
+  slot.client.stop();
+  // Connect by cached IP; host name is still used for SNI.
+  bool ok = slot.client.connect(ip, 443, h.name, nullptr, nullptr, nullptr) == 1;
+  *elapsedMs = millis() - startMs;
+  if (!ok) {
+    Serial.printf("Net: TLS connect to %s failed\n", h.name);
+    lockPool();
+    h.resolvedMs = 0;  // maybe a stale address; resolve again next time
+    unlockPool();
+  }
+  return ok;
+}
+
+static void prewarmTask(void*) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    if (WiFi.status() != WL_CONNECTED) continue;
+    for (int i = 0; i < NET_HOST_COUNT; i++) {
+      if (i == NET_HOST_GOOGLE_TTS && ttsProvider != TTS_GOOGLE) continue;
+      NetHostState& h = hosts[i];
+      // Only the first slot is pre-warmed; the rest open on demand.
+      NetSlot& slot = h.slots[0];
+      lockPool();
+      bool take = !slot.busy;
+      if (take) slot.busy = true;
+      unlockPool();
+      if (!take) continue;
+      if (!slot.client.connected()) {
+        uint32_t elapsed = 0;
+        bool ok = connectSlot(h, slot, &elapsed);
+        lockPool();
+        if (ok) {
+          NET_COUNT(prewarmed, 1);
+          h.handshakeEwmaMs = (h.handshakeEwmaMs * 3 + elapsed) / 4;
+          slot.lastUsedMs = millis();
+        }
+        unlockPool();
+        if (ok) Serial.printf("Net: pre-warmed %s (%u ms)\n", h.name, (unsigned)elapsed);
+      }
+      lockPool();
+      slot.busy = false;
+      unlockPool();
+    }
+  }
+}
+
+void netPoolBegin() {
+  if (poolMutex) return;
+  poolMutex = xSemaphoreCreateMutex();
+  for (int i = 0; i < NET_HOST_COUNT; i++) {
+    for (int s = 0; s < hosts[i].slotCount; s++) {
+      NetSlot& slot = hosts[i].slots[s];
+      slot.client.setInsecure();
+      slot.client.setTimeout(20000);
+      slot.busy = false;
+      slot.lastUsedMs = 0;
+    }
+  }
+  xTaskCreatePinnedToCore(prewarmTask, "netPrewarm", 6144, NULL, 1, &prewarmTaskHandle, 0);
+}
+
+bool netAcquire(NetHost host, NetLease* lease) {
+  lease->host = host;
+  lease->slot = -1;
+  lease->reused = false;
+  lease->connectMs = 0;
+  NetHostState& h = hosts[host];
+
+  unsigned long waitStartMs = millis();
+  for (;;) {
+    lockPool();
+    int pick = -1;
+    for (int s = 0; s < h.slotCount; s++) {
+      if (h.slots[s].busy) continue;
+      if (pick < 0) pick = s;
+      if (h.slots[s].client.connected()) { pick = s; break; }
+    }
+    if (pick >= 0) h.slots[pick].busy = true;
+    unlockPool();
+    if (pick >= 0) {
+      lease->slot = pick;
+      break;
+    }
+    if (millis() - waitStartMs > 20000) {
+      Serial.printf("Net: no free connection for %s\n", h.name);
+      return false;
+    }
+    delay(10);
+  }
+
+  NetSlot& slot = h.slots[lease->slot];
+  if (slot.client.connected()) {
+    lease->reused = true;
+    lockPool();
+    NET_COUNT(requests, 1);
+    NET_COUNT(reused, 1);
+    NET_COUNT(savedMs, h.handshakeEwmaMs);
+    unlockPool();
+    return true;
+  }
+
+  uint32_t elapsed = 0;
+  bool ok = connectSlot(h, slot, &elapsed);
+  lockPool();
+  NET_COUNT(requests, 1);
+  if (ok) {
+    lease->connectMs = elapsed;
+    NET_COUNT(handshakes, 1);
+    NET_COUNT(handshakeMs, elapsed);
+    h.handshakeEwmaMs = (h.handshakeEwmaMs * 3 + elapsed) / 4;
+  } else {
+    NET_COUNT(failures, 1);
+    slot.busy = false;
+    lease->slot = -1;
+  }
+  unlockPool();
+  return ok;
+}
+
+void netRelease(NetLease* lease, bool keepAlive) {
+  if (lease->slot < 0) return;
+  NetSlot& slot = hosts[lease->host].slots[lease->slot];
+  if (!keepAlive) slot.client.stop();
+  lockPool();
+  slot.lastUsedMs = millis();
+  slot.busy = false;
+  unlockPool();
+  lease->slot = -1;
+}
+
+WiFiClientSecure& netClient(const NetLease& lease) {
+  return hosts[lease.host].slots[lease.slot].client;
+}
+
+HTTPClient& netHttp(const NetLease& lease) {
+  return hosts[lease.host].slots[lease.slot].http;
+}
+
+bool netBeginHttp(NetHost host, NetLease* lease, const String& url) {
+  if (!netAcquire(host, lease)) return false;
+  HTTPClient& http = netHttp(*lease);
+  http.setReuse(true);
+  if (!http.begin(netClient(*lease), url)) {
+    netRelease(lease, false);
+    return false;
+  }
+  return true;
+}
+
+bool netRetryStale(NetLease* lease, int httpCode, const String& url) {
+  if (httpCode >= 0 || !lease->reused || lease->slot < 0) return false;
+  Serial.printf("Net: kept-alive connection to %s was closed, reconnecting\n", hosts[lease->host].name);
+  NetHost host = lease->host;
+  netHttp(*lease).end();
+  netRelease(lease, false);
+  lockPool();
+  // The handshake was not avoided after all
+  NET_COUNT(savedMs, -(int32_t)hosts[host].handshakeEwmaMs);
+  NET_COUNT(reused, -1);
+  NET_COUNT(requests, -1);
+  unlockPool();
+  return netBeginHttp(host, lease, url);
+}
+
+void netEndHttp(NetLease* lease, bool keepAlive) {
+  if (lease->slot < 0) return;
+  netHttp(*lease).end();
+  netRelease(lease, keepAlive);
+}
+
+void netPrewarm() {
+  if (!prewarmTaskHandle) return;
+  if (millis() - lastPrewarmMs < NET_PREWARM_MIN_INTERVAL_MS) return;
+  lastPrewarmMs = millis();
+  xTaskNotifyGive(prewarmTaskHandle);
+}
+
+void netTurnBegin() {
+  lockPool();
+  memset(&turn, 0, sizeof(turn));
+  turnActive = true;
+  unlockPool();
+}
+
+void netTurnEnd() {
+  lockPool();
+  NetCounters t = turn;
+  turnActive = false;
+  unlockPool();
+  Serial.printf("Net: turn used %u connection(s): %u reused (~%u ms saved), %u handshake(s) (%u ms), DNS %u hit/%u lookup\n",
+                (unsigned)t.requests, (unsigned)t.reused, (unsigned)t.savedMs, (unsigned)t.handshakes,
+                (unsigned)t.handshakeMs, (unsigned)t.dnsHits, (unsigned)t.dnsLookups);
+}
+
+void netPrintStats() {
+  lockPool();
+  NetCounters t = totals;
+  unlockPool();
+  Serial.println("\n=== Connection pool ===");
+  for (int i = 0; i < NET_HOST_COUNT; i++) {
+    NetHostState& h = hosts[i];
+    int open = 0;
+    for (int s = 0; s < h.slotCount; s++) {
+      if (h.slots[s].client.connected()) open++;
+    }
+    Serial.printf("  %s: %d/%d open, handshake ~%u ms, DNS %s\n", h.name, open, h.slotCount,
+                  (unsigned)h.handshakeEwmaMs, h.resolvedMs ? h.ip.toString().c_str() : "(not cached)");
+  }
+  Serial.printf("  Requests: %u, reused: %u, handshakes: %u (%u ms), pre-warmed: %u, failures: %u\n",
+                (unsigned)t.requests, (unsigned)t.reused, (unsigned)t.handshakes, (unsigned)t.handshakeMs,
+                (unsigned)t.prewarmed, (unsigned)t.failures);
+  Serial.printf("  Estimated time saved: %u ms; DNS: %u hits, %u lookups (%u ms)\n",
+                (unsigned)t.savedMs, (unsigned)t.dnsHits, (unsigned)t.dnsLookups, (unsigned)t.dnsMs);
+  Serial.println("=======================\n");
+}
@@ -0,0 +1,48 @@
+#ifndef AI_RELAY_WEBSOCKET_NET_POOL_H
+#define AI_RELAY_WEBSOCKET_NET_POOL_H
+
+#include <Arduino.h>
+#include <WiFiClientSecure.h>
+#include <HTTPClient.h>
+
+// Keep-alive HTTPS connections per host, with a DNS cache and pre-warming,
+// so a turn doesn't pay DNS + a full TLS handshake for every request.
+enum NetHost {
+  NET_HOST_GROQ = 0,        // api.groq.com (LLM, Groq TTS, Whisper)
+  NET_HOST_GOOGLE_TTS = 1,  // texttospeech.googleapis.com
+  NET_HOST_COUNT
+};
+
+struct NetLease {
+  NetHost host;
+  int slot;          // -1 = not acquired
+  bool reused;       // connection was already open: handshake avoided
+  uint32_t connectMs;
+};
+
+void netPoolBegin();
+
+// Acquire an idle slot for host and make sure it is connected.
+bool netAcquire(NetHost host, NetLease* lease);
+// keepAlive=false closes the connection (error, unread body, Connection: close).
+void netRelease(NetLease* lease, bool keepAlive);
+WiFiClientSecure& netClient(const NetLease& lease);
+// Each slot keeps its HTTPClient alive too; a destroyed HTTPClient stops its client.
+HTTPClient& netHttp(const NetLease& lease);
+
+// Acquire + http.begin() on the pooled connection.
+bool netBeginHttp(NetHost host, NetLease* lease, const String& url);
+// If a reused connection turned out to be dead (httpCode < 0), reconnect and begin again.
+// Returns true when the caller should re-add headers and resend.
+bool netRetryStale(NetLease* lease, int httpCode, const String& url);
+void netEndHttp(NetLease* lease, bool keepAlive);
+
+// Connect idle slots in the background (e.g. while the user is still speaking).
+void netPrewarm();
+
+// Per-turn report of handshakes avoided and time saved.
+void netTurnBegin();
+void netTurnEnd();
+void netPrintStats();
+
+#endif
@@ -0,0 +1,293 @@
+#include "ns.h"
+#include "vad.h"
+#include "config.h"
+#include <Arduino.h>
+
+// Frame = previous block + this block, zero-padded to FFT_N; the real FFT runs as
+// a HALF-point complex FFT of the even/odd samples.
+static const uint32_t FRAME = 2 * MIC_BLOCK_SAMPLES;
+static const uint32_t FFT_N = 512;
+static const uint32_t HALF = FFT_N / 2;
+static const uint32_t BINS = HALF + 1;
+static_assert(FRAME <= FFT_N, "frame must fit the FFT");
+// Windowed samples enter the FFT as x << 12; each of the 8 stages halves, so the
+// spectrum is 16x the sample scale and the inverse returns 16x too.
+static const int WINDOW_SHIFT = 3;   // x * w (Q15) >> 3 = x << 12
+static const int OUT_SHIFT = 4;
+// Gain table over bin SNR, in 1/8 octave steps (~0.4 dB) up to 16 octaves
+static const uint32_t GAIN_STEP_Q8 = 32;
+static const uint32_t GAIN_STEPS = 128;
+static const int32_t R_STEP_Q15 = 30048;  // 2^(-1/8)
+static const uint32_t INIT_BLOCKS = 20;   // noise estimate taken as the minimum of the first 200 ms
+static const int32_t SPEECH_SNR_Q8 = 4 * 256;  // frame 12 dB over its floor: counted as speech
+
+struct NsStats {
+  uint32_t blocks;
+  uint32_t cyclesMax;
+  uint64_t cyclesTotal;
+  uint32_t overBudget;    // blocks over NS_BUDGET_CYCLES
+  uint32_t noiseBlocks;   // frame within 3 dB of its floor
+  uint32_t speechBlocks;
+};
+
+static int16_t win[FRAME];         // sqrt-Hann, Q15: win[n]^2 + win[n + block]^2 = 1
+static int16_t cosT[HALF];         // cos(2 pi k / FFT_N), Q15
+static int16_t sinT[HALF];
+static uint8_t bitRev[HALF];
+static uint16_t gainT[GAIN_STEPS];  // Q15
+
+static int16_t prevIn[MIC_BLOCK_SAMPLES];
+static int32_t tail[MIC_BLOCK_SAMPLES];  // second half of the last frame, after synthesis window
+static int32_t re[HALF];
+static int32_t im[HALF];
+static int32_t xr[BINS];
+static int32_t xi[BINS];
+
+static int16_t fastQ8[BINS];     // log2 power, lightly smoothed: drives the gain
+static int16_t slowQ8[BINS];     // more smoothing: its minimum is the noise estimate
+static int16_t noiseQ8[BINS];
+static uint16_t gainQ15[BINS];   // released slowly
+static int32_t frameFloorQ8 = 0;
+static int32_t noiseRedQ8 = 0;   // smoothed attenuation of noise-only frames
+static int32_t speechRedQ8 = 0;  // and of speech frames
+static uint32_t blocksSeen = 0;
+static volatile bool enabled = NOISE_SUPPRESS;
+static bool ready = false;
+static NsStats stats;
+
+static uint32_t isqrt(uint32_t v) {
+  uint32_t r = 0;
+  for (uint32_t bit = 1u << 30; bit; bit >>= 2) {
+    if (v >= r + bit) {
+      v -= r + bit;
+      r = (r >> 1) + bit;
+    } else {
+      r >>= 1;
+    }
+  }
+  return r;
+}
+
+// Power subtraction: g^2 = 1 - oversub * noise / power, at least NS_FLOOR_Q15^2.
+static void buildGainTable() {
+  uint32_t floor2 = (uint32_t)NS_FLOOR_Q15 * NS_FLOOR_Q15 >> 15;
+  int64_t r = 32768;  // noise / power, Q15
+  for (uint32_t i = 0; i < GAIN_STEPS; i++) {
+    int64_t g2 = 32768 - ((r * NS_OVERSUB_Q8) >> 8);
+    if (g2 < (int64_t)floor2) g2 = floor2;
+    uint32_t g = isqrt((uint32_t)g2 << 15);
+    gainT[i] = g > 32767 ? 32767 : g;
+    r = (r * R_STEP_Q15 + 16384) >> 15;
+  }
+}
+
+static uint16_t gainFor(int32_t snrQ8) {
+  if (snrQ8 <= 0) return gainT[0];
+  uint32_t i = (uint32_t)snrQ8 / GAIN_STEP_Q8;
+  return i < GAIN_STEPS ? gainT[i] : 32767;
+}
+
+bool nsBegin() {
+  if (ready) return true;
+  // Tables rounded from double once; everything after is integer
+  for (uint32_t n = 0; n < FRAME; n++) {
+    win[n] = (int16_t)lround(sin(M_PI * (n + 0.5) / FRAME) * 32767.0);
+  }
+  for (uint32_t k = 0; k < HALF; k++) {
+    cosT[k] = (int16_t)lround(cos(2.0 * M_PI * k / FFT_N) * 32767.0);
+    sinT[k] = (int16_t)lround(sin(2.0 * M_PI * k / FFT_N) * 32767.0);
+    uint32_t r = 0;
+    for (uint32_t b = 1, v = k; b < HALF; b <<= 1, v >>= 1) r = (r << 1) | (v & 1);
+    bitRev[k] = (uint8_t)r;
+  }
+  buildGainTable();
+  for (uint32_t k = 0; k < BINS; k++) gainQ15[k] = 32767;
+  ready = true;
+  Serial.printf("NS: %u-point FFT, %u ms frames every %u ms, floor %d dB, budget %u cycles per block\n",
+                (unsigned)FFT_N, (unsigned)(FRAME * 1000 / SAMPLE_RATE), (unsigned)MIC_BLOCK_MS,
+                (int)lround(20.0 * log10(NS_FLOOR_Q15 / 32768.0)), (unsigned)NS_BUDGET_CYCLES);
+  return true;
+}
+
+// In-place HALF-point complex FFT, radix 2, halving every stage (output = DFT / HALF).
+// inverse: conjugate twiddles.
+static void fftHalf(bool inverse) {
+  for (uint32_t i = 0; i < HALF; i++) {
+    uint32_t j = bitRev[i];
+    if (j > i) {
+      int32_t t = re[i]; re[i] = re[j]; re[j] = t;
+      t = im[i]; im[i] = im[j]; im[j] = t;
+    }
+  }
+  for (uint32_t len = 2; len <= HALF; len <<= 1) {
+    uint32_t half = len / 2;
+    uint32_t step = FFT_N / len;
+    for (uint32_t k = 0; k < half; k++) {
+      int32_t wr = cosT[k * step];
+      int32_t wi = inverse ? sinT[k * step] : -sinT[k * step];
+      for (uint32_t a = k; a < HALF; a += len) {
+        uint32_t b = a + half;
+        int32_t tr = (int32_t)(((int64_t)wr * re[b] - (int64_t)wi * im[b]) >> 15);
+        int32_t ti = (int32_t)(((int64_t)wr * im[b] + (int64_t)wi * re[b]) >> 15);
+        re[b] = (re[a] - tr) >> 1;
+        im[b] = (im[a] - ti) >> 1;
+        re[a] = (re[a] + tr) >> 1;
+        im[a] = (im[a] + ti) >> 1;
+      }
+    }
+  }
+}
+
+// re/im hold the FFT of even (re) and odd (im) samples -> bins 0..HALF of the real signal.
+static void splitSpectrum() {
+  xr[0] = re[0] + im[0];
+  xi[0] = 0;
+  xr[HALF] = re[0] - im[0];
+  xi[HALF] = 0;
+  for (uint32_t k = 1; k < HALF; k++) {
+    uint32_t m = HALF - k;
+    int32_t er = (re[k] + re[m]) >> 1;
+    int32_t ei = (im[k] - im[m]) >> 1;
+    int32_t orr = (im[k] + im[m]) >> 1;
+    int32_t oi = (re[m] - re[k]) >> 1;
+    xr[k] = er + (int32_t)(((int64_t)cosT[k] * orr + (int64_t)sinT[k] * oi) >> 15);
+    xi[k] = ei + (int32_t)(((int64_t)cosT[k] * oi - (int64_t)sinT[k] * orr) >> 15);
+  }
+}
+
+// Inverse of splitSpectrum: bins 0..HALF -> the spectrum of z[n] = x[2n] + i x[2n+1].
+static void mergeSpectrum() {
+  for (uint32_t k = 0; k < HALF; k++) {
+    uint32_t m = HALF - k;
+    int32_t er = (xr[k] + xr[m]) >> 1;
+    int32_t ei = (xi[k] - xi[m]) >> 1;
+    int32_t dr = (xr[k] - xr[m]) >> 1;
+    int32_t di = (xi[k] + xi[m]) >> 1;
+    int32_t orr = (int32_t)(((int64_t)cosT[k] * dr - (int64_t)sinT[k] * di) >> 15);
+    int32_t oi = (int32_t)(((int64_t)cosT[k] * di + (int64_t)sinT[k] * dr) >> 15);
+    re[k] = er - oi;
+    im[k] = ei + orr;
+  }
+}
+
+// Per-bin noise estimate and gain; applies the gain to xr/xi. Returns the frame's
+// energy before and after (log2, Q8) for the stats.
+static void suppress(int32_t* beforeQ8, int32_t* afterQ8) {
+  bool init = blocksSeen < INIT_BLOCKS;
+  uint64_t before = 0;
+  uint64_t after = 0;
+  for (uint32_t k = 0; k < BINS; k++) {
+    uint64_t p = (uint64_t)((int64_t)xr[k] * xr[k] + (int64_t)xi[k] * xi[k]);
+    int32_t l = log2Q8(p + 1);
+    if (init && blocksSeen == 0) fastQ8[k] = slowQ8[k] = noiseQ8[k] = (int16_t)l;
+    fastQ8[k] += (l - fastQ8[k]) / 2;
+    slowQ8[k] += (l - slowQ8[k]) / 8;
+    // Minimum statistics: down at once, up slowly (a louder fan is learned in seconds)
+    if (slowQ8[k] < noiseQ8[k]) noiseQ8[k] = slowQ8[k];
+    else if (!init) noiseQ8[k] += NS_NOISE_RISE_Q8;
+
+    uint16_t g = gainFor(fastQ8[k] - noiseQ8[k] - NS_NOISE_BIAS_Q8);
+    // Up at once (speech onsets), down over a few frames
+    if (g < gainQ15[k]) g = gainQ15[k] - (gainQ15[k] - g) / 4;
+    gainQ15[k] = g;
+    xr[k] = (int32_t)(((int64_t)xr[k] * g) >> 15);
+    xi[k] = (int32_t)(((int64_t)xi[k] * g) >> 15);
+
+    uint64_t ps = p >> 8;  // keeps the sums and the gain products in 64 bits
+    before += ps;
+    after += (((ps * g) >> 15) * g) >> 15;
+  }
+  *beforeQ8 = log2Q8(before + 1);
+  *afterQ8 = log2Q8(after + 1);
+}
+
+void nsProcess(int16_t* block) {
+  if (!ready) return;
+  if (!enabled) {
+    memcpy(prevIn, block, sizeof(prevIn));
+    memset(tail, 0, sizeof(tail));
+    return;
+  }
+  uint32_t startCycles = ESP.getCycleCount();
+
+  // Analysis: window, pack even/odd samples as one complex sequence, zero-pad
+  for (uint32_t n = 0; n < HALF; n++) {
+    uint32_t i = 2 * n;
+    int32_t a = 0;
+    int32_t b = 0;
+    if (i < FRAME) {
+      int32_t x0 = i < MIC_BLOCK_SAMPLES ? prevIn[i] : block[i - MIC_BLOCK_SAMPLES];
+      int32_t x1 = i + 1 < MIC_BLOCK_SAMPLES ? prevIn[i + 1] : block[i + 1 - MIC_BLOCK_SAMPLES];
+      a = (x0 * win[i]) >> WINDOW_SHIFT;
+      b = (x1 * win[i + 1]) >> WINDOW_SHIFT;
+    }
+    re[n] = a;
+    im[n] = b;
+  }
+  memcpy(prevIn, block, sizeof(prevIn));
+  fftHalf(false);
+  splitSpectrum();
+
+  int32_t beforeQ8;
+  int32_t afterQ8;
+  suppress(&beforeQ8, &afterQ8);
+
+  mergeSpectrum();
+  fftHalf(true);
+
+  // Synthesis window, overlap-add: output is the block before this one
+  for (uint32_t n = 0; n < MIC_BLOCK_SAMPLES; n++) {
+    int32_t y = n % 2 ? im[n / 2] : re[n / 2];
+    int32_t v = tail[n] + (int32_t)(((int64_t)y * win[n]) >> 15);
+    int32_t s = (v + (1 << (OUT_SHIFT - 1))) >> OUT_SHIFT;
+    block[n] = s > 32767 ? 32767 : (s < -32768 ? -32768 : (int16_t)s);
+    uint32_t m = n + MIC_BLOCK_SAMPLES;
+    int32_t y2 = m % 2 ? im[m / 2] : re[m / 2];
+    tail[n] = (int32_t)(((int64_t)y2 * win[m]) >> 15);
+  }
+
+  // Stats: attenuation of frames near their floor (noise) and well above it (speech)
+  if (blocksSeen < INIT_BLOCKS || beforeQ8 < frameFloorQ8) frameFloorQ8 = beforeQ8;
+  else frameFloorQ8 += (beforeQ8 - frameFloorQ8) / 256 + 1;
+  blocksSeen++;
+  int32_t redQ8 = beforeQ8 - afterQ8;
+  if (beforeQ8 < frameFloorQ8 + 256) {
+    noiseRedQ8 += (redQ8 - noiseRedQ8) / 16;
+    stats.noiseBlocks++;
+  } else if (beforeQ8 > frameFloorQ8 + SPEECH_SNR_Q8) {
+    speechRedQ8 += (redQ8 - speechRedQ8) / 16;
+    stats.speechBlocks++;
+  }
+
+  uint32_t cycles = ESP.getCycleCount() - startCycles;
+  stats.blocks++;
+  stats.cyclesTotal += cycles;
+  if (cycles > stats.cyclesMax) stats.cyclesMax = cycles;
+  if (cycles > NS_BUDGET_CYCLES) stats.overBudget++;
+}
+
+void nsSetEnabled(bool on) {
+  enabled = on;
+}
+
+bool nsEnabled() {
+  return enabled;
+}
+
+// log2 energy in Q8 -> dB (10 * log10(2) = 3.01)
+static int q8ToDb(int32_t q8) {
+  return (int)(q8 * 301 / 25600);
+}
+
+void nsPrintStats() {
+  NsStats s = stats;
+  Serial.println("\n=== Noise suppression ===");
+  Serial.printf("  %s; blocks: %u, cycles per block avg %u, max %u, over %u budget: %u\n",
+                enabled ? "on" : "off", (unsigned)s.blocks,
+                (unsigned)(s.blocks ? s.cyclesTotal / s.blocks : 0), (unsigned)s.cyclesMax,
+                (unsigned)NS_BUDGET_CYCLES, (unsigned)s.overBudget);
+  Serial.printf("  Attenuation: noise-only frames %d dB (%u), speech frames %d dB (%u)\n",
+                q8ToDb(noiseRedQ8), (unsigned)s.noiseBlocks, q8ToDb(speechRedQ8),
+                (unsigned)s.speechBlocks);
+  Serial.println("=========================\n");
+}
@@ -0,0 +1,27 @@
+#ifndef AI_RELAY_WEBSOCKET_NS_H
+#define AI_RELAY_WEBSOCKET_NS_H
+
+#include <Arduino.h>
+
+// Noise suppressor on the capture path (after the echo canceller), so the
+// WS uplink, Whisper recordings and the VAD all get the cleaned signal.
+// Spectral subtraction: each MIC_BLOCK_SAMPLES block completes a 2-block
+// sqrt-Hann frame, transformed with a 512-point fixed-point real FFT. Every
+// bin's noise level follows the minimum of its smoothed log power; the gain
+// comes from a table over the bin's SNR and is released slowly, which keeps
+// isolated noise bins from twittering ("musical noise"). Integer arithmetic
+// only, so a host build of this file gives the same samples as the device.
+bool nsBegin();
+
+// Mic capture task: replaces the block with the suppressed block before it.
+// Adds MIC_BLOCK_MS of latency (the overlap-add needs the next half frame).
+void nsProcess(int16_t* block);
+
+// Runtime switch for A/B listening (mic test mode); off passes blocks through.
+void nsSetEnabled(bool on);
+bool nsEnabled();
+
+// Cycles per block vs NS_BUDGET_CYCLES, noise floor, attenuation of noise-only blocks.
+void nsPrintStats();
+
+#endif
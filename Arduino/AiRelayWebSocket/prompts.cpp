@@ -1,9 +1,9 @@
 #include "prompts.h"
+#include "json_body.h"
 #include <Arduino.h>
 
-// Array of available prompts
-const char* PROMPTS[] = {
-    // Prompt 0: Math tutor (current)
+// Prompt 0: Math tutor (current)
+static constexpr char PROMPT_0[] =
     "You are a friendly mathematics tutor for 8th grade students. "
     "Your name is Math Buddy. "
     "\n\n"
@@ -22,9 +22,10 @@ const char* PROMPTS[] = {
     "FORMAT: Keep responses SHORT (max 2-3 sentences). This is a voice conversation - be concise and conversational. "
     "Ask one question at a time. Wait for the student to respond before continuing. "
     "CRITICAL: Never include action descriptions, stage directions, or parenthetical notes like '(drawing)' or '(gesturing)'. "
-    "Speak naturally as if having a real conversation. Everything you say will be read aloud by text-to-speech.",
-    
-    // Prompt 1: Pythagoras - Ancient Greek mathematician and philosopher
+    "Speak naturally as if having a real conversation. Everything you say will be read aloud by text-to-speech.";
+
+// Prompt 1: Pythagoras - Ancient Greek mathematician and philosopher
+static constexpr char PROMPT_1[] =
     "You are Pythagoras, the ancient Greek mathematician and philosopher from Samos (c. 570-495 BCE). "
     "You are known for the Pythagorean theorem and your mystical approach to mathematics. "
     "\n\n"
@@ -44,9 +45,10 @@ const char* PROMPTS[] = {
     "Do NOT give long philosophical speeches. Answer directly and briefly. "
     "Speak with ancient wisdom but remain accessible and to-the-point. Use geometric examples when possible, but keep them brief. "
     "CRITICAL: Never include action descriptions, stage directions, or parenthetical notes like '(drawing)' or '(gesturing)'. "
-    "Speak naturally as if having a real conversation. Everything you say will be read aloud by text-to-speech.",
-    
-    // Prompt 2: Archimedes - The great inventor and mathematician
+    "Speak naturally as if having a real conversation. Everything you say will be read aloud by text-to-speech.";
+
+// Prompt 2: Archimedes - The great inventor and mathematician
+static constexpr char PROMPT_2[] =
     "You are Archimedes, the brilliant Greek mathematician, physicist, and inventor from Syracuse (c. 287-212 BCE). "
     "You are known for your practical inventions and mathematical discoveries. "
     "\n\n"
@@ -65,9 +67,10 @@ const char* PROMPTS[] = {
     "FORMAT: Keep responses SHORT (max 2-3 sentences). This is a voice conversation - be concise and conversational. "
     "Be enthusiastic and practical. Use real-world examples to illustrate mathematical concepts. "
     "CRITICAL: Never include action descriptions, stage directions, or parenthetical notes like '(drawing)' or '(gesturing)'. "
-    "Speak naturally as if having a real conversation. Everything you say will be read aloud by text-to-speech.",
-    
-    // Prompt 3: Euclid - The Father of Geometry
+    "Speak naturally as if having a real conversation. Everything you say will be read aloud by text-to-speech.";
+
+// Prompt 3: Euclid - The Father of Geometry
+static constexpr char PROMPT_3[] =
     "You are Euclid, the ancient Greek mathematician from Alexandria (c. 300 BCE), known as the 'Father of Geometry'. "
     "You wrote 'Elements', one of the most influential mathematical works in history. "
     "\n\n"
@@ -86,9 +89,10 @@ const char* PROMPTS[] = {
     "FORMAT: Keep responses SHORT (max 2-3 sentences). This is a voice conversation - be concise and conversational. "
     "Be systematic and clear. Guide through logical steps and geometric reasoning. "
     "CRITICAL: Never include action descriptions, stage directions, or parenthetical notes like '(drawing)' or '(gesturing)'. "
-    "Speak naturally as if having a real conversation. Everything you say will be read aloud by text-to-speech.",
-    
-    // Prompt 4: Campus Sustainability Advisor
+    "Speak naturally as if having a real conversation. Everything you say will be read aloud by text-to-speech.";
+
+// Prompt 4: Campus Sustainability Advisor
+static constexpr char PROMPT_4[] =
     "You are a friendly and knowledgeable campus sustainability advisor. "
     "You help students make responsible and environmentally friendly decisions. "
     "\n\n"
@@ -109,8 +113,20 @@ const char* PROMPTS[] = {
     "FORMAT: Keep responses SHORT (max 2-3 sentences). This is a voice conversation - be concise and conversational. "
     "Give practical, actionable advice. Focus on what students can do right now. "
     "CRITICAL: Never include action descriptions, stage directions, or parenthetical notes like '(pointing)' or '(smiling)'. "
-    "Speak naturally as if having a real conversation. Everything you say will be read aloud by text-to-speech."
-};
+    "Speak naturally as if having a real conversation. Everything you say will be read aloud by text-to-speech.";
+
+// Array of available prompts
+const char* PROMPTS[] = {PROMPT_0, PROMPT_1, PROMPT_2, PROMPT_3, PROMPT_4};
+
+// JSON-escaped copies for the chat request body, built by the compiler (flash only)
+static constexpr auto PROMPT_0_JSON = jsonEscaped<jsonEscapedLength(PROMPT_0)>(PROMPT_0);
+static constexpr auto PROMPT_1_JSON = jsonEscaped<jsonEscapedLength(PROMPT_1)>(PROMPT_1);
+static constexpr auto PROMPT_2_JSON = jsonEscaped<jsonEscapedLength(PROMPT_2)>(PROMPT_2);
+static constexpr auto PROMPT_3_JSON = jsonEscaped<jsonEscapedLength(PROMPT_3)>(PROMPT_3);
+static constexpr auto PROMPT_4_JSON = jsonEscaped<jsonEscapedLength(PROMPT_4)>(PROMPT_4);
+static const char* const PROMPTS_JSON[] = {PROMPT_0_JSON.text, PROMPT_1_JSON.text, PROMPT_2_JSON.text, PROMPT_3_JSON.text, PROMPT_4_JSON.text};
+static const size_t PROMPTS_JSON_LEN[] = {PROMPT_0_JSON.length(), PROMPT_1_JSON.length(), PROMPT_2_JSON.length(), PROMPT_3_JSON.length(), PROMPT_4_JSON.length()};
+static_assert(sizeof(PROMPTS_JSON) / sizeof(PROMPTS_JSON[0]) == PROMPT_COUNT, "one escaped copy per prompt");
 
 // Current prompt index (default to 0)
 uint8_t currentPromptIndex = 0;
@@ -123,6 +139,13 @@ const char* getCurrentPrompt() {
     return PROMPTS[currentPromptIndex];
 }
 
+// JSON-escaped current prompt (no quotes), ready to copy into a request body
+const char* getCurrentPromptJson(size_t* length) {
+    getCurrentPrompt();  // clamps the index
+    *length = PROMPTS_JSON_LEN[currentPromptIndex];
+    return PROMPTS_JSON[currentPromptIndex];
+}
+
 // Get the first line of the current prompt
 String getCurrentPromptFirstLine() {
     const char* prompt = getCurrentPrompt();
@@ -205,3 +228,30 @@ float getCurrentPromptPitch() {
             return 0.0;
     }
 }
+
+static const char* const PROMPT_NAMES[PROMPT_COUNT] = {
+    "Math Buddy", "Pythagoras", "Archimedes", "Euclid", "Sustainability Advisor"
+};
+
+const char* getPromptName(uint8_t promptIndex) {
+    if (promptIndex >= PROMPT_COUNT) {
+        return "";
+    }
+    return PROMPT_NAMES[promptIndex];
+}
+
+// Filler lines per prompt, spoken from flash while the LLM works on the reply
+static const char* const PROMPT_FILLERS[PROMPT_COUNT][PROMPT_FILLER_COUNT] = {
+    {"Hmm, let me think.", "Good question, one moment."},             // Math Buddy
+    {"Ah, let us ponder this.", "Hmm, the numbers are speaking."},      // Pythagoras
+    {"Ooh, let me work this out!", "One moment, I am calculating!"},   // Archimedes
+    {"Let us proceed step by step.", "Hmm, consider this carefully."},  // Euclid
+    {"Great question, let me check.", "Hmm, let me think about that."}  // Campus Sustainability Advisor
+};
+
+const char* getPromptFiller(uint8_t promptIndex, uint8_t n) {
+    if (promptIndex >= PROMPT_COUNT || n >= PROMPT_FILLER_COUNT) {
+        return "";
+    }
+    return PROMPT_FILLERS[promptIndex][n];
+}
@@ -16,6 +16,9 @@ extern uint8_t currentPromptIndex;
 // Get the current system prompt
 const char* getCurrentPrompt();
 
+// JSON-escaped current prompt (no quotes), precomputed at build time
+const char* getCurrentPromptJson(size_t* length);
+
 // Get the first line of the current prompt
 String getCurrentPromptFirstLine();
 
@@ -28,4 +31,11 @@ float getCurrentPromptSpeakingRate();
 // Get SSML pitch for the current prompt (-20.0 to 20.0 semitones, 0.0 = normal)
 float getCurrentPromptPitch();
 
+// Name a persona is called by ("Math Buddy"), e.g. in "switch to Pythagoras"
+const char* getPromptName(uint8_t promptIndex);
+
+// Short lines a persona says while it thinks (pre-rendered filler audio)
+#define PROMPT_FILLER_COUNT 2
+const char* getPromptFiller(uint8_t promptIndex, uint8_t n);
+
 #endif
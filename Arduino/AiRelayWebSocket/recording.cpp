@@ -1,32 +1,33 @@
 #include "recording.h"
 #include "audio_utils.h"
-#include "chat_utils.h"
+#include "dialog_task.h"
 #include "stt.h"
-#include "tts.h"
+#include "mic_capture.h"
+#include "agc.h"
+#include "audio_out.h"
+#include "vad.h"
 #include "config.h"
 #include "globals.h"
 #include <Arduino.h>
 #include <driver/i2s.h>
 
 void runMicTest() {
-  int32_t buffer[512];
-  size_t bytes_read = 0;
-  size_t bytes_written = 0;
-  i2s_read(I2S_NUM_0, buffer, sizeof(buffer), &bytes_read, portMAX_DELAY);
-  if (bytes_read > 0) {
-    int samples = bytes_read / 4;
-    int32_t signal_energy = 0;
-    int16_t outBuffer[512];
+  static MicReader testReader;
+  static unsigned long lastCallMs = 0;
+  if (lastCallMs == 0) micReaderAttach(&testReader, "micTest");
+  // Test mode was off in between: start from live audio, not what piled up meanwhile
+  if (millis() - lastCallMs > 500) micReaderSkip(&testReader);
+  lastCallMs = millis();
+  int16_t buffer[MIC_FRAME_SAMPLES(20)];
+  if (micReadFrame(&testReader, buffer, MIC_FRAME_SAMPLES(20), nullptr, 100)) {
+    int samples = MIC_FRAME_SAMPLES(20);
+    uint32_t level = pcmMeanAbs(buffer, samples);
+    int16_t outBuffer[MIC_FRAME_SAMPLES(20)];
     for (int i = 0; i < samples; i++) {
-      int32_t sample = buffer[i] >> (14 + micTestVolumeShift);
-      sample = (sample * outputVolumePercent) / 100;
-      if (sample > 32767) sample = 32767;
-      if (sample < -32768) sample = -32768;
-      outBuffer[i] = (int16_t)sample;
-      signal_energy += abs(buffer[i] >> 14);
+      outBuffer[i] = (int16_t)(buffer[i] >> micTestVolumeShift);  // volume is applied by audio_out
     }
-    i2s_write(I2S_NUM_1, outBuffer, samples * 2, &bytes_written, portMAX_DELAY);
-    if ((signal_energy / samples) > silenceThreshold) {
+    audioOutWrite((const uint8_t*)outBuffer, samples * 2, 100);
+    if (level > (uint32_t)silenceThreshold) {
       digitalWrite(PIN_RED, LOW);
     } else {
       digitalWrite(PIN_RED, HIGH);
@@ -34,46 +35,112 @@ void runMicTest() {
   }
 }
 
-void processAudio(int dataSize) {
-  ledWaiting = true;
-  String text = transcribeAudio(dataSize);
+// The Whisper transcript becomes a turn like a streamed final transcript or "say"
+static void processTranscript(const String& text) {
   Serial.println("You said: " + text);
-  if (text.length() > 0) {
-    String reply = getChatResponse(text);
-    Serial.println("AI says: " + reply);
-    speakGroqTTS(reply);
-  }
+  if (text.length() > 0 && !dialogSubmit(text)) Serial.println("Busy, try again when the reply is done");
   ledWaiting = false;
 }
 
+void processAudio(int dataSize) {
+  ledWaiting = true;
+  processTranscript(transcribeAudio(dataSize));
+}
+
+#if STT_UPLOAD_STREAMING
+// Same two-reader scheme as the WS uplink: the VAD reader runs ahead, the
+// upload reader trails it by at most the pre-roll and only sends analysed audio.
+void RecordAudio(bool holdToRecord) {
+  if (holdToRecord) return;  // No button: hold-to-record not used
+  Serial.println("Recording (waiting for speech)...");
+  static MicReader vadReader;
+  static MicReader uploadReader;
+  micReaderAttach(&vadReader, "recordVad");
+  micReaderAttach(&uploadReader, "record");
+  Vad vad;
+  vad.setMinLevel(silenceThreshold);
+  const uint32_t preroll = MIC_FRAME_SAMPLES(VAD_PREROLL_MS);
+  const uint32_t chunkSamples = MIC_FRAME_SAMPLES(STT_UPLOAD_CHUNK_MS);
+  const uint32_t maxSamples = MIC_FRAME_SAMPLES(RECORD_MAX_SECONDS * 1000);
+  int16_t block[MIC_BLOCK_SAMPLES];
+  int16_t chunk[MIC_FRAME_SAMPLES(STT_UPLOAD_CHUNK_MS)];
+  SttUpload upload;
+  upload.open = false;
+  uint32_t sentSamples = 0;
+  unsigned long startMs = millis();
+  bool speaking = false;
+  uint8_t readFailures = 0;
+
+  for (;;) {
+    // A failed read still goes through the deadline checks, so a stalled
+    // capture task can't keep us here
+    bool got = micReadFrame(&vadReader, block, MIC_BLOCK_SAMPLES, nullptr, 2 * MIC_BLOCK_MS);
+    wsPump();  // keep the streaming STT session answering pings meanwhile
+    readFailures = got ? 0 : readFailures + 1;
+    bool stalled = readFailures >= RECORD_MAX_READ_FAILURES;
+    if (stalled) Serial.println("Recording: no audio from the mic");
+    if (got) vad.process(block, MIC_BLOCK_SAMPLES);
+    if (!speaking) {
+      if (got && vad.active()) {
+        // Onset: open the connection now; the mic ring holds the audio meanwhile
+        speaking = true;
+        ledRecording = true;
+        if (!sttUploadBegin(&upload)) break;
+      } else {
+        if (stalled) return;
+        if (millis() - startMs > RECORD_WAIT_MS) {
+          Serial.println("No speech");
+          return;
+        }
+        uint32_t behind = vadReader.pos - uploadReader.pos;
+        if (behind > preroll) micReaderAdvance(&uploadReader, behind - preroll);
+        continue;
+      }
+    }
+    bool ended = stalled || !vad.active() || sentSamples >= maxSamples;
+    // Send analysed audio in whole chunks (the rest too once speech has ended)
+    while (vadReader.pos - uploadReader.pos >= (ended ? 1u : chunkSamples)) {
+      uint32_t n = vadReader.pos - uploadReader.pos;
+      if (n > chunkSamples) n = chunkSamples;
+      if (!micReadFrame(&uploadReader, chunk, n, nullptr, 0)) break;
+      sttUploadWrite(&upload, (const uint8_t*)chunk, n * 2);
+      sentSamples += n;
+    }
+    if (ended) break;
+  }
+  ledRecording = false;
+  if (!upload.open) return;
+  Serial.printf("Recorded %lu ms of speech\n", (unsigned long)(sentSamples * 1000UL / SAMPLE_RATE));
+  ledWaiting = true;
+  processTranscript(sttUploadFinish(&upload));
+}
+#else
 void RecordAudio(bool holdToRecord) {
   Serial.println("Recording...");
   ledRecording = true;
-  size_t bytes_read = 0;
   if (!recording_buffer) return;
   memset(recording_buffer, 0, bufferSize);
-  int32_t buffer[256];
-  for (int i = 0; i < 2; i++) {
-    i2s_read(I2S_NUM_0, buffer, sizeof(buffer), &bytes_read, 100);
-  }
+  static MicReader recReader;
+  micReaderAttach(&recReader, "record");
+  const int frameSamples = MIC_FRAME_SAMPLES(20);
   int flash_wr_size = 0;
   uint64_t sum_abs = 0;
   uint32_t samples_total = 0;
-  while (flash_wr_size < waveDataSize) {
+  uint8_t readFailures = 0;
+  while (flash_wr_size + frameSamples * 2 <= waveDataSize) {
     if (holdToRecord) break;  // No button: hold-to-record not used
-    i2s_read(I2S_NUM_0, buffer, sizeof(buffer), &bytes_read, portMAX_DELAY);
-    if (bytes_read > 0) {
-      int samples_read = bytes_read / 4;
-      if (flash_wr_size + (samples_read * 2) > waveDataSize) break;
-      int16_t* wav_buffer_ptr = (int16_t*)(recording_buffer + headerSize + flash_wr_size);
-      for (int i = 0; i < samples_read; i++) {
-        int16_t sample = (int16_t)(buffer[i] >> 14);
-        wav_buffer_ptr[i] = sample;
-        sum_abs += abs(sample);
-        samples_total++;
-      }
-      flash_wr_size += (samples_read * 2);
+    int16_t* wav_buffer_ptr = (int16_t*)(recording_buffer + headerSize + flash_wr_size);
+    bool got = micReadFrame(&recReader, wav_buffer_ptr, frameSamples, nullptr, 100);
+    wsPump();
+    if (!got) {
+      if (++readFailures < RECORD_MAX_READ_FAILURES) continue;
+      Serial.println("Recording: no audio from the mic");
+      break;  // keep what was recorded; the length check below decides
     }
+    readFailures = 0;
+    sum_abs += pcmSumAbs(wav_buffer_ptr, frameSamples);
+    samples_total += frameSamples;
+    flash_wr_size += frameSamples * 2;
   }
   uint32_t avg_abs = samples_total ? (uint32_t)(sum_abs / samples_total) : 0;
   createWavHeader(recording_buffer, flash_wr_size);
@@ -87,3 +154,4 @@ void RecordAudio(bool holdToRecord) {
     processAudio(flash_wr_size + headerSize);
   }
 }
+#endif
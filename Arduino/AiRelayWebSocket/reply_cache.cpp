@@ -0,0 +1,372 @@
+#include "reply_cache.h"
+#include "config.h"
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include <esp_heap_caps.h>
+
+static const char* CACHE_PATH = "/replyc";
+static const uint32_t FILE_MAGIC = 0x31435152;  // "RQC1"
+static const uint8_t MAX_WORDS = 16;
+static const size_t QUESTION_CHARS = 48;
+
+// Dropped before matching
+static const char* const FILLER_WORDS[] = {
+  "a", "an", "the", "is", "are", "was", "were", "am", "be", "of", "to", "in", "on", "for",
+  "and", "or", "me", "can", "could", "would", "will", "please", "tell", "um", "uh", "er",
+  "hey", "so", "well", "okay", "ok", "just", "do", "does", "i", "my", "like"};
+// Only make sense with the conversation before them, so the answer can't be reused
+static const char* const CONTEXT_WORDS[] = {
+  "it", "that", "this", "those", "these", "he", "she", "they", "them", "him", "her", "his",
+  "its", "there", "again", "more", "else", "another", "next", "previous", "last", "same",
+  "also", "then", "yes", "no"};
+
+struct QuestionKey {
+  uint32_t words[MAX_WORDS];  // sorted, unique word hashes (numbers included)
+  uint32_t numbers;           // hash of the numbers in order; must match exactly
+  uint8_t count;
+};
+
+struct Entry {
+  bool used;
+  uint8_t persona;
+  uint16_t replyLength;
+  QuestionKey key;
+  uint32_t storedMs;   // millis() when stored (TTL); written to flash as the age
+  uint32_t lastUse;
+  uint32_t llmMs;
+  uint32_t hits;
+  char question[QUESTION_CHARS];  // normalized words, for the stats listing
+};
+
+struct FileHeader {
+  uint32_t magic;
+  uint32_t count;
+};
+
+struct CacheStats {
+  uint32_t lookups;
+  uint32_t exactHits;
+  uint32_t fuzzyHits;
+  uint32_t uncacheable;   // too short or depends on the conversation
+  uint32_t stores;
+  uint32_t evictions;
+  uint32_t expired;
+  uint64_t savedMs;       // LLM time of the cached replies, summed over hits
+  uint32_t lookupUsTotal;
+  uint32_t lookupUsMax;
+  uint32_t flushes;
+  uint32_t flushMsMax;
+};
+
+static Entry* entries = nullptr;   // PSRAM
+static char* replies = nullptr;    // PSRAM, REPLY_CACHE_MAX_REPLY bytes per entry
+static uint32_t useClock = 0;
+static bool dirty = false;
+static uint32_t dirtyMs = 0;   // millis() of the last unsaved change
+static SemaphoreHandle_t cacheMutex = nullptr;
+static CacheStats stats;
+
+static bool inList(const char* word, const char* const* list, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    if (strcmp(word, list[i]) == 0) return true;
+  }
+  return false;
+}
+
+static uint32_t fnv1a(uint32_t h, const char* s, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    h ^= (uint8_t)s[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+// Content words of the question; false if it isn't worth caching.
+static bool questionKey(const String& question, QuestionKey* key, char* text) {
+  key->count = 0;
+  key->numbers = 2166136261u;
+  size_t textLen = 0;
+  text[0] = '\0';
+  char word[24];
+  size_t len = 0;
+  size_t n = question.length();
+  for (size_t i = 0; i <= n; i++) {
+    char c = i < n ? question[i] : ' ';
+    if (c >= 'A' && c <= 'Z') c = c - 'A' + 'a';
+    if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')) {
+      if (len < sizeof(word) - 1) word[len++] = c;
+      continue;
+    }
+    if (c == '\'') continue;  // what's -> whats
+    if (len == 0) continue;
+    word[len] = '\0';
+    bool number = word[0] >= '0' && word[0] <= '9';
+    if (!number) {
+      if (inList(word, CONTEXT_WORDS, sizeof(CONTEXT_WORDS) / sizeof(CONTEXT_WORDS[0]))) return false;
+      if (inList(word, FILLER_WORDS, sizeof(FILLER_WORDS) / sizeof(FILLER_WORDS[0]))) {
+        len = 0;
+        continue;
+      }
+      // Plural and "what's" -> "what"
+      if (len > 3 && word[len - 1] == 's' && word[len - 2] != 's') word[--len] = '\0';
+    }
+    uint32_t h = fnv1a(2166136261u, word, len);
+    if (number) key->numbers = fnv1a(key->numbers, word, len + 1);
+    // Insert into the sorted set
+    uint8_t at = 0;
+    while (at < key->count && key->words[at] < h) at++;
+    if (at == key->count || key->words[at] != h) {
+      if (key->count >= MAX_WORDS) return false;  // long questions hardly ever repeat
+      memmove(&key->words[at + 1], &key->words[at], (key->count - at) * sizeof(uint32_t));
+      key->words[at] = h;
+      key->count++;
+      if (textLen + len + 2 < QUESTION_CHARS) {
+        if (textLen > 0) text[textLen++] = ' ';
+        memcpy(text + textLen, word, len + 1);
+        textLen += len;
+      }
+    }
+    len = 0;
+  }
+  return key->count >= 2;
+}
+
+// Word-set overlap in percent (intersection over union); 0 if the numbers differ
+static uint8_t similarity(const QuestionKey& a, const QuestionKey& b) {
+  if (a.numbers != b.numbers) return 0;
+  uint8_t i = 0, j = 0, common = 0;
+  while (i < a.count && j < b.count) {
+    if (a.words[i] == b.words[j]) {
+      common++;
+      i++;
+      j++;
+    } else if (a.words[i] < b.words[j]) {
+      i++;
+    } else {
+      j++;
+    }
+  }
+  uint8_t all = a.count + b.count - common;
+  return all ? (uint8_t)(common * 100 / all) : 0;
+}
+
+static void markDirty() {
+  dirty = true;
+  dirtyMs = millis();
+}
+
+static bool expired(const Entry& e, uint32_t now) {
+  return now - e.storedMs > REPLY_CACHE_TTL_MS;
+}
+
+static void loadFromFlash() {
+  if (!SPIFFS.exists(CACHE_PATH)) return;
+  File f = SPIFFS.open(CACHE_PATH, FILE_READ);
+  if (!f) return;
+  FileHeader h;
+  uint32_t now = millis();
+  if (f.read((uint8_t*)&h, sizeof(h)) == sizeof(h) && h.magic == FILE_MAGIC) {
+    for (uint32_t i = 0; i < h.count && i < REPLY_CACHE_ENTRIES; i++) {
+      Entry& e = entries[i];
+      if (f.read((uint8_t*)&e, sizeof(e)) != sizeof(e) || e.replyLength > REPLY_CACHE_MAX_REPLY ||
+          f.read((uint8_t*)replies + i * REPLY_CACHE_MAX_REPLY, e.replyLength) != e.replyLength) {
+        e.used = false;
+        break;
+      }
+      e.storedMs = now - e.storedMs;  // saved as the age
+      if (e.lastUse > useClock) useClock = e.lastUse;
+    }
+  }
+  f.close();
+}
+
+bool replyCacheBegin() {
+  if (entries) return true;
+  size_t entryBytes = sizeof(Entry) * REPLY_CACHE_ENTRIES;
+  size_t replyBytes = (size_t)REPLY_CACHE_MAX_REPLY * REPLY_CACHE_ENTRIES;
+  uint8_t* mem = nullptr;
+  if (psramFound()) mem = (uint8_t*)heap_caps_malloc(entryBytes + replyBytes, MALLOC_CAP_SPIRAM);
+  if (!mem) mem = (uint8_t*)malloc(entryBytes + replyBytes);
+  if (!mem) {
+    Serial.println("Reply cache: alloc failed");
+    return false;
+  }
+  memset(mem, 0, entryBytes);
+  entries = (Entry*)mem;
+  replies = (char*)(mem + entryBytes);
+  cacheMutex = xSemaphoreCreateMutex();
+#if REPLY_CACHE_PERSIST
+  loadFromFlash();
+#endif
+  uint8_t n = 0;
+  for (uint8_t i = 0; i < REPLY_CACHE_ENTRIES; i++) n += entries[i].used;
+  Serial.printf("Reply cache: %u entries\n", (unsigned)n);
+  return true;
+}
+
+bool replyCacheLookup(uint8_t persona, const String& question, String* reply) {
+  if (!entries) return false;
+  uint32_t startUs = micros();
+  QuestionKey key;
+  char text[QUESTION_CHARS];
+  xSemaphoreTake(cacheMutex, portMAX_DELAY);
+  stats.lookups++;
+  if (!questionKey(question, &key, text)) {
+    stats.uncacheable++;
+    xSemaphoreGive(cacheMutex);
+    return false;
+  }
+  uint32_t now = millis();
+  int best = -1;
+  uint8_t bestScore = 0;
+  for (uint8_t i = 0; i < REPLY_CACHE_ENTRIES; i++) {
+    Entry& e = entries[i];
+    if (!e.used || e.persona != persona) continue;
+    if (expired(e, now)) {
+      e.used = false;
+      markDirty();
+      stats.expired++;
+      continue;
+    }
+    uint8_t score = similarity(key, e.key);
+    if (score >= REPLY_CACHE_MATCH_PERCENT && score > bestScore) {
+      best = i;
+      bestScore = score;
+    }
+  }
+  if (best >= 0) {
+    Entry& e = entries[best];
+    reply->remove(0);
+    reply->concat(replies + best * REPLY_CACHE_MAX_REPLY, e.replyLength);
+    e.lastUse = ++useClock;
+    e.hits++;
+    if (bestScore == 100) stats.exactHits++;
+    else stats.fuzzyHits++;
+    stats.savedMs += e.llmMs;
+  }
+  uint32_t us = micros() - startUs;
+  stats.lookupUsTotal += us;
+  if (us > stats.lookupUsMax) stats.lookupUsMax = us;
+  xSemaphoreGive(cacheMutex);
+  if (best >= 0) {
+    Serial.printf("Reply cache: hit (%u%% match, %u us), skipping the LLM (~%u ms)\n",
+                  (unsigned)bestScore, (unsigned)us, (unsigned)entries[best].llmMs);
+  }
+  return best >= 0;
+}
+
+void replyCacheStore(uint8_t persona, const String& question, const String& reply, uint32_t llmMs) {
+  if (!entries || reply.length() == 0 || reply.length() > REPLY_CACHE_MAX_REPLY) return;
+  QuestionKey key;
+  char text[QUESTION_CHARS];
+  if (!questionKey(question, &key, text)) return;
+  xSemaphoreTake(cacheMutex, portMAX_DELAY);
+  // Same question again (e.g. after expiry elsewhere): replace it; else a free slot; else LRU
+  int slot = -1;
+  for (uint8_t i = 0; i < REPLY_CACHE_ENTRIES && slot < 0; i++) {
+    if (entries[i].used && entries[i].persona == persona && similarity(key, entries[i].key) == 100) slot = i;
+  }
+  for (uint8_t i = 0; i < REPLY_CACHE_ENTRIES && slot < 0; i++) {
+    if (!entries[i].used) slot = i;
+  }
+  if (slot < 0) {
+    slot = 0;
+    for (uint8_t i = 1; i < REPLY_CACHE_ENTRIES; i++) {
+      if (entries[i].lastUse < entries[slot].lastUse) slot = i;
+    }
+    stats.evictions++;
+  }
+  Entry& e = entries[slot];
+  e.used = true;
+  e.persona = persona;
+  e.key = key;
+  e.replyLength = reply.length();
+  e.storedMs = millis();
+  e.lastUse = ++useClock;
+  e.llmMs = llmMs;
+  e.hits = 0;
+  memcpy(e.question, text, QUESTION_CHARS);
+  memcpy(replies + slot * REPLY_CACHE_MAX_REPLY, reply.c_str(), e.replyLength);
+  stats.stores++;
+  markDirty();
+  xSemaphoreGive(cacheMutex);
+}
+
+bool replyCacheFlushPending() {
+#if REPLY_CACHE_PERSIST
+  return entries && dirty;
+#else
+  return false;
+#endif
+}
+
+bool replyCacheFlushDue() {
+  return replyCacheFlushPending() && millis() - dirtyMs >= REPLY_CACHE_FLUSH_DELAY_MS;
+}
+
+void replyCacheFlush() {
+#if REPLY_CACHE_PERSIST
+  if (!entries || !dirty) return;
+  unsigned long startMs = millis();
+  xSemaphoreTake(cacheMutex, portMAX_DELAY);
+  File f = SPIFFS.open(CACHE_PATH, FILE_WRITE);
+  if (f) {
+    uint32_t now = millis();
+    uint32_t count = 0;
+    for (uint8_t i = 0; i < REPLY_CACHE_ENTRIES; i++) count += entries[i].used && !expired(entries[i], now);
+    FileHeader h = {FILE_MAGIC, count};
+    f.write((const uint8_t*)&h, sizeof(h));
+    for (uint8_t i = 0; i < REPLY_CACHE_ENTRIES; i++) {
+      if (!entries[i].used || expired(entries[i], now)) continue;
+      Entry e = entries[i];
+      e.storedMs = now - e.storedMs;  // age; millis() restarts with the next boot
+      f.write((const uint8_t*)&e, sizeof(e));
+      f.write((const uint8_t*)replies + i * REPLY_CACHE_MAX_REPLY, e.replyLength);
+    }
+    f.close();
+    dirty = false;
+    uint32_t ms = millis() - startMs;
+    stats.flushes++;
+    if (ms > stats.flushMsMax) stats.flushMsMax = ms;
+  }
+  xSemaphoreGive(cacheMutex);
+#endif
+}
+
+void replyCacheClear() {
+  if (!entries) return;
+  xSemaphoreTake(cacheMutex, portMAX_DELAY);
+  for (uint8_t i = 0; i < REPLY_CACHE_ENTRIES; i++) entries[i].used = false;
+  markDirty();
+  xSemaphoreGive(cacheMutex);
+  replyCacheFlush();
+}
+
+void replyCachePrintStats() {
+  if (!entries) return;
+  CacheStats s = stats;
+  uint32_t hits = s.exactHits + s.fuzzyHits;
+  uint32_t misses = s.lookups - hits - s.uncacheable;
+  uint8_t used = 0;
+  for (uint8_t i = 0; i < REPLY_CACHE_ENTRIES; i++) used += entries[i].used;
+  Serial.println("\n=== Reply cache ===");
+  Serial.printf("  Entries: %u/%u, TTL %lu min, match >= %u%%\n", (unsigned)used,
+                (unsigned)REPLY_CACHE_ENTRIES, (unsigned long)(REPLY_CACHE_TTL_MS / 60000),
+                (unsigned)REPLY_CACHE_MATCH_PERCENT);
+  Serial.printf("  Lookups: %u, hits: %u exact + %u fuzzy (%u%%), misses: %u, not cacheable: %u\n",
+                (unsigned)s.lookups, (unsigned)s.exactHits, (unsigned)s.fuzzyHits,
+                (unsigned)(s.lookups ? hits * 100 / s.lookups : 0), (unsigned)misses,
+                (unsigned)s.uncacheable);
+  Serial.printf("  Lookup: avg %u us, max %u us; LLM time saved: %u ms\n",
+                (unsigned)(s.lookups ? s.lookupUsTotal / s.lookups : 0), (unsigned)s.lookupUsMax,
+                (unsigned)s.savedMs);
+  Serial.printf("  Stores: %u, evictions: %u, expired: %u, flash writes: %u (max %u ms)%s\n",
+                (unsigned)s.stores, (unsigned)s.evictions, (unsigned)s.expired, (unsigned)s.flushes,
+                (unsigned)s.flushMsMax, dirty ? ", unsaved changes" : "");
+  for (uint8_t i = 0; i < REPLY_CACHE_ENTRIES; i++) {
+    const Entry& e = entries[i];
+    if (!e.used) continue;
+    Serial.printf("  p%u %3u hits  %s\n", (unsigned)e.persona, (unsigned)e.hits, e.question);
+  }
+  Serial.println("===================\n");
+}
@@ -0,0 +1,29 @@
+#ifndef AI_RELAY_WEBSOCKET_REPLY_CACHE_H
+#define AI_RELAY_WEBSOCKET_REPLY_CACHE_H
+
+#include <Arduino.h>
+
+// Question -> reply cache, scoped by persona (currentPromptIndex). Questions are
+// normalized to a set of content words (lowercase, no punctuation or filler,
+// plural "s" dropped); a lookup hits when the word sets overlap by at least
+// REPLY_CACHE_MATCH_PERCENT and every number matches. Questions that lean on the
+// conversation ("it", "that", "again", ...) or have fewer than two content words
+// are never cached. Replies live in fixed PSRAM slots, LRU-evicted and expiring
+// after REPLY_CACHE_TTL_MS; with REPLY_CACHE_PERSIST they survive a reboot.
+bool replyCacheBegin();
+
+// Hit: reply gets the cached text.
+bool replyCacheLookup(uint8_t persona, const String& question, String* reply);
+// llmMs: what the LLM took for this reply, reported as saved on later hits.
+void replyCacheStore(uint8_t persona, const String& question, const String& reply, uint32_t llmMs);
+// Write new entries to flash (REPLY_CACHE_PERSIST). Rewrites the whole file, so
+// stores are batched: idle work calls it once replyCacheFlushDue(), i.e.
+// REPLY_CACHE_FLUSH_DELAY_MS after the last change.
+void replyCacheFlush();
+bool replyCacheFlushPending();  // unsaved changes
+bool replyCacheFlushDue();
+
+void replyCacheClear();
+void replyCachePrintStats();
+
+#endif
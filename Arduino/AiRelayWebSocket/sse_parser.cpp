@@ -0,0 +1,67 @@
+#include "sse_parser.h"
+#include <Arduino.h>
+
+SseParser::SseParser(EventCallback onEvent, void* ctx) : onEvent_(onEvent), ctx_(ctx) {
+  reset();
+}
+
+void SseParser::reset() {
+  lineLen_ = 0;
+  lineOverflow_ = false;
+  dataLen_ = 0;
+  sawDoneMarker_ = false;
+  events_ = 0;
+  overflows_ = 0;
+}
+
+void SseParser::feed(const uint8_t* data, size_t len) {
+  for (size_t i = 0; i < len && !sawDoneMarker_; i++) {
+    char c = (char)data[i];
+    if (c == '\n') {
+      handleLine();
+      lineLen_ = 0;
+      lineOverflow_ = false;
+      continue;
+    }
+    if (c == '\r') continue;
+    if (lineLen_ < LINE_MAX_LEN - 1) {
+      line_[lineLen_++] = c;
+    } else if (!lineOverflow_) {
+      lineOverflow_ = true;
+      overflows_++;
+    }
+  }
+}
+
+void SseParser::handleLine() {
+  if (lineOverflow_) return;  // drop truncated line rather than emit broken JSON
+  if (lineLen_ == 0) {
+    dispatch();
+    return;
+  }
+  if (line_[0] == ':') return;  // comment / keep-alive
+  if (lineLen_ < 5 || memcmp(line_, "data:", 5) != 0) return;  // event:, id:, retry: unused
+  size_t start = 5;
+  if (start < lineLen_ && line_[start] == ' ') start++;
+  size_t n = lineLen_ - start;
+  size_t sep = (dataLen_ > 0) ? 1 : 0;
+  if (dataLen_ + sep + n >= LINE_MAX_LEN) {
+    overflows_++;
+    return;
+  }
+  if (sep) data_[dataLen_++] = '\n';
+  memcpy(data_ + dataLen_, line_ + start, n);
+  dataLen_ += n;
+}
+
+void SseParser::dispatch() {
+  if (dataLen_ == 0) return;
+  data_[dataLen_] = '\0';
+  if (dataLen_ == 6 && memcmp(data_, "[DONE]", 6) == 0) {
+    sawDoneMarker_ = true;
+  } else {
+    events_++;
+    if (onEvent_) onEvent_(data_, dataLen_, ctx_);
+  }
+  dataLen_ = 0;
+}
@@ -0,0 +1,44 @@
+#ifndef AI_RELAY_WEBSOCKET_SSE_PARSER_H
+#define AI_RELAY_WEBSOCKET_SSE_PARSER_H
+
+#include <Arduino.h>
+
+// Incremental Server-Sent Events parser (used for streamed LLM responses).
+// Feed body bytes as they arrive (framing already removed by HttpBodyReader);
+// one callback per complete "data:" event.
+class SseParser {
+ public:
+  typedef void (*EventCallback)(const char* data, size_t len, void* ctx);
+
+  static const size_t LINE_MAX_LEN = 1024;
+
+  SseParser(EventCallback onEvent, void* ctx);
+
+  void reset();
+  void feed(const uint8_t* data, size_t len);
+
+  // "data: [DONE]" seen. The end of the body alone (final 0-size chunk, close)
+  // doesn't set it: a stream cut off before the marker is an incomplete reply.
+  bool sawDoneMarker() const { return sawDoneMarker_; }
+  uint32_t eventCount() const { return events_; }
+  uint32_t overflowCount() const { return overflows_; }
+
+ private:
+  void handleLine();
+  void dispatch();
+
+  EventCallback onEvent_;
+  void* ctx_;
+
+  char line_[LINE_MAX_LEN];
+  size_t lineLen_ = 0;
+  bool lineOverflow_ = false;
+  char data_[LINE_MAX_LEN];
+  size_t dataLen_ = 0;
+
+  bool sawDoneMarker_ = false;
+  uint32_t events_ = 0;
+  uint32_t overflows_ = 0;
+};
+
+#endif
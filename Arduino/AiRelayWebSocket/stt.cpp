@@ -1,12 +1,43 @@
 #include "stt.h"
 #include "chat_utils.h"
-#include "tts.h"
+#include "audio_utils.h"
+#include "dialog_task.h"
+#include "net_pool.h"
+#include "http_reader.h"
+#include "mic_capture.h"
+#include "agc.h"
+#include "aec.h"
+#include "vad.h"
+#include "endpointer.h"
+#include "turn_timeline.h"
+#include "uplink_codec.h"
+#include "flac_encoder.h"
 #include "config.h"
 #include "globals.h"
 #include <Arduino.h>
 #include <WebSocketsClient.h>
 #include <ArduinoJson.h>
 #include <driver/i2s.h>
+#include <esp_heap_caps.h>
+
+// WS pump health: time spent inside wsEvent and gaps between ws.loop() calls.
+struct WsPumpStats {
+  uint32_t events;
+  uint32_t dwellMaxUs;
+  uint64_t dwellTotalUs;
+  uint32_t loops;
+  uint32_t gapMaxMs;
+  uint32_t starved;        // gaps longer than WS_STARVATION_MS
+  uint32_t starvedTotalMs;
+};
+
+static WsPumpStats wsStats;
+static unsigned long lastWsLoopMs = 0;
+
+#if ENDPOINT_LOCAL
+static Endpointer endpointer;
+static int lastEndpointTurnOrder = -1;  // format_turns sends end_of_turn twice per turn
+#endif
 
 void handleWsTextMessage(const uint8_t* payload, size_t length) {
   StaticJsonDocument<512> doc;
@@ -19,14 +50,27 @@ void handleWsTextMessage(const uint8_t* payload, size_t length) {
   if (strcmp(type, "Begin") == 0) {
     Serial.print("STT session started: ");
     Serial.println(doc["id"].as<String>());
+#if ENDPOINT_LOCAL
+    endpointer.reset();
+#endif
   } else if (strcmp(type, "Turn") == 0) {
     bool endOfTurn = doc["end_of_turn"] | false;
     String transcript = doc["transcript"].as<String>();
     int turnOrder = doc["turn_order"] | -1;
     if (transcript.length() > 0) {
       if (endOfTurn) {
+        unsigned long speechEndMs = 0;
+#if ENDPOINT_LOCAL
+        if (turnOrder != lastEndpointTurnOrder) speechEndMs = endpointer.lastVoiceMs();
+#endif
         Serial.print("Final: ");
         Serial.println(transcript);
+#if ENDPOINT_LOCAL
+        if (turnOrder != lastEndpointTurnOrder) {
+          endpointer.onEndOfTurn(transcript, millis());
+          lastEndpointTurnOrder = turnOrder;
+        }
+#endif
         String command = "";
         bool shouldSend = false;
         if (requireWakeEndWords) {
@@ -44,34 +88,27 @@ void handleWsTextMessage(const uint8_t* payload, size_t length) {
           command = transcript;
           shouldSend = true;
         }
+        // After a barge-in the cut-off turn is still winding down; this one queues behind it
         if (shouldSend &&
-            !isProcessing &&
             turnOrder != lastTurnOrderHandled &&
             (transcript != lastFinalTranscript || (millis() - lastFinalMs) > 10000)) {
-          isProcessing = true;
-          lastFinalTranscript = transcript;
-          lastFinalMs = millis();
-          lastTurnOrderHandled = turnOrder;
-          ledRecording = false;
-          ledWaiting = true;
-          String reply = getChatResponse(command);
-          if (reply.length() > 0) {
-            Serial.print("AI says: ");
-            Serial.println(reply);
-            if (ttsProvider == TTS_GOOGLE) {
-              speakGoogleTTS(reply);
-            } else {
-              speakGroqTTS(reply);
-            }
+          // LLM + TTS run on the dialog task; this callback returns right away.
+          // False while another turn runs, unless it was barged in on.
+          if (dialogSubmit(command, speechEndMs, true)) {
+            lastFinalTranscript = transcript;
+            lastFinalMs = millis();
+            lastTurnOrderHandled = turnOrder;
+            ledRecording = false;
           }
-          addHistory("user", command);
-          addHistory("assistant", reply);
-          isProcessing = false;
-          ledWaiting = false;
         }
       } else {
         Serial.print("\rPartial: ");
         Serial.print(transcript);
+#if ENDPOINT_LOCAL
+        endpointer.onPartial(transcript, doc["end_of_turn_confidence"] | 0.0f, millis());
+#endif
+        // User is still speaking: open LLM/TTS connections now, off the critical path
+        netPrewarm();
       }
     }
   } else if (strcmp(type, "Termination") == 0) {
@@ -80,11 +117,15 @@ void handleWsTextMessage(const uint8_t* payload, size_t length) {
 }
 
 void wsEvent(WStype_t type, uint8_t* payload, size_t length) {
+  uint32_t startUs = micros();
   switch (type) {
     case WStype_DISCONNECTED:
       wsConnected = false;
       ledRecording = false;
       ledWaiting = false;
+#if ENDPOINT_LOCAL
+      endpointer.reset();
+#endif
       Serial.println("WS disconnected");
       break;
     case WStype_CONNECTED:
@@ -113,11 +154,155 @@ void wsEvent(WStype_t type, uint8_t* payload, size_t length) {
       Serial.printf("WS event: %d\n", type);
       break;
   }
+  uint32_t dwellUs = micros() - startUs;
+  wsStats.events++;
+  wsStats.dwellTotalUs += dwellUs;
+  if (dwellUs > wsStats.dwellMaxUs) wsStats.dwellMaxUs = dwellUs;
+}
+
+void wsPump() {
+  unsigned long now = millis();
+  if (lastWsLoopMs != 0) {
+    uint32_t gap = now - lastWsLoopMs;
+    if (gap > wsStats.gapMaxMs) wsStats.gapMaxMs = gap;
+    if (gap > WS_STARVATION_MS) {
+      wsStats.starved++;
+      wsStats.starvedTotalMs += gap;
+    }
+  }
+  wsStats.loops++;
+  ws.loop();
+  lastWsLoopMs = millis();
+}
+
+void wsResetPumpClock() {
+  lastWsLoopMs = 0;
+}
+
+void wsPrintStats() {
+  WsPumpStats s = wsStats;
+  Serial.println("\n=== WebSocket pump ===");
+  Serial.printf("  Events: %u, callback dwell avg %u us, max %u us\n", (unsigned)s.events,
+                (unsigned)(s.events ? s.dwellTotalUs / s.events : 0), (unsigned)s.dwellMaxUs);
+  Serial.printf("  ws.loop() calls: %u, max gap %u ms, starved %u time(s) (> %u ms, %u ms total)\n",
+                (unsigned)s.loops, (unsigned)s.gapMaxMs, (unsigned)s.starved,
+                (unsigned)WS_STARVATION_MS, (unsigned)s.starvedTotalMs);
+  Serial.println("======================\n");
+}
+
+static MicReader wsMicReader;
+
+#if VAD_GATE_UPLINK
+// Uplink gating: a second reader runs the VAD over 10 ms blocks ahead of the WS reader.
+struct UplinkStats {
+  uint32_t blocks;
+  uint32_t speechBlocks;   // raw per-block decisions
+  uint32_t bursts;         // gate openings
+  uint32_t keepalives;
+  uint64_t bytesSent;
+  uint64_t bytesSaved;     // audio skipped instead of streamed
+  uint32_t bargeIns;       // replies cut off by speech
+  unsigned long sinceMs;
+};
+
+static MicReader vadMicReader;
+static Vad uplinkVad;
+static UplinkStats upStats;
+static unsigned long lastVoiceMs = 0;      // last block with the VAD active (0 = none yet)
+static unsigned long lastUplinkSendMs = 0;  // frames and keepalives
+#endif
+
+// Send one frame (encoded in place to the wire format); returns its mean |sample|
+// (used for LED / debug output).
+static uint32_t sendMicFrame(int16_t* pcm, int samples) {
+  uint32_t avg_abs = pcmMeanAbs(pcm, samples);
+  bool isVoice = avg_abs >= silenceThreshold;
+  size_t bytes = uplinkEncode(pcm, samples);
+  bool sent = ws.sendBIN((uint8_t*)pcm, bytes);
+  lastMicSendMs = millis();
+#if VAD_GATE_UPLINK
+  lastUplinkSendMs = lastMicSendMs;
+  upStats.bytesSent += bytes;
+#endif
+  static unsigned long lastVoiceDebugMs = 0;
+  static int sendFailCount = 0;
+  if (!sent) sendFailCount++;
+  if (isVoice && millis() - lastVoiceDebugMs > 1000) {
+    Serial.printf("Voice detected (level: %u) - WS send: %s (fails: %d)\n",
+                  avg_abs, sent ? "OK" : "FAIL", sendFailCount);
+    lastVoiceDebugMs = millis();
+    sendFailCount = 0;
+  }
+  return avg_abs;
+}
+
+// Ask the server to finalize the turn now if the local endpointer is confident.
+static void checkEndpoint() {
+#if ENDPOINT_LOCAL
+  if (endpointer.shouldForce(millis())) {
+    ws.sendTXT("{\"type\":\"ForceEndpoint\"}");
+    Serial.println("\nEndpoint: forcing end of turn");
+  }
+#endif
+}
+
+#if VAD_GATE_UPLINK
+// Keep only the pre-roll behind the audio the VAD has analysed; the rest is never sent.
+static void keepPrerollOnly() {
+  uint32_t behind = vadMicReader.pos - wsMicReader.pos;
+  uint32_t preroll = MIC_FRAME_SAMPLES(VAD_PREROLL_MS);
+  if (behind > preroll) {
+    micReaderAdvance(&wsMicReader, behind - preroll);
+    upStats.bytesSaved += uplinkBytes(behind - preroll);
+  }
+}
+#endif
+
+#if BARGE_IN && ECHO_CANCEL && VAD_GATE_UPLINK
+// While a turn runs nothing is sent, but the VAD keeps listening to the
+// echo-cancelled mic. Speech that also stays above the predicted echo for
+// BARGE_IN_MS cuts the reply off and the uplink opens with its pre-roll.
+static void watchForBargeIn() {
+  int16_t block[MIC_BLOCK_SAMPLES];
+  uint32_t waitMs = 2 * MIC_BLOCK_MS;
+  while (micReadFrame(&vadMicReader, block, MIC_BLOCK_SAMPLES, nullptr, waitMs)) {
+    waitMs = 0;
+    uplinkVad.process(block, MIC_BLOCK_SAMPLES);
+  }
+  keepPrerollOnly();
+  if (uplinkVad.active() && aecNearEndMs() >= BARGE_IN_MS && dialogCancelTurn()) {
+    upStats.bargeIns++;
+    lastVoiceMs = millis();
+    Serial.println("\nBarge-in: reply cut off");
+  }
+}
+#endif
+
+static void skipMic() {
+  micReaderSkip(&wsMicReader);
+#if VAD_GATE_UPLINK
+  micReaderSkip(&vadMicReader);
+  uplinkVad.pause();
+  lastVoiceMs = 0;
+#endif
 }
 
 void streamMicFrame() {
-  if (!wsConnected) return;
+  static bool readerAttached = false;
+  if (!readerAttached) {
+    micReaderAttach(&wsMicReader, "ws");
+#if VAD_GATE_UPLINK
+    micReaderAttach(&vadMicReader, "vad");
+    upStats.sinceMs = millis();
+#endif
+    readerAttached = true;
+  }
+  if (!wsConnected) {
+    skipMic();
+    return;
+  }
   if (!listeningEnabled) {
+    skipMic();
     ledRecording = false;
     ledWaiting = false;
     static unsigned long lastMutedPrintMs = 0;
@@ -127,97 +312,357 @@ void streamMicFrame() {
     }
     return;
   }
+#if BARGE_IN && ECHO_CANCEL && VAD_GATE_UPLINK
+  // No cooldown: the echo canceller keeps our own voice out of the VAD
+  if ((isProcessing || ttsPlaying) && !dialogTurnCancelled()) {
+    watchForBargeIn();
+    ledRecording = false;
+    ledWaiting = true;
+    return;
+  }
+#else
   if (isProcessing || ttsPlaying || millis() < ttsCooldownUntilMs) {
+    // Audio captured while we talk is dropped, not sent late
+    skipMic();
     ledRecording = false;
     ledWaiting = true;
+    delay(5);  // no mic read to block on; don't spin while the dialog task works
     return;
   }
-  size_t bytes_read = 0;
-  i2s_read(I2S_NUM_0, mic_buffer, sizeof(mic_buffer), &bytes_read, pdMS_TO_TICKS(250));
-  if (bytes_read == 0) return;
-  int samples_read = bytes_read / 4;
-  if (samples_read <= 0) return;
-  uint64_t sum_abs = 0;
-  for (int i = 0; i < samples_read; i++) {
-    int16_t sample = (int16_t)(mic_buffer[i] >> 14);
-    pcm_frame[i] = sample;
-    sum_abs += abs(sample);
-  }
-  uint32_t avg_abs = (samples_read > 0) ? (uint32_t)(sum_abs / samples_read) : 0;
-  bool isVoice = avg_abs >= silenceThreshold;
+#endif
+#if VAD_GATE_UPLINK
+  // Run the VAD over everything captured so far (waits for the first block)
+  int16_t block[MIC_BLOCK_SAMPLES];
+  uint32_t waitMs = 2 * MIC_BLOCK_MS;
+  while (micReadFrame(&vadMicReader, block, MIC_BLOCK_SAMPLES, nullptr, waitMs)) {
+    waitMs = 0;
+    bool wasActive = uplinkVad.active();
+    if (uplinkVad.process(block, MIC_BLOCK_SAMPLES)) {
+      upStats.speechBlocks++;
+#if ENDPOINT_LOCAL
+      endpointer.onVoice(millis());
+#endif
+    }
+    upStats.blocks++;
+    if (uplinkVad.active()) {
+      if (!wasActive) upStats.bursts++;
+      lastVoiceMs = millis();
+    }
+  }
+  uplinkVad.setMinLevel(silenceThreshold);
+  ledRecording = uplinkVad.active();
+  if (ledRecording) {
+    ledWaiting = false;
+  }
+
+  bool gateOpen = lastVoiceMs != 0 && millis() - lastVoiceMs < VAD_TRAILING_MS;
+  if (!gateOpen) {
+    keepPrerollOnly();
+    // Occasional silence so the session isn't closed for inactivity. Doesn't touch
+    // lastMicSendMs: that would make the loop's "audio but no reply" reconnect fire.
+    if (millis() - lastUplinkSendMs >= VAD_KEEPALIVE_MS) {
+      int n = MIC_FRAME_SAMPLES(VAD_KEEPALIVE_FRAME_MS);
+      memset(pcm_frame, 0, n * sizeof(int16_t));
+      ws.sendBIN((uint8_t*)pcm_frame, uplinkEncode(pcm_frame, n));
+      lastUplinkSendMs = millis();
+      upStats.keepalives++;
+    }
+    return;
+  }
+  // Stream only audio the VAD has already seen, in FRAME_MS frames
+  while (vadMicReader.pos - wsMicReader.pos >= (uint32_t)FRAME_SAMPLES) {
+    if (!micReadFrame(&wsMicReader, pcm_frame, FRAME_SAMPLES, nullptr, 0)) break;
+    sendMicFrame(pcm_frame, FRAME_SAMPLES);
+  }
+  checkEndpoint();
+#else
+  if (!micReadFrame(&wsMicReader, pcm_frame, FRAME_SAMPLES, nullptr, 2 * MIC_BLOCK_MS)) return;
+  bool isVoice = sendMicFrame(pcm_frame, FRAME_SAMPLES) >= (uint32_t)silenceThreshold;
   ledRecording = isVoice;
   if (isVoice) {
     ledWaiting = false;
+#if ENDPOINT_LOCAL
+    endpointer.onVoice(millis());
+#endif
   }
-  bool sent = ws.sendBIN((uint8_t*)pcm_frame, samples_read * 2);
-  lastMicSendMs = millis();
-  static unsigned long lastVoiceDebugMs = 0;
-  static int sendFailCount = 0;
-  if (!sent) sendFailCount++;
-  if (isVoice && millis() - lastVoiceDebugMs > 1000) {
-    Serial.printf("Voice detected (level: %u) - WS send: %s (fails: %d)\n",
-                  avg_abs, sent ? "OK" : "FAIL", sendFailCount);
-    lastVoiceDebugMs = millis();
-    sendFailCount = 0;
+  checkEndpoint();
+#endif
+}
+
+bool sttSpeechActive() {
+#if VAD_GATE_UPLINK
+  unsigned long last = lastVoiceMs;
+  return last != 0 && millis() - last < VAD_TRAILING_MS;
+#else
+  return ledRecording;  // last frame over the silence threshold
+#endif
+}
+
+void uplinkPrintStats() {
+#if VAD_GATE_UPLINK
+  UplinkStats s = upStats;
+  unsigned long elapsedMs = millis() - s.sinceMs;
+  uint64_t total = s.bytesSent + s.bytesSaved;
+  Serial.println("\n=== Uplink VAD ===");
+  Serial.printf("  Blocks: %u, speech: %u, bursts: %u, active now: %s (SNR %d/256 log2, floor %d)\n",
+                (unsigned)s.blocks, (unsigned)s.speechBlocks, (unsigned)s.bursts,
+                uplinkVad.active() ? "yes" : "no", (int)uplinkVad.snrQ8(), (int)uplinkVad.floorQ8());
+  Serial.printf("  Sent: %u KB, skipped: %u KB (%u%% of captured), keepalives: %u\n",
+                (unsigned)(s.bytesSent / 1024), (unsigned)(s.bytesSaved / 1024),
+                (unsigned)(total ? s.bytesSaved * 100 / total : 0), (unsigned)s.keepalives);
+#if BARGE_IN && ECHO_CANCEL
+  Serial.printf("  Barge-ins: %u\n", (unsigned)s.bargeIns);
+#endif
+  if (elapsedMs > 0) {
+    Serial.printf("  Uplink saved: %u KB/hour over %lu s\n",
+                  (unsigned)(s.bytesSaved * 3600000ULL / elapsedMs / 1024), elapsedMs / 1000);
   }
+  uplinkCodecPrintStats();
+  Serial.println("==================\n");
+#else
+  Serial.println("Uplink VAD disabled (VAD_GATE_UPLINK 0)");
+  uplinkCodecPrintStats();
+#endif
+#if ENDPOINT_LOCAL
+  endpointer.printStats();
+#endif
 }
 
-String transcribeAudio(int dataLength) {
-  Serial.println("Sending to Groq (STT)...");
-  client.setTimeout(15000);
-  client.setInsecure();
-  if (!client.connect("api.groq.com", 443)) {
-    Serial.println("Connection failed");
+// Parses a Whisper response in place (only "text" is kept). keepAlive is set
+// when the whole body was read and the server didn't ask to close. status < 0:
+// no response at all (e.g. a kept-alive connection the server had closed).
+static String readTranscriptResponse(WiFiClientSecure& client, bool* keepAlive, int* status) {
+  HttpBodyReader body(&client, 10000);
+  *status = body.readHeaders();
+  *keepAlive = false;
+  if (*status != 200) {
+    if (*status >= 0) Serial.printf("STT HTTP error: %d\n", *status);
     return "";
   }
-  String boundary = "------------------------ESP32Bound";
-  String head = "--" + boundary + "\r\nContent-Disposition: form-data; name=\"file\"; filename=\"audio.wav\"\r\nContent-Type: audio/wav\r\n\r\n";
-  String tail = "\r\n--" + boundary + "--\r\n";
-  String modelParam = "--" + boundary + "\r\nContent-Disposition: form-data; name=\"model\"\r\n\r\n" + stt_model + "\r\n";
-  int contentLength = head.length() + dataLength + tail.length() + modelParam.length();
-  client.println("POST /openai/v1/audio/transcriptions HTTP/1.1");
-  client.println("Host: api.groq.com");
-  client.println("Authorization: Bearer " + String(groq_api_key));
-  client.println("Content-Type: multipart/form-data; boundary=" + boundary);
-  client.print("Content-Length: ");
-  client.println(contentLength);
-  client.println();
-  client.print(modelParam);
-  client.print(head);
-  uint8_t* fb = recording_buffer;
-  int chunk = 1024;
-  for (int i = 0; i < dataLength; i += chunk) {
-    if (i + chunk > dataLength) chunk = dataLength - i;
-    client.write(fb + i, chunk);
-  }
-  client.print(tail);
-  String response = "";
-  bool headerEnd = false;
-  unsigned long startRead = millis();
-  while (client.connected() && millis() - startRead < 10000) {
-    while (client.available()) {
-      char c = client.read();
-      if (!headerEnd) {
-        if (c == '{') {
-          headerEnd = true;
-          response += c;
-        }
-      } else {
-        response += c;
-      }
-      startRead = millis();
-    }
-    delay(10);
+  static JsonDocument filter;
+  if (filter.isNull()) {
+    filter["text"] = true;
   }
-  client.stop();
-  int jsonStart = response.indexOf("{");
-  if (jsonStart == -1 && response.length() > 0 && response[0] == '{') jsonStart = 0;
-  if (jsonStart == -1) {
-    Serial.println("Failed to find JSON in response");
+  JsonDocument doc;
+  DeserializationError err = deserializeJson(doc, body, DeserializationOption::Filter(filter));
+  body.skipRest();
+  *keepAlive = body.complete() && !body.closeAfter();
+  if (err) {
+    Serial.printf("STT: bad JSON response (%s)\n", err.c_str());
     return "";
   }
-  String jsonStr = response.substring(jsonStart);
-  JsonDocument doc;
-  deserializeJson(doc, jsonStr);
   return doc["text"].as<String>();
 }
+
+static const char* STT_BOUNDARY = "------------------------ESP32Bound";
+
+static String sttModelPart() {
+  return String("--") + STT_BOUNDARY + "\r\nContent-Disposition: form-data; name=\"model\"\r\n\r\n" + stt_model + "\r\n";
+}
+
+static String sttFileHead(bool flac) {
+  return String("--") + STT_BOUNDARY + "\r\nContent-Disposition: form-data; name=\"file\"; filename=\"audio." +
+         (flac ? "flac" : "wav") + "\"\r\nContent-Type: audio/" + (flac ? "flac" : "wav") + "\r\n\r\n";
+}
+
+static String sttTail() {
+  return String("\r\n--") + STT_BOUNDARY + "--\r\n";
+}
+
+static String sttRequestHead(const char* framing) {
+  return String("POST /openai/v1/audio/transcriptions HTTP/1.1\r\nHost: api.groq.com\r\nAuthorization: Bearer ") +
+         groq_api_key + "\r\nContent-Type: multipart/form-data; boundary=" + STT_BOUNDARY + "\r\n" + framing +
+         "\r\n\r\n";
+}
+
+static bool writeString(WiFiClientSecure& client, const String& s) {
+  return client.write((const uint8_t*)s.c_str(), s.length()) == s.length();
+}
+
+// Known length: WAV with Content-Length. A kept-alive connection that turns out
+// to be closed is retried once on a fresh one; the recording is still in memory.
+static String transcribeWav(int dataLength) {
+  String head = sttFileHead(false);
+  String tail = sttTail();
+  String modelParam = sttModelPart();
+  int contentLength = head.length() + dataLength + tail.length() + modelParam.length();
+  String request = sttRequestHead((String("Content-Length: ") + contentLength).c_str()) + modelParam + head;
+  for (int attempt = 0; attempt < 2; attempt++) {
+    NetLease lease;
+    if (!netAcquire(NET_HOST_GROQ, &lease)) {
+      Serial.println("Connection failed");
+      return "";
+    }
+    WiFiClientSecure& client = netClient(lease);
+    client.setTimeout(15000);
+    bool sent = writeString(client, request) &&
+                client.write(recording_buffer, dataLength) == (size_t)dataLength &&
+                writeString(client, tail);
+    bool keepAlive = false;
+    int status = -1;
+    String text = sent ? readTranscriptResponse(client, &keepAlive, &status) : "";
+    netRelease(&lease, keepAlive);
+    if (status >= 0 || !lease.reused) return text;
+    Serial.println("STT: kept-alive connection was closed, reconnecting");
+  }
+  return "";
+}
+
+String transcribeAudio(int dataLength) {
+  Serial.println("Sending to Groq (STT)...");
+#if STT_UPLOAD_FLAC
+  // FLAC size isn't known before encoding: chunked, like the streaming upload
+  SttUpload upload;
+  if (sttUploadBegin(&upload)) {
+    sttUploadWrite(&upload, recording_buffer + headerSize, dataLength - headerSize);
+    return sttUploadFinish(&upload);
+  }
+  if (upload.encoderReady) return "";
+  Serial.println("STT: no FLAC encoder, sending WAV");
+#endif
+  return transcribeWav(dataLength);
+}
+
+// One HTTP/1.1 chunk: hex size line, data, CRLF.
+static bool writeChunk(WiFiClientSecure& client, const uint8_t* data, size_t len) {
+  if (len == 0) return true;
+  char sizeLine[12];
+  int n = snprintf(sizeLine, sizeof(sizeLine), "%X\r\n", (unsigned)len);
+  return client.write((const uint8_t*)sizeLine, n) == (size_t)n &&
+         client.write(data, len) == len &&
+         client.write((const uint8_t*)"\r\n", 2) == 2;
+}
+
+static bool writeChunk(WiFiClientSecure& client, const String& s) {
+  return writeChunk(client, (const uint8_t*)s.c_str(), s.length());
+}
+
+#if STT_UPLOAD_STREAMING && !STT_UPLOAD_FLAC
+#error "STT_UPLOAD_STREAMING needs STT_UPLOAD_FLAC: a streamed WAV has no length to announce"
+#endif
+
+// Copy of the FLAC stream sent on a kept-alive connection, so the request can be
+// replayed on a fresh one when the server had already closed it (the write or the
+// response then fails). Allocated in PSRAM on the first reused connection.
+static uint8_t* replayBuf = nullptr;
+
+static void replayKeep(SttUpload* up, const uint8_t* data, size_t len) {
+  if (!up->replayable) return;
+  if (up->replayLen + len > STT_REPLAY_BYTES) {
+    Serial.println("STT upload: replay copy full, a closed connection can't be retried");
+    up->replayable = false;
+    return;
+  }
+  memcpy(replayBuf + up->replayLen, data, len);
+  up->replayLen += len;
+}
+
+// Request line, headers and the multipart head, as one chunked request.
+static bool writeUploadHead(WiFiClientSecure& client) {
+  return writeString(client, sttRequestHead("Transfer-Encoding: chunked")) &&
+         writeChunk(client, sttModelPart() + sttFileHead(true));
+}
+
+// The reused connection was dead: open a fresh one and resend the stream so far.
+static bool reconnectUpload(SttUpload* up) {
+  if (!up->replayable || up->retried) return false;
+  up->retried = true;
+  up->replayable = false;
+  Serial.println("STT upload: kept-alive connection was closed, reconnecting");
+  netRelease(&up->lease, false);
+  if (!netAcquire(NET_HOST_GROQ, &up->lease)) {
+    Serial.println("STT upload: reconnect failed");
+    return false;
+  }
+  WiFiClientSecure& client = netClient(up->lease);
+  client.setTimeout(15000);
+  return writeUploadHead(client) && writeChunk(client, replayBuf, up->replayLen);
+}
+
+static bool writeFlacFrame(const uint8_t* frame, size_t len, void* ctx) {
+  SttUpload* up = (SttUpload*)ctx;
+  replayKeep(up, frame, len);
+  if (!writeChunk(netClient(up->lease), frame, len) && !reconnectUpload(up)) return false;
+  up->sentBytes += len;
+  return true;
+}
+
+bool sttUploadBegin(SttUpload* up) {
+  up->open = false;
+  up->failed = false;
+  up->replayable = false;
+  up->retried = false;
+  up->audioBytes = 0;
+  up->sentBytes = 0;
+  up->replayLen = 0;
+  up->startMs = millis();
+  uint8_t header[FLAC_HEADER_BYTES];
+  size_t headerLen = flacStreamBegin(header);
+  up->encoderReady = headerLen > 0;
+  if (!up->encoderReady) {
+    // The length is unknown until speech ends, so only FLAC can be streamed
+    Serial.println("STT upload: FLAC encoder not available");
+    return false;
+  }
+  if (!netAcquire(NET_HOST_GROQ, &up->lease)) {
+    Serial.println("STT upload: connection failed");
+    return false;
+  }
+  if (up->lease.reused) {
+    if (!replayBuf && psramFound()) replayBuf = (uint8_t*)heap_caps_malloc(STT_REPLAY_BYTES, MALLOC_CAP_SPIRAM);
+    up->replayable = replayBuf != nullptr;
+  }
+  replayKeep(up, header, headerLen);
+  up->sentBytes = headerLen;
+  WiFiClientSecure& client = netClient(up->lease);
+  client.setTimeout(15000);
+  if (!(writeUploadHead(client) && writeChunk(client, header, headerLen)) && !reconnectUpload(up)) {
+    Serial.println("STT upload: header write failed");
+    netRelease(&up->lease, false);
+    return false;
+  }
+  up->open = true;
+  Serial.printf("STT upload: streaming (connect %u ms, %s)\n", (unsigned)up->lease.connectMs,
+                up->lease.reused ? "reused" : up->retried ? "reconnected" : "new handshake");
+  return true;
+}
+
+bool sttUploadWrite(SttUpload* up, const uint8_t* pcm, size_t len) {
+  if (!up->open || up->failed) return false;
+  if (!flacEncode((const int16_t*)pcm, len / 2, writeFlacFrame, up)) {
+    Serial.println("STT upload: write failed");
+    up->failed = true;
+    return false;
+  }
+  up->audioBytes += len;
+  return true;
+}
+
+static bool writeUploadEnd(WiFiClientSecure& client) {
+  return writeChunk(client, sttTail()) && client.write((const uint8_t*)"0\r\n\r\n", 5) == 5;
+}
+
+String sttUploadFinish(SttUpload* up) {
+  if (!up->open) return "";
+  up->open = false;
+  String text = "";
+  bool keepAlive = false;
+  if (!up->failed && !flacStreamFinish(writeFlacFrame, up)) up->failed = true;
+  if (!up->failed && !writeUploadEnd(netClient(up->lease))) {
+    up->failed = !(reconnectUpload(up) && writeUploadEnd(netClient(up->lease)));
+  }
+  if (!up->failed) {
+    unsigned long sentMs = millis();
+    int status = -1;
+    text = readTranscriptResponse(netClient(up->lease), &keepAlive, &status);
+    if (status < 0 && reconnectUpload(up) && writeUploadEnd(netClient(up->lease))) {
+      text = readTranscriptResponse(netClient(up->lease), &keepAlive, &status);
+    }
+    if (status < 0) Serial.println("STT upload: no response");
+    Serial.printf("STT upload: %u KB audio as %u KB FLAC, last chunk -> transcript %lu ms%s\n",
+                  (unsigned)(up->audioBytes / 1024), (unsigned)(up->sentBytes / 1024), millis() - sentMs,
+                  up->retried ? " (resent on a new connection)" : "");
+  }
+  netRelease(&up->lease, keepAlive);
+  return text;
+}
@@ -3,10 +3,40 @@
 
 #include <Arduino.h>
 #include <WebSocketsClient.h>
+#include "net_pool.h"
 
 void handleWsTextMessage(const uint8_t* payload, size_t length);
 void wsEvent(WStype_t type, uint8_t* payload, size_t length);
+// ws.loop() wrapper that tracks gaps between calls (WS starvation).
+void wsPump();
+void wsResetPumpClock();
+void wsPrintStats();
 void streamMicFrame();
+// VAD gating of the WS uplink (bursts, bytes sent / skipped) and local endpointing.
+void uplinkPrintStats();
+// The mic hears the user now (uplink VAD, with its trailing hangover). Any task.
+bool sttSpeechActive();
 String transcribeAudio(int dataLength);
 
+// Whisper upload streamed with Transfer-Encoding: chunked while the user speaks:
+// begin at speech onset, write PCM as it is captured, finish at speech end.
+// The PCM is encoded to FLAC frames on the way out (the length isn't known up
+// front, so there is no WAV variant). On a reused connection the stream is also
+// copied to PSRAM and resent once on a fresh connection if the old one was dead.
+struct SttUpload {
+  NetLease lease;
+  bool open;
+  bool failed;
+  bool encoderReady;    // false: no FLAC encoder buffers, nothing was sent
+  bool replayable;      // replay copy is complete so far
+  bool retried;
+  uint32_t audioBytes;  // PCM written
+  uint32_t sentBytes;   // FLAC bytes sent
+  uint32_t replayLen;
+  unsigned long startMs;
+};
+bool sttUploadBegin(SttUpload* up);
+bool sttUploadWrite(SttUpload* up, const uint8_t* pcm, size_t len);
+String sttUploadFinish(SttUpload* up);
+
 #endif
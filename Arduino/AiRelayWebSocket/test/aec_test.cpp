@@ -0,0 +1,174 @@
+// Echo canceller (aec.cpp) on a simulated speaker-to-mic path: convergence,
+// delay search, double talk, and the CPU per block behind AEC_BUDGET_US.
+// Built from the source so the delay estimate and stats are reachable.
+#include "../aec.cpp"
+#include "host_test.h"
+#include <math.h>
+#include <vector>
+
+static const uint32_t OUT_RATE = 24000;   // TTS rate the audio out task plays at
+static const uint32_t OUT_BLOCK = OUT_RATE * MIC_BLOCK_MS / 1000;
+
+// Far end at 24 kHz: five harmonics with a wobbling pitch plus breath noise,
+// gated by a 3.1 Hz syllable envelope; or steady speech-band noise.
+static std::vector<int16_t> farEnd(HostRng& rng, uint32_t seconds, bool steady) {
+  std::vector<int16_t> out(OUT_RATE * seconds);
+  double history[8] = {};
+  double boxcar = 0;
+  for (size_t i = 0; i < out.size(); i++) {
+    double t = (double)i / OUT_RATE;
+    double noise = rng.unit() * 2 - 1;
+    double v, env;
+    if (steady) {
+      // 8-sample moving average: noise across the speech band, first null at 3 kHz
+      env = 1;
+      boxcar += noise - history[i % 8];
+      history[i % 8] = noise;
+      v = boxcar / 3;
+    } else {
+      env = fmax(0, sin(2 * M_PI * 3.1 * t)) * fmax(0.2, sin(2 * M_PI * 0.37 * t));
+      v = noise / 3;
+      for (int k = 1; k < 6; k++) v += sin(2 * M_PI * (140 * k + 30 * sin(t)) * t) / k;
+    }
+    out[i] = (int16_t)(6000 * env * v);
+  }
+  return out;
+}
+
+struct Segment {
+  const char* name;
+  uint32_t seconds;
+  uint32_t delayMs;    // loudspeaker output -> mic, as the mic sees it
+  bool noise;          // steady noise instead of syllables
+  int nearStartMs;     // near-end talker for one second from here (-1 = none)
+};
+
+struct SegmentResult {
+  double erleDb;          // after the first 3 s, far end only
+  double nearKeptDb;      // near-end talker out vs in (0 = untouched)
+  uint32_t nearEndMaxMs;  // longest near-end run while the talker speaks
+  uint32_t falseBargeIns; // blocks over BARGE_IN_MS while only the far end plays
+  int delayErrorMs;       // estimated bulk delay vs the simulated one
+};
+
+static uint32_t micPosition = 0;
+
+// Mic = far end through delay + a short room response + the near-end talker +
+// noise. The audio out task hands each 10 ms to aecReference() after the mic
+// block, as on the device, so the reference is anchored one block late.
+static SegmentResult runSegment(HostRng& rng, const Segment& seg) {
+  std::vector<int16_t> far = farEnd(rng, seg.seconds, seg.noise);
+  std::vector<double> far16(SAMPLE_RATE * seg.seconds);
+  for (size_t i = 0; i < far16.size(); i++) {
+    double p = i * (double)OUT_RATE / SAMPLE_RATE;
+    size_t a = (size_t)p;
+    double f = p - a;
+    far16[i] = a + 1 < far.size() ? far[a] * (1 - f) + far[a + 1] * f : 0;
+  }
+  static const double room[5] = {0.6, -0.3, 0.2, 0.1, -0.05};
+  const long delay = seg.delayMs * SAMPLE_RATE / 1000;
+  const long nearFrom = seg.nearStartMs < 0 ? -1 : (long)seg.nearStartMs * SAMPLE_RATE / 1000;
+  const long nearTo = nearFrom + SAMPLE_RATE;
+
+  SegmentResult r = {};
+  double echoIn = 0, echoOut = 0, nearIn = 0, nearOut = 0;
+  aecReferenceBreak();
+  size_t outPos = 0;
+  uint32_t blocks = SAMPLE_RATE * seg.seconds / MIC_BLOCK_SAMPLES;
+  for (uint32_t b = 0; b < blocks; b++) {
+    int16_t block[MIC_BLOCK_SAMPLES];
+    double blockNear = 0, blockIn = 0;
+    bool nearBlock = false;
+    for (uint32_t n = 0; n < MIC_BLOCK_SAMPLES; n++) {
+      long i = (long)b * MIC_BLOCK_SAMPLES + n;
+      double y = 0;
+      for (int k = 0; k < 5; k++) {
+        long j = i - delay - k * 7;
+        if (j >= 0) y += room[k] * far16[j];
+      }
+      double nearV = 0;
+      if (nearFrom >= 0 && i >= nearFrom && i < nearTo) {
+        nearV = 3000 * sin(2 * M_PI * 220 * i / SAMPLE_RATE) * (0.5 + 0.5 * sin(2 * M_PI * 4 * i / SAMPLE_RATE));
+        nearBlock = true;
+      }
+      y += nearV + (rng.unit() * 100 - 50);
+      block[n] = (int16_t)fmax(-32768, fmin(32767, y));
+      blockNear += nearV * nearV;
+      blockIn += (double)block[n] * block[n];
+    }
+    aecProcess(block, micPosition);
+    double blockOut = 0;
+    for (uint32_t n = 0; n < MIC_BLOCK_SAMPLES; n++) blockOut += (double)block[n] * block[n];
+    uint32_t nearEndMs = aecNearEndMs();
+    if (nearBlock) {
+      nearIn += blockNear;
+      nearOut += blockOut;
+      if (nearEndMs > r.nearEndMaxMs) r.nearEndMaxMs = nearEndMs;
+    } else if (b * MIC_BLOCK_MS >= 3000) {
+      // Only blocks the near-end talker doesn't reach, hold included
+      bool afterNear = nearFrom >= 0 && b * MIC_BLOCK_SAMPLES < (uint32_t)(nearTo + SAMPLE_RATE / 2) &&
+                       b * MIC_BLOCK_SAMPLES >= (uint32_t)nearFrom;
+      if (!afterNear) {
+        echoIn += blockIn;
+        echoOut += blockOut;
+        if (nearEndMs >= BARGE_IN_MS) r.falseBargeIns++;
+      }
+    }
+    micPosition += MIC_BLOCK_SAMPLES;
+    aecReference(&far[outPos], OUT_BLOCK, OUT_RATE, 1);
+    outPos += OUT_BLOCK;
+  }
+  r.erleDb = 10 * log10((echoIn + 1) / (echoOut + 1));
+  r.nearKeptDb = nearIn > 0 ? 10 * log10(nearOut / nearIn) : 0;
+  // Reference is anchored at the next mic block: one block less delay to find
+  int estimatedMs = lag >= 0 ? (int)(lag * ENV_SUB * 1000 / SAMPLE_RATE) : -1;
+  r.delayErrorMs = estimatedMs - (int)(seg.delayMs - MIC_BLOCK_MS);
+  return r;
+}
+
+// One second with nothing playing, as between replies.
+static void idle(HostRng& rng) {
+  for (uint32_t b = 0; b < 1000 / MIC_BLOCK_MS; b++) {
+    int16_t block[MIC_BLOCK_SAMPLES];
+    for (uint32_t n = 0; n < MIC_BLOCK_SAMPLES; n++) block[n] = (int16_t)(rng.unit() * 100 - 50);
+    aecProcess(block, micPosition);
+    micPosition += MIC_BLOCK_SAMPLES;
+  }
+}
+
+int main(int argc, char** argv) {
+  bool bench = argc > 1 && strcmp(argv[1], "--bench") == 0;
+  hostSerialQuiet = !bench;
+  CHECK(aecBegin());
+  HostRng rng(2024);
+  // In sequence, like replies on the device: the filter and delay carry over
+  const Segment segments[] = {
+      {"speech, 150 ms", 8, 150, false, -1},
+      {"speech, 150 ms, near-end talk at 5 s", 8, 150, false, 5000},
+      {"speech, 300 ms (new delay)", 8, 300, false, -1},
+      {"speech, 60 ms (new delay)", 8, 60, false, -1},
+      {"speech-band noise, 60 ms (same delay)", 8, 60, true, -1},
+  };
+  if (bench) ::printf("  %-38s %9s %9s %10s %9s %8s\n", "segment", "ERLE", "near kept", "near-end", "false BI", "delay err");
+  for (const Segment& seg : segments) {
+    idle(rng);
+    SegmentResult r = runSegment(rng, seg);
+    if (bench) {
+      ::printf("  %-38s %6.1f dB %6.1f dB %7u ms %9u %6d ms\n", seg.name, r.erleDb, r.nearKeptDb,
+               (unsigned)r.nearEndMaxMs, (unsigned)r.falseBargeIns, r.delayErrorMs);
+    }
+    CHECK(r.erleDb >= (seg.noise ? 13 : 10));
+    CHECK(r.falseBargeIns == 0);
+    CHECK(abs(r.delayErrorMs) <= 5);
+    if (seg.nearStartMs >= 0) {
+      CHECK(r.nearEndMaxMs >= BARGE_IN_MS);
+      CHECK(r.nearKeptDb > -3);
+    }
+  }
+  if (bench) {
+    ::printf("  host CPU: %.1f us per 10 ms block with echo (max %u us), device budget %u us\n",
+             (double)stats.usTotal / stats.activeBlocks, (unsigned)stats.usMax, (unsigned)AEC_BUDGET_US);
+    aecPrintStats();
+  }
+  return hostTestResult("aec_test");
+}
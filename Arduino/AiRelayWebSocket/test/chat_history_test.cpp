@@ -0,0 +1,249 @@
+// Unit tests and benchmark for the chat history ring (chat_history.cpp).
+// Built from the source so the static helpers (utf8Cut) are reachable.
+#include "../chat_history.cpp"
+#include "host_test.h"
+#include <deque>
+#include <string>
+#include <vector>
+
+struct ModelMessage {
+  bool user;
+  std::string text;
+};
+
+// Largest text a message keeps (mirrors chatHistoryAppend).
+static size_t maxMessageBytes() {
+  size_t maxBytes = (size_t)(HISTORY_TOKEN_BUDGET / 2 - HISTORY_TOKENS_PER_MESSAGE) * 4;
+  if (maxBytes > HISTORY_ARENA_BYTES / 2) maxBytes = HISTORY_ARENA_BYTES / 2;
+  return maxBytes;
+}
+
+static std::string historyText(uint8_t i) {
+  HistoryMessage m = {};
+  if (!chatHistoryGet(i, &m)) return "";
+  return std::string(m.text, m.length);
+}
+
+// Text of `len` bytes mixing ASCII with 2-, 3- and 4-byte UTF-8 sequences.
+static std::string randomText(HostRng& rng, size_t len) {
+  static const char* const pieces[] = {"a", "b", "c", " ", "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80", "z", "."};
+  std::string s;
+  while (s.size() < len) s += pieces[rng.below(sizeof(pieces) / sizeof(pieces[0]))];
+  return s;
+}
+
+static bool isContinuation(char c) {
+  return ((uint8_t)c & 0xC0) == 0x80;
+}
+
+static void testUtf8Cut() {
+  const char* ascii = "hello world";
+  CHECK(utf8Cut(ascii, 11, 20) == 11);
+  CHECK(utf8Cut(ascii, 11, 5) == 5);
+  const char* e = "ab\xc3\xa9" "cd";  // a b é c d
+  CHECK(utf8Cut(e, 6, 3) == 2);        // would split é
+  CHECK(utf8Cut(e, 6, 4) == 4);        // é complete
+  const char* euro = "\xe2\x82\xac\xe2\x82\xac";
+  CHECK(utf8Cut(euro, 6, 5) == 3);
+  CHECK(utf8Cut(euro, 6, 4) == 3);
+  CHECK(utf8Cut(euro, 6, 2) == 0);
+  const char* emoji = "x\xf0\x9f\x98\x80";
+  CHECK(utf8Cut(emoji, 5, 4) == 1);
+  CHECK(utf8Cut(emoji, 5, 5) == 5);
+}
+
+static void testTruncation() {
+  chatHistoryClear();
+  std::string longText;
+  while (longText.size() < 6000) longText += "\xc3\xa9";  // 2-byte chars only
+  uint32_t before = truncated;
+  CHECK(chatHistoryAppend(true, longText.data(), longText.size()));
+  CHECK(truncated == before + 1);
+  HistoryMessage m = {};
+  CHECK(chatHistoryGet(0, &m));
+  CHECK(m.length <= maxMessageBytes());
+  CHECK(m.length % 2 == 0);
+  CHECK(m.length >= maxMessageBytes() - 1);
+  CHECK(chatHistoryTokens() <= HISTORY_TOKEN_BUDGET / 2);
+}
+
+static void testCountEviction() {
+  chatHistoryClear();
+  char text[16];
+  for (int i = 0; i < 3 * HISTORY_MAX; i++) {
+    int n = snprintf(text, sizeof(text), "msg %d", i);
+    CHECK(chatHistoryAppend(i % 2 == 0, text, n));
+  }
+  CHECK(chatHistoryCount() == HISTORY_MAX);
+  CHECK(historyText(chatHistoryCount() - 1) == "msg 47");
+  CHECK(historyText(0) == "msg 32");
+  HistoryMessage m = {};
+  chatHistoryGet(0, &m);
+  CHECK(m.user);
+}
+
+static void testBudgetEviction() {
+  chatHistoryClear();
+  std::string text(1000, 'x');  // ~254 tokens each
+  for (int i = 0; i < 12; i++) {
+    CHECK(chatHistoryAppend(i % 2 == 0, text.data(), text.size()));
+    CHECK(chatHistoryTokens() <= HISTORY_TOKEN_BUDGET);
+  }
+  uint16_t cost = chatHistoryEstimateTokens(text.size());
+  CHECK(chatHistoryCount() <= HISTORY_TOKEN_BUDGET / cost);
+  CHECK(chatHistoryCount() >= 2);
+  uint32_t sum = 0;
+  for (uint8_t i = 0; i < chatHistoryCount(); i++) {
+    HistoryMessage m = {};
+    chatHistoryGet(i, &m);
+    sum += m.tokens;
+  }
+  CHECK(sum == chatHistoryTokens());
+}
+
+static void testOrphanReplyDropped() {
+  chatHistoryClear();
+  std::string big(1600, 'q');   // ~404 tokens
+  std::string small(40, 'r');
+  chatHistoryAppend(true, big.data(), big.size());
+  chatHistoryAppend(false, big.data(), big.size());
+  chatHistoryAppend(true, small.data(), small.size());
+  chatHistoryAppend(false, small.data(), small.size());
+  // Needs the first question evicted; its reply must go with it
+  chatHistoryAppend(true, big.data(), big.size());
+  HistoryMessage m = {};
+  CHECK(chatHistoryGet(0, &m));
+  CHECK(m.user);
+  CHECK(chatHistoryCount() == 3);
+}
+
+static void testCompactAndGeneration() {
+  chatHistoryClear();
+  uint32_t gen = chatHistoryGeneration();
+  const char* texts[] = {"q1", "a1", "q2", "a2", "q3", "a3"};
+  for (int i = 0; i < 6; i++) chatHistoryAppend(i % 2 == 0, texts[i], 2);
+  const char* memory = "User asked q1 and q2.";
+  chatHistoryCompact(4, memory, strlen(memory));
+  CHECK(chatHistoryCount() == 2);
+  CHECK(historyText(0) == "q3");
+  HistoryMessage s = {};
+  CHECK(chatHistoryGetSummary(&s));
+  CHECK(std::string(s.text, s.length) == memory);
+  CHECK(chatHistoryGeneration() == gen);
+  std::string huge(HISTORY_SUMMARY_MAX_BYTES + 100, 'm');
+  chatHistoryCompact(0, huge.data(), huge.size());
+  CHECK(chatHistoryGetSummary(&s) && s.length == HISTORY_SUMMARY_MAX_BYTES);
+  chatHistoryClear();
+  CHECK(chatHistoryGeneration() == gen + 1);
+  CHECK(!chatHistoryGetSummary(&s));
+  CHECK(chatHistoryCount() == 0 && chatHistoryTokens() == 0);
+}
+
+// Random appends and clears against a plain list of everything appended: the
+// history must always be a suffix of it, within every limit, with the newest
+// message intact and no text overwritten by the ring wrapping around.
+static void testAgainstModel(uint32_t ops) {
+  HostRng rng(12345);
+  chatHistoryClear();
+  std::deque<ModelMessage> model;
+  bool user = true;
+  uint32_t wraps = 0;
+  uint32_t lastHead = 0;
+  for (uint32_t op = 0; op < ops; op++) {
+    if (rng.below(100) == 0) {
+      chatHistoryClear();
+      model.clear();
+      user = true;
+      continue;
+    }
+    size_t len = 1 + (rng.below(10) == 0 ? rng.below(6000) : rng.below(700));
+    std::string text = randomText(rng, len);
+    CHECK(chatHistoryAppend(user, text.data(), text.size()));
+    size_t kept = utf8Cut(text.data(), text.size(), maxMessageBytes());
+    model.push_back({user, text.substr(0, kept)});
+    if (model.size() > 4 * HISTORY_MAX) model.pop_front();
+    user = !user;
+    if (head < lastHead) wraps++;
+    lastHead = head;
+
+    uint8_t n = chatHistoryCount();
+    CHECK(n >= 1 && n <= HISTORY_MAX);
+    CHECK(chatHistoryTokens() <= HISTORY_TOKEN_BUDGET);
+    CHECK(n <= model.size());
+    uint32_t sum = 0;
+    for (uint8_t i = 0; i < n; i++) {
+      HistoryMessage m = {};
+      chatHistoryGet(i, &m);
+      const ModelMessage& ref = model[model.size() - n + i];
+      if (m.user != ref.user || m.length != ref.text.size() ||
+          memcmp(m.text, ref.text.data(), m.length) != 0) {
+        CHECK(!"history is not a suffix of the appended messages");
+        return;
+      }
+      CHECK(m.length == 0 || !isContinuation(m.text[0]));
+      sum += m.tokens;
+    }
+    CHECK(sum == chatHistoryTokens());
+    HistoryMessage front = {};
+    chatHistoryGet(0, &front);
+    CHECK(front.user || n == 1);
+  }
+  CHECK(wraps > 100);  // the arena actually went round
+  ::printf("  model check: %u ops, arena wrapped %u times\n", (unsigned)ops, (unsigned)wraps);
+}
+
+// The addHistory() this replaced: a String array shifted once full.
+struct ShiftMessage {
+  String role;
+  String content;
+};
+static ShiftMessage shiftHistory[HISTORY_MAX];
+static uint8_t shiftCount = 0;
+
+static void shiftAppend(const char* role, const String& content) {
+  if (shiftCount >= HISTORY_MAX) {
+    for (uint8_t i = 1; i < HISTORY_MAX; i++) shiftHistory[i - 1] = shiftHistory[i];
+    shiftCount = HISTORY_MAX - 1;
+  }
+  shiftHistory[shiftCount].role = role;
+  shiftHistory[shiftCount].content = content;
+  shiftCount++;
+}
+
+static void benchmark(uint32_t appends) {
+  HostRng rng(777);
+  std::vector<String> texts;
+  for (int i = 0; i < 256; i++) {
+    std::string t = randomText(rng, 50 + rng.below(600));
+    texts.push_back(String(t.data(), t.size()));
+  }
+  uint64_t t0 = hostNowUs();
+  for (uint32_t i = 0; i < appends; i++) {
+    shiftAppend(i % 2 ? "assistant" : "user", texts[i & 255]);
+  }
+  uint64_t shiftUs = hostNowUs() - t0;
+
+  chatHistoryClear();
+  t0 = hostNowUs();
+  for (uint32_t i = 0; i < appends; i++) {
+    const String& t = texts[i & 255];
+    chatHistoryAppend(i % 2 == 0, t.c_str(), t.length());
+  }
+  uint64_t ringUs = hostNowUs() - t0;
+  ::printf("  benchmark, %u appends of 50-650 bytes: String shift %.0f ns/append, ring %.0f ns/append\n",
+           (unsigned)appends, shiftUs * 1000.0 / appends, ringUs * 1000.0 / appends);
+}
+
+int main(int argc, char** argv) {
+  bool bench = argc > 1 && strcmp(argv[1], "--bench") == 0;
+  CHECK(chatHistoryBegin());
+  testUtf8Cut();
+  testTruncation();
+  testCountEviction();
+  testBudgetEviction();
+  testOrphanReplyDropped();
+  testCompactAndGeneration();
+  testAgainstModel(bench ? 200000 : 20000);
+  if (bench) benchmark(100000);
+  return hostTestResult("chat_history_test");
+}
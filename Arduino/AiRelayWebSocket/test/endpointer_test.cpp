@@ -0,0 +1,236 @@
+// Local endpointer (endpointer.cpp): hold/force decisions and early-cut
+// accounting, then the turn simulation behind the ENDPOINT_* thresholds:
+// last word -> end_of_turn with and without ForceEndpoint, and early cuts.
+#include "../endpointer.h"
+#include "../config.h"
+#include "host_test.h"
+#include <math.h>
+#include <string>
+#include <vector>
+
+// Speech from t0 to t1, one onVoice() per mic block, as the VAD reader does.
+static void voice(Endpointer& ep, unsigned long t0, unsigned long t1) {
+  for (unsigned long t = t0; t < t1; t += MIC_BLOCK_MS) ep.onVoice(t);
+}
+
+static void testDecisions() {
+  // Nothing said yet
+  Endpointer ep;
+  CHECK(!ep.shouldForce(5000));
+
+  // Confident partial: ENDPOINT_SILENCE_CONFIDENT_MS after the last speech block
+  voice(ep, 1000, 2000);
+  ep.onPartial("what time is it", 0.9f, 2100);
+  unsigned long last = 2000 - MIC_BLOCK_MS;
+  CHECK(!ep.shouldForce(last + ENDPOINT_SILENCE_CONFIDENT_MS - 1));
+  CHECK(ep.shouldForce(last + ENDPOINT_SILENCE_CONFIDENT_MS));
+  CHECK(!ep.shouldForce(last + 5000));  // once per turn
+  ep.onEndOfTurn("what time is it", last + ENDPOINT_SILENCE_CONFIDENT_MS + 150);
+  CHECK(ep.stats().forced == 1);
+  CHECK(ep.stats().falseCuts == 0);
+  CHECK(ep.stats().forcedLatencyMaxMs == ENDPOINT_SILENCE_CONFIDENT_MS + 150);
+
+  // Unsure partial waits ENDPOINT_SILENCE_MS
+  voice(ep, 10000, 11000);
+  last = 11000 - MIC_BLOCK_MS;
+  ep.onPartial("tell me a joke", 0.2f, 10800);
+  CHECK(!ep.shouldForce(last + ENDPOINT_SILENCE_MS - 1));
+  CHECK(ep.shouldForce(last + ENDPOINT_SILENCE_MS));
+  ep.onEndOfTurn("tell me a joke", last + ENDPOINT_SILENCE_MS + 100);
+
+  // Trailing "and" / "the" / "um": ENDPOINT_CONTINUATION_EXTRA_MS more
+  voice(ep, 20000, 21000);
+  last = 21000 - MIC_BLOCK_MS;
+  ep.onPartial("turn on the lights and", 0.9f, 20900);
+  CHECK(!ep.shouldForce(last + ENDPOINT_SILENCE_CONFIDENT_MS));
+  CHECK(!ep.shouldForce(last + ENDPOINT_SILENCE_CONFIDENT_MS + ENDPOINT_CONTINUATION_EXTRA_MS - 1));
+  CHECK(ep.shouldForce(last + ENDPOINT_SILENCE_CONFIDENT_MS + ENDPOINT_CONTINUATION_EXTRA_MS));
+  // Speech resumed after the force: an early cut
+  voice(ep, last + 1000, last + 1500);
+  ep.onEndOfTurn("turn on the lights and", last + 1500);
+  CHECK(ep.stats().falseCuts == 1);
+
+  // Partial still changing: held until it has been stable ENDPOINT_STABLE_MS
+  voice(ep, 30000, 31000);
+  last = 31000 - MIC_BLOCK_MS;
+  ep.onPartial("how far", 0.9f, 31000);
+  ep.onPartial("how far is the moon", 0.9f, last + ENDPOINT_SILENCE_CONFIDENT_MS);
+  CHECK(!ep.shouldForce(last + ENDPOINT_SILENCE_CONFIDENT_MS + ENDPOINT_STABLE_MS - 1));
+  CHECK(ep.shouldForce(last + ENDPOINT_SILENCE_CONFIDENT_MS + ENDPOINT_STABLE_MS));
+  // The final has more words than the partial we cut on: also an early cut
+  ep.onEndOfTurn("how far is the moon from here", last + 1200);
+  CHECK(ep.stats().falseCuts == 2);
+
+  // Ended by the server before we forced
+  voice(ep, 40000, 41000);
+  ep.onPartial("hello", 0.9f, 41000);
+  ep.onEndOfTurn("hello", 41200);
+  CHECK(ep.stats().serverTurns == 1);
+  CHECK(ep.stats().turns == 5);
+
+  // No VAD feed (gate off): the partial itself counts as the last voice
+  Endpointer noVad;
+  noVad.onPartial("gr\xc3\xbc\xc3\x9f dich", 0.9f, 1000);
+  CHECK(noVad.shouldForce(1000 + ENDPOINT_SILENCE_CONFIDENT_MS));
+}
+
+// ---- Turn simulation ----
+
+static const char* const WORDS[] = {"what", "time", "weather", "tomorrow", "play", "music", "lights",
+                                    "kitchen", "timer", "minutes", "joke", "tell", "me", "about",
+                                    "news", "today", "set", "volume", "louder", "please"};
+static const char* const FILLERS[] = {"and", "the", "um", "so", "to"};
+
+struct Word {
+  unsigned long start, end;
+  std::string text;
+};
+
+struct Turn {
+  std::vector<Word> words;
+};
+
+// 3-12 words of 200-450 ms with 50-200 ms gaps. 8% of gaps are a hesitation
+// of 400 ms plus an exponential tail (mean 300 ms: median ~600 ms, one in
+// seven over 1 s), half of them after a filler ("and", "um", ...).
+static Turn makeTurn(HostRng& rng) {
+  Turn turn;
+  unsigned long t = 500;
+  uint32_t n = 3 + rng.below(10);
+  for (uint32_t i = 0; i < n; i++) {
+    bool hesitate = i + 1 < n && rng.below(100) < 8;
+    Word w;
+    w.text = hesitate && rng.below(2) ? FILLERS[rng.below(5)] : WORDS[rng.below(20)];
+    w.start = t;
+    w.end = t + 200 + rng.below(250);
+    turn.words.push_back(w);
+    t = w.end + (hesitate ? 400 + (unsigned long)(-300 * log(1 - rng.unit())) : 50 + rng.below(150));
+  }
+  return turn;
+}
+
+static std::string textUpTo(const Turn& turn, size_t words) {
+  std::string s;
+  for (size_t i = 0; i < words; i++) s += (i ? " " : "") + turn.words[i].text;
+  return s;
+}
+
+// Server side: end_of_turn after 800 ms of silence when the last partial was
+// confident (end_of_turn_confidence_threshold 0.6), else after
+// max_turn_silence 1500 ms.
+static const unsigned long SERVER_CONFIDENT_MS = 800;
+static const unsigned long SERVER_MAX_SILENCE_MS = 1500;
+
+struct TurnResult {
+  unsigned long endMs;
+  size_t wordsBefore;  // words spoken before end_of_turn
+  bool forced;
+};
+
+// One turn, 10 ms steps. Partials for the first k words arrive 150-350 ms
+// after word k ends; confidence is high (mostly >= 0.6) on the last word and
+// low mid-utterance, except 10% of those.
+static TurnResult runTurn(const Turn& turn, HostRng& rng, Endpointer* ep) {
+  struct Partial {
+    unsigned long at;
+    size_t words;
+    float confidence;
+  };
+  std::vector<Partial> partials;
+  for (size_t k = 0; k < turn.words.size(); k++) {
+    bool lastWord = k + 1 == turn.words.size();
+    float conf = lastWord ? (rng.below(100) < 80 ? 0.6f + 0.4f * (float)rng.unit() : 0.6f * (float)rng.unit())
+                          : (rng.below(100) < 10 ? 0.6f + 0.3f * (float)rng.unit() : 0.5f * (float)rng.unit());
+    partials.push_back({turn.words[k].end + 150 + rng.below(200), k + 1, conf});
+  }
+  unsigned long rtt = 100 + rng.below(150);
+  size_t nextPartial = 0;
+  float serverConf = 0;
+  unsigned long lastSpeech = 0;
+  unsigned long forcedEnd = 0;
+  for (unsigned long t = 0;; t += MIC_BLOCK_MS) {
+    bool speaking = false;
+    size_t spoken = 0;
+    for (const Word& w : turn.words) {
+      if (t >= w.start && t < w.end) speaking = true;
+      if (w.start <= t) spoken++;
+    }
+    if (speaking) {
+      lastSpeech = t;
+      if (ep) ep->onVoice(t);
+    }
+    while (nextPartial < partials.size() && partials[nextPartial].at <= t) {
+      const Partial& p = partials[nextPartial++];
+      serverConf = p.confidence;
+      if (ep) ep->onPartial(textUpTo(turn, p.words).c_str(), p.confidence, t);
+    }
+    if (ep && !forcedEnd && ep->shouldForce(t)) forcedEnd = t + rtt;
+    bool serverEnds = lastSpeech && !speaking &&
+                      t - lastSpeech >= (serverConf >= ENDPOINT_CONFIDENT ? SERVER_CONFIDENT_MS : SERVER_MAX_SILENCE_MS);
+    if (serverEnds || (forcedEnd && t >= forcedEnd)) {
+      bool forced = forcedEnd && t >= forcedEnd;
+      if (ep) ep->onEndOfTurn(textUpTo(turn, spoken).c_str(), t);
+      return {t, spoken, forced};
+    }
+  }
+}
+
+struct SimResult {
+  double meanLatencyMs;  // last word before end_of_turn -> end_of_turn
+  uint32_t cuts;         // turns ended with words still to come
+  uint32_t forcedCuts;   // of those, cut by ForceEndpoint where the server alone wouldn't have
+  uint32_t flagged;      // early cuts the endpointer's own counter saw
+};
+
+static SimResult simulate(uint32_t turns, bool local) {
+  HostRng rng(77);
+  Endpointer ep;
+  SimResult r = {};
+  double latency = 0;
+  for (uint32_t i = 0; i < turns; i++) {
+    Turn turn = makeTurn(rng);
+    // Same partial timing and confidences for both runs of this turn
+    uint32_t seed = rng.next();
+    HostRng serverRng(seed);
+    TurnResult server = runTurn(turn, serverRng, nullptr);
+    TurnResult res = server;
+    if (local) {
+      HostRng localRng(seed);
+      res = runTurn(turn, localRng, &ep);
+    }
+    unsigned long lastWordEnd = 0;
+    for (const Word& w : turn.words) {
+      if (w.end <= res.endMs) lastWordEnd = w.end;
+    }
+    latency += res.endMs - lastWordEnd;
+    if (res.wordsBefore < turn.words.size()) {
+      r.cuts++;
+      if (res.forced && server.wordsBefore == turn.words.size()) r.forcedCuts++;
+    }
+  }
+  r.meanLatencyMs = latency / turns;
+  r.flagged = ep.stats().falseCuts;
+  return r;
+}
+
+int main(int argc, char** argv) {
+  bool bench = argc > 1 && strcmp(argv[1], "--bench") == 0;
+  hostSerialQuiet = true;
+  testDecisions();
+
+  const uint32_t turns = 2000;
+  SimResult server = simulate(turns, false);
+  SimResult local = simulate(turns, true);
+  if (bench) {
+    ::printf("  %u simulated turns, last word -> end_of_turn:\n", (unsigned)turns);
+    ::printf("    server only:     %4.0f ms, %u turns cut early (%.1f%%)\n", server.meanLatencyMs,
+             (unsigned)server.cuts, 100.0 * server.cuts / turns);
+    ::printf("    ForceEndpoint:   %4.0f ms, %u turns cut early (%.1f%%), %u of them by the force;\n",
+             local.meanLatencyMs, (unsigned)local.cuts, 100.0 * local.cuts / turns, (unsigned)local.forcedCuts);
+    ::printf("                     the endpointer's counter flagged %u\n", (unsigned)local.flagged);
+  }
+  CHECK(local.meanLatencyMs < server.meanLatencyMs - 80);
+  CHECK(local.forcedCuts < turns * 4 / 100);
+  CHECK(local.flagged > 0 && local.flagged <= local.cuts);
+  return hostTestResult("endpointer_test");
+}
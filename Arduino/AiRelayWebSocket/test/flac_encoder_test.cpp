@@ -0,0 +1,397 @@
+// FLAC encoder (flac_encoder.cpp): every stream is decoded by the small
+// reference decoder below, which checks the frame CRCs itself, and must come
+// back sample for sample. Silence, a sine, full-scale noise, square wave and
+// sweep, voiced speech written in random pieces, last blocks of every awkward
+// length and a 30 s stream; compression ratio and time per frame under --bench.
+#include "../flac_encoder.h"
+#include "../config.h"
+#include "host_test.h"
+#include <math.h>
+#include <vector>
+
+static bool bench = false;  // print the measurements
+
+// ---- Decoder for what a mono 16-bit FLAC stream may hold (RFC 9639) ----
+
+static uint8_t crc8(const uint8_t* p, size_t n) {
+  uint8_t c = 0;
+  for (size_t i = 0; i < n; i++) {
+    c ^= p[i];
+    for (int b = 0; b < 8; b++) c = (c & 0x80) ? (uint8_t)((c << 1) ^ 0x07) : (uint8_t)(c << 1);
+  }
+  return c;
+}
+
+static uint16_t crc16(const uint8_t* p, size_t n) {
+  uint16_t c = 0;
+  for (size_t i = 0; i < n; i++) {
+    c ^= (uint16_t)(p[i] << 8);
+    for (int b = 0; b < 8; b++) c = (c & 0x8000) ? (uint16_t)((c << 1) ^ 0x8005) : (uint16_t)(c << 1);
+  }
+  return c;
+}
+
+struct BitReader {
+  const uint8_t* data;
+  size_t len;
+  size_t bit = 0;
+  bool ok = true;
+
+  uint32_t get(int n) {  // n <= 32
+    uint64_t v = 0;
+    for (int i = 0; i < n; i++) {
+      if (bit >= len * 8) {
+        ok = false;
+        return 0;
+      }
+      v = (v << 1) | ((data[bit >> 3] >> (7 - (bit & 7))) & 1);
+      bit++;
+    }
+    return (uint32_t)v;
+  }
+  int32_t getSigned(int n) {
+    uint32_t v = get(n);
+    return n == 0 ? 0 : (int32_t)(v << (32 - n)) >> (32 - n);
+  }
+  uint32_t unary() {
+    uint32_t zeros = 0;
+    while (ok && get(1) == 0) zeros++;
+    return zeros;
+  }
+  void align() { bit = (bit + 7) & ~(size_t)7; }
+  size_t byte() const { return bit >> 3; }
+};
+
+struct Decoded {
+  bool ok = false;
+  const char* error = "";
+  uint32_t blockSize = 0;  // STREAMINFO max block size
+  uint32_t sampleRate = 0;
+  uint32_t frames = 0;
+  uint32_t constant = 0, verbatim = 0, fixed = 0, lpc = 0;
+  std::vector<int16_t> pcm;
+};
+
+static bool decodeResidual(BitReader& br, size_t n, int predOrder, int32_t* out) {
+  uint32_t method = br.get(2);
+  if (method > 1) return false;
+  int paramBits = method ? 5 : 4;
+  uint32_t escape = (1u << paramBits) - 1;
+  int order = br.get(4);
+  if ((n >> order) << order != n || (n >> order) < (size_t)predOrder) return false;
+  size_t size = n >> order;
+  size_t i = predOrder;
+  for (int p = 0; p < (1 << order); p++) {
+    uint32_t k = br.get(paramBits);
+    size_t end = (p + 1) * size;
+    if (k == escape) {
+      int raw = br.get(5);
+      for (; i < end; i++) out[i] = br.getSigned(raw);
+    } else {
+      for (; i < end; i++) {
+        uint32_t u = (br.unary() << k) | br.get(k);
+        out[i] = (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+      }
+    }
+  }
+  return br.ok;
+}
+
+static bool decodeSubframe(BitReader& br, size_t n, Decoded* d, int32_t* x) {
+  if (br.get(1) != 0) return false;
+  uint32_t type = br.get(6);
+  int depth = 16;
+  int wasted = 0;
+  if (br.get(1)) {
+    wasted = br.unary() + 1;
+    depth -= wasted;
+  }
+  if (type == 0) {
+    int32_t v = br.getSigned(depth);
+    for (size_t i = 0; i < n; i++) x[i] = v;
+    d->constant++;
+  } else if (type == 1) {
+    for (size_t i = 0; i < n; i++) x[i] = br.getSigned(depth);
+    d->verbatim++;
+  } else if (type >= 8 && type <= 12) {
+    int order = type - 8;
+    if ((size_t)order > n) return false;
+    for (int i = 0; i < order; i++) x[i] = br.getSigned(depth);
+    if (!decodeResidual(br, n, order, x)) return false;
+    static const int32_t COEF[5][4] = {{0}, {1}, {2, -1}, {3, -3, 1}, {4, -6, 4, -1}};
+    for (size_t i = order; i < n; i++) {
+      int64_t pred = 0;
+      for (int j = 0; j < order; j++) pred += (int64_t)COEF[order][j] * x[i - 1 - j];
+      x[i] += (int32_t)pred;
+    }
+    d->fixed++;
+  } else if (type >= 32) {
+    int order = type - 31;
+    if ((size_t)order > n) return false;
+    for (int i = 0; i < order; i++) x[i] = br.getSigned(depth);
+    int precision = br.get(4) + 1;
+    if (precision == 16) return false;
+    int shift = br.getSigned(5);
+    if (shift < 0) return false;
+    int32_t coef[32];
+    for (int j = 0; j < order; j++) coef[j] = br.getSigned(precision);
+    if (!decodeResidual(br, n, order, x)) return false;
+    for (size_t i = order; i < n; i++) {
+      int64_t sum = 0;
+      for (int j = 0; j < order; j++) sum += (int64_t)coef[j] * x[i - 1 - j];
+      x[i] += (int32_t)(sum >> shift);
+    }
+    d->lpc++;
+  } else {
+    return false;
+  }
+  for (size_t i = 0; i < n; i++) x[i] = (int32_t)((uint32_t)x[i] << wasted);
+  return br.ok;
+}
+
+static Decoded decodeFlac(const std::vector<uint8_t>& s) {
+  Decoded d;
+  if (s.size() < 42 || memcmp(s.data(), "fLaC", 4) != 0) {
+    d.error = "no fLaC magic";
+    return d;
+  }
+  BitReader meta = {s.data() + 4, 38};
+  bool last = meta.get(1);
+  uint32_t type = meta.get(7);
+  uint32_t len = meta.get(24);
+  uint32_t minBlock = meta.get(16);
+  d.blockSize = meta.get(16);
+  meta.get(24);
+  meta.get(24);
+  d.sampleRate = meta.get(20);
+  uint32_t channels = meta.get(3) + 1;
+  uint32_t bits = meta.get(5) + 1;
+  if (!last || type != 0 || len != 34 || minBlock != d.blockSize || channels != 1 || bits != 16) {
+    d.error = "unexpected STREAMINFO";
+    return d;
+  }
+  size_t pos = 42;
+  std::vector<int32_t> x;
+  while (pos < s.size()) {
+    BitReader br = {s.data() + pos, s.size() - pos};
+    if (br.get(14) != 0x3FFE || br.get(1) != 0 || br.get(1) != 0) {
+      d.error = "bad sync";
+      return d;
+    }
+    uint32_t sizeCode = br.get(4);
+    uint32_t rateCode = br.get(4);
+    uint32_t channelCode = br.get(4);
+    uint32_t depthCode = br.get(3);
+    br.get(1);
+    // Frame number, UTF-8 style
+    uint32_t first = br.get(8);
+    int extra = 0;
+    while (extra < 7 && (first & (0x80 >> extra))) extra++;
+    uint32_t number = first & (0x7F >> extra);
+    if (extra) extra--;
+    for (int i = 0; i < extra; i++) number = (number << 6) | (br.get(8) & 0x3F);
+    size_t n;
+    if (sizeCode == 1) n = 192;
+    else if (sizeCode >= 2 && sizeCode <= 5) n = 576u << (sizeCode - 2);
+    else if (sizeCode == 6) n = br.get(8) + 1;
+    else if (sizeCode == 7) n = br.get(16) + 1;
+    else if (sizeCode >= 8) n = 256u << (sizeCode - 8);
+    else n = 0;
+    if (rateCode == 12) br.get(8);
+    else if (rateCode == 13 || rateCode == 14) br.get(16);
+    uint8_t headerCrc = crc8(s.data() + pos, br.byte());
+    if (br.get(8) != headerCrc) {
+      d.error = "header CRC-8";
+      return d;
+    }
+    if (n == 0 || n > d.blockSize || channelCode != 0 || (depthCode != 4 && depthCode != 0) ||
+        number != d.frames) {
+      d.error = "bad frame header";
+      return d;
+    }
+    x.assign(n, 0);
+    if (!decodeSubframe(br, n, &d, x.data())) {
+      d.error = "bad subframe";
+      return d;
+    }
+    br.align();
+    uint16_t frameCrc = crc16(s.data() + pos, br.byte());
+    if (br.get(16) != frameCrc || !br.ok) {
+      d.error = "frame CRC-16";
+      return d;
+    }
+    for (int32_t v : x) {
+      if (v < -32768 || v > 32767) {
+        d.error = "sample out of range";
+        return d;
+      }
+      d.pcm.push_back((int16_t)v);
+    }
+    d.frames++;
+    pos += br.byte();
+  }
+  d.ok = true;
+  return d;
+}
+
+// ---- Encoder side ----
+
+static bool appendFrame(const uint8_t* frame, size_t len, void* ctx) {
+  std::vector<uint8_t>* out = (std::vector<uint8_t>*)ctx;
+  out->insert(out->end(), frame, frame + len);
+  return true;
+}
+
+// Whole stream; `pieces` > 0 writes it in random pieces of 1..pieces samples.
+static std::vector<uint8_t> encode(const std::vector<int16_t>& pcm, uint32_t pieces = 0, uint32_t seed = 1) {
+  std::vector<uint8_t> out(FLAC_HEADER_BYTES);
+  CHECK(flacStreamBegin(out.data()) == FLAC_HEADER_BYTES);
+  HostRng rng(seed);
+  size_t done = 0;
+  while (done < pcm.size()) {
+    size_t n = pieces ? 1 + rng.below(pieces) : pcm.size();
+    if (n > pcm.size() - done) n = pcm.size() - done;
+    CHECK(flacEncode(pcm.data() + done, n, appendFrame, &out));
+    done += n;
+  }
+  CHECK(flacStreamFinish(appendFrame, &out));
+  return out;
+}
+
+struct RoundTrip {
+  bool exact;
+  double ratio;
+  Decoded decoded;
+};
+
+static RoundTrip roundTrip(const char* name, const std::vector<int16_t>& pcm, uint32_t pieces = 0) {
+  std::vector<uint8_t> flac = encode(pcm, pieces);
+  RoundTrip r;
+  r.decoded = decodeFlac(flac);
+  r.exact = r.decoded.ok && r.decoded.pcm == pcm;
+  r.ratio = (double)pcm.size() * 2 / flac.size();
+  if (!r.decoded.ok) ::printf("  %s: decoder: %s\n", name, r.decoded.error);
+  if (bench) {
+    const Decoded& d = r.decoded;
+    ::printf("  %-24s %7u -> %6u bytes (%.2f:1), %s; subframes LPC %u, fixed %u, verbatim %u, constant %u\n", name,
+             (unsigned)(pcm.size() * 2), (unsigned)flac.size(), r.ratio, r.exact ? "bit-exact" : "MISMATCH",
+             (unsigned)d.lpc, (unsigned)d.fixed, (unsigned)d.verbatim, (unsigned)d.constant);
+  }
+  CHECK(r.exact);
+  CHECK(r.decoded.sampleRate == SAMPLE_RATE);
+  CHECK(r.decoded.blockSize == FLAC_BLOCK_SAMPLES);
+  CHECK(r.decoded.frames == (pcm.size() + FLAC_BLOCK_SAMPLES - 1) / FLAC_BLOCK_SAMPLES);
+  return r;
+}
+
+// Voiced syllables at about the AGC target level, with a little mic noise.
+static std::vector<int16_t> speech(uint32_t samples, uint32_t seed) {
+  HostRng rng(seed);
+  std::vector<int16_t> out(samples);
+  double phase = 0;
+  for (uint32_t i = 0; i < samples; i++) {
+    double t = (double)i / SAMPLE_RATE;
+    double f0 = 130 + 30 * sin(2 * M_PI * 0.6 * t);
+    phase += 2 * M_PI * f0 / SAMPLE_RATE;
+    double syllable = 0.5 - 0.5 * cos(2 * M_PI * t / 0.3);
+    double s = 0;
+    for (int h = 1; h * f0 < 3800; h++) {
+      double f = f0 * h;
+      s += (exp(-pow((f - 700) / 300, 2)) + 0.6 * exp(-pow((f - 1800) / 400, 2)) + 0.02) * sin(h * phase + h);
+    }
+    out[i] = (int16_t)lround(s * syllable * 2500 + (rng.unit() - 0.5) * 40);
+  }
+  return out;
+}
+
+static void testStreams() {
+  const uint32_t n = 3 * SAMPLE_RATE;
+  HostRng rng(25);
+
+  RoundTrip silence = roundTrip("silence", std::vector<int16_t>(n, 0));
+  CHECK(silence.decoded.constant == silence.decoded.frames);
+  CHECK(silence.ratio > 100);
+
+  std::vector<int16_t> sine(n);
+  for (uint32_t i = 0; i < n; i++) sine[i] = (int16_t)lround(16000 * sin(2 * M_PI * 440.0 * i / SAMPLE_RATE));
+  RoundTrip tone = roundTrip("440 Hz sine, -6 dBFS", sine);
+  CHECK(tone.ratio > 3);
+
+  std::vector<int16_t> noise(n);
+  for (auto& v : noise) v = (int16_t)(rng.next() & 0xFFFF);
+  RoundTrip full = roundTrip("full-scale noise", noise);
+  CHECK(full.decoded.verbatim == full.decoded.frames);
+  CHECK(full.ratio > 0.99);  // never much bigger than the PCM
+
+  std::vector<int16_t> square(n);
+  for (uint32_t i = 0; i < n; i++) square[i] = (i / 40) % 2 ? 32767 : -32768;
+  roundTrip("full-scale square", square);
+
+  std::vector<int16_t> sweep(n);
+  double ph = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    ph += 2 * M_PI * (50 + 7900.0 * i / n) / SAMPLE_RATE;
+    sweep[i] = (int16_t)lround(32767 * sin(ph));
+  }
+  roundTrip("full-scale sweep", sweep);
+
+  std::vector<int16_t> voice = speech(n, 7);
+  RoundTrip voiced = roundTrip("speech", voice);
+  CHECK(voiced.ratio > 1.7);
+  CHECK(voiced.decoded.lpc > voiced.decoded.frames / 2);
+  // Write sizes don't change a byte of the stream
+  roundTrip("speech, random writes", voice, 700);
+  CHECK(encode(voice, 700, 9) == encode(voice));
+  // The decoder does check: one flipped bit fails a frame CRC
+  std::vector<uint8_t> corrupt = encode(voice);
+  corrupt[corrupt.size() / 2] ^= 0x10;
+  CHECK(!decodeFlac(corrupt).ok);
+}
+
+// Last blocks of every length class: below MIN_PREDICT_SAMPLES (verbatim),
+// 8- vs 16-bit block size field, and one short of a whole block.
+static void testPartialLastBlock() {
+  const uint32_t tails[] = {1, 2, 31, 32, 33, 255, 256, 257, FLAC_BLOCK_SAMPLES - 1};
+  uint32_t bad = 0;
+  for (uint32_t tail : tails) {
+    std::vector<int16_t> pcm = speech(2 * FLAC_BLOCK_SAMPLES + tail, tail);
+    Decoded d = decodeFlac(encode(pcm));
+    if (!d.ok || d.pcm != pcm || d.frames != 3) {
+      ::printf("  last block of %u samples: %s\n", (unsigned)tail, d.ok ? "mismatch" : d.error);
+      bad++;
+    }
+  }
+  // A stream shorter than one block
+  std::vector<int16_t> shortOne = speech(100, 3);
+  Decoded d = decodeFlac(encode(shortOne));
+  CHECK(d.ok && d.pcm == shortOne && d.frames == 1);
+  if (bench) ::printf("  last blocks of 1..%u samples: %u of %u bit-exact\n", (unsigned)(FLAC_BLOCK_SAMPLES - 1),
+                      (unsigned)(sizeof(tails) / sizeof(tails[0]) - bad), (unsigned)(sizeof(tails) / sizeof(tails[0])));
+  CHECK(bad == 0);
+}
+
+// 30 s, a RECORD_MAX_SECONDS upload and then some: frame numbers past 127 take two bytes.
+static void testLongStream() {
+  std::vector<int16_t> pcm = speech(30 * SAMPLE_RATE, 11);
+  uint64_t t0 = hostNowUs();
+  std::vector<uint8_t> flac = encode(pcm);
+  double us = (double)(hostNowUs() - t0) / (pcm.size() / FLAC_BLOCK_SAMPLES);
+  Decoded d = decodeFlac(flac);
+  if (bench) {
+    ::printf("  30 s of speech: %u frames, %s, %.1f us per %u-sample frame on the host, ratio %.2f\n",
+             (unsigned)d.frames, d.ok && d.pcm == pcm ? "bit-exact" : "MISMATCH", us, (unsigned)FLAC_BLOCK_SAMPLES,
+             (double)pcm.size() * 2 / flac.size());
+  }
+  CHECK(d.ok && d.pcm == pcm);
+}
+
+int main(int argc, char** argv) {
+  bench = argc > 1 && strcmp(argv[1], "--bench") == 0;
+  hostSerialQuiet = !bench;
+  CHECK(flacEncoderBegin());
+  testStreams();
+  testPartialLastBlock();
+  testLongStream();
+  if (bench) flacPrintStats();
+  return hostTestResult("flac_encoder_test");
+}
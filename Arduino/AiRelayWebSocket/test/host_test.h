@@ -0,0 +1,41 @@
+// Minimal check/benchmark helpers for the host tests (see Makefile).
+#ifndef AI_RELAY_TEST_HOST_TEST_H
+#define AI_RELAY_TEST_HOST_TEST_H
+
+#include <Arduino.h>
+
+inline int hostTestFailures = 0;
+
+#define CHECK(cond)                                                         \
+  do {                                                                      \
+    if (!(cond)) {                                                          \
+      hostTestFailures++;                                                   \
+      ::printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);              \
+    }                                                                       \
+  } while (0)
+
+// Exit status for main(): non-zero if any CHECK failed.
+inline int hostTestResult(const char* name) {
+  if (hostTestFailures) {
+    ::printf("%s: %d check(s) failed\n", name, hostTestFailures);
+    return 1;
+  }
+  ::printf("%s: ok\n", name);
+  return 0;
+}
+
+// Deterministic PRNG (xorshift32), so runs are repeatable across hosts.
+struct HostRng {
+  uint32_t s;
+  explicit HostRng(uint32_t seed) : s(seed ? seed : 1) {}
+  uint32_t next() {
+    s ^= s << 13;
+    s ^= s >> 17;
+    s ^= s << 5;
+    return s;
+  }
+  uint32_t below(uint32_t n) { return next() % n; }
+  double unit() { return (next() >> 8) / 16777216.0; }  // [0, 1)
+};
+
+#endif
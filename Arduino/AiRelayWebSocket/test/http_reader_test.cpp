@@ -0,0 +1,260 @@
+// Unit tests for HttpBodyReader (http_reader.cpp) against canned responses fed
+// in TCP-sized segments, and a benchmark against the String-accumulating loop
+// readTranscriptResponse() used before it.
+#include "../http_reader.h"
+#include "host_test.h"
+#include <string>
+
+// Serves a canned response at most `segment` bytes per available()/read(), like
+// a socket receiving TCP segments. connected() goes false once it is drained
+// when closeAtEnd is set (the server closed the connection).
+class MockClient : public Client {
+ public:
+  MockClient(const std::string& data, size_t segment, bool closeAtEnd)
+      : data_(data), segment_(segment), closeAtEnd_(closeAtEnd) {}
+
+  int available() override {
+    size_t left = data_.size() - pos_;
+    return (int)(left < segment_ ? left : segment_);
+  }
+  int read() override {
+    if (pos_ >= data_.size()) return -1;
+    return (uint8_t)data_[pos_++];
+  }
+  int read(uint8_t* buf, size_t size) override {
+    size_t n = (size_t)available();
+    if (n > size) n = size;
+    memcpy(buf, data_.data() + pos_, n);
+    pos_ += n;
+    return (int)n;
+  }
+  int peek() override { return pos_ < data_.size() ? (uint8_t)data_[pos_] : -1; }
+  uint8_t connected() override { return !closeAtEnd_ || pos_ < data_.size(); }
+  size_t write(uint8_t) override { return 0; }
+  size_t left() const { return data_.size() - pos_; }
+
+ private:
+  std::string data_;
+  size_t segment_;
+  bool closeAtEnd_;
+  size_t pos_ = 0;
+};
+
+static const size_t SEGMENTS[] = {1, 13, 536, 1460};
+
+// A Groq chat completion of about 1 KB, the size of a spoken reply.
+static std::string chatBody() {
+  std::string content;
+  while (content.size() < 700) content += "Sure, here is a short answer that fits in a spoken reply. ";
+  return "{\"id\":\"chatcmpl-0f3a\",\"object\":\"chat.completion\",\"created\":1730000000,"
+         "\"model\":\"llama-3.3-70b-versatile\",\"choices\":[{\"index\":0,\"message\":"
+         "{\"role\":\"assistant\",\"content\":\"" + content + "\"},\"logprobs\":null,"
+         "\"finish_reason\":\"stop\"}],\"usage\":{\"prompt_tokens\":412,\"completion_tokens\":160,"
+         "\"total_tokens\":572},\"x_groq\":{\"id\":\"req_01j\"}}";
+}
+
+static std::string withLength(const std::string& body, const char* extraHeader = "") {
+  return "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n" + std::string(extraHeader) +
+         "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+// 7-byte chunks, every third with an extension, and a trailer.
+static std::string chunked(const std::string& body) {
+  std::string out = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nTransfer-Encoding: chunked\r\n\r\n";
+  char line[32];
+  int n = 0;
+  for (size_t i = 0; i < body.size(); i += 7, n++) {
+    size_t len = body.size() - i < 7 ? body.size() - i : 7;
+    snprintf(line, sizeof(line), n % 3 == 0 ? "%x;ext=%d\r\n" : "%x\r\n", (unsigned)len, n);
+    out += line;
+    out += body.substr(i, len) + "\r\n";
+  }
+  return out + "0\r\nX-Trailer: done\r\n\r\n";
+}
+
+static std::string untilClose(const std::string& body) {
+  return "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n" + body;
+}
+
+static std::string readBody(HttpBodyReader& reader, size_t chunk) {
+  std::string out;
+  char buf[600];
+  size_t n;
+  while ((n = reader.readBytes(buf, chunk)) > 0) out.append(buf, n);
+  return out;
+}
+
+static void testFraming() {
+  const std::string body = chatBody();
+  struct Case {
+    const char* name;
+    std::string response;
+    bool closeAtEnd;
+    bool closeAfter;
+  } cases[] = {
+      {"content-length", withLength(body), false, false},
+      {"chunked", chunked(body), false, false},
+      {"until-close", untilClose(body), true, true},
+      {"connection-close", withLength(body, "Connection: close\r\n"), false, true},
+  };
+  for (const Case& c : cases) {
+    for (size_t segment : SEGMENTS) {
+      for (size_t chunk : {1, 64, 600}) {
+        MockClient client(c.response, segment, c.closeAtEnd);
+        HttpBodyReader reader(&client, 100);
+        CHECK(reader.readHeaders() == 200);
+        std::string got = readBody(reader, chunk);
+        if (got != body) {
+          ::printf("  %s, %u-byte segments, %u-byte reads: body differs\n", c.name, (unsigned)segment,
+                   (unsigned)chunk);
+          CHECK(got == body);
+        }
+        CHECK(reader.complete());
+        CHECK(reader.closeAfter() == c.closeAfter);
+        CHECK(reader.bodyBytes() == body.size());
+        CHECK(client.left() == 0);
+      }
+    }
+  }
+}
+
+// read()/peek() one byte at a time, the way ArduinoJson pulls from a Stream.
+static void testByteReads() {
+  const std::string body = "{\"text\":\"hello there\"}";
+  for (size_t segment : SEGMENTS) {
+    MockClient client(chunked(body), segment, false);
+    HttpBodyReader reader(&client, 100);
+    CHECK(reader.readHeaders() == 200);
+    std::string got;
+    for (;;) {
+      int p = reader.peek();
+      int c = reader.read();
+      CHECK(p == c);
+      if (c < 0) break;
+      got += (char)c;
+    }
+    CHECK(got == body);
+    CHECK(reader.complete());
+  }
+}
+
+// The body stops exactly where the framing says, so the next response on a
+// kept-alive connection is left in the socket.
+static void testStopsAtBodyEnd() {
+  const std::string body = "{\"text\":\"first\"}";
+  const std::string next = "HTTP/1.1 200 OK\r\n";
+  MockClient client(withLength(body) + next, 1, false);
+  HttpBodyReader reader(&client, 100);
+  CHECK(reader.readHeaders() == 200);
+  CHECK(readBody(reader, 64) == body);
+  CHECK(reader.complete());
+  CHECK(client.left() == next.size());
+}
+
+static void testErrors() {
+  // Kept-alive connection the server had already closed: nothing to read
+  MockClient dead("", 1460, true);
+  HttpBodyReader deadReader(&dead, 100);
+  CHECK(deadReader.readHeaders() == -1);
+
+  MockClient unavailable("HTTP/1.1 503 Service Unavailable\r\nContent-Length: 2\r\n\r\n{}", 13, false);
+  HttpBodyReader unavailableReader(&unavailable, 100);
+  CHECK(unavailableReader.readHeaders() == 503);
+  unavailableReader.skipRest();
+  CHECK(unavailableReader.complete());
+
+  // Body cut short: not complete, so the connection isn't reused
+  std::string full = withLength(chatBody());
+  MockClient cut(full.substr(0, full.size() - 100), 536, true);
+  HttpBodyReader cutReader(&cut, 100);
+  CHECK(cutReader.readHeaders() == 200);
+  cutReader.skipRest();
+  CHECK(!cutReader.complete());
+
+  MockClient emptyBody("HTTP/1.1 204 No Content\r\nContent-Length: 0\r\n\r\n", 1460, false);
+  HttpBodyReader emptyReader(&emptyBody, 100);
+  CHECK(emptyReader.readHeaders() == 204);
+  CHECK(emptyReader.complete());
+  CHECK(emptyReader.read() == -1);
+}
+
+// The loop readTranscriptResponse() had before HttpBodyReader (minus its
+// delay(10) between polls): byte by byte into a String from the first '{',
+// then a substring copy for the JSON parser. Returns the peak String capacity.
+static size_t stringLoop(MockClient& client, std::string* out) {
+  String response = "";
+  bool headerEnd = false;
+  size_t peak = 0;
+  while (client.connected()) {
+    while (client.available()) {
+      char c = client.read();
+      if (!headerEnd) {
+        if (c == '{') {
+          headerEnd = true;
+          response += c;
+        }
+      } else {
+        response += c;
+      }
+    }
+  }
+  int jsonStart = response.indexOf('{');
+  String jsonStr = response.substring(jsonStart);
+  peak = response.length() + jsonStr.length();
+  out->assign(jsonStr.c_str(), jsonStr.length());
+  return peak;
+}
+
+// Drains the body the way the JSON parser does: read() per byte.
+static size_t readerLoop(MockClient& client, std::string* out) {
+  HttpBodyReader reader(&client, 100);
+  if (reader.readHeaders() != 200) return 0;
+  int c;
+  while ((c = reader.read()) >= 0) *out += (char)c;
+  return 0;
+}
+
+static void benchmark(uint32_t responses) {
+  const std::string body = chatBody();
+  // Until-close for the old loop (it read until the server closed), the same
+  // body with Content-Length for the reader
+  const std::string closeResponse = untilClose(body);
+  const std::string lengthResponse = withLength(body);
+  std::string sink;
+  sink.reserve(body.size());
+  size_t peak = 0;
+  uint64_t t0 = hostNowUs();
+  for (uint32_t i = 0; i < responses; i++) {
+    MockClient client(closeResponse, 1460, true);
+    sink.clear();
+    peak = stringLoop(client, &sink);
+  }
+  uint64_t stringUs = hostNowUs() - t0;
+  CHECK(sink == body);
+
+  t0 = hostNowUs();
+  for (uint32_t i = 0; i < responses; i++) {
+    MockClient client(lengthResponse, 1460, false);
+    sink.clear();
+    readerLoop(client, &sink);
+  }
+  uint64_t readerUs = hostNowUs() - t0;
+  CHECK(sink == body);
+  ::printf("  %u B response in 1460-byte segments, %u runs:\n", (unsigned)lengthResponse.size(),
+           (unsigned)responses);
+  ::printf("    String loop:    %.2f us/response, %u B of String heap at peak\n",
+           (double)stringUs / responses, (unsigned)peak);
+  ::printf("    HttpBodyReader: %.2f us/response, %u B buffer on the stack, no heap (%.0f%% less time)\n",
+           (double)readerUs / responses, (unsigned)HTTP_READER_BUF_BYTES,
+           100.0 * (1.0 - (double)readerUs / stringUs));
+}
+
+int main(int argc, char** argv) {
+  bool bench = argc > 1 && strcmp(argv[1], "--bench") == 0;
+  testFraming();
+  testByteReads();
+  testStopsAtBodyEnd();
+  testErrors();
+  if (bench) benchmark(100000);
+  return hostTestResult("http_reader_test");
+}
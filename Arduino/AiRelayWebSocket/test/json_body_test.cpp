@@ -0,0 +1,187 @@
+// Unit tests for JsonBodyStream (json_body.cpp) and a request-size benchmark of
+// the rolling history summary (HISTORY_SUMMARY) on top of chat_history.cpp.
+#include "../json_body.h"
+#include "../chat_history.h"
+#include "host_test.h"
+#include <string>
+
+static std::string readAll(JsonBodyStream& body, size_t chunk) {
+  std::string out;
+  char buf[512];
+  for (;;) {
+    size_t n = body.readBytes(buf, chunk < sizeof(buf) ? chunk : sizeof(buf));
+    if (n == 0) break;
+    out.append(buf, n);
+  }
+  return out;
+}
+
+// Enough of a JSON syntax check for the bodies built here: balanced containers,
+// strings with valid escapes and no raw control characters.
+static bool jsonValid(const std::string& s) {
+  std::string stack;
+  bool inString = false;
+  for (size_t i = 0; i < s.size(); i++) {
+    char c = s[i];
+    if (inString) {
+      if ((unsigned char)c < 0x20) return false;
+      if (c == '"') inString = false;
+      if (c == '\\') {
+        if (++i >= s.size()) return false;
+        char e = s[i];
+        if (e == 'u') {
+          if (i + 4 >= s.size()) return false;
+          for (int k = 1; k <= 4; k++) if (!isxdigit((unsigned char)s[i + k])) return false;
+          i += 4;
+        } else if (!strchr("\"\\/bfnrt", e)) {
+          return false;
+        }
+      }
+      continue;
+    }
+    if (c == '"') inString = true;
+    else if (c == '{' || c == '[') stack += c;
+    else if (c == '}' || c == ']') {
+      if (stack.empty() || stack.back() != (c == '}' ? '{' : '[')) return false;
+      stack.pop_back();
+    }
+  }
+  return !inString && stack.empty();
+}
+
+static void testEscaping() {
+  JsonBodyStream body;
+  const char* text = "say \"hi\"\n\tback\\slash \x01 end";
+  body.addRaw("{\"t\":\"");
+  body.addEscaped(text, strlen(text));
+  body.addRaw("\"}");
+  const std::string expected = "{\"t\":\"say \\\"hi\\\"\\n\\tback\\\\slash \\u0001 end\"}";
+  CHECK(body.size() == expected.size());
+  CHECK(readAll(body, 512) == expected);
+  for (size_t chunk : {1, 2, 7, 13}) {
+    body.rewind();
+    CHECK(readAll(body, chunk) == expected);
+  }
+  CHECK(jsonValid(expected));
+
+  constexpr auto escaped = jsonEscaped<jsonEscapedLength("a\"b\n")>("a\"b\n");
+  CHECK(strcmp(escaped.text, "a\\\"b\\n") == 0);
+  CHECK(escaped.length() == 6);
+}
+
+static void testOverflow() {
+  JsonBodyStream body;
+  for (int i = 0; i < JSON_BODY_MAX_PIECES; i++) CHECK(body.addRaw("x"));
+  CHECK(!body.overflowed());
+  CHECK(!body.addRaw("y"));
+  CHECK(body.overflowed());
+  CHECK(body.size() == JSON_BODY_MAX_PIECES);
+}
+
+// The pieces buildChatBody() (chat_utils.cpp) adds, in the same order.
+static const char* const PROMPT = "You are a friendly voice assistant. Keep answers short and spoken.";
+
+static bool buildBody(JsonBodyStream* body, const char* input) {
+  body->addRaw("{\"model\":\"");
+  body->addRaw("llama-3.3-70b-versatile");
+  body->addRaw("\",\"stream\":true,\"messages\":[{\"role\":\"system\",\"content\":\"");
+  body->addRaw(PROMPT);
+  HistoryMessage m;
+  if (chatHistoryGetSummary(&m)) {
+    body->addRaw("\"},{\"role\":\"system\",\"content\":\"Memory of the conversation so far: ");
+    body->addEscaped(m.text, m.length);
+  }
+  for (uint8_t i = 0; chatHistoryGet(i, &m); i++) {
+    body->addRaw(m.user ? "\"},{\"role\":\"user\",\"content\":\""
+                        : "\"},{\"role\":\"assistant\",\"content\":\"");
+    body->addEscaped(m.text, m.length);
+  }
+  body->addRaw("\"},{\"role\":\"user\",\"content\":\"");
+  body->addEscaped(input, strlen(input));
+  body->addRaw("\"}]}");
+  return !body->overflowed();
+}
+
+// Worst case: HISTORY_MAX messages plus a memory. This is the body that lost its
+// closing "}]} when JSON_BODY_MAX_PIECES was 8 + 2 * HISTORY_MAX.
+static void testFullChatBody() {
+  CHECK(chatHistoryBegin());
+  chatHistoryClear();
+  const char* memory = "User is called \"Sam\",\nlikes trains.";
+  chatHistoryCompact(0, memory, strlen(memory));
+  for (int i = 0; i < HISTORY_MAX; i++) chatHistoryAppend(i % 2 == 0, "short \"q\"", 9);
+  CHECK(chatHistoryCount() == HISTORY_MAX);
+  JsonBodyStream body;
+  CHECK(buildBody(&body, "and now?"));
+  std::string json = readAll(body, 100);
+  CHECK(json.size() == body.size());
+  CHECK(json.size() >= 4 && json.compare(json.size() - 4, 4, "\"}]}") == 0);
+  CHECK(jsonValid(json));
+  chatHistoryClear();
+}
+
+// Mirrors historySummaryDue() / summarizeHistory() (chat_utils.cpp) with a mock
+// summarizer that returns an ~80-word memory.
+static bool foldHistory(HostRng& rng) {
+  if (chatHistoryTokens() <= HISTORY_SUMMARY_TRIGGER_TOKENS ||
+      chatHistoryCount() <= HISTORY_SUMMARY_KEEP_MESSAGES) {
+    return false;
+  }
+  uint8_t n = chatHistoryCount() - HISTORY_SUMMARY_KEEP_MESSAGES;
+  HistoryMessage m;
+  while (n > 0 && chatHistoryGet(n, &m) && !m.user) n--;
+  if (n == 0) return false;
+  std::string memory;
+  size_t bytes = 460 + rng.below(60);
+  while (memory.size() < bytes) memory += "remembered ";
+  chatHistoryCompact(n, memory.data(), memory.size());
+  return true;
+}
+
+static std::string words(size_t bytes) {
+  std::string s;
+  while (s.size() < bytes) s += "word ";
+  s.resize(bytes);
+  return s;
+}
+
+// 60 turns with 40-140 byte questions and 150-650 byte replies; request body size
+// for turns 10-59, without and with the rolling summary.
+static void benchmarkBodySize(bool summary) {
+  HostRng rng(99);
+  chatHistoryClear();
+  uint64_t total = 0;
+  size_t maxBytes = 0;
+  int measured = 0, folds = 0;
+  for (int turn = 0; turn < 60; turn++) {
+    std::string question = words(40 + rng.below(100));
+    JsonBodyStream body;
+    CHECK(buildBody(&body, question.c_str()));
+    if (turn >= 10) {
+      total += body.size();
+      if (body.size() > maxBytes) maxBytes = body.size();
+      measured++;
+    }
+    std::string reply = words(150 + rng.below(500));
+    chatHistoryAppend(true, question.data(), question.size());
+    chatHistoryAppend(false, reply.data(), reply.size());
+    if (summary && foldHistory(rng)) folds++;
+  }
+  ::printf("  %s: request body avg %u B, max %u B (~%u tok)%s", summary ? "with summary" : "without summary",
+           (unsigned)(total / measured), (unsigned)maxBytes, (unsigned)(maxBytes / 4),
+           summary ? "" : "\n");
+  if (summary) ::printf(", %d folds\n", folds);
+}
+
+int main(int argc, char** argv) {
+  bool bench = argc > 1 && strcmp(argv[1], "--bench") == 0;
+  testEscaping();
+  testOverflow();
+  testFullChatBody();
+  if (bench) {
+    ::printf("  60 turns, body size over turns 10-59:\n");
+    benchmarkBodySize(false);
+    benchmarkBodySize(true);
+  }
+  return hostTestResult("json_body_test");
+}
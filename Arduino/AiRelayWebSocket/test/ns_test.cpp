@@ -0,0 +1,227 @@
+// Noise suppressor (ns.cpp): fixed-point FFT accuracy, pass-through, and the
+// SNR gain on synthetic voiced speech in white and fan noise, with the time per
+// block behind NS_BUDGET_CYCLES. Built from the source for the FFT internals.
+#include "../ns.cpp"
+#include "host_test.h"
+#include <complex>
+#include <vector>
+
+static const uint32_t RATE = SAMPLE_RATE;
+static bool bench = false;  // print the measurements
+
+// Voiced speech: harmonics of a gliding f0 shaped by three formants, in
+// syllables; 1.2 s of talk, then 0.8 s of pause, every 2 s.
+static double speech(uint32_t i) {
+  double t = (double)i / RATE;
+  double cycle = fmod(t, 2.0);
+  if (cycle > 1.2) return 0;
+  double syllable = 0.5 - 0.5 * cos(2 * M_PI * cycle / 0.3);
+  double f0 = 120 + 30 * sin(2 * M_PI * 0.7 * t);
+  double s = 0;
+  for (int h = 1; h <= 20; h++) {
+    double f = f0 * h;
+    if (f > 3800) break;
+    double formant = exp(-pow((f - 700) / 300, 2)) + 0.6 * exp(-pow((f - 1800) / 400, 2)) +
+                     0.3 * exp(-pow((f - 2800) / 500, 2));
+    s += formant * sin(2 * M_PI * f * t + h);
+  }
+  return syllable * s * 2500;
+}
+
+static bool talking(uint32_t i) {
+  double cycle = fmod((double)i / RATE, 2.0);
+  return cycle > 0.05 && cycle < 1.15;
+}
+
+static bool pause(uint32_t i) {
+  double cycle = fmod((double)i / RATE, 2.0);
+  return cycle > 1.25 && cycle < 1.95;
+}
+
+static int16_t clip16(double v) {
+  return (int16_t)fmax(-32768, fmin(32767, lround(v)));
+}
+
+// Forward transform against a double DFT, and forward + inverse back to the input.
+static void testFft() {
+  HostRng rng(1);
+  std::vector<double> x(FFT_N, 0);
+  for (uint32_t i = 0; i < FRAME; i++) x[i] = ((double)rng.below(20000) - 10000) * 4096.0;
+  for (uint32_t n = 0; n < HALF; n++) {
+    re[n] = (int32_t)x[2 * n];
+    im[n] = (int32_t)x[2 * n + 1];
+  }
+  fftHalf(false);
+  splitSpectrum();
+  double maxErr = 0, maxMag = 0;
+  for (uint32_t k = 0; k < BINS; k++) {
+    std::complex<double> s = 0;
+    for (uint32_t n = 0; n < FFT_N; n++) s += x[n] * std::polar(1.0, -2 * M_PI * k * n / FFT_N);
+    s /= HALF;
+    maxErr = fmax(maxErr, std::abs(s - std::complex<double>(xr[k], xi[k])));
+    maxMag = fmax(maxMag, std::abs(s));
+  }
+  double fwdDb = 20 * log10(maxErr / maxMag);
+  mergeSpectrum();
+  fftHalf(true);
+  double roundTrip = 0;
+  for (uint32_t n = 0; n < HALF; n++) {
+    roundTrip = fmax(roundTrip, fabs(re[n] - x[2 * n] / HALF));
+    roundTrip = fmax(roundTrip, fabs(im[n] - x[2 * n + 1] / HALF));
+  }
+  // Samples enter as x << 12 and come back / HALF, so 16 units are one output LSB
+  double roundTripLsb = roundTrip / (1 << OUT_SHIFT);
+  if (bench) ::printf("  FFT: forward max error %.1f dB vs a double DFT, round trip max %.1f LSB on +-10000\n", fwdDb,
+           roundTripLsb);
+  CHECK(fwdDb < -70);
+  CHECK(roundTripLsb < 8);
+}
+
+static void testPassThrough() {
+  nsSetEnabled(false);
+  int16_t block[MIC_BLOCK_SAMPLES];
+  for (uint32_t n = 0; n < MIC_BLOCK_SAMPLES; n++) block[n] = (int16_t)(n * 37 - 3000);
+  int16_t copy[MIC_BLOCK_SAMPLES];
+  memcpy(copy, block, sizeof(block));
+  nsProcess(block);
+  CHECK(memcmp(block, copy, sizeof(block)) == 0);
+  nsSetEnabled(true);
+}
+
+// Fresh noise estimate, as at boot: each scenario learns its own room.
+static void resetSuppressor() {
+  blocksSeen = 0;
+  for (uint32_t k = 0; k < BINS; k++) gainQ15[k] = 32767;
+  memset(prevIn, 0, sizeof(prevIn));
+  memset(tail, 0, sizeof(tail));
+}
+
+// A quiet room, then a loud tone burst: the tone bins sit far above the floor
+// learned before, so the burst comes out one block later, nearly untouched.
+// (A tone that never stops is learned as noise, like the fan hum below.)
+static void testToneBurst() {
+  resetSuppressor();
+  HostRng rng(5);
+  const uint32_t blocks = 130;
+  const uint32_t burstFrom = 100 * MIC_BLOCK_SAMPLES;
+  std::vector<int16_t> in(blocks * MIC_BLOCK_SAMPLES), out(in.size());
+  for (size_t i = 0; i < in.size(); i++) {
+    double tone = i >= burstFrom ? 8000 * sin(2 * M_PI * 440.0 * i / RATE) : 0;
+    in[i] = clip16(tone + rng.unit() * 20 - 10);
+  }
+  for (uint32_t b = 0; b < blocks; b++) {
+    int16_t block[MIC_BLOCK_SAMPLES];
+    memcpy(block, &in[b * MIC_BLOCK_SAMPLES], sizeof(block));
+    nsProcess(block);
+    memcpy(&out[b * MIC_BLOCK_SAMPLES], block, sizeof(block));
+  }
+  // Past the onset frame, up to the last full output block
+  double sig = 0, err = 0;
+  for (size_t i = burstFrom + 2 * MIC_BLOCK_SAMPLES; i + MIC_BLOCK_SAMPLES < in.size(); i++) {
+    double d = out[i + MIC_BLOCK_SAMPLES] - in[i];
+    sig += (double)in[i] * in[i];
+    err += d * d;
+  }
+  double snr = 10 * log10(sig / (err + 1));
+  if (bench) ::printf("  440 Hz burst over a quiet floor: output vs input %.1f dB\n", snr);
+  CHECK(snr > 30);
+}
+
+struct NoiseResult {
+  double segSnrIn;
+  double segSnrOut;
+  double pauseAttenuationDb;
+  double usPerBlock;
+};
+
+// 12 s of speech in noise; the first 3 s (noise learning) aren't scored.
+static NoiseResult runNoise(bool fan, double amplitude) {
+  HostRng rng(fan ? 3 : 4);
+  resetSuppressor();
+  const uint32_t total = 12 * RATE;
+  std::vector<double> clean(total), noisy(total);
+  std::vector<int16_t> out(total);
+  double lowpass = 0;
+  for (uint32_t i = 0; i < total; i++) {
+    clean[i] = speech(i);
+    double w = rng.unit() * 2 - 1;
+    double n;
+    if (fan) {
+      // Rumble, some broadband hiss and 100 Hz hum
+      lowpass = 0.97 * lowpass + 0.03 * w;
+      n = (lowpass * 8 + 0.25 * w + 0.4 * sin(2 * M_PI * 100.0 * i / RATE)) * amplitude;
+    } else {
+      n = w * amplitude;
+    }
+    noisy[i] = clean[i] + n;
+  }
+  uint64_t t0 = hostNowUs();
+  for (uint32_t b = 0; b < total / MIC_BLOCK_SAMPLES; b++) {
+    int16_t block[MIC_BLOCK_SAMPLES];
+    for (uint32_t n = 0; n < MIC_BLOCK_SAMPLES; n++) block[n] = clip16(noisy[b * MIC_BLOCK_SAMPLES + n]);
+    nsProcess(block);
+    memcpy(&out[b * MIC_BLOCK_SAMPLES], block, sizeof(block));
+  }
+  NoiseResult r = {};
+  r.usPerBlock = (double)(hostNowUs() - t0) / (total / MIC_BLOCK_SAMPLES);
+
+  // Output lags one block. Segmental SNR over 10 ms of talk, each clamped to [-10, 35] dB
+  double in = 0, outSum = 0, pauseIn = 0, pauseOut = 0;
+  int segments = 0;
+  for (uint32_t s0 = 3 * RATE; s0 + 2 * MIC_BLOCK_SAMPLES < total; s0 += MIC_BLOCK_SAMPLES) {
+    if (pause(s0)) {
+      for (uint32_t i = s0; i < s0 + MIC_BLOCK_SAMPLES; i++) {
+        pauseIn += noisy[i] * noisy[i];
+        pauseOut += (double)out[i + MIC_BLOCK_SAMPLES] * out[i + MIC_BLOCK_SAMPLES];
+      }
+    }
+    if (!talking(s0)) continue;
+    double s = 0, nIn = 0, nOut = 0;
+    for (uint32_t i = s0; i < s0 + MIC_BLOCK_SAMPLES; i++) {
+      double c = clean[i];
+      double o = out[i + MIC_BLOCK_SAMPLES];
+      s += c * c;
+      nIn += (noisy[i] - c) * (noisy[i] - c);
+      nOut += (o - c) * (o - c);
+    }
+    if (s < 1) continue;
+    in += fmax(-10, fmin(35, 10 * log10(s / nIn)));
+    outSum += fmax(-10, fmin(35, 10 * log10(s / nOut)));
+    segments++;
+  }
+  r.segSnrIn = in / segments;
+  r.segSnrOut = outSum / segments;
+  r.pauseAttenuationDb = 10 * log10(pauseIn / pauseOut);
+  return r;
+}
+
+int main(int argc, char** argv) {
+  bench = argc > 1 && strcmp(argv[1], "--bench") == 0;
+  hostSerialQuiet = !bench;
+  CHECK(nsBegin());
+  nsSetEnabled(true);
+  testFft();
+  testPassThrough();
+  testToneBurst();
+  struct {
+    const char* name;
+    bool fan;
+    double amplitude;
+    double minGainDb;
+    double minPauseDb;
+  } cases[] = {
+      {"white noise", false, 800, 1.0, 10},
+      {"fan (rumble + hiss + hum)", true, 800, 4.0, 9},
+  };
+  for (const auto& c : cases) {
+    NoiseResult r = runNoise(c.fan, c.amplitude);
+    if (bench) {
+      ::printf("  %-26s segSNR %5.1f -> %5.1f dB (%+.1f), pauses %.1f dB quieter, host %.1f us/block\n",
+               c.name, r.segSnrIn, r.segSnrOut, r.segSnrOut - r.segSnrIn, r.pauseAttenuationDb, r.usPerBlock);
+    }
+    CHECK(r.segSnrOut - r.segSnrIn >= c.minGainDb);
+    CHECK(r.pauseAttenuationDb >= c.minPauseDb);
+  }
+  if (bench) nsPrintStats();
+  return hostTestResult("ns_test");
+}
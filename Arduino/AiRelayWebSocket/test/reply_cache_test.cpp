@@ -0,0 +1,291 @@
+// Unit tests and hit-rate benchmark for the reply cache (reply_cache.cpp).
+// Built from the source so the cache can be torn down and reloaded from the
+// in-memory SPIFFS stub.
+#include "../reply_cache.cpp"
+#include "host_test.h"
+#include <string>
+#include <vector>
+
+// Question corpus: paraphrases share a group (same answer). Group 0 questions
+// lean on the conversation and must never be served from the cache.
+struct CorpusQuestion {
+  int group;
+  const char* text;
+};
+
+static const CorpusQuestion CORPUS[] = {
+  {1, "What is the capital of France?"},
+  {1, "what's the capital of france"},
+  {1, "Tell me the capital of France please"},
+  {1, "um what is the capital city of France"},
+  {2, "How far away is the moon?"},
+  {2, "how far is the moon from earth"},
+  {2, "What's the distance to the moon?"},
+  {2, "how far away is the moon from the earth"},
+  {3, "Who wrote Romeo and Juliet?"},
+  {3, "who wrote romeo and juliet"},
+  {3, "Can you tell me who wrote Romeo and Juliet?"},
+  {4, "How many legs does a spider have?"},
+  {4, "how many legs do spiders have"},
+  {4, "How many legs has a spider got?"},
+  {5, "What is the boiling point of water?"},
+  {5, "what's the boiling point of water"},
+  {5, "At what temperature does water boil?"},
+  {6, "Tell me a joke about cats"},
+  {6, "tell me a cat joke"},
+  {6, "Do you know a joke about cats?"},
+  {7, "What is photosynthesis?"},
+  {7, "what is photosynthesis"},
+  {7, "Can you explain photosynthesis?"},
+  {7, "explain photosynthesis please"},
+  {8, "How do rainbows form?"},
+  {8, "how are rainbows formed"},
+  {8, "How does a rainbow form?"},
+  {9, "What is 12 times 12?"},
+  {9, "what's 12 times 12"},
+  {10, "What is 12 times 13?"},
+  {10, "what's 12 times 13"},
+  {11, "Who was the first person on the moon?"},
+  {11, "who was the first man on the moon"},
+  {11, "Who first walked on the moon?"},
+  {12, "Why is the sky blue?"},
+  {12, "why is the sky blue"},
+  {12, "Why's the sky blue?"},
+  {13, "What is the largest ocean on Earth?"},
+  {13, "what's the largest ocean on earth"},
+  {13, "Which ocean is the largest?"},
+  {14, "How do I boil an egg?"},
+  {14, "how do you boil an egg"},
+  {14, "How long should I boil an egg?"},
+  {15, "Tell me a fun fact about octopuses"},
+  {15, "tell me a fun fact about an octopus"},
+  {15, "Give me a fun fact about octopuses"},
+  {16, "What is the speed of light?"},
+  {16, "what's the speed of light"},
+  {16, "How fast is light?"},
+  {17, "Who painted the Mona Lisa?"},
+  {17, "who painted the mona lisa"},
+  {17, "Who is the painter of the Mona Lisa?"},
+  {18, "What is the tallest mountain in the world?"},
+  {18, "what's the tallest mountain in the world"},
+  {18, "Which mountain is the highest in the world?"},
+  {19, "How many planets are in the solar system?"},
+  {19, "how many planets are there in our solar system"},
+  {19, "How many planets does the solar system have?"},
+  {20, "What year did World War 2 end?"},
+  {20, "what year did world war 2 end"},
+  {20, "When did World War 2 end?"},
+  {21, "What year did World War 1 end?"},
+  {21, "when did world war 1 end"},
+  {22, "How do volcanoes erupt?"},
+  {22, "how does a volcano erupt"},
+  {22, "Why do volcanoes erupt?"},
+  {23, "What do pandas eat?"},
+  {23, "what do pandas eat"},
+  {23, "What does a panda eat?"},
+  {24, "Tell me a story about a dragon"},
+  {24, "tell me a dragon story"},
+  {24, "Can you tell me a story about dragons?"},
+  {25, "How do airplanes fly?"},
+  {25, "how do planes fly"},
+  {25, "How does an airplane fly?"},
+  {0, "Tell me more about it"},
+  {0, "What about that one?"},
+  {0, "Can you say that again?"},
+  {0, "Why did he do that?"},
+  {0, "And what happened next?"},
+  {0, "Is it bigger than the last one?"},
+  {0, "yes"},
+  {0, "no thanks"},
+  {0, "What else do you know?"},
+  {0, "Tell me another one"},
+  {0, "How old is she?"},
+  {0, "Where is it?"},
+};
+static const size_t CORPUS_SIZE = sizeof(CORPUS) / sizeof(CORPUS[0]);
+
+static void cacheReset() {
+  free(entries);  // entries and replies are one allocation
+  entries = nullptr;
+  replies = nullptr;
+  memset(&stats, 0, sizeof(stats));
+  dirty = false;
+  useClock = 0;
+}
+
+static String replyFor(int group) {
+  char text[64];
+  snprintf(text, sizeof(text), "answer for group %d", group);
+  return String(text);
+}
+
+static int groupOf(const String& reply) {
+  int group = -1;
+  sscanf(reply.c_str(), "answer for group %d", &group);
+  return group;
+}
+
+static void testMatching() {
+  SPIFFS.files.clear();
+  cacheReset();
+  CHECK(replyCacheBegin());
+  String reply;
+  replyCacheStore(0, "What is the capital of France?", "Paris.", 900);
+  CHECK(replyCacheLookup(0, "what's the capital of france", &reply) && reply == "Paris.");
+  CHECK(stats.exactHits == 1);
+  CHECK(replyCacheLookup(0, "um what is the capital city of France", &reply));
+  CHECK(stats.fuzzyHits == 1);
+  CHECK(!replyCacheLookup(1, "What is the capital of France?", &reply));  // other persona
+  replyCacheStore(0, "What is 12 times 12?", "144.", 500);
+  CHECK(!replyCacheLookup(0, "What is 12 times 13?", &reply));            // numbers differ
+  CHECK(!replyCacheLookup(0, "Tell me more about it", &reply));
+  CHECK(stats.uncacheable == 1);
+  replyCacheStore(0, "Why did he do that?", "Because.", 500);             // not stored
+  CHECK(stats.stores == 2);
+  String tooLong;
+  for (int i = 0; i < REPLY_CACHE_MAX_REPLY + 1; i++) tooLong += 'x';
+  replyCacheStore(0, "How do airplanes fly?", tooLong, 500);
+  CHECK(stats.stores == 2);
+}
+
+static void testLruAndTtl() {
+  SPIFFS.files.clear();
+  cacheReset();
+  CHECK(replyCacheBegin());
+  char question[64];
+  for (int i = 0; i < REPLY_CACHE_ENTRIES + 4; i++) {
+    snprintf(question, sizeof(question), "what is fact number %d", i);
+    replyCacheStore(0, question, "reply", 100);
+  }
+  CHECK(stats.evictions == 4);
+  String reply;
+  CHECK(!replyCacheLookup(0, "what is fact number 0", &reply));
+  CHECK(replyCacheLookup(0, "what is fact number 4", &reply));
+  hostClockOffsetMs += REPLY_CACHE_TTL_MS + 1000;
+  CHECK(!replyCacheLookup(0, "what is fact number 5", &reply));
+  CHECK(stats.expired > 0);
+  hostClockOffsetMs = 0;
+}
+
+// Stores are batched: nothing is written until REPLY_CACHE_FLUSH_DELAY_MS after
+// the last one, and a reload from the file gives the same answers.
+static void testFlushAndReload() {
+  SPIFFS.files.clear();
+  cacheReset();
+  CHECK(replyCacheBegin());
+  CHECK(!replyCacheFlushPending());
+  replyCacheStore(2, "Who painted the Mona Lisa?", "Leonardo da Vinci.", 700);
+  replyCacheStore(2, "How do rainbows form?", "Sunlight refracts in raindrops.", 800);
+  CHECK(replyCacheFlushPending());
+  CHECK(!replyCacheFlushDue());
+  hostClockOffsetMs += REPLY_CACHE_FLUSH_DELAY_MS;
+  CHECK(replyCacheFlushDue());
+  replyCacheFlush();
+  CHECK(!replyCacheFlushPending());
+  CHECK(stats.flushes == 1);
+  CHECK(SPIFFS.exists(CACHE_PATH));
+
+  cacheReset();
+  CHECK(replyCacheBegin());
+  String reply;
+  CHECK(replyCacheLookup(2, "who painted the mona lisa", &reply) && reply == "Leonardo da Vinci.");
+  CHECK(replyCacheLookup(2, "how do rainbows form", &reply));
+  hostClockOffsetMs = 0;
+}
+
+// A long session drawn from the corpus: popular questions come back more often
+// (weights ~ 1/rank), each turn asked in a random paraphrase. Misses store the
+// group's answer; a hit is correct when it returns the asked group's answer.
+static void benchmarkHitRate(uint32_t turns, bool print) {
+  SPIFFS.files.clear();
+  cacheReset();
+  replyCacheBegin();
+  std::vector<std::vector<size_t>> groups(26);
+  for (size_t i = 0; i < CORPUS_SIZE; i++) groups[CORPUS[i].group].push_back(i);
+  double weightSum = 0;
+  for (size_t g = 0; g < groups.size(); g++) weightSum += 1.0 / (g + 1);
+
+  HostRng rng(2024);
+  uint32_t correct = 0, wrong = 0, contextHits = 0, misses = 0, cacheable = 0;
+  uint64_t lookupNs = 0;
+  for (uint32_t t = 0; t < turns; t++) {
+    double pick = rng.unit() * weightSum;
+    size_t g = 0;
+    while (g + 1 < groups.size() && pick >= 1.0 / (g + 1)) {
+      pick -= 1.0 / (g + 1);
+      g++;
+    }
+    const CorpusQuestion& q = CORPUS[groups[g][rng.below(groups[g].size())]];
+    String question(q.text);
+    String reply;
+    uint64_t t0 = hostNowUs();
+    bool hit = replyCacheLookup(0, question, &reply);
+    lookupNs += (hostNowUs() - t0) * 1000;
+    if (q.group != 0) cacheable++;
+    if (hit) {
+      if (q.group == 0) contextHits++;
+      else if (groupOf(reply) == q.group) correct++;
+      else wrong++;
+    } else {
+      misses++;
+      replyCacheStore(0, question, replyFor(q.group), 1000);
+    }
+    hostClockOffsetMs += 20000;  // a turn every 20 s
+  }
+  hostClockOffsetMs = 0;
+  CHECK(wrong == 0);
+  CHECK(contextHits == 0);
+  CHECK(correct > cacheable / 2);
+  if (!print) return;
+  ::printf("  hit rate over %u turns (%u questions, 25 topics + follow-ups):\n", (unsigned)turns,
+           (unsigned)CORPUS_SIZE);
+  ::printf("    correct hits %u (%.1f%% of all turns, %.1f%% of cacheable), wrong answers %u, "
+           "follow-ups answered from cache %u\n",
+           (unsigned)correct, 100.0 * correct / turns, 100.0 * correct / cacheable, (unsigned)wrong,
+           (unsigned)contextHits);
+  ::printf("    exact %u / fuzzy %u, misses %u, not cacheable %u, avg lookup %.2f us\n",
+           (unsigned)stats.exactHits, (unsigned)stats.fuzzyHits, (unsigned)misses,
+           (unsigned)stats.uncacheable, lookupNs / 1000.0 / turns);
+}
+
+// Every corpus question against every other one, each stored alone: how many
+// paraphrase pairs match (recall) and how many pairs from different topics do
+// (must be none).
+static void benchmarkPairs(bool print) {
+  uint32_t pairs = 0, matched = 0, crossPairs = 0, crossMatched = 0;
+  for (size_t i = 0; i < CORPUS_SIZE; i++) {
+    if (CORPUS[i].group == 0) continue;
+    SPIFFS.files.clear();
+    cacheReset();
+    replyCacheBegin();
+    replyCacheStore(0, CORPUS[i].text, replyFor(CORPUS[i].group), 1000);
+    for (size_t j = 0; j < CORPUS_SIZE; j++) {
+      if (j == i) continue;
+      String reply;
+      bool hit = replyCacheLookup(0, CORPUS[j].text, &reply);
+      if (CORPUS[j].group == CORPUS[i].group) {
+        pairs++;
+        matched += hit;
+      } else {
+        crossPairs++;
+        crossMatched += hit;
+      }
+    }
+  }
+  CHECK(crossMatched == 0);
+  if (!print) return;
+  ::printf("  paraphrase pairs matched: %u/%u (%.0f%%), different-topic pairs matched: %u/%u\n",
+           (unsigned)matched, (unsigned)pairs, 100.0 * matched / pairs, (unsigned)crossMatched,
+           (unsigned)crossPairs);
+}
+
+int main(int argc, char** argv) {
+  bool bench = argc > 1 && strcmp(argv[1], "--bench") == 0;
+  hostSerialQuiet = true;  // per-hit log lines
+  testMatching();
+  testLruAndTtl();
+  testFlushAndReload();
+  benchmarkPairs(bench);
+  benchmarkHitRate(bench ? 20000 : 2000, bench);
+  return hostTestResult("reply_cache_test");
+}
@@ -0,0 +1,196 @@
+// Host stand-in for the Arduino-ESP32 core: just enough of String, Stream,
+// Serial, timing, PSRAM and FreeRTOS for the platform-independent modules to
+// build and run on Linux (see ../Makefile).
+#ifndef AI_RELAY_TEST_ARDUINO_H
+#define AI_RELAY_TEST_ARDUINO_H
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <strings.h>
+
+typedef bool boolean;
+
+// ---- Timing ----
+inline uint64_t hostNowUs() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000u + t.tv_nsec / 1000;
+}
+// Added to millis(), so tests can move the clock (TTLs, debounces).
+inline uint32_t hostClockOffsetMs = 0;
+inline uint32_t micros() { return (uint32_t)hostNowUs(); }
+inline uint32_t millis() { return (uint32_t)(hostNowUs() / 1000) + hostClockOffsetMs; }
+inline void delay(uint32_t ms) { usleep(ms * 1000); }
+inline void yield() {}
+
+struct HostEsp {
+  // 240 MHz, like the S3, so cycle budgets read the same
+  uint32_t getCycleCount() { return (uint32_t)(hostNowUs() * 240); }
+  uint32_t getFreeHeap() { return 0; }
+};
+inline HostEsp ESP;
+
+// ---- Memory ----
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_DEFAULT (1 << 12)
+inline bool psramFound() { return true; }
+inline void* heap_caps_malloc(size_t n, uint32_t) { return malloc(n); }
+inline void* heap_caps_calloc(size_t n, size_t m, uint32_t) { return calloc(n, m); }
+inline void* ps_malloc(size_t n) { return malloc(n); }
+inline void* ps_calloc(size_t n, size_t m) { return calloc(n, m); }
+
+#define log_e(...) do {} while (0)
+#define log_w(...) do {} while (0)
+#define log_i(...) do {} while (0)
+#define log_d(...) do {} while (0)
+
+// ---- FreeRTOS (single-threaded host: locks always succeed) ----
+typedef void* SemaphoreHandle_t;
+typedef uint32_t TickType_t;
+#define portMAX_DELAY 0xFFFFFFFFu
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdMS_TO_TICKS(ms) (ms)
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { return (SemaphoreHandle_t)1; }
+inline int xSemaphoreTake(SemaphoreHandle_t, TickType_t) { return pdTRUE; }
+inline int xSemaphoreGive(SemaphoreHandle_t) { return pdTRUE; }
+
+// ---- String (heap-backed like WString: grows with realloc) ----
+class String {
+ public:
+  String() {}
+  String(const char* s) { if (s) copy(s, strlen(s)); }
+  String(const char* s, size_t n) { copy(s, n); }
+  String(const String& o) { copy(o.buf_, o.len_); }
+  String(String&& o) : buf_(o.buf_), len_(o.len_), cap_(o.cap_) { o.buf_ = nullptr; o.len_ = o.cap_ = 0; }
+  explicit String(int v) { char t[16]; snprintf(t, sizeof(t), "%d", v); copy(t, strlen(t)); }
+  ~String() { free(buf_); }
+  String& operator=(const String& o) { if (this != &o) copy(o.buf_, o.len_); return *this; }
+  String& operator=(String&& o) {
+    if (this != &o) { free(buf_); buf_ = o.buf_; len_ = o.len_; cap_ = o.cap_; o.buf_ = nullptr; o.len_ = o.cap_ = 0; }
+    return *this;
+  }
+  String& operator=(const char* s) { copy(s ? s : "", s ? strlen(s) : 0); return *this; }
+
+  size_t length() const { return len_; }
+  const char* c_str() const { return buf_ ? buf_ : ""; }
+  char operator[](size_t i) const { return i < len_ ? buf_[i] : 0; }
+  char& operator[](size_t i) { return buf_[i]; }
+
+  bool reserve(size_t n) {
+    if (n <= cap_ && buf_) return true;
+    char* b = (char*)realloc(buf_, n + 1);
+    if (!b) return false;
+    if (!buf_) b[0] = 0;
+    buf_ = b;
+    cap_ = n;
+    return true;
+  }
+  bool concat(const char* s, size_t n) {
+    if (!reserve(len_ + n)) return false;
+    memcpy(buf_ + len_, s, n);
+    len_ += n;
+    buf_[len_] = 0;
+    return true;
+  }
+  bool concat(const char* s) { return concat(s, strlen(s)); }
+  bool concat(const String& s) { return concat(s.c_str(), s.len_); }
+  bool concat(char c) { return concat(&c, 1); }
+  String& operator+=(const String& s) { concat(s); return *this; }
+  String& operator+=(const char* s) { concat(s); return *this; }
+  String& operator+=(char c) { concat(c); return *this; }
+  void remove(size_t index) { if (index < len_) { len_ = index; buf_[len_] = 0; } }
+  void remove(size_t index, size_t n) {
+    if (index >= len_) return;
+    if (n > len_ - index) n = len_ - index;
+    memmove(buf_ + index, buf_ + index + n, len_ - index - n + 1);
+    len_ -= n;
+  }
+  String substring(size_t from, size_t to) const {
+    if (to > len_) to = len_;
+    return from < to ? String(buf_ + from, to - from) : String();
+  }
+  String substring(size_t from) const { return substring(from, len_); }
+  bool equals(const String& o) const { return len_ == o.len_ && memcmp(c_str(), o.c_str(), len_) == 0; }
+  bool equalsIgnoreCase(const String& o) const { return len_ == o.len_ && strncasecmp(c_str(), o.c_str(), len_) == 0; }
+  bool operator==(const String& o) const { return equals(o); }
+  bool operator==(const char* s) const { return strcmp(c_str(), s) == 0; }
+  bool operator!=(const String& o) const { return !equals(o); }
+  int indexOf(char c, size_t from = 0) const {
+    for (size_t i = from; i < len_; i++) if (buf_[i] == c) return (int)i;
+    return -1;
+  }
+  bool startsWith(const char* s) const { size_t n = strlen(s); return n <= len_ && memcmp(c_str(), s, n) == 0; }
+  void trim() {
+    size_t a = 0, b = len_;
+    while (a < b && (buf_[a] == ' ' || buf_[a] == '\t' || buf_[a] == '\r' || buf_[a] == '\n')) a++;
+    while (b > a && (buf_[b - 1] == ' ' || buf_[b - 1] == '\t' || buf_[b - 1] == '\r' || buf_[b - 1] == '\n')) b--;
+    if (a > 0 || b < len_) { memmove(buf_, buf_ + a, b - a); len_ = b - a; buf_[len_] = 0; }
+  }
+
+ private:
+  void copy(const char* s, size_t n) {
+    if (!reserve(n)) return;
+    memmove(buf_, s, n);
+    len_ = n;
+    buf_[n] = 0;
+  }
+  char* buf_ = nullptr;
+  size_t len_ = 0;
+  size_t cap_ = 0;
+};
+
+// ---- Print / Stream / Serial ----
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buf, size_t n) {
+    size_t i = 0;
+    while (i < n && write(buf[i])) i++;
+    return i;
+  }
+};
+
+class Stream : public Print {
+ public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+  virtual size_t readBytes(char* buffer, size_t length) {
+    size_t n = 0;
+    while (n < length) {
+      int c = read();
+      if (c < 0) break;
+      buffer[n++] = (char)c;
+    }
+    return n;
+  }
+  size_t readBytes(uint8_t* buffer, size_t length) { return readBytes((char*)buffer, length); }
+  void setTimeout(unsigned long) {}
+};
+
+// Benchmarks set this to keep per-call logging out of the timing and the output.
+inline bool hostSerialQuiet = false;
+
+struct HostSerial {
+  template <class... A>
+  void printf(const char* f, A... a) { if (!hostSerialQuiet) ::printf(f, a...); }
+  void print(const char* s) { if (!hostSerialQuiet) fputs(s, stdout); }
+  void print(const String& s) { print(s.c_str()); }
+  void println(const char* s) { if (!hostSerialQuiet) puts(s); }
+  void println(const String& s) { println(s.c_str()); }
+  void println() { println(""); }
+};
+inline HostSerial Serial;
+
+#endif
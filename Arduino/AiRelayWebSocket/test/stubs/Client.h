@@ -0,0 +1,15 @@
+// Host stand-in for Arduino's Client: the calls HttpBodyReader makes.
+#ifndef AI_RELAY_TEST_CLIENT_H
+#define AI_RELAY_TEST_CLIENT_H
+
+#include <Arduino.h>
+
+class Client : public Stream {
+ public:
+  virtual int read(uint8_t* buf, size_t size) = 0;
+  using Stream::read;
+  virtual uint8_t connected() = 0;
+  virtual void stop() {}
+};
+
+#endif
@@ -0,0 +1,86 @@
+// Host stand-in for SPIFFS: files live in memory for the life of the process.
+#ifndef AI_RELAY_TEST_SPIFFS_H
+#define AI_RELAY_TEST_SPIFFS_H
+
+#include <Arduino.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+
+class File {
+ public:
+  File() {}
+  File(std::vector<uint8_t>* data, bool write, const std::string& path = "") : data_(data), path_(path) {
+    if (write) data_->clear();
+  }
+  // Directory: iterated with openNextFile()
+  explicit File(const std::vector<std::string>& children) : isDir_(true), children_(children) {}
+  explicit operator bool() const { return data_ != nullptr || isDir_; }
+  size_t read(uint8_t* buf, size_t n) {
+    if (!data_) return 0;
+    if (n > data_->size() - pos_) n = data_->size() - pos_;
+    memcpy(buf, data_->data() + pos_, n);
+    pos_ += n;
+    return n;
+  }
+  size_t write(const uint8_t* buf, size_t n) {
+    if (!data_) return 0;
+    data_->insert(data_->end(), buf, buf + n);
+    return n;
+  }
+  size_t size() const { return data_ ? data_->size() : 0; }
+  const char* path() const { return path_.c_str(); }
+  File openNextFile();
+  void close() {
+    data_ = nullptr;
+    isDir_ = false;
+  }
+
+ private:
+  std::vector<uint8_t>* data_ = nullptr;
+  size_t pos_ = 0;
+  std::string path_;
+  bool isDir_ = false;
+  std::vector<std::string> children_;
+  size_t next_ = 0;
+};
+
+struct HostSpiffs {
+  std::map<std::string, std::vector<uint8_t>> files;
+  size_t total = 1536 * 1024;  // a 1.5 MB SPIFFS partition
+  bool exists(const char* path) { return files.count(path) > 0; }
+  bool exists(const String& path) { return exists(path.c_str()); }
+  File open(const char* path, const char* mode = FILE_READ) {
+    bool write = mode[0] == 'w';
+    if (!write && strcmp(path, "/") == 0) {
+      std::vector<std::string> children;
+      for (const auto& f : files) children.push_back(f.first);
+      return File(children);
+    }
+    if (!write && !exists(path)) return File();
+    return File(&files[path], write, path);
+  }
+  File open(const String& path, const char* mode = FILE_READ) { return open(path.c_str(), mode); }
+  bool remove(const char* path) { return files.erase(path) > 0; }
+  bool remove(const String& path) { return remove(path.c_str()); }
+  size_t usedBytes() const {
+    size_t n = 0;
+    for (const auto& f : files) n += f.second.size();
+    return n;
+  }
+  size_t totalBytes() const { return total; }
+};
+inline HostSpiffs SPIFFS;
+
+inline File File::openNextFile() {
+  while (isDir_ && next_ < children_.size()) {
+    const std::string& path = children_[next_++];
+    if (SPIFFS.exists(path.c_str())) return File(&SPIFFS.files[path], false, path);
+  }
+  return File();
+}
+
+#endif
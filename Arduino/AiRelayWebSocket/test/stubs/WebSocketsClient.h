@@ -0,0 +1,7 @@
+// Host stand-in: globals.h only declares the STT WebSocket, the host tests never use it.
+#ifndef AI_RELAY_TEST_WEBSOCKETS_CLIENT_H
+#define AI_RELAY_TEST_WEBSOCKETS_CLIENT_H
+
+class WebSocketsClient {};
+
+#endif
@@ -0,0 +1,9 @@
+// Host stand-in: globals.h only declares the TLS client, the host tests never use it.
+#ifndef AI_RELAY_TEST_WIFI_CLIENT_SECURE_H
+#define AI_RELAY_TEST_WIFI_CLIENT_SECURE_H
+
+#include <Client.h>
+
+class WiFiClientSecure {};
+
+#endif
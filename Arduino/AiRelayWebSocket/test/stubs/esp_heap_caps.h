@@ -0,0 +1,2 @@
+// heap_caps_malloc() and the MALLOC_CAP_* flags are in the Arduino.h stub.
+#include <Arduino.h>
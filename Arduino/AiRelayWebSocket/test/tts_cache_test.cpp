@@ -0,0 +1,262 @@
+// TTS cache (tts_cache.cpp): ADPCM round trip per sample rate, LRU eviction
+// under TTS_CACHE_MAX_BYTES with a reload from flash, and the second-miss
+// admission rule on a stock-phrase/one-off mix. Built from the source so the
+// cache can be torn down and reloaded from the in-memory SPIFFS stub.
+#include "../tts_cache.cpp"
+#include "host_test.h"
+#include <math.h>
+#include <string>
+#include <vector>
+
+// Host stand-ins for the persona and the WAV helpers in audio_utils.cpp
+const char* tts_model = "playai-tts";
+const char* tts_voice = "Fritz-PlayAI";
+const char* google_tts_language = "en-US";
+static const char* promptVoice = "en-US-Chirp3-HD-Kore";
+const char* getCurrentPromptVoice() { return promptVoice; }
+float getCurrentPromptSpeakingRate() { return 1.0f; }
+float getCurrentPromptPitch() { return 0.0f; }
+
+bool parseWavHeader(const uint8_t* buf, size_t len, WavInfo* info) {
+  if (len < 44 || memcmp(buf, "RIFF", 4) != 0 || memcmp(buf + 36, "data", 4) != 0) return false;
+  info->channels = buf[22] | (buf[23] << 8);
+  memcpy(&info->sampleRate, buf + 24, 4);
+  uint32_t dataSize;
+  memcpy(&dataSize, buf + 40, 4);
+  info->dataOffset = 44;
+  info->dataSize = dataSize;
+  return true;
+}
+
+// Always 16 kHz, like the firmware's; the cache patches in the clip's rate
+void createWavHeader(uint8_t* header, int waveDataSize) {
+  uint32_t riff = waveDataSize + 36, fmtLen = 16, rate = 16000, byteRate = 32000;
+  uint16_t pcm = 1, channels = 1, align = 2, bits = 16;
+  memcpy(header, "RIFF", 4);
+  memcpy(header + 4, &riff, 4);
+  memcpy(header + 8, "WAVEfmt ", 8);
+  memcpy(header + 16, &fmtLen, 4);
+  memcpy(header + 20, &pcm, 2);
+  memcpy(header + 22, &channels, 2);
+  memcpy(header + 24, &rate, 4);
+  memcpy(header + 28, &byteRate, 4);
+  memcpy(header + 32, &align, 2);
+  memcpy(header + 34, &bits, 2);
+  memcpy(header + 36, "data", 4);
+  memcpy(header + 40, &waveDataSize, 4);
+}
+
+static bool bench = false;  // print the measurements
+
+// Voiced speech at `rate`: harmonics of a gliding f0 under three formants, in
+// syllables, peaking near -6 dBFS like the TTS providers' output.
+static std::vector<int16_t> voiced(uint32_t rate, uint32_t samples, double f0Base) {
+  std::vector<int16_t> out(samples);
+  double phase = 0;
+  for (uint32_t i = 0; i < samples; i++) {
+    double t = (double)i / rate;
+    double f0 = f0Base + 25 * sin(2 * M_PI * 0.8 * t);
+    phase += 2 * M_PI * f0 / rate;
+    double syllable = 0.2 + 0.8 * fabs(sin(M_PI * t * 4));
+    double s = 0;
+    for (int h = 1; h * f0 < rate * 0.45; h++) {
+      double f = f0 * h;
+      double formant = exp(-pow((f - 650) / 250, 2)) + 0.5 * exp(-pow((f - 1700) / 350, 2)) +
+                       0.25 * exp(-pow((f - 2900) / 450, 2)) + 0.002;
+      s += formant * sin(h * phase + h);
+    }
+    out[i] = (int16_t)lround(fmax(-32768, fmin(32767, s * 5000 * syllable)));
+  }
+  return out;
+}
+
+static std::vector<uint8_t> wavOf(const std::vector<int16_t>& pcm, uint32_t rate) {
+  std::vector<uint8_t> wav(44 + pcm.size() * 2);
+  createWavHeader(wav.data(), (int)(pcm.size() * 2));
+  uint32_t byteRate = rate * 2;
+  memcpy(&wav[24], &rate, 4);
+  memcpy(&wav[28], &byteRate, 4);
+  memcpy(&wav[44], pcm.data(), pcm.size() * 2);
+  return wav;
+}
+
+// Fresh boot: the cache forgets its RAM state and reloads from SPIFFS.
+static void reboot() {
+  cacheMutex = nullptr;
+  entryCount = 0;
+  cacheBytes = 0;
+  useClock = 0;
+  memset(recentMisses, 0, sizeof(recentMisses));
+  recentNext = 0;
+  stats = CacheStats();
+  ttsCacheBegin();
+}
+
+static void wipe() {
+  SPIFFS.files.clear();
+  reboot();
+}
+
+static void testKey() {
+  uint64_t k = ttsCacheKey(TTS_GROQ, "Hello there!");
+  CHECK(ttsCacheKey(TTS_GROQ, "  Hello there!\n") == k);
+  CHECK(ttsCacheKey(TTS_GROQ, "hello there!") != k);
+  CHECK(ttsCacheKey(TTS_GOOGLE, "Hello there!") != k);
+  uint64_t g = ttsCacheKey(TTS_GOOGLE, "Hello there!");
+  promptVoice = "en-US-Chirp3-HD-Puck";
+  CHECK(ttsCacheKey(TTS_GOOGLE, "Hello there!") != g);
+  CHECK(ttsCacheKey(TTS_GROQ, "Hello there!") == k);  // the persona voice is Google's only
+  promptVoice = "en-US-Chirp3-HD-Kore";
+}
+
+// Store and load one clip per rate; the last block is a partial one.
+static void testRoundTrip() {
+  wipe();
+  struct {
+    uint32_t rate;
+    double minSnrDb;
+  } cases[] = {{16000, 20}, {24000, 27}, {48000, 34}};
+  uint64_t key = 1;
+  for (const auto& c : cases) {
+    std::vector<int16_t> pcm = voiced(c.rate, c.rate * 2 + 333, 140);
+    std::vector<uint8_t> wav = wavOf(pcm, c.rate);
+    CHECK(ttsCacheStore(key, wav.data(), wav.size(), 900));
+    TtsAudio audio = {};
+    CHECK(ttsCacheLoad(key, &audio));
+    if (!audio.data) continue;
+    WavInfo info;
+    CHECK(parseWavHeader(audio.data, audio.len, &info));
+    CHECK(info.sampleRate == c.rate);
+    CHECK(info.dataSize == pcm.size() * 2);
+    CHECK(audio.len == wav.size());
+    const int16_t* out = (const int16_t*)(audio.data + 44);
+    double sig = 0, err = 0;
+    for (size_t i = 0; i < pcm.size(); i++) {
+      double d = (double)out[i] - pcm[i];
+      sig += (double)pcm[i] * pcm[i];
+      err += d * d;
+    }
+    double snr = 10 * log10(sig / err);
+    double ratio = (double)(pcm.size() * 2) / SPIFFS.files[clipPath(key).c_str()].size();
+    if (bench) ::printf("  ADPCM at %5u Hz: SNR %.1f dB, %.2f:1\n", (unsigned)c.rate, snr, ratio);
+    CHECK(snr >= c.minSnrDb);
+    CHECK(ratio > 3.9);
+    free(audio.data);
+    key++;
+  }
+}
+
+// 24 clips of ~23 KB into the 384 KB cap while clip 0 is replayed after every
+// store; then one clip file is lost and a stray one appears before a reboot.
+static void testEvictionAndReload() {
+  wipe();
+  const uint32_t clips = 24;
+  const uint64_t base = 0x1000;
+  for (uint32_t i = 0; i < clips; i++) {
+    std::vector<uint8_t> wav = wavOf(voiced(16000, 46000, 100 + 5 * i), 16000);
+    CHECK(ttsCacheStore(base + i, wav.data(), wav.size(), 1200));
+    TtsAudio audio = {};
+    if (ttsCacheLoad(base, &audio)) free(audio.data);
+  }
+  uint32_t kept = entryCount;
+  bool hotKept = ttsCacheContains(base);
+  if (bench) {
+    ::printf("  %u clips into %u KB: %u kept (%u KB), %u evicted, hot clip %s\n", (unsigned)clips,
+             (unsigned)(TTS_CACHE_MAX_BYTES / 1024), (unsigned)kept, (unsigned)(cacheBytes / 1024),
+             (unsigned)stats.evictions, hotKept ? "kept" : "evicted");
+  }
+  CHECK(hotKept);
+  CHECK(cacheBytes <= TTS_CACHE_MAX_BYTES);
+  CHECK(kept == 16);
+  CHECK(stats.evictions == clips - kept);
+  CHECK(!ttsCacheContains(base + 1));  // the oldest cold clips went first
+  CHECK(ttsCacheContains(base + clips - 1));
+
+  reboot();
+  uint32_t loaded = 0;
+  for (uint32_t i = 0; i < clips; i++) {
+    TtsAudio audio = {};
+    if (ttsCacheLoad(base + i, &audio)) {
+      loaded++;
+      free(audio.data);
+    }
+  }
+  CHECK(loaded == kept);
+
+  // Power lost mid-store: an indexed clip is missing and an unindexed one is left over
+  SPIFFS.remove(clipPath(base + clips - 1));
+  const char* stray = "/ttsc/00000000deadbeef";
+  SPIFFS.files[stray] = std::vector<uint8_t>(100, 0);
+  reboot();
+  CHECK(entryCount == kept - 1);
+  CHECK(!ttsCacheContains(base + clips - 1));
+  CHECK(!SPIFFS.exists(stray));
+  CHECK(SPIFFS.exists(INDEX_PATH));
+
+  ttsCacheClear();
+  CHECK(entryCount == 0 && cacheBytes == 0);
+  reboot();
+  CHECK(entryCount == 0);
+}
+
+// 400 sentences: 35% from 8 stock phrases (greetings, identity answers), the
+// rest one-off reply sentences, looked up and stored as the TTS path does.
+static void testAdmission() {
+  wipe();
+  static const char* const STOCK[] = {"Hello! How can I help?", "I'm your voice assistant.",
+                                      "Sorry, I didn't catch that.", "Timer set.",
+                                      "Good morning!", "One moment please.",
+                                      "The lights are on.", "Goodbye!"};
+  HostRng rng(16);
+  const uint32_t lookups = 400;
+  uint32_t hits = 0, stored = 0;
+  for (uint32_t i = 0; i < lookups; i++) {
+    String text;
+    if (rng.below(100) < 35) {
+      text = STOCK[rng.below(8)];
+    } else {
+      char s[96];
+      snprintf(s, sizeof(s), "Reply sentence number %u with some detail %u.", (unsigned)i,
+               (unsigned)rng.below(100000));
+      text = s;
+    }
+    uint64_t key = ttsCacheKey(TTS_GROQ, text);
+    TtsAudio audio = {};
+    if (ttsCacheLoad(key, &audio)) {
+      hits++;
+      free(audio.data);
+      continue;
+    }
+    if (ttsCacheShouldStore(key, text.length())) {
+      std::vector<uint8_t> wav = wavOf(voiced(24000, 12000, 150), 24000);
+      stored += ttsCacheStore(key, wav.data(), wav.size(), 800);
+    }
+  }
+  if (bench) {
+    ::printf("  %u lookups, 35%% stock phrases: %u hits (%.0f%%), %u stored, %u not admitted\n",
+             (unsigned)lookups, (unsigned)hits, 100.0 * hits / lookups, (unsigned)stored,
+             (unsigned)stats.notAdmitted);
+  }
+  CHECK(stats.lookups == lookups);
+  CHECK(stats.hits == hits);
+  CHECK(stored == 8);  // every stock phrase, no one-off
+  CHECK(hits + stored + stats.notAdmitted == lookups);
+  CHECK(hits > lookups / 4);
+
+  // Too long to admit, however often it misses
+  String longText = "This sentence is well over the admission limit for the cache, so it is never written "
+                    "to flash no matter how often it comes back.";
+  uint64_t key = ttsCacheKey(TTS_GROQ, longText);
+  CHECK(!ttsCacheShouldStore(key, longText.length()));
+  CHECK(!ttsCacheShouldStore(key, longText.length()));
+}
+
+int main(int argc, char** argv) {
+  bench = argc > 1 && strcmp(argv[1], "--bench") == 0;
+  hostSerialQuiet = true;
+  testKey();
+  testRoundTrip();
+  testEvictionAndReload();
+  testAdmission();
+  return hostTestResult("tts_cache_test");
+}
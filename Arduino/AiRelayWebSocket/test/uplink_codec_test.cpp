@@ -0,0 +1,163 @@
+// STT uplink codec (uplink_codec.cpp) with the mu-law uplink switched on: the
+// encoder against the G.711 reference for every input, decode/encode symmetry,
+// in-place framing, SNR on voiced speech at and under the AGC target, and the
+// encode time per frame.
+#include "../config.h"
+#undef STT_UPLINK_MULAW
+#define STT_UPLINK_MULAW 1
+#undef STT_UPLINK_ENCODING
+#define STT_UPLINK_ENCODING "pcm_mulaw"
+#include "../uplink_codec.cpp"
+#include "host_test.h"
+#include <math.h>
+#include <vector>
+
+// ---- G.711 reference (Sun's g711.c): segment table search, and the decoder ----
+
+static const int16_t SEG_UEND[8] = {0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF, 0x1FFF};
+
+static uint8_t refLinearToMulaw(int16_t pcm) {
+  int32_t v = pcm >> 2;
+  uint8_t mask = 0xFF;
+  if (v < 0) {
+    v = -v;
+    mask = 0x7F;
+  }
+  if (v > 8159) v = 8159;
+  v += 0x84 >> 2;
+  int seg = 0;
+  while (seg < 8 && v > SEG_UEND[seg]) seg++;
+  if (seg >= 8) return 0x7F ^ mask;
+  return (uint8_t)((seg << 4) | ((v >> (seg + 1)) & 0x0F)) ^ mask;
+}
+
+static int16_t mulawToLinear(uint8_t code) {
+  code = ~code;
+  int32_t t = (((code & 0x0F) << 3) + 0x84) << ((code & 0x70) >> 4);
+  return (int16_t)((code & 0x80) ? 0x84 - t : t - 0x84);
+}
+
+static bool bench = false;  // print the measurements
+
+static void testReference() {
+  uint32_t mismatches = 0;
+  for (int32_t x = -32768; x <= 32767; x++) {
+    if (linearToMulaw((int16_t)x) != refLinearToMulaw((int16_t)x)) mismatches++;
+  }
+  if (bench) ::printf("  encoder vs G.711 reference: %u of 65536 inputs differ\n", (unsigned)mismatches);
+  CHECK(mismatches == 0);
+}
+
+static void testSymmetry() {
+  // Every code's level encodes back to a code with that level (+0 and -0 share one)
+  for (int c = 0; c < 256; c++) {
+    int16_t level = mulawToLinear((uint8_t)c);
+    CHECK(mulawToLinear(linearToMulaw(level)) == level);
+  }
+  // Every input decodes to the level next to it: within half a step of the
+  // segment, plus the two bits dropped before companding
+  uint32_t outside = 0;
+  for (int32_t x = -32768; x <= 32767; x++) {
+    uint8_t code = linearToMulaw((int16_t)x);
+    int32_t err = abs(mulawToLinear(code) - x);
+    int seg = ((uint8_t)~code & 0x70) >> 4;
+    int32_t bound = (abs(x) > 32124 ? 32768 - 32124 : (4 << seg) + 3);
+    if (err > bound) outside++;
+  }
+  CHECK(outside == 0);
+  // Odd symmetry apart from the truncating >> 2
+  for (int32_t x = 4; x <= 32764; x += 4) {
+    CHECK((linearToMulaw((int16_t)x) ^ 0x80) == linearToMulaw((int16_t)-x));
+  }
+}
+
+// The frame buffer is overwritten with the wire bytes as it is read.
+static void testInPlace() {
+  HostRng rng(24);
+  std::vector<int16_t> frame(FRAME_SAMPLES), copy(FRAME_SAMPLES);
+  for (int pass = 0; pass < 20; pass++) {
+    for (auto& s : frame) s = (int16_t)(rng.next() & 0xFFFF);
+    copy = frame;
+    size_t bytes = uplinkEncode(frame.data(), frame.size());
+    CHECK(bytes == FRAME_SAMPLES);
+    CHECK(bytes == uplinkBytes(FRAME_SAMPLES));
+    const uint8_t* wire = (const uint8_t*)frame.data();
+    bool same = true;
+    for (size_t i = 0; i < copy.size(); i++) same = same && wire[i] == linearToMulaw(copy[i]);
+    CHECK(same);
+  }
+  // Odd-length keepalive
+  int16_t odd[3] = {1000, -1000, 32767};
+  CHECK(uplinkEncode(odd, 3) == 3);
+  const uint8_t* wire = (const uint8_t*)odd;
+  CHECK(wire[0] == linearToMulaw(1000) && wire[1] == linearToMulaw(-1000) && wire[2] == linearToMulaw(32767));
+  CHECK(stats.wireBytes * 2 == stats.pcmBytes);
+}
+
+// Voiced syllables scaled so the loud ones average `level` in |sample|.
+static std::vector<int16_t> speech(double level, uint32_t samples) {
+  std::vector<double> v(samples);
+  double phase = 0, loud = 0;
+  uint32_t loudCount = 0;
+  for (uint32_t i = 0; i < samples; i++) {
+    double t = (double)i / SAMPLE_RATE;
+    phase += 2 * M_PI * (120 + 30 * sin(2 * M_PI * 0.7 * t)) / SAMPLE_RATE;
+    double syllable = 0.5 - 0.5 * cos(2 * M_PI * t / 0.3);
+    double s = 0;
+    for (int h = 1; h <= 25; h++) {
+      double f = (120 + 30 * sin(2 * M_PI * 0.7 * t)) * h;
+      s += (exp(-pow((f - 700) / 300, 2)) + 0.6 * exp(-pow((f - 1800) / 400, 2)) + 0.05) * sin(h * phase + h);
+    }
+    v[i] = s * syllable;
+    if (syllable > 0.5) {
+      loud += fabs(v[i]);
+      loudCount++;
+    }
+  }
+  double scale = level / (loud / loudCount);
+  std::vector<int16_t> out(samples);
+  for (uint32_t i = 0; i < samples; i++) out[i] = (int16_t)lround(fmax(-32768, fmin(32767, v[i] * scale)));
+  return out;
+}
+
+static double snrAt(double level) {
+  std::vector<int16_t> pcm = speech(level, 4 * SAMPLE_RATE);
+  double sig = 0, err = 0;
+  for (int16_t x : pcm) {
+    double d = mulawToLinear(linearToMulaw(x)) - x;
+    sig += (double)x * x;
+    err += d * d;
+  }
+  return 10 * log10(sig / err);
+}
+
+static void testSnrAndTime() {
+  double atTarget = snrAt(AGC_TARGET_LEVEL);
+  double under = snrAt(AGC_TARGET_LEVEL / 10.0);
+  std::vector<int16_t> pcm = speech(AGC_TARGET_LEVEL, FRAME_SAMPLES);
+  const int frames = 2000;
+  uint64_t t0 = hostNowUs();
+  for (int i = 0; i < frames; i++) {
+    std::vector<int16_t> frame = pcm;
+    uplinkEncode(frame.data(), frame.size());
+  }
+  double usPerFrame = (double)(hostNowUs() - t0) / frames;
+  if (bench) {
+    ::printf("  speech SNR: %.1f dB at the AGC target, %.1f dB 20 dB under it\n", atTarget, under);
+    ::printf("  encode: %.1f us per %u ms frame on the host (incl. the frame copy)\n", usPerFrame,
+             (unsigned)FRAME_MS);
+  }
+  CHECK(atTarget > 36);
+  CHECK(under > 32);
+}
+
+int main(int argc, char** argv) {
+  bench = argc > 1 && strcmp(argv[1], "--bench") == 0;
+  hostSerialQuiet = !bench;
+  testReference();
+  testSymmetry();
+  testInPlace();
+  testSnrAndTime();
+  if (bench) uplinkCodecPrintStats();
+  return hostTestResult("uplink_codec_test");
+}
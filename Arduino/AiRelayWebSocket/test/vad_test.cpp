@@ -0,0 +1,180 @@
+// VAD (vad.cpp) on a synthetic labelled corpus: voiced segments and fricative
+// bursts in white, rumble, hum and fan noise at 20/10/5 dB SNR. Recall and
+// precision of the gate (active(), with onset debounce and hangover) and of
+// the raw per-block decision, and how often pure noise opens the gate.
+#include "../vad.h"
+#include "../config.h"
+#include "host_test.h"
+#include <math.h>
+#include <vector>
+
+static const uint32_t RATE = SAMPLE_RATE;
+
+enum NoiseKind { NOISE_WHITE, NOISE_RUMBLE, NOISE_HUM, NOISE_FAN, NOISE_KINDS };
+static const char* const NOISE_NAMES[NOISE_KINDS] = {"white", "rumble", "60 Hz hum", "fan"};
+
+// Two-pole resonator (one formant).
+struct Resonator {
+  double a1, a2, g, y1 = 0, y2 = 0;
+  Resonator(double freq, double bandwidth) {
+    double r = exp(-M_PI * bandwidth / RATE);
+    a1 = 2 * r * cos(2 * M_PI * freq / RATE);
+    a2 = -r * r;
+    g = 1 - r;
+  }
+  double step(double x) {
+    double y = g * x + a1 * y1 + a2 * y2;
+    y2 = y1;
+    y1 = y;
+    return y;
+  }
+};
+
+struct NoiseSource {
+  NoiseKind kind;
+  HostRng rng;
+  double lowpass = 0, lowpass2 = 0;
+  uint32_t n = 0;
+  NoiseSource(NoiseKind k, uint32_t seed) : kind(k), rng(seed) {}
+  // Roughly unit RMS
+  double next() {
+    double w = (rng.unit() * 2 - 1) * 1.73;
+    double t = (double)n++ / RATE;
+    switch (kind) {
+      case NOISE_WHITE:
+        return w;
+      case NOISE_RUMBLE:
+        lowpass += 0.02 * (w - lowpass);
+        lowpass2 += 0.02 * (lowpass - lowpass2);
+        return lowpass2 * 12;
+      case NOISE_HUM:
+        return 1.2 * sin(2 * M_PI * 60 * t) + 0.5 * sin(2 * M_PI * 180 * t) + 0.05 * w;
+      case NOISE_FAN:
+      default:
+        lowpass += 0.1 * (w - lowpass);
+        return lowpass * 2.6 + 0.3 * w + 0.4 * sin(2 * M_PI * 120 * t);
+    }
+  }
+};
+
+// Unit-RMS speech-like segment: voiced syllables (glottal pulses through two
+// formants) with an occasional fricative burst (high-passed noise).
+static std::vector<double> utterance(HostRng& rng, uint32_t samples) {
+  std::vector<double> out(samples);
+  double f0 = 100 + rng.below(120);
+  Resonator f1(500 + rng.below(400), 90), f2(1200 + rng.below(1000), 150);
+  double phase = 0, prev = 0, sum = 0;
+  uint32_t fricFrom = rng.below(2) ? rng.below(samples) : samples;
+  uint32_t fricLen = RATE / 10;
+  for (uint32_t i = 0; i < samples; i++) {
+    double t = (double)i / RATE;
+    double syllable = 0.35 + 0.65 * fabs(sin(M_PI * t * 4.5));
+    double v;
+    if (i >= fricFrom && i < fricFrom + fricLen) {
+      double w = rng.unit() * 2 - 1;
+      v = (w - prev) * 0.5;  // first difference: energy up high, like /s/
+      prev = w;
+    } else {
+      phase += (f0 + 20 * sin(2 * M_PI * 3 * t)) / RATE;
+      double pulse = 0;
+      if (phase >= 1) {
+        phase -= 1;
+        pulse = 1;
+      }
+      v = f1.step(pulse) * 6 + f2.step(pulse) * 3;
+    }
+    out[i] = v * syllable;
+    sum += out[i] * out[i];
+  }
+  double rms = sqrt(sum / samples);
+  for (double& v : out) v /= rms;
+  return out;
+}
+
+struct Score {
+  uint32_t speechBlocks = 0;
+  uint32_t gatedHits = 0;     // speech blocks with the gate open
+  uint32_t gatedBlocks = 0;   // blocks with the gate open
+  uint32_t rawHits = 0;
+  uint32_t rawBlocks = 0;
+  double recall() const { return speechBlocks ? (double)gatedHits / speechBlocks : 0; }
+  double precision() const { return gatedBlocks ? (double)gatedHits / gatedBlocks : 1; }
+  double rawPrecision() const { return rawBlocks ? (double)rawHits / rawBlocks : 1; }
+};
+
+static const double SPEECH_RMS = 2500;  // about the AGC target
+
+// 40 utterances of 0.8-2.5 s with 0.6-2 s of noise between them; speech blocks
+// are labelled from the clean signal (blocks inside an utterance).
+static Score runCorpus(NoiseKind kind, double snrDb, uint32_t seed) {
+  HostRng rng(seed);
+  NoiseSource noise(kind, seed * 7 + 1);
+  double noiseRms = SPEECH_RMS / pow(10, snrDb / 20);
+  Vad vad;
+  Score score;
+  std::vector<int16_t> signal;
+  std::vector<bool> label;
+  for (int u = 0; u < 40; u++) {
+    uint32_t gap = (RATE * (600 + rng.below(1400)) / 1000) / MIC_BLOCK_SAMPLES * MIC_BLOCK_SAMPLES;
+    uint32_t talk = (RATE * (800 + rng.below(1700)) / 1000) / MIC_BLOCK_SAMPLES * MIC_BLOCK_SAMPLES;
+    for (uint32_t i = 0; i < gap; i++) signal.push_back((int16_t)lround(noise.next() * noiseRms));
+    label.insert(label.end(), gap / MIC_BLOCK_SAMPLES, false);
+    std::vector<double> speech = utterance(rng, talk);
+    for (uint32_t i = 0; i < talk; i++) {
+      double v = speech[i] * SPEECH_RMS + noise.next() * noiseRms;
+      signal.push_back((int16_t)fmax(-32768, fmin(32767, lround(v))));
+    }
+    label.insert(label.end(), talk / MIC_BLOCK_SAMPLES, true);
+  }
+  for (size_t b = 0; b < label.size(); b++) {
+    bool raw = vad.process(&signal[b * MIC_BLOCK_SAMPLES], MIC_BLOCK_SAMPLES);
+    bool gate = vad.active();
+    score.speechBlocks += label[b];
+    score.gatedBlocks += gate;
+    score.gatedHits += gate && label[b];
+    score.rawBlocks += raw;
+    score.rawHits += raw && label[b];
+  }
+  return score;
+}
+
+// Share of blocks with the gate open over 60 s of noise alone.
+static double noiseOnlyOpen(NoiseKind kind, uint32_t seed) {
+  NoiseSource noise(kind, seed);
+  Vad vad;
+  uint32_t open = 0;
+  const uint32_t blocks = 60 * 1000 / MIC_BLOCK_MS;
+  for (uint32_t b = 0; b < blocks; b++) {
+    int16_t block[MIC_BLOCK_SAMPLES];
+    for (uint32_t n = 0; n < MIC_BLOCK_SAMPLES; n++) block[n] = (int16_t)lround(noise.next() * 300);
+    vad.process(block, MIC_BLOCK_SAMPLES);
+    open += vad.active();
+  }
+  return (double)open / blocks;
+}
+
+int main(int argc, char** argv) {
+  bool bench = argc > 1 && strcmp(argv[1], "--bench") == 0;
+  if (bench) ::printf("  %-10s %6s %8s %10s %14s\n", "noise", "SNR", "recall", "precision", "raw precision");
+  const double snrs[] = {20, 10, 5};
+  for (int k = 0; k < NOISE_KINDS; k++) {
+    for (double snr : snrs) {
+      Score s = runCorpus((NoiseKind)k, snr, 100 + k);
+      if (bench) {
+        ::printf("  %-10s %3.0f dB %8.2f %10.2f %14.3f\n", NOISE_NAMES[k], snr, s.recall(), s.precision(),
+                 s.rawPrecision());
+      }
+      // Gated precision is bounded by the hangover (300 ms after every utterance)
+      CHECK(s.precision() >= 0.8);
+      CHECK(s.rawPrecision() >= 0.97);
+      // White noise at 5 dB buries the weaker syllables: about half get through
+      CHECK(s.recall() >= (snr < 10 && k == NOISE_WHITE ? 0.5 : 0.95));
+    }
+  }
+  for (int k = 0; k < NOISE_KINDS; k++) {
+    double open = noiseOnlyOpen((NoiseKind)k, 200 + k);
+    if (bench) ::printf("  60 s of %s alone: gate open %.1f%% of the time\n", NOISE_NAMES[k], open * 100);
+    CHECK(open < 0.01);
+  }
+  return hostTestResult("vad_test");
+}
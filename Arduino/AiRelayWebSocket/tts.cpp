@@ -3,6 +3,12 @@
 #include "config.h"
 #include "globals.h"
 #include "prompts.h"
+#include "net_pool.h"
+#include "http_reader.h"
+#include "wav_stream.h"
+#include "audio_out.h"
+#include "turn_timeline.h"
+#include "tts_cache.h"
 #include <Arduino.h>
 #include <HTTPClient.h>
 #include <WiFiClientSecure.h>
@@ -14,44 +20,204 @@
 #include <esp_heap_caps.h>
 #endif
 
-void speakGroqTTS(String text) {
+static const char* GROQ_TTS_URL = "https://api.groq.com/openai/v1/audio/speech";
+
+static String googleTtsUrl() {
+  return String("https://texttospeech.googleapis.com/v1/text:synthesize?key=") + google_tts_api_key;
+}
+
+static void addGroqTtsHeaders(HTTPClient& http) {
+  http.addHeader("Authorization", "Bearer " + String(groq_api_key));
+  http.addHeader("Content-Type", "application/json");
+}
+
+static String buildGroqTtsPayload(const String& text) {
+  JsonDocument doc;
+  doc["model"] = tts_model;
+  doc["voice"] = tts_voice;
+  doc["input"] = text;
+  doc["response_format"] = "wav";
+  String payload;
+  serializeJson(doc, payload);
+  return payload;
+}
+
+// SSML with the current prompt's voice, speaking rate and pitch.
+static String buildGoogleTtsPayload(const String& text) {
+  const char* voiceName = getCurrentPromptVoice();
+  float speakingRate = getCurrentPromptSpeakingRate();
+  float pitch = getCurrentPromptPitch();
+
+  // Escape text for SSML (escape &, <, >)
+  String escapedText = text;
+  escapedText.replace("&", "&amp;");
+  escapedText.replace("<", "&lt;");
+  escapedText.replace(">", "&gt;");
+
+  // Build SSML with prosody for rate and pitch
+  String ssmlText = "<speak><prosody rate=\"" + String(speakingRate) +
+                    "\" pitch=\"" + String(pitch) + "st\">" +
+                    escapedText + "</prosody></speak>";
+
+  JsonDocument requestDoc;
+  requestDoc["input"]["ssml"] = ssmlText;
+  requestDoc["voice"]["languageCode"] = google_tts_language;
+  requestDoc["voice"]["name"] = voiceName;
+  requestDoc["audioConfig"]["audioEncoding"] = "LINEAR16";
+  requestDoc["audioConfig"]["sampleRateHertz"] = 24000;
+
+  String payload;
+  serializeJson(requestDoc, payload);
+  return payload;
+}
+
+static bool ttsAudioAppend(TtsAudio* audio, const uint8_t* data, size_t len) {
+  if (audio->len + len > audio->capacity) {
+    size_t newCap = audio->capacity ? audio->capacity : 65536;
+    while (newCap < audio->len + len) newCap *= 2;
+    uint8_t* grown = nullptr;
+#if defined(ESP32)
+    if (psramFound()) grown = (uint8_t*)heap_caps_realloc(audio->data, newCap, MALLOC_CAP_SPIRAM);
+#endif
+    if (!grown) grown = (uint8_t*)realloc(audio->data, newCap);
+    if (!grown) {
+      Serial.printf("TTS fetch: out of memory at %u bytes\n", (unsigned)newCap);
+      return false;
+    }
+    audio->data = grown;
+    audio->capacity = newCap;
+  }
+  memcpy(audio->data + audio->len, data, len);
+  audio->len += len;
+  return true;
+}
+
+static void appendTtsBytes(uint8_t* data, size_t len, void* ctx) {
+  ttsAudioAppend((TtsAudio*)ctx, data, len);
+}
+
+// Lets HTTPClient::writeToStream() (which handles chunked/Content-Length) fill a TtsAudio.
+class TtsAudioWriter : public Stream {
+ public:
+  explicit TtsAudioWriter(TtsAudio* audio) : audio_(audio) {}
+  size_t write(uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t* buf, size_t size) override { return ttsAudioAppend(audio_, buf, size) ? size : 0; }
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+
+ private:
+  TtsAudio* audio_;
+};
+
+#if TTS_CACHE
+// Play a cached clip straight from flash; false on a miss.
+static bool speakCachedTts(uint64_t key) {
+  TtsAudio audio = {};
+  if (!ttsCacheLoad(key, &audio)) return false;
+  WavInfo wav;
+  if (parseWavHeader(audio.data, audio.len, &wav)) {
+    timelineMark(TL_TTS_SENT);
+    timelineMark(TL_TTS_FIRST_BYTE);
+    audioOutSessionBegin();
+    audioOutSetFormat(wav.sampleRate, wav.channels);
+    audioOutWrite(audio.data + wav.dataOffset, (audio.len - wav.dataOffset) & ~(size_t)1, portMAX_DELAY);
+    audioOutDrain(60000);
+  }
+  freeTtsAudio(&audio);
+  ttsCooldownUntilMs = millis() + 500;
+  stopSpeakerNoise();
+  return true;
+}
+#endif
+
+// Every TTS path plays through the audio_out ring. If it could not be allocated,
+// don't spend a request on audio nobody hears; the reply stays text only.
+static bool ttsOutputReady(const char* who) {
+  if (audioOutBegin()) return true;
+  Serial.printf("%s: no audio output, reply left as text\n", who);
+  return false;
+}
+
+bool speakGroqTTS(String text, const char* cachePath) {
   Serial.println("Requesting Groq TTS...");
+  if (!ttsOutputReady("Groq TTS")) return false;
   digitalWrite(PIN_RED, LOW);
   ttsPlaying = true;
+#if TTS_CACHE
+  uint64_t cacheKey = ttsCacheKey(TTS_GROQ, text);
+  if (speakCachedTts(cacheKey)) {
+    digitalWrite(PIN_RED, HIGH);
+    ttsPlaying = false;
+    return true;
+  }
+#endif
   
   if (WiFi.status() != WL_CONNECTED) {
     Serial.println("Groq TTS: WiFi not connected!");
     digitalWrite(PIN_RED, HIGH);
     ttsPlaying = false;
-    return;
+    return false;
   }
   
-  HTTPClient http;
-  http.setTimeout(20000);
-  http.setReuse(false); // Don't reuse connections
-  
   Serial.println("Groq TTS: Connecting...");
-  http.begin("https://api.groq.com/openai/v1/audio/speech");
-  
-  http.addHeader("Authorization", "Bearer " + String(groq_api_key));
-  http.addHeader("Content-Type", "application/json");
-  JsonDocument doc;
-  doc["model"] = tts_model;
-  doc["voice"] = tts_voice;
-  doc["input"] = text;
-  doc["response_format"] = "wav";
-  String payload;
-  serializeJson(doc, payload);
+  NetLease lease;
+  if (!netBeginHttp(NET_HOST_GROQ, &lease, GROQ_TTS_URL)) {
+    Serial.println("Groq TTS: connection failed");
+    digitalWrite(PIN_RED, HIGH);
+    ttsPlaying = false;
+    return false;
+  }
+  netHttp(lease).setTimeout(20000);
+  addGroqTtsHeaders(netHttp(lease));
+  String payload = buildGroqTtsPayload(text);
   
   Serial.println("Groq TTS: Sending POST...");
-  int httpCode = http.POST(payload);
+  timelineMark(TL_TTS_SENT);
+#if TTS_CACHE
+  unsigned long requestMs = millis();
+#endif
+  int httpCode = netHttp(lease).POST(payload);
+  if (netRetryStale(&lease, httpCode, GROQ_TTS_URL)) {
+    addGroqTtsHeaders(netHttp(lease));
+    httpCode = netHttp(lease).POST(payload);
+  }
+  bool keepAlive = false;
+  bool played = false;
+#if TTS_CACHE
+  TtsAudio copy = {};
+  uint32_t firstAudioMs = 0;
+#endif
   if (httpCode == 200) {
-    Serial.println("Groq TTS: Success!");
-    File outfile = SPIFFS.open("/tts.wav", FILE_WRITE);
-    if (outfile) {
-      http.writeToStream(&outfile);
-      outfile.close();
-      playWavFile("/tts.wav");
+    timelineMark(TL_TTS_FIRST_BYTE);
+    Serial.println("Groq TTS: Success! Streaming to speaker...");
+    // PCM goes to I2S while the body downloads; flash is only touched when caching is asked for
+    WavStreamPlayer player;
+    File cacheFile;
+    if (player.begin()) {
+      if (cachePath) {
+        cacheFile = SPIFFS.open(cachePath, FILE_WRITE);
+        if (cacheFile) player.setTee(&cacheFile);
+      }
+#if TTS_CACHE
+      // Keep a copy of the WAV when this text earned a place in the flash cache
+      unsigned long headersMs = millis() - requestMs;
+      TtsAudioWriter copier(&copy);
+      if (!cachePath && ttsCacheShouldStore(cacheKey, text.length())) player.setTee(&copier);
+#endif
+      keepAlive = netHttp(lease).writeToStream(&player) > 0;
+      played = player.finish();
+      if (cacheFile) cacheFile.close();
+      AudioOutStats out;
+      audioOutSessionStats(&out);
+      Serial.printf("Groq TTS: %u bytes played, first audio after %u ms, ring peak %u/%u, underruns %u\n",
+                    (unsigned)player.bytesQueued(), (unsigned)out.firstAudioMs,
+                    (unsigned)out.highWater, (unsigned)audioOutRingSize(), (unsigned)out.underruns);
+#if TTS_CACHE
+      firstAudioMs = headersMs + out.firstAudioMs;
+#endif
+    } else {
+      Serial.println("Groq TTS: no audio output, reply left as text");
     }
   } else {
     Serial.printf("TTS Error: %d\n", httpCode);
@@ -59,19 +225,30 @@ void speakGroqTTS(String text) {
       Serial.printf("Connection failed. WiFi status: %d\n", WiFi.status());
     }
   }
-  http.end();
+  netEndHttp(&lease, keepAlive);
+#if TTS_CACHE
+  if (copy.len > 0 && keepAlive) ttsCacheStore(cacheKey, copy.data, copy.len, firstAudioMs);
+  freeTtsAudio(&copy);
+#endif
   digitalWrite(PIN_RED, HIGH);
   ttsPlaying = false;
   ttsCooldownUntilMs = millis() + 800;
   stopSpeakerNoise();
+  return played;
 }
 
-// Read chunked HTTP body in small chunks; find "audioContent" base64; decode and play PCM as we go.
+// Read the HTTP body in small blocks; find "audioContent" base64; decode and hand PCM to a sink as we go.
 static inline bool isBase64Char(char c) {
   return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '+' || c == '/' || c == '=';
 }
 
-bool streamGoogleTTSChunked(Stream* stream, HTTPClient& http) {
+// Decoded bytes are passed in a writable buffer so sinks can apply volume in place.
+typedef void (*TtsBytesSink)(uint8_t* data, size_t len, void* ctx);
+
+// bodyComplete (optional) is set once the whole body, trailer included, has been read,
+// i.e. the connection is clean for keep-alive reuse.
+static size_t decodeGoogleAudioContent(Client* stream, HTTPClient& http, TtsBytesSink sink, void* ctx,
+                                       uint32_t* decodeUs, bool* bodyComplete) {
   const char* needle = "\"audioContent\":";
   const size_t needleLen = 15;
   size_t needleIdx = 0;
@@ -80,157 +257,71 @@ bool streamGoogleTTSChunked(Stream* stream, HTTPClient& http) {
 
   const size_t B64_BLOCK = 4096;   // decode in blocks of 4096 chars -> 3072 bytes
   const size_t READ_BUF = 2048;
-  const size_t HEADER_BUF = 256;
 
   char* readBuf = (char*)malloc(READ_BUF);
   char* b64Buf = (char*)malloc(B64_BLOCK + 4);
   uint8_t* pcmBuf = (uint8_t*)malloc(3072);
-  uint8_t* headerBuf = (uint8_t*)malloc(HEADER_BUF);
-  if (!readBuf || !b64Buf || !pcmBuf || !headerBuf) {
+  if (!readBuf || !b64Buf || !pcmBuf) {
     Serial.println("Stream: alloc failed");
     if (readBuf) free(readBuf);
     if (b64Buf) free(b64Buf);
     if (pcmBuf) free(pcmBuf);
-    if (headerBuf) free(headerBuf);
-    return false;
+    return 0;
   }
   size_t b64Len = 0;
-  size_t headerLen = 0;
-  bool wavParsed = false;
-  uint32_t sampleRate = 24000;
-  uint16_t channels = 1;
-  size_t dataOffset = 0;
-  size_t dataSize = 0;
-  size_t totalPlayed = 0;
-
-  auto flushDecode = [&](size_t decodeChars, size_t decodedBytes) {
-    if (decodedBytes == 0) return;
-    if (!wavParsed) {
-      size_t toCopy = (HEADER_BUF - headerLen) < decodedBytes ? (HEADER_BUF - headerLen) : decodedBytes;
-      memcpy(headerBuf + headerLen, pcmBuf, toCopy);
-      headerLen += toCopy;
-      if (headerLen >= HEADER_BUF) {
-        if (headerBuf[0] != 'R' || headerBuf[1] != 'I' || headerBuf[2] != 'F' || headerBuf[3] != 'F') {
-          Serial.println("Stream: invalid WAV");
-          return;
-        }
-        size_t pos = 12;
-        while (pos + 8 <= HEADER_BUF && pos < 200) {
-          uint32_t chunkLen = headerBuf[pos+4] | (headerBuf[pos+5]<<8) | (headerBuf[pos+6]<<16) | (headerBuf[pos+7]<<24);
-          if (memcmp(headerBuf + pos, "fmt ", 4) == 0 && pos + 16 <= HEADER_BUF) {
-            channels = headerBuf[pos+10] | (headerBuf[pos+11]<<8);
-            sampleRate = headerBuf[pos+12] | (headerBuf[pos+13]<<8) | (headerBuf[pos+14]<<16) | (headerBuf[pos+15]<<24);
-          }
-          if (memcmp(headerBuf + pos, "data", 4) == 0) {
-            dataOffset = pos + 8;
-            dataSize = chunkLen;
-            break;
-          }
-          pos += 8 + chunkLen;
-          if (chunkLen & 1) pos++;
-        }
-        if (dataOffset == 0 || dataSize == 0) {
-          Serial.println("Stream: no data chunk");
-          return;
-        }
-        i2s_set_clk(I2S_NUM_1, sampleRate, I2S_BITS_PER_SAMPLE_16BIT, channels == 2 ? I2S_CHANNEL_STEREO : I2S_CHANNEL_MONO);
-        i2s_zero_dma_buffer(I2S_NUM_1);
-        wavParsed = true;
-        size_t headerPcm = HEADER_BUF - dataOffset;
-        applyVolumeToPcm16(headerBuf + dataOffset, headerPcm);
-        size_t written = 0;
-        i2s_write(I2S_NUM_1, headerBuf + dataOffset, headerPcm, &written, portMAX_DELAY);
-        totalPlayed += written;
-        size_t fromFirst = decodedBytes - toCopy;
-        if (fromFirst > 0) {
-          applyVolumeToPcm16(pcmBuf + toCopy, fromFirst);
-          i2s_write(I2S_NUM_1, pcmBuf + toCopy, fromFirst, &written, portMAX_DELAY);
-          totalPlayed += written;
-        }
-      }
-    } else {
-      applyVolumeToPcm16(pcmBuf, decodedBytes);
-      size_t written = 0;
-      i2s_write(I2S_NUM_1, pcmBuf, decodedBytes, &written, portMAX_DELAY);
-      totalPlayed += written;
-    }
-  };
+  size_t totalDecoded = 0;
+  uint32_t decodeTimeUs = 0;
 
   unsigned long startMs = millis();
-  size_t totalBytesRead = 0;
-
-  while (http.connected() && state != 3 && (millis() - startMs < 60000)) {
-    String chunkSizeLine;
-    while (stream->available() && chunkSizeLine.length() < 16) {
-      char c = stream->read();
-      if (c == '\n') break;
-      if (c != '\r') chunkSizeLine += c;
-    }
-    chunkSizeLine.trim();
-    int sc = chunkSizeLine.indexOf(';');
-    if (sc >= 0) chunkSizeLine = chunkSizeLine.substring(0, sc);
-    chunkSizeLine.trim();
-    if (chunkSizeLine.length() == 0) {
-      delay(5);
-      continue;
-    }
-    size_t chunkSize = 0;
-    for (size_t i = 0; i < chunkSizeLine.length(); i++) {
-      char c = chunkSizeLine.charAt(i);
-      uint8_t n = 0;
-      if (c >= '0' && c <= '9') n = c - '0';
-      else if (c >= 'A' && c <= 'F') n = c - 'A' + 10;
-      else if (c >= 'a' && c <= 'f') n = c - 'a' + 10;
-      else break;
-      chunkSize = (chunkSize << 4) + n;
-    }
-    if (chunkSize == 0) break;
-
-    while (chunkSize > 0 && (millis() - startMs < 60000)) {
-      size_t toRead = (chunkSize < READ_BUF) ? chunkSize : READ_BUF;
-      size_t n = stream->readBytes((uint8_t*)readBuf, toRead);
-      if (n == 0) { delay(1); continue; }
-      chunkSize -= n;
-      totalBytesRead += n;
-
-      for (size_t i = 0; i < n && state != 3; i++) {
-        char c = readBuf[i];
-        if (state == 0) {
-          if (c == needle[needleIdx]) {
-            needleIdx++;
-            if (needleIdx == needleLen) { state = 1; needleIdx = 0; }
-          } else needleIdx = 0;
-          continue;
-        }
-        if (state == 1) {
-          if (c == ' ' || c == '\t' || c == '\r' || c == '\n') continue;
-          if (c == '"') { state = 2; continue; }
-          state = 0;
+
+  // Google answers chunked (no Content-Length); the reader removes the framing.
+  // Reading goes on after the closing quote so the whole body is consumed.
+  HttpBodyReader body(stream, 60000);
+  int size = http.getSize();
+  body.beginBody(size, size < 0);
+  size_t n;
+  while (millis() - startMs < 60000 && (n = body.readBytes(readBuf, READ_BUF)) > 0) {
+    for (size_t i = 0; i < n && state != 3; i++) {
+      char c = readBuf[i];
+      if (state == 0) {
+        if (c == needle[needleIdx]) {
+          needleIdx++;
+          if (needleIdx == needleLen) { state = 1; needleIdx = 0; }
+        } else needleIdx = 0;
+        continue;
+      }
+      if (state == 1) {
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n') continue;
+        if (c == '"') { state = 2; continue; }
+        state = 0;
+        continue;
+      }
+      if (state == 2) {
+        if (afterBackslash) {
+          afterBackslash = false;
+          if (c == '"' || c == '\\') { if (b64Len < B64_BLOCK + 4) b64Buf[b64Len++] = c; }
           continue;
         }
-        if (state == 2) {
-          if (afterBackslash) {
-            afterBackslash = false;
-            if (c == '"' || c == '\\') { if (b64Len < B64_BLOCK + 4) b64Buf[b64Len++] = c; }
-            continue;
-          }
-          if (c == '\\') { afterBackslash = true; continue; }
-          if (c == '"') { state = 3; break; }
-          if (isBase64Char(c)) {
-            if (b64Len < B64_BLOCK + 4) b64Buf[b64Len++] = c;
-            if (b64Len >= B64_BLOCK) {
-              size_t toDecode = B64_BLOCK;
-              size_t outLen = 0;
-              int ret = mbedtls_base64_decode(pcmBuf, 3072, &outLen, (const uint8_t*)b64Buf, toDecode);
-              if (ret == 0 && outLen > 0) flushDecode(toDecode, outLen);
-              memmove(b64Buf, b64Buf + toDecode, b64Len - toDecode);
-              b64Len -= toDecode;
+        if (c == '\\') { afterBackslash = true; continue; }
+        if (c == '"') { state = 3; break; }
+        if (isBase64Char(c)) {
+          if (b64Len < B64_BLOCK + 4) b64Buf[b64Len++] = c;
+          if (b64Len >= B64_BLOCK) {
+            size_t toDecode = B64_BLOCK;
+            size_t outLen = 0;
+            uint32_t t0 = micros();
+            int ret = mbedtls_base64_decode(pcmBuf, 3072, &outLen, (const uint8_t*)b64Buf, toDecode);
+            decodeTimeUs += micros() - t0;
+            if (ret == 0 && outLen > 0) {
+              totalDecoded += outLen;
+              sink(pcmBuf, outLen, ctx);
             }
+            memmove(b64Buf, b64Buf + toDecode, b64Len - toDecode);
+            b64Len -= toDecode;
           }
         }
       }
     }
-    for (int i = 0; i < 2 && stream->available(); i++) stream->read();
   }
 
   if (b64Len > 0 && state == 3) {
@@ -243,47 +334,81 @@ bool streamGoogleTTSChunked(Stream* stream, HTTPClient& http) {
     size_t maxOut = (padLen * 3) / 4 + 4;
     if (maxOut > 3072) maxOut = 3072;
     size_t outLen = 0;
+    uint32_t t0 = micros();
     int ret = mbedtls_base64_decode(pcmBuf, maxOut, &outLen, (const uint8_t*)b64Buf, padLen);
-    if (ret == 0 && outLen > 0) flushDecode(padLen, outLen);
+    decodeTimeUs += micros() - t0;
+    if (ret == 0 && outLen > 0) {
+      totalDecoded += outLen;
+      sink(pcmBuf, outLen, ctx);
+    }
   }
 
   free(readBuf);
   free(b64Buf);
   free(pcmBuf);
-  free(headerBuf);
+  if (decodeUs) *decodeUs = decodeTimeUs;
+  if (bodyComplete) *bodyComplete = body.complete() && !body.closeAfter();
+  return totalDecoded;
+}
 
-  if (!wavParsed) {
+static void playWavBytes(uint8_t* data, size_t len, void* ctx) {
+  ((WavStreamPlayer*)ctx)->write(data, len);
+}
+
+bool streamGoogleTTSChunked(Client* stream, HTTPClient& http, bool* bodyComplete, Print* tee) {
+  WavStreamPlayer player;
+  if (!player.begin()) return false;
+  player.setTee(tee);
+  decodeGoogleAudioContent(stream, http, playWavBytes, &player, nullptr, bodyComplete);
+  bool parsed = player.headerParsed();
+  player.finish();
+
+  if (!parsed) {
     Serial.println("Stream: no WAV header received");
     return false;
   }
-  uint8_t silence[512] = {0};
-  size_t written = 0;
-  i2s_write(I2S_NUM_1, silence, 512, &written, 100);
+  AudioOutStats out;
+  audioOutSessionStats(&out);
+  Serial.printf("Stream: first audio after %u ms, ring peak %u/%u, underruns %u\n",
+                (unsigned)out.firstAudioMs, (unsigned)out.highWater,
+                (unsigned)audioOutRingSize(), (unsigned)out.underruns);
   return true;
 }
 
-void speakGoogleTTS(const String& text) {
-  if (text.length() == 0) return;
+bool speakGoogleTTS(const String& text) {
+  if (text.length() == 0) return false;
   Serial.println("Requesting Google TTS...");
+  if (!ttsOutputReady("Google TTS")) return false;
   digitalWrite(PIN_RED, LOW);
   ttsPlaying = true;
+#if TTS_CACHE
+  uint64_t cacheKey = ttsCacheKey(TTS_GOOGLE, text);
+  if (speakCachedTts(cacheKey)) {
+    digitalWrite(PIN_RED, HIGH);
+    ttsPlaying = false;
+    return true;
+  }
+#endif
 
   if (WiFi.status() != WL_CONNECTED) {
     Serial.println("Google TTS: WiFi not connected!");
     digitalWrite(PIN_RED, HIGH);
     ttsPlaying = false;
-    speakGroqTTS(text);
-    return;
+    return speakGroqTTS(text);
   }
 
-  HTTPClient http;
-  http.setTimeout(60000);
-  http.setReuse(false); // Don't reuse connections
-  String url = String("https://texttospeech.googleapis.com/v1/text:synthesize?key=") + google_tts_api_key;
+  String url = googleTtsUrl();
   
   Serial.println("Google TTS: Connecting...");
-  http.begin(url);
-  http.addHeader("Content-Type", "application/json");
+  NetLease lease;
+  if (!netBeginHttp(NET_HOST_GOOGLE_TTS, &lease, url)) {
+    Serial.println("Google TTS: connection failed");
+    digitalWrite(PIN_RED, HIGH);
+    ttsPlaying = false;
+    return speakGroqTTS(text);
+  }
+  netHttp(lease).setTimeout(60000);
+  netHttp(lease).addHeader("Content-Type", "application/json");
 
   // Get character-specific voice settings
   const char* voiceName = getCurrentPromptVoice();
@@ -291,36 +416,28 @@ void speakGoogleTTS(const String& text) {
   float pitch = getCurrentPromptPitch();
   
   Serial.printf("Google TTS: Voice=%s, Rate=%.2f, Pitch=%.1fst\n", voiceName, speakingRate, pitch);
-  
-  // Escape text for SSML (escape &, <, >)
-  String escapedText = text;
-  escapedText.replace("&", "&amp;");
-  escapedText.replace("<", "&lt;");
-  escapedText.replace(">", "&gt;");
-  
-  // Build SSML with prosody for rate and pitch
-  String ssmlText = "<speak><prosody rate=\"" + String(speakingRate) + 
-                    "\" pitch=\"" + String(pitch) + "st\">" + 
-                    escapedText + "</prosody></speak>";
-  
-  JsonDocument requestDoc;
-  requestDoc["input"]["ssml"] = ssmlText;
-  requestDoc["voice"]["languageCode"] = google_tts_language;
-  requestDoc["voice"]["name"] = voiceName;
-  requestDoc["audioConfig"]["audioEncoding"] = "LINEAR16";
-  requestDoc["audioConfig"]["sampleRateHertz"] = 24000;
-
-  String payload;
-  serializeJson(requestDoc, payload);
+  String payload = buildGoogleTtsPayload(text);
 
-  int httpCode = http.POST(payload);
+  timelineMark(TL_TTS_SENT);
+#if TTS_CACHE
+  unsigned long requestMs = millis();
+#endif
+  int httpCode = netHttp(lease).POST(payload);
+  if (netRetryStale(&lease, httpCode, url)) {
+    netHttp(lease).addHeader("Content-Type", "application/json");
+    httpCode = netHttp(lease).POST(payload);
+  }
+#if TTS_CACHE
+  unsigned long headersMs = millis() - requestMs;
+#endif
+  HTTPClient& http = netHttp(lease);
+  if (httpCode == 200) timelineMark(TL_TTS_FIRST_BYTE);
   if (httpCode != 200) {
     Serial.printf("Google TTS HTTP error: %d\n", httpCode);
-    http.end();
+    netEndHttp(&lease, false);
     digitalWrite(PIN_RED, HIGH);
     ttsPlaying = false;
-    speakGroqTTS(text);
-    return;
+    return speakGroqTTS(text);
   }
 
 #if defined(ESP32)
@@ -330,29 +447,113 @@ void speakGoogleTTS(const String& text) {
   WiFiClient* stream = http.getStreamPtr();
   if (!stream) {
     Serial.println("No response stream");
-    http.end();
+    netEndHttp(&lease, false);
     digitalWrite(PIN_RED, HIGH);
     ttsPlaying = false;
-    speakGroqTTS(text);
-    return;
+    return speakGroqTTS(text);
   }
 
   Serial.println("Streaming download and play...");
-  bool streamOk = streamGoogleTTSChunked(stream, http);
-  http.end();
+  bool bodyComplete = false;
+#if TTS_CACHE
+  TtsAudio copy = {};
+  TtsAudioWriter copier(&copy);
+  bool keepCopy = ttsCacheShouldStore(cacheKey, text.length());
+  bool streamOk = streamGoogleTTSChunked(stream, http, &bodyComplete, keepCopy ? &copier : nullptr);
+  netEndHttp(&lease, bodyComplete);
+  if (streamOk && bodyComplete && copy.len > 0) {
+    AudioOutStats out;
+    audioOutSessionStats(&out);
+    ttsCacheStore(cacheKey, copy.data, copy.len, headersMs + out.firstAudioMs);
+  }
+  freeTtsAudio(&copy);
+#else
+  bool streamOk = streamGoogleTTSChunked(stream, http, &bodyComplete);
+  netEndHttp(&lease, bodyComplete);
+#endif
 
   if (!streamOk) {
     Serial.println("Streaming failed, falling back to Groq");
     digitalWrite(PIN_RED, HIGH);
     ttsPlaying = false;
-    speakGroqTTS(text);
-    return;
+    return speakGroqTTS(text);
   }
 
   digitalWrite(PIN_RED, HIGH);
   ttsPlaying = false;
   ttsCooldownUntilMs = millis() + 500;
   stopSpeakerNoise();
+  return true;
+}
+
+void freeTtsAudio(TtsAudio* audio) {
+  if (audio->data) free(audio->data);
+  audio->data = nullptr;
+  audio->len = 0;
+  audio->capacity = 0;
+}
+
+bool fetchGroqTTSAudio(const String& text, TtsAudio* out) {
+  out->len = 0;
+  out->decodeUs = 0;
+  if (WiFi.status() != WL_CONNECTED) {
+    Serial.println("Groq TTS: WiFi not connected!");
+    return false;
+  }
+  NetLease lease;
+  if (!netBeginHttp(NET_HOST_GROQ, &lease, GROQ_TTS_URL)) return false;
+  netHttp(lease).setTimeout(20000);
+  addGroqTtsHeaders(netHttp(lease));
+  String payload = buildGroqTtsPayload(text);
+  timelineMark(TL_TTS_SENT);
+  int httpCode = netHttp(lease).POST(payload);
+  if (netRetryStale(&lease, httpCode, GROQ_TTS_URL)) {
+    addGroqTtsHeaders(netHttp(lease));
+    httpCode = netHttp(lease).POST(payload);
+  }
+  if (httpCode != 200) {
+    Serial.printf("Groq TTS fetch error: %d\n", httpCode);
+    netEndHttp(&lease, false);
+    return false;
+  }
+  timelineMark(TL_TTS_FIRST_BYTE);
+  TtsAudioWriter writer(out);
+  int written = netHttp(lease).writeToStream(&writer);
+  netEndHttp(&lease, written > 0);
+  return written > 0 && out->len > 44;
+}
+
+bool fetchGoogleTTSAudio(const String& text, TtsAudio* out) {
+  out->len = 0;
+  out->decodeUs = 0;
+  if (WiFi.status() != WL_CONNECTED) {
+    Serial.println("Google TTS: WiFi not connected!");
+    return false;
+  }
+  String url = googleTtsUrl();
+  NetLease lease;
+  if (!netBeginHttp(NET_HOST_GOOGLE_TTS, &lease, url)) return false;
+  netHttp(lease).setTimeout(60000);
+  netHttp(lease).addHeader("Content-Type", "application/json");
+  String payload = buildGoogleTtsPayload(text);
+  timelineMark(TL_TTS_SENT);
+  int httpCode = netHttp(lease).POST(payload);
+  if (netRetryStale(&lease, httpCode, url)) {
+    netHttp(lease).addHeader("Content-Type", "application/json");
+    httpCode = netHttp(lease).POST(payload);
+  }
+  if (httpCode != 200) {
+    Serial.printf("Google TTS fetch error: %d\n", httpCode);
+    netEndHttp(&lease, false);
+    return false;
+  }
+  timelineMark(TL_TTS_FIRST_BYTE);
+  HTTPClient& http = netHttp(lease);
+  WiFiClient* stream = http.getStreamPtr();
+  bool bodyComplete = false;
+  size_t decoded = stream ? decodeGoogleAudioContent(stream, http, appendTtsBytes, out, &out->decodeUs, &bodyComplete) : 0;
+  netEndHttp(&lease, bodyComplete);
+  return decoded > 44 && out->len == decoded;
 }
 
 void streamDecodeAndPlay(const char* b64Str) {
@@ -475,31 +676,13 @@ void streamDecodeAndPlay(const char* b64Str) {
                 channels == 1 ? "Mono" : "Stereo",
                 (unsigned)dataSize);
 
-  // Configure I2S
-  i2s_set_clk(I2S_NUM_1, sampleRate, I2S_BITS_PER_SAMPLE_16BIT,
-             channels == 2 ? I2S_CHANNEL_STEREO : I2S_CHANNEL_MONO);
-  i2s_zero_dma_buffer(I2S_NUM_1);
-
-  // Apply volume to entire buffer at once
-  applyVolumeToPcm16(wavBuffer + dataOffset, dataSize);
-
-  // Play in 32KB chunks for faster playback (less loop overhead)
-  const size_t PLAY_CHUNK = 32768;
-  size_t totalWritten = 0;
-
-  for (size_t offset = 0; offset < dataSize; offset += PLAY_CHUNK) {
-    size_t toWrite = (dataSize - offset) < PLAY_CHUNK ? (dataSize - offset) : PLAY_CHUNK;
-    size_t written = 0;
-    i2s_write(I2S_NUM_1, wavBuffer + dataOffset + offset, toWrite, &written, portMAX_DELAY);
-    totalWritten += written;
-    if ((offset / PLAY_CHUNK) % 3 == 0) Serial.print(".");
-  }
-
-  Serial.printf("\nPlayed %u bytes\n", (unsigned)totalWritten);
+  // Queue on the audio output task (it applies volume and owns I2S)
+  audioOutSessionBegin();
+  audioOutSetFormat(sampleRate, channels);
+  size_t totalWritten = audioOutWrite(wavBuffer + dataOffset, dataSize, portMAX_DELAY);
+  audioOutDrain(60000);
 
-  uint8_t silence[512] = {0};
-  size_t written = 0;
-  i2s_write(I2S_NUM_1, silence, 512, &written, 100);
+  Serial.printf("Played %u bytes\n", (unsigned)totalWritten);
 
   if (wavInPsram) heap_caps_free(wavBuffer); else free(wavBuffer);
 }
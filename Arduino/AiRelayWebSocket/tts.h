@@ -2,13 +2,31 @@
 #define AI_RELAY_WEBSOCKET_TTS_H
 
 #include <Arduino.h>
+#include <Client.h>
 
 class HTTPClient;  // forward declaration (full header only in tts.cpp)
 
-void speakGroqTTS(String text);
-void speakGoogleTTS(const String& text);
+// cachePath: also save the WAV to SPIFFS (otherwise it is streamed straight to I2S)
+// Both return false if no audio was played (no output ring, network or API error),
+// so the caller can fall back to showing the reply as text.
+bool speakGroqTTS(String text, const char* cachePath = nullptr);
+bool speakGoogleTTS(const String& text);
 void streamDecodeAndPlay(const char* b64Str);
-// Streaming: read chunked HTTP, extract base64, decode and play in chunks (no full-body buffer).
-bool streamGoogleTTSChunked(Stream* stream, HTTPClient& http);
+// Streaming: read the HTTP body, extract base64, decode and play in chunks (no full-body buffer).
+// bodyComplete reports whether the whole response was consumed (safe to keep the connection).
+// tee (optional) gets a copy of the WAV bytes.
+bool streamGoogleTTSChunked(Client* stream, HTTPClient& http, bool* bodyComplete = nullptr,
+                            Print* tee = nullptr);
+
+// Download a whole clip into memory (PSRAM when available) without playing it.
+struct TtsAudio {
+  uint8_t* data;      // complete WAV file
+  size_t len;
+  size_t capacity;
+  uint32_t decodeUs;  // base64 decode time (Google only)
+};
+bool fetchGroqTTSAudio(const String& text, TtsAudio* out);
+bool fetchGoogleTTSAudio(const String& text, TtsAudio* out);
+void freeTtsAudio(TtsAudio* audio);
 
 #endif
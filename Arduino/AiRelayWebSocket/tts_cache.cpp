@@ -0,0 +1,450 @@
+#include "tts_cache.h"
+#include "audio_utils.h"
+#include "globals.h"
+#include "prompts.h"
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include <esp_heap_caps.h>
+
+// Files: /ttsc/<key as 16 hex digits> per clip, /ttsc/index for the LRU table.
+static const char* CACHE_DIR = "/ttsc/";
+static const char* INDEX_PATH = "/ttsc/index";
+static const uint32_t INDEX_MAGIC = 0x31435454;  // "TTC1"
+static const uint32_t CLIP_MAGIC = 0x31505454;   // "TTP1"
+// Left free on SPIFFS besides the cache (recordings, other files)
+static const size_t FLASH_RESERVE_BYTES = 64 * 1024;
+
+// IMA ADPCM blocks: predictor + step index, then two samples per byte
+static const uint16_t BLOCK_SAMPLES = 1024;
+static const size_t BLOCK_BYTES = 4 + BLOCK_SAMPLES / 2;
+
+struct ClipHeader {
+  uint32_t magic;
+  uint32_t sampleRate;
+  uint32_t samples;
+};
+
+struct Entry {
+  uint64_t key;
+  uint32_t bytes;     // file size
+  uint32_t lastUse;   // useClock at the last hit or store
+  uint32_t fetchMs;   // what the network took for this clip
+  uint32_t hits;
+};
+
+struct IndexHeader {
+  uint32_t magic;
+  uint32_t count;
+  uint32_t useClock;
+};
+
+struct CacheStats {
+  uint32_t lookups;
+  uint32_t hits;
+  uint32_t stores;
+  uint32_t storeFailures;
+  uint32_t evictions;
+  uint32_t notAdmitted;   // missed, but too long or seen only once
+  uint64_t savedMs;       // network time minus flash load time, summed over hits
+  uint32_t loadMsTotal;
+  uint32_t storeMsTotal;
+};
+
+static Entry entries[TTS_CACHE_MAX_ENTRIES];
+static uint8_t entryCount = 0;
+static uint32_t useClock = 0;
+static uint32_t cacheBytes = 0;
+static uint64_t recentMisses[TTS_CACHE_RECENT_MISSES];
+static uint8_t recentNext = 0;
+static SemaphoreHandle_t cacheMutex = nullptr;
+static CacheStats stats;
+
+static const int16_t STEP_TABLE[89] = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+  337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+  2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+  15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+static const int8_t INDEX_TABLE[16] = {-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8};
+
+struct Adpcm {
+  int32_t predictor;
+  int32_t index;
+};
+
+static void adpcmStep(Adpcm* s, uint8_t code, int32_t delta) {
+  s->predictor += (code & 8) ? -delta : delta;
+  if (s->predictor > 32767) s->predictor = 32767;
+  if (s->predictor < -32768) s->predictor = -32768;
+  s->index += INDEX_TABLE[code];
+  if (s->index < 0) s->index = 0;
+  if (s->index > 88) s->index = 88;
+}
+
+static uint8_t adpcmEncode(Adpcm* s, int16_t sample) {
+  int32_t step = STEP_TABLE[s->index];
+  int32_t diff = sample - s->predictor;
+  uint8_t code = 0;
+  if (diff < 0) {
+    code = 8;
+    diff = -diff;
+  }
+  int32_t delta = step >> 3;
+  if (diff >= step) { code |= 4; diff -= step; delta += step; }
+  step >>= 1;
+  if (diff >= step) { code |= 2; diff -= step; delta += step; }
+  step >>= 1;
+  if (diff >= step) { code |= 1; delta += step; }
+  adpcmStep(s, code, delta);
+  return code;
+}
+
+static int16_t adpcmDecode(Adpcm* s, uint8_t code) {
+  int32_t step = STEP_TABLE[s->index];
+  int32_t delta = step >> 3;
+  if (code & 4) delta += step;
+  if (code & 2) delta += step >> 1;
+  if (code & 1) delta += step >> 2;
+  adpcmStep(s, code, delta);
+  return (int16_t)s->predictor;
+}
+
+static inline int16_t le16(const uint8_t* p) {
+  return (int16_t)(p[0] | (p[1] << 8));
+}
+
+// One block of up to BLOCK_SAMPLES little-endian samples (any alignment) -> bytes written to out
+static size_t encodeBlock(const uint8_t* pcm, size_t n, uint8_t* out) {
+  Adpcm s = {le16(pcm), 0};
+  // Start the step size near the block's first difference so it doesn't ramp up from 7
+  int32_t firstDiff = n > 1 ? abs(le16(pcm + 2) - le16(pcm)) : 0;
+  while (s.index < 88 && STEP_TABLE[s.index] < firstDiff / 2) s.index++;
+  out[0] = pcm[0];
+  out[1] = pcm[1];
+  out[2] = (uint8_t)s.index;
+  out[3] = 0;
+  size_t o = 4;
+  for (size_t i = 0; i < n; i += 2) {
+    uint8_t lo = adpcmEncode(&s, le16(pcm + 2 * i));
+    uint8_t hi = i + 1 < n ? adpcmEncode(&s, le16(pcm + 2 * i + 2)) : 0;
+    out[o++] = lo | (hi << 4);
+  }
+  return o;
+}
+
+static void decodeBlock(const uint8_t* in, size_t n, int16_t* pcm) {
+  Adpcm s = {(int16_t)(in[0] | (in[1] << 8)), in[2] > 88 ? 88 : in[2]};
+  const uint8_t* codes = in + 4;
+  for (size_t i = 0; i < n; i += 2) {
+    uint8_t b = codes[i / 2];
+    pcm[i] = adpcmDecode(&s, b & 0x0F);
+    if (i + 1 < n) pcm[i + 1] = adpcmDecode(&s, b >> 4);
+  }
+}
+
+static size_t encodedBytes(uint32_t samples) {
+  size_t full = samples / BLOCK_SAMPLES;
+  size_t rest = samples % BLOCK_SAMPLES;
+  return sizeof(ClipHeader) + full * BLOCK_BYTES + (rest ? 4 + (rest + 1) / 2 : 0);
+}
+
+static uint64_t fnv1a(uint64_t h, const void* data, size_t len) {
+  const uint8_t* p = (const uint8_t*)data;
+  for (size_t i = 0; i < len; i++) {
+    h ^= p[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+static uint64_t fnv1aString(uint64_t h, const char* s) {
+  return fnv1a(h, s, strlen(s) + 1);  // the NUL separates fields
+}
+
+uint64_t ttsCacheKey(TtsProvider provider, const String& text) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  uint8_t p = (uint8_t)provider;
+  h = fnv1a(h, &p, 1);
+  if (provider == TTS_GOOGLE) {
+    float rate = getCurrentPromptSpeakingRate();
+    float pitch = getCurrentPromptPitch();
+    h = fnv1aString(h, getCurrentPromptVoice());
+    h = fnv1aString(h, google_tts_language);
+    h = fnv1a(h, &rate, sizeof(rate));
+    h = fnv1a(h, &pitch, sizeof(pitch));
+  } else {
+    h = fnv1aString(h, tts_model);
+    h = fnv1aString(h, tts_voice);
+  }
+  String t = text;
+  t.trim();
+  return fnv1aString(h, t.c_str());
+}
+
+static String clipPath(uint64_t key) {
+  char name[40];
+  snprintf(name, sizeof(name), "%s%08lx%08lx", CACHE_DIR, (unsigned long)(key >> 32),
+           (unsigned long)(key & 0xFFFFFFFF));
+  return String(name);
+}
+
+static int findEntry(uint64_t key) {
+  for (uint8_t i = 0; i < entryCount; i++) {
+    if (entries[i].key == key) return i;
+  }
+  return -1;
+}
+
+static void removeEntry(int i) {
+  SPIFFS.remove(clipPath(entries[i].key));
+  cacheBytes -= entries[i].bytes;
+  entries[i] = entries[--entryCount];
+}
+
+static void evictLru() {
+  int oldest = 0;
+  for (uint8_t i = 1; i < entryCount; i++) {
+    if (entries[i].lastUse < entries[oldest].lastUse) oldest = i;
+  }
+  removeEntry(oldest);
+  stats.evictions++;
+}
+
+static void saveIndex() {
+  File f = SPIFFS.open(INDEX_PATH, FILE_WRITE);
+  if (!f) return;
+  IndexHeader h = {INDEX_MAGIC, entryCount, useClock};
+  f.write((const uint8_t*)&h, sizeof(h));
+  f.write((const uint8_t*)entries, sizeof(Entry) * entryCount);
+  f.close();
+}
+
+static void loadIndex() {
+  entryCount = 0;
+  cacheBytes = 0;
+  if (!SPIFFS.exists(INDEX_PATH)) return;
+  File f = SPIFFS.open(INDEX_PATH, FILE_READ);
+  if (!f) return;
+  IndexHeader h;
+  if (f.read((uint8_t*)&h, sizeof(h)) == sizeof(h) && h.magic == INDEX_MAGIC &&
+      h.count <= TTS_CACHE_MAX_ENTRIES &&
+      f.read((uint8_t*)entries, sizeof(Entry) * h.count) == sizeof(Entry) * h.count) {
+    useClock = h.useClock;
+    // Drop entries whose clip is gone (power lost between clip and index writes)
+    for (uint32_t i = 0; i < h.count; i++) {
+      if (SPIFFS.exists(clipPath(entries[i].key))) {
+        entries[entryCount] = entries[i];
+        cacheBytes += entries[entryCount].bytes;
+        entryCount++;
+      }
+    }
+  }
+  f.close();
+}
+
+// Clips on flash the index doesn't know (the reverse case) only waste space
+static void removeOrphans() {
+  File root = SPIFFS.open("/");
+  if (!root) return;
+  size_t dirLen = strlen(CACHE_DIR);
+  for (File f = root.openNextFile(); f; f = root.openNextFile()) {
+    String path = f.path();
+    f.close();
+    if (!path.startsWith(CACHE_DIR) || path == INDEX_PATH) continue;
+    uint64_t key = strtoull(path.c_str() + dirLen, nullptr, 16);
+    if (findEntry(key) < 0) SPIFFS.remove(path);
+  }
+  root.close();
+}
+
+bool ttsCacheBegin() {
+  if (cacheMutex) return true;
+  cacheMutex = xSemaphoreCreateMutex();
+  loadIndex();
+  removeOrphans();
+  Serial.printf("TTS cache: %u clips, %u KB on flash\n", (unsigned)entryCount,
+                (unsigned)(cacheBytes / 1024));
+  return true;
+}
+
+bool ttsCacheLoad(uint64_t key, TtsAudio* out) {
+  if (!cacheMutex) return false;
+  unsigned long startMs = millis();
+  xSemaphoreTake(cacheMutex, portMAX_DELAY);
+  stats.lookups++;
+  int i = findEntry(key);
+  if (i < 0) {
+    xSemaphoreGive(cacheMutex);
+    return false;
+  }
+  bool ok = false;
+  File f = SPIFFS.open(clipPath(key), FILE_READ);
+  ClipHeader h;
+  if (f && f.read((uint8_t*)&h, sizeof(h)) == sizeof(h) && h.magic == CLIP_MAGIC && h.samples > 0) {
+    size_t len = 44 + (size_t)h.samples * 2;
+    uint8_t* wav = nullptr;
+    if (psramFound()) wav = (uint8_t*)heap_caps_malloc(len, MALLOC_CAP_SPIRAM);
+    if (!wav) wav = (uint8_t*)malloc(len);
+    if (wav) {
+      createWavHeader(wav, (int)(h.samples * 2));
+      // createWavHeader writes 16 kHz; patch in the clip's rate
+      uint32_t byteRate = h.sampleRate * 2;
+      memcpy(wav + 24, &h.sampleRate, 4);
+      memcpy(wav + 28, &byteRate, 4);
+      int16_t* pcm = (int16_t*)(wav + 44);
+      uint8_t block[BLOCK_BYTES];
+      ok = true;
+      for (uint32_t done = 0; done < h.samples; done += BLOCK_SAMPLES) {
+        size_t n = h.samples - done < BLOCK_SAMPLES ? h.samples - done : BLOCK_SAMPLES;
+        size_t bytes = 4 + (n + 1) / 2;
+        if (f.read(block, bytes) != bytes) {
+          ok = false;
+          break;
+        }
+        decodeBlock(block, n, pcm + done);
+      }
+      if (ok) {
+        out->data = wav;
+        out->len = len;
+        out->capacity = len;
+        out->decodeUs = 0;
+      } else {
+        free(wav);
+      }
+    }
+  }
+  if (f) f.close();
+  if (!ok) {
+    Serial.println("TTS cache: unreadable clip dropped");
+    removeEntry(i);
+    saveIndex();
+    xSemaphoreGive(cacheMutex);
+    return false;
+  }
+  // LRU order reaches flash with the next store
+  entries[i].lastUse = ++useClock;
+  entries[i].hits++;
+  uint32_t loadMs = millis() - startMs;
+  stats.hits++;
+  stats.loadMsTotal += loadMs;
+  if (entries[i].fetchMs > loadMs) stats.savedMs += entries[i].fetchMs - loadMs;
+  xSemaphoreGive(cacheMutex);
+  Serial.printf("TTS cache: hit, %u ms from flash (network took %u ms)\n", (unsigned)loadMs,
+                (unsigned)entries[i].fetchMs);
+  return true;
+}
+
+bool ttsCacheContains(uint64_t key) {
+  if (!cacheMutex) return false;
+  xSemaphoreTake(cacheMutex, portMAX_DELAY);
+  bool found = findEntry(key) >= 0;
+  xSemaphoreGive(cacheMutex);
+  return found;
+}
+
+bool ttsCacheShouldStore(uint64_t key, size_t textLen) {
+  if (!cacheMutex) return false;
+  xSemaphoreTake(cacheMutex, portMAX_DELAY);
+  bool seen = false;
+  for (uint8_t i = 0; i < TTS_CACHE_RECENT_MISSES; i++) {
+    if (recentMisses[i] == key) seen = true;
+  }
+  bool store = textLen <= TTS_CACHE_MAX_CHARS && seen;
+  if (!store) {
+    if (!seen) {
+      recentMisses[recentNext] = key;
+      recentNext = (recentNext + 1) % TTS_CACHE_RECENT_MISSES;
+    }
+    stats.notAdmitted++;
+  }
+  xSemaphoreGive(cacheMutex);
+  return store;
+}
+
+bool ttsCacheStore(uint64_t key, const uint8_t* wav, size_t len, uint32_t fetchMs) {
+  if (!cacheMutex) return false;
+  WavInfo info;
+  if (!parseWavHeader(wav, len, &info) || info.channels != 1 || info.dataOffset >= len) return false;
+  size_t pcmBytes = len - info.dataOffset;
+  if (info.dataSize != 0 && info.dataSize < pcmBytes) pcmBytes = info.dataSize;
+  uint32_t samples = pcmBytes / 2;
+  if (samples == 0) return false;
+  size_t bytes = encodedBytes(samples);
+  if (bytes > TTS_CACHE_MAX_BYTES) return false;
+
+  unsigned long startMs = millis();
+  xSemaphoreTake(cacheMutex, portMAX_DELAY);
+  if (findEntry(key) >= 0) {
+    xSemaphoreGive(cacheMutex);
+    return true;
+  }
+  while (entryCount > 0 &&
+         (entryCount >= TTS_CACHE_MAX_ENTRIES || cacheBytes + bytes > TTS_CACHE_MAX_BYTES ||
+          SPIFFS.usedBytes() + bytes + FLASH_RESERVE_BYTES > SPIFFS.totalBytes())) {
+    evictLru();
+  }
+  bool ok = SPIFFS.usedBytes() + bytes + FLASH_RESERVE_BYTES <= SPIFFS.totalBytes();
+  String path = clipPath(key);
+  File f;
+  if (ok) f = SPIFFS.open(path, FILE_WRITE);
+  ok = ok && f;
+  if (ok) {
+    ClipHeader h = {CLIP_MAGIC, info.sampleRate, samples};
+    ok = f.write((const uint8_t*)&h, sizeof(h)) == sizeof(h);
+    uint8_t block[BLOCK_BYTES];
+    const uint8_t* src = wav + info.dataOffset;
+    for (uint32_t done = 0; ok && done < samples; done += BLOCK_SAMPLES) {
+      size_t n = samples - done < BLOCK_SAMPLES ? samples - done : BLOCK_SAMPLES;
+      size_t blockBytes = encodeBlock(src + done * 2, n, block);
+      ok = f.write(block, blockBytes) == blockBytes;
+    }
+    f.close();
+  }
+  if (ok) {
+    Entry& e = entries[entryCount++];
+    e.key = key;
+    e.bytes = bytes;
+    e.lastUse = ++useClock;
+    e.fetchMs = fetchMs;
+    e.hits = 0;
+    cacheBytes += bytes;
+    saveIndex();
+    stats.stores++;
+    stats.storeMsTotal += millis() - startMs;
+  } else {
+    SPIFFS.remove(path);
+    stats.storeFailures++;
+  }
+  xSemaphoreGive(cacheMutex);
+  if (ok) {
+    Serial.printf("TTS cache: stored %u samples as %u bytes in %lu ms\n", (unsigned)samples,
+                  (unsigned)bytes, millis() - startMs);
+  }
+  return ok;
+}
+
+void ttsCacheClear() {
+  if (!cacheMutex) return;
+  xSemaphoreTake(cacheMutex, portMAX_DELAY);
+  while (entryCount > 0) removeEntry(entryCount - 1);
+  memset(recentMisses, 0, sizeof(recentMisses));
+  saveIndex();
+  xSemaphoreGive(cacheMutex);
+}
+
+void ttsCachePrintStats() {
+  CacheStats s = stats;
+  Serial.println("\n=== TTS cache ===");
+  Serial.printf("  Clips: %u/%u, %u/%u KB (SPIFFS %u/%u KB used)\n", (unsigned)entryCount,
+                (unsigned)TTS_CACHE_MAX_ENTRIES, (unsigned)(cacheBytes / 1024),
+                (unsigned)(TTS_CACHE_MAX_BYTES / 1024), (unsigned)(SPIFFS.usedBytes() / 1024),
+                (unsigned)(SPIFFS.totalBytes() / 1024));
+  Serial.printf("  Lookups: %u, hits: %u (%u%%), saved %u ms total, avg load %u ms\n",
+                (unsigned)s.lookups, (unsigned)s.hits,
+                (unsigned)(s.lookups ? s.hits * 100 / s.lookups : 0), (unsigned)s.savedMs,
+                (unsigned)(s.hits ? s.loadMsTotal / s.hits : 0));
+  Serial.printf("  Stores: %u (avg %u ms), failed: %u, evictions: %u, not admitted: %u\n",
+                (unsigned)s.stores, (unsigned)(s.stores ? s.storeMsTotal / s.stores : 0),
+                (unsigned)s.storeFailures, (unsigned)s.evictions, (unsigned)s.notAdmitted);
+  Serial.println("=================\n");
+}
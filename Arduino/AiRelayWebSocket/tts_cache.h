@@ -0,0 +1,29 @@
+#ifndef AI_RELAY_WEBSOCKET_TTS_CACHE_H
+#define AI_RELAY_WEBSOCKET_TTS_CACHE_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "tts.h"
+
+// Content-addressed TTS cache on SPIFFS. The key hashes the text with everything
+// that changes the audio (provider, model/voice, language, rate, pitch). Clips are
+// stored as IMA ADPCM (4:1) and evicted least recently used beyond
+// TTS_CACHE_MAX_BYTES. A text is only written after it missed twice, so one-off
+// sentences don't wear the flash. Safe to call from the dialog and TTS fetch tasks.
+bool ttsCacheBegin();
+
+uint64_t ttsCacheKey(TtsProvider provider, const String& text);
+
+// Hit: `out` gets the clip as a WAV in PSRAM (free with freeTtsAudio()).
+bool ttsCacheLoad(uint64_t key, TtsAudio* out);
+// Whether the clip is on flash, without loading it or counting a lookup.
+bool ttsCacheContains(uint64_t key);
+// After a miss: whether the fetched clip should be kept (short text, seen before).
+bool ttsCacheShouldStore(uint64_t key, size_t textLen);
+// fetchMs: network time of this clip, reported as saved on every later hit.
+bool ttsCacheStore(uint64_t key, const uint8_t* wav, size_t len, uint32_t fetchMs);
+
+void ttsCacheClear();
+void ttsCachePrintStats();
+
+#endif
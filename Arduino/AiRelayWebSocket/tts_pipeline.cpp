@@ -0,0 +1,259 @@
+#include "tts_pipeline.h"
+#include "tts.h"
+#include "tts_cache.h"
+#include "audio_utils.h"
+#include "audio_out.h"
+#include "chat_utils.h"
+#include "filler.h"
+#include "config.h"
+#include "globals.h"
+#include <Arduino.h>
+
+struct PipelineJob {
+  char* text;   // nullptr marks end of reply
+  int index;
+};
+
+struct PipelineClip {
+  TtsAudio audio;
+  WavInfo wav;
+  int index;
+  bool ok;
+  uint16_t chars;
+  uint32_t fetchMs;
+  uint32_t decodeMs;
+  bool cached;         // loaded from the flash cache
+  bool storeInCache;   // fetched, and admitted to the flash cache
+  uint64_t cacheKey;
+};
+
+struct SentenceTiming {
+  uint16_t chars;
+  bool ok;
+  uint32_t fetchMs;   // network time, request to last byte
+  uint32_t decodeMs;  // base64 + WAV header
+  uint32_t waitMs;    // player idle before this clip was ready (audible only if the output ring ran dry)
+  uint32_t playMs;    // handing the clip to the output ring (waits only while the ring is full)
+};
+
+static QueueHandle_t jobQueue = nullptr;
+static QueueHandle_t clipQueue = nullptr;    // PipelineClip*, nullptr = end of reply
+static SemaphoreHandle_t replyDone = nullptr;
+
+static SentenceTiming timings[TTS_PIPELINE_MAX_SENTENCES];
+static volatile int timingCount = 0;
+static int nextIndex = 0;
+static unsigned long replyStartMs = 0;
+static unsigned long idleSinceMs = 0;
+static volatile uint32_t firstAudioMs = 0;
+static uint32_t replyTotalMs = 0;
+
+static void ttsFetcherTask(void*) {
+  for (;;) {
+    PipelineJob job;
+    if (xQueueReceive(jobQueue, &job, portMAX_DELAY) != pdTRUE) continue;
+    PipelineClip* clip = nullptr;
+    if (!job.text) {
+      xQueueSend(clipQueue, &clip, portMAX_DELAY);
+      continue;
+    }
+    if (audioOutCancelled()) {
+      // Barged in: the rest of the reply isn't fetched
+      free(job.text);
+      continue;
+    }
+    clip = (PipelineClip*)calloc(1, sizeof(PipelineClip));
+    if (!clip) {
+      Serial.println("TTS pipeline: clip alloc failed");
+      free(job.text);
+      continue;
+    }
+    clip->index = job.index;
+    clip->chars = strlen(job.text);
+    String text(job.text);
+    free(job.text);
+
+    unsigned long startMs = millis();
+    bool ok = false;
+    TtsProvider source = ttsProvider;
+#if TTS_CACHE
+    ok = clip->cached = ttsCacheLoad(ttsCacheKey(source, text), &clip->audio);
+#endif
+    if (!ok && ttsProvider == TTS_GOOGLE) {
+      ok = fetchGoogleTTSAudio(text, &clip->audio);
+      if (!ok) Serial.println("TTS pipeline: Google failed, falling back to Groq");
+    }
+    if (!ok) {
+      clip->audio.len = 0;
+      source = TTS_GROQ;
+      ok = fetchGroqTTSAudio(text, &clip->audio);
+    }
+    uint32_t elapsedMs = millis() - startMs;
+#if TTS_CACHE
+    if (ok && !clip->cached) {
+      // Written by the player once the clip is in the output ring, off the fetch path
+      clip->cacheKey = ttsCacheKey(source, text);
+      clip->storeInCache = ttsCacheShouldStore(clip->cacheKey, clip->chars);
+    }
+#endif
+    uint32_t parseStartUs = micros();
+    clip->ok = ok && parseWavHeader(clip->audio.data, clip->audio.len, &clip->wav);
+    uint32_t decodeUs = clip->audio.decodeUs + (micros() - parseStartUs);
+    clip->decodeMs = decodeUs / 1000;
+    clip->fetchMs = elapsedMs > clip->decodeMs ? elapsedMs - clip->decodeMs : 0;
+    if (clip->ok && clip->wav.dataOffset + clip->wav.dataSize > clip->audio.len) {
+      // Streamed WAVs may announce an unknown (0xFFFFFFFF) data size
+      clip->wav.dataSize = clip->audio.len - clip->wav.dataOffset;
+    }
+    xQueueSend(clipQueue, &clip, portMAX_DELAY);
+  }
+}
+
+static void ttsPlayerTask(void*) {
+  for (;;) {
+    PipelineClip* clip = nullptr;
+    if (xQueueReceive(clipQueue, &clip, portMAX_DELAY) != pdTRUE) continue;
+    if (!clip) {
+      audioOutDrain(60000);
+      replyTotalMs = millis() - replyStartMs;
+      xSemaphoreGive(replyDone);
+      continue;
+    }
+
+    unsigned long playStartMs = millis();
+    uint32_t waitMs = playStartMs - idleSinceMs;
+    bool skipped = clip->ok && audioOutCancelled();  // fetched before a barge-in
+    if (clip->ok && !skipped) {
+#if FILLER_AUDIO
+      // Real audio is ready: fade the filler out and start the reply's session
+      fillerStop();
+#endif
+      // Returns once the clip is in the output ring, so the next fetch overlaps playback
+      audioOutSetFormat(clip->wav.sampleRate, clip->wav.channels);
+      if (firstAudioMs == 0) {
+        firstAudioMs = playStartMs - replyStartMs;
+        Serial.printf("TTS: first audio after %u ms\n", (unsigned)firstAudioMs);
+      }
+      uint8_t* pcm = clip->audio.data + clip->wav.dataOffset;
+      size_t bytes = clip->wav.dataSize & ~(size_t)1;
+      audioOutWrite(pcm, bytes, portMAX_DELAY);
+    }
+    uint32_t playMs = millis() - playStartMs;
+
+    Serial.printf("TTS #%d (%u chars): fetch %u ms, decode %u ms, wait %u ms, play %u ms%s%s\n",
+                  clip->index, (unsigned)clip->chars, (unsigned)clip->fetchMs, (unsigned)clip->decodeMs,
+                  (unsigned)waitMs, (unsigned)playMs, clip->cached ? " [cache]" : "",
+                  !clip->ok ? " [FAILED]" : skipped ? " [cancelled]" : "");
+#if TTS_CACHE
+    // The ring holds seconds of this clip, so the flash write doesn't starve the speaker
+    if (clip->ok && clip->storeInCache) {
+      ttsCacheStore(clip->cacheKey, clip->audio.data, clip->audio.len, clip->fetchMs);
+    }
+#endif
+    int slot = timingCount;
+    if (slot < TTS_PIPELINE_MAX_SENTENCES) {
+      timings[slot] = {clip->chars, clip->ok, clip->fetchMs, clip->decodeMs, waitMs, playMs};
+      timingCount = slot + 1;
+    }
+    freeTtsAudio(&clip->audio);
+    free(clip);
+    idleSinceMs = millis();
+  }
+}
+
+void ttsPipelineBegin() {
+  if (jobQueue) return;
+  jobQueue = xQueueCreate(TTS_PIPELINE_MAX_SENTENCES, sizeof(PipelineJob));
+  // Depth 1: the fetcher stays at most one finished clip ahead of the player.
+  clipQueue = xQueueCreate(1, sizeof(PipelineClip*));
+  replyDone = xSemaphoreCreateBinary();
+  xTaskCreatePinnedToCore(ttsFetcherTask, "ttsFetch", 8192, NULL, 2, NULL, 0);
+  xTaskCreatePinnedToCore(ttsPlayerTask, "ttsPlay", 6144, NULL, 3, NULL, 1);  // + flash cache writes
+}
+
+void ttsPipelineStartReply() {
+  xSemaphoreTake(replyDone, 0);
+  timingCount = 0;
+  nextIndex = 0;
+  firstAudioMs = 0;
+  replyTotalMs = 0;
+  replyStartMs = millis();
+  idleSinceMs = replyStartMs;
+#if FILLER_AUDIO
+  // A filler still playing keeps the session; the first clip's fillerStop() opens ours
+  if (!fillerActive()) audioOutSessionBegin();
+#else
+  audioOutSessionBegin();
+#endif
+  digitalWrite(PIN_RED, LOW);
+  ttsPlaying = true;
+}
+
+bool ttsPipelineEnqueue(const String& sentence) {
+  if (sentence.length() == 0) return false;
+  PipelineJob job = {strdup(sentence.c_str()), ++nextIndex};
+  if (!job.text) return false;
+  if (xQueueSend(jobQueue, &job, portMAX_DELAY) != pdTRUE) {
+    free(job.text);
+    return false;
+  }
+  return true;
+}
+
+void ttsPipelineEndReply() {
+  PipelineJob end = {nullptr, 0};
+  xQueueSend(jobQueue, &end, portMAX_DELAY);
+}
+
+bool ttsPipelineWait(uint32_t timeoutMs) {
+  bool done = xSemaphoreTake(replyDone, pdMS_TO_TICKS(timeoutMs)) == pdTRUE;
+  if (!done) {
+    // The player may still be writing I2S: cut it off and let the rest of the
+    // reply be skipped before the output (and the mic gate) is released.
+    Serial.println("TTS pipeline: timed out waiting for playback, cancelling");
+    audioOutCancel(BARGE_IN_FADE_MS);
+    if (xSemaphoreTake(replyDone, pdMS_TO_TICKS(TTS_PIPELINE_CANCEL_WAIT_MS)) != pdTRUE) {
+      Serial.println("TTS pipeline: player still busy after cancel");
+    }
+    audioOutDrain(BARGE_IN_FADE_MS + 200);
+  }
+  digitalWrite(PIN_RED, HIGH);
+  ttsPlaying = false;
+  ttsCooldownUntilMs = millis() + 500;
+  AudioOutStats out;
+  audioOutSessionStats(&out);
+  Serial.printf("TTS: %d sentence(s), first audio %u ms, total %u ms, output underruns %u\n",
+                nextIndex, (unsigned)firstAudioMs, (unsigned)replyTotalMs, (unsigned)out.underruns);
+  return done;
+}
+
+void ttsPipelineSpeak(const String& reply) {
+  if (reply.length() == 0) return;
+  ttsPipelineStartReply();
+  int start = 0;
+  int end;
+  while ((end = findSentenceEnd(reply, start)) > 0) {
+    ttsPipelineEnqueue(trimCopy(extractBetween(reply, start, end)));
+    start = end;
+  }
+  ttsPipelineEnqueue(trimCopy(extractBetween(reply, start, reply.length())));
+  ttsPipelineEndReply();
+  ttsPipelineWait(120000);
+}
+
+void ttsPipelinePrintStats() {
+  int n = timingCount;
+  if (n == 0) {
+    Serial.println("TTS pipeline: no reply played yet");
+    return;
+  }
+  Serial.println("\n=== TTS pipeline (last reply) ===");
+  Serial.println("  #  chars  fetch  decode   wait   play (ms)");
+  for (int i = 0; i < n; i++) {
+    const SentenceTiming& t = timings[i];
+    Serial.printf("%3d  %5u  %5u  %6u  %5u  %5u%s\n", i + 1, (unsigned)t.chars, (unsigned)t.fetchMs,
+                  (unsigned)t.decodeMs, (unsigned)t.waitMs, (unsigned)t.playMs, t.ok ? "" : "  FAILED");
+  }
+  Serial.printf("First audio: %u ms, reply total: %u ms\n", (unsigned)firstAudioMs, (unsigned)replyTotalMs);
+  Serial.println("=================================\n");
+}
@@ -0,0 +1,23 @@
+#ifndef AI_RELAY_WEBSOCKET_TTS_PIPELINE_H
+#define AI_RELAY_WEBSOCKET_TTS_PIPELINE_H
+
+#include <Arduino.h>
+
+// Sentence-pipelined TTS: a fetcher task downloads sentence N+1 into PSRAM
+// while the player task drains sentence N to I2S.
+void ttsPipelineBegin();
+
+// One reply = StartReply, any number of Enqueue, EndReply, then Wait. On a
+// timeout Wait cancels the output and returns false once the player has stopped.
+void ttsPipelineStartReply();
+bool ttsPipelineEnqueue(const String& sentence);
+void ttsPipelineEndReply();
+bool ttsPipelineWait(uint32_t timeoutMs);
+
+// Split a complete reply into sentences and play it through the pipeline (blocking).
+void ttsPipelineSpeak(const String& reply);
+
+// Per-sentence fetch/decode/playback timings of the last reply.
+void ttsPipelinePrintStats();
+
+#endif
@@ -0,0 +1,178 @@
+#include "turn_timeline.h"
+#include "config.h"
+#include "globals.h"
+#include <Arduino.h>
+
+// Intervals kept per turn (from phase -> to phase)
+struct TimelineInterval {
+  const char* name;
+  TurnPhase from;
+  TurnPhase to;
+};
+
+static const TimelineInterval INTERVALS[] = {
+  {"eot_wait", TL_SPEECH_END, TL_END_OF_TURN},
+  {"llm_queue", TL_END_OF_TURN, TL_LLM_SENT},
+  {"filler_audio", TL_END_OF_TURN, TL_FILLER_FIRST_SAMPLE},
+  {"llm_ttfb", TL_LLM_SENT, TL_LLM_FIRST_BYTE},
+  {"llm_total", TL_LLM_SENT, TL_LLM_DONE},
+  {"tts_ttfb", TL_TTS_SENT, TL_TTS_FIRST_BYTE},
+  {"first_audio", TL_END_OF_TURN, TL_TTS_FIRST_SAMPLE},
+  {"mouth_to_ear", TL_SPEECH_END, TL_TTS_FIRST_SAMPLE},
+  {"turn", TL_END_OF_TURN, TL_TTS_DONE},
+};
+static const int INTERVAL_COUNT = sizeof(INTERVALS) / sizeof(INTERVALS[0]);
+
+static const char* const PHASE_NAMES[TL_PHASE_COUNT] = {
+  "speech_end", "end_of_turn", "filler_sample", "llm_sent", "llm_first_byte", "llm_done",
+  "tts_sent", "tts_first_byte", "tts_first_sample", "tts_done"
+};
+
+// Provider combinations: LLM 8b/70b x TTS Groq/Google, plus reply-cache hits
+static const int PROVIDER_COUNT = 5;
+static const int PROVIDER_CACHED = 4;
+static const char* const PROVIDER_NAMES[PROVIDER_COUNT] = {"8b/groq", "8b/google", "70b/groq", "70b/google",
+                                                           "cached"};
+
+// Rolling window of the last TIMELINE_WINDOW samples, in ms (saturates at 65535)
+struct TimelineWindow {
+  uint16_t samples[TIMELINE_WINDOW];
+  uint16_t next;
+  uint16_t count;
+  uint32_t total;  // all samples ever, not just the window
+};
+
+static TimelineWindow windows[PROVIDER_COUNT][INTERVAL_COUNT];
+static volatile unsigned long stamps[TL_PHASE_COUNT];
+static volatile bool turnOpen = false;
+static int turnProvider = 0;
+static unsigned long lastStamps[TL_PHASE_COUNT];
+static int lastProvider = -1;
+
+static int currentProvider() {
+  int llm = (llm_model == llm_model_8b) ? 0 : 1;
+  int tts = (ttsProvider == TTS_GOOGLE) ? 1 : 0;
+  return llm * 2 + tts;
+}
+
+void timelineTurnBegin(unsigned long speechEndMs, unsigned long endOfTurnMs) {
+  turnOpen = false;
+  for (int i = 0; i < TL_PHASE_COUNT; i++) stamps[i] = 0;
+  stamps[TL_SPEECH_END] = speechEndMs;
+  stamps[TL_END_OF_TURN] = endOfTurnMs;
+  turnProvider = currentProvider();
+  turnOpen = true;
+}
+
+void timelineMark(TurnPhase phase) {
+  if (!turnOpen || phase >= TL_PHASE_COUNT || stamps[phase] != 0) return;
+  unsigned long now = millis();
+  stamps[phase] = now ? now : 1;
+  // The LLM router picks the model per turn, just before the request goes out
+  if (phase == TL_LLM_SENT) turnProvider = currentProvider();
+}
+
+void timelineMarkCachedReply() {
+  if (turnOpen) turnProvider = PROVIDER_CACHED;
+}
+
+static void addSample(TimelineWindow* w, unsigned long ms) {
+  w->samples[w->next] = ms > 65535 ? 65535 : (uint16_t)ms;
+  w->next = (w->next + 1) % TIMELINE_WINDOW;
+  if (w->count < TIMELINE_WINDOW) w->count++;
+  w->total++;
+}
+
+void timelineTurnEnd() {
+  if (!turnOpen) return;
+  timelineMark(TL_TTS_DONE);
+  turnOpen = false;
+  for (int i = 0; i < TL_PHASE_COUNT; i++) lastStamps[i] = stamps[i];
+  lastProvider = turnProvider;
+  for (int i = 0; i < INTERVAL_COUNT; i++) {
+    unsigned long from = lastStamps[INTERVALS[i].from];
+    unsigned long to = lastStamps[INTERVALS[i].to];
+    // Phases that didn't happen (no speech stamp, TTS failed, ...) leave no sample
+    if (from == 0 || to == 0 || to < from) continue;
+    addSample(&windows[turnProvider][i], to - from);
+  }
+}
+
+// p50/p95/max of one window (insertion sort of a copy; the window is small)
+static void windowPercentiles(const TimelineWindow* w, uint16_t* p50, uint16_t* p95, uint16_t* maxMs) {
+  uint16_t sorted[TIMELINE_WINDOW];
+  int n = w->count;
+  for (int i = 0; i < n; i++) {
+    uint16_t v = w->samples[i];
+    int j = i;
+    while (j > 0 && sorted[j - 1] > v) {
+      sorted[j] = sorted[j - 1];
+      j--;
+    }
+    sorted[j] = v;
+  }
+  *p50 = n ? sorted[(n - 1) * 50 / 100] : 0;
+  *p95 = n ? sorted[(n - 1) * 95 / 100] : 0;
+  *maxMs = n ? sorted[n - 1] : 0;
+}
+
+void timelinePrint() {
+  Serial.println("\n=== Turn timeline ===");
+  if (lastProvider >= 0) {
+    unsigned long base = lastStamps[TL_SPEECH_END] ? lastStamps[TL_SPEECH_END] : lastStamps[TL_END_OF_TURN];
+    Serial.printf("  Last turn (%s), ms from %s:\n", PROVIDER_NAMES[lastProvider],
+                  lastStamps[TL_SPEECH_END] ? "speech end" : "end of turn");
+    for (int i = 0; i < TL_PHASE_COUNT; i++) {
+      if (lastStamps[i] == 0) {
+        Serial.printf("    %-17s -\n", PHASE_NAMES[i]);
+      } else {
+        Serial.printf("    %-17s %ld\n", PHASE_NAMES[i], (long)(lastStamps[i] - base));
+      }
+    }
+  }
+  Serial.printf("  Last %u turns per provider:\n", (unsigned)TIMELINE_WINDOW);
+  for (int p = 0; p < PROVIDER_COUNT; p++) {
+    bool any = false;
+    for (int i = 0; i < INTERVAL_COUNT; i++) any |= windows[p][i].count > 0;
+    if (!any) continue;
+    Serial.printf("  [%s]\n", PROVIDER_NAMES[p]);
+    for (int i = 0; i < INTERVAL_COUNT; i++) {
+      const TimelineWindow* w = &windows[p][i];
+      if (w->count == 0) continue;
+      uint16_t p50, p95, maxMs;
+      windowPercentiles(w, &p50, &p95, &maxMs);
+      Serial.printf("    %-13s p50 %5u  p95 %5u  max %5u ms  (n=%u)\n", INTERVALS[i].name,
+                    (unsigned)p50, (unsigned)p95, (unsigned)maxMs, (unsigned)w->count);
+    }
+  }
+  Serial.println("=====================\n");
+}
+
+void timelinePrintJson() {
+  // {"window":32,"providers":{"8b/groq":{"llm_ttfb":[p50,p95,max,turns seen],...},...}}
+  Serial.printf("{\"window\":%u,\"providers\":{", (unsigned)TIMELINE_WINDOW);
+  bool firstProvider = true;
+  for (int p = 0; p < PROVIDER_COUNT; p++) {
+    bool firstInterval = true;
+    for (int i = 0; i < INTERVAL_COUNT; i++) {
+      const TimelineWindow* w = &windows[p][i];
+      if (w->count == 0) continue;
+      if (firstInterval) {
+        Serial.printf("%s\"%s\":{", firstProvider ? "" : ",", PROVIDER_NAMES[p]);
+        firstProvider = false;
+      }
+      uint16_t p50, p95, maxMs;
+      windowPercentiles(w, &p50, &p95, &maxMs);
+      Serial.printf("%s\"%s\":[%u,%u,%u,%u]", firstInterval ? "" : ",", INTERVALS[i].name,
+                    (unsigned)p50, (unsigned)p95, (unsigned)maxMs, (unsigned)w->total);
+      firstInterval = false;
+    }
+    if (!firstInterval) Serial.print("}");
+  }
+  Serial.println("}}");
+}
+
+void timelineReset() {
+  memset(windows, 0, sizeof(windows));
+  lastProvider = -1;
+}
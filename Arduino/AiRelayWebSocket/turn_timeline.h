@@ -0,0 +1,38 @@
+#ifndef AI_RELAY_WEBSOCKET_TURN_TIMELINE_H
+#define AI_RELAY_WEBSOCKET_TURN_TIMELINE_H
+
+#include <Arduino.h>
+
+// Per-turn latency timeline. The dialog task opens a turn, the LLM/TTS/audio
+// code stamps phases as they happen (first stamp of a phase wins, so the first
+// sentence's TTS is what counts), and closing the turn folds the intervals into
+// rolling windows per LLM model x TTS provider for p50/p95 reporting.
+enum TurnPhase : uint8_t {
+  TL_SPEECH_END,       // last VAD speech block (0 if unknown, e.g. typed input)
+  TL_END_OF_TURN,      // final transcript handed to the dialog task
+  TL_FILLER_FIRST_SAMPLE, // first sample of a filler clip (see filler.h)
+  TL_LLM_SENT,
+  TL_LLM_FIRST_BYTE,   // first token when streaming, response headers otherwise
+  TL_LLM_DONE,
+  TL_TTS_SENT,
+  TL_TTS_FIRST_BYTE,
+  TL_TTS_FIRST_SAMPLE, // first PCM of the reply itself handed to the I2S DMA
+  TL_TTS_DONE,
+  TL_PHASE_COUNT
+};
+
+void timelineTurnBegin(unsigned long speechEndMs, unsigned long endOfTurnMs);
+// Safe from any task; ignored when no turn is open.
+void timelineMark(TurnPhase phase);
+void timelineTurnEnd();
+// The reply came from the reply cache, with no LLM request: the turn's samples
+// go to a "cached" row so they don't pull down the providers' percentiles.
+void timelineMarkCachedReply();
+
+// Last turn's stamps plus p50/p95/max per interval and provider.
+void timelinePrint();
+// One line of JSON with the same numbers, for comparing builds.
+void timelinePrintJson();
+void timelineReset();
+
+#endif
@@ -0,0 +1,56 @@
+#include "uplink_codec.h"
+#include <Arduino.h>
+
+struct CodecStats {
+  uint32_t frames;
+  uint64_t pcmBytes;
+  uint64_t wireBytes;
+  uint32_t encodeUsTotal;
+  uint32_t encodeUsMax;
+};
+
+static CodecStats stats = {};
+
+// Segment = position of the top bit above the 5 bits every biased sample has;
+// the 4 bits below it are the mantissa. Same codes as the G.711 reference's
+// segment table search, without the search.
+uint8_t linearToMulaw(int16_t pcm) {
+  int32_t s = pcm >> 2;
+  int32_t m = s >> 31;
+  uint8_t mask = m ? 0x7F : 0xFF;
+  s = (s ^ m) - m;
+  s += 33;                     // bias: every value has bit 5 set
+  if (s > 0x1FFF) s = 0x1FFF;  // full scale -> top code
+  int seg = 26 - __builtin_clz((uint32_t)s);
+  uint8_t code = (uint8_t)((seg << 4) | ((s >> (seg + 1)) & 0x0F));
+  return code ^ mask;
+}
+
+size_t uplinkEncode(int16_t* pcm, size_t samples) {
+  stats.frames++;
+  stats.pcmBytes += samples * 2;
+#if STT_UPLINK_MULAW
+  unsigned long t0 = micros();
+  uint8_t* out = (uint8_t*)pcm;
+  for (size_t i = 0; i < samples; i++) out[i] = linearToMulaw(pcm[i]);
+  uint32_t us = micros() - t0;
+  stats.encodeUsTotal += us;
+  if (us > stats.encodeUsMax) stats.encodeUsMax = us;
+#endif
+  size_t bytes = uplinkBytes(samples);
+  stats.wireBytes += bytes;
+  return bytes;
+}
+
+void uplinkCodecPrintStats() {
+  CodecStats s = stats;
+  Serial.printf("  Codec: %s, %u kbit/s while streaming\n", STT_UPLINK_ENCODING,
+                (unsigned)(uplinkBytes(SAMPLE_RATE) * 8 / 1000));
+  Serial.printf("  Frames: %u, PCM %u KB -> wire %u KB", (unsigned)s.frames,
+                (unsigned)(s.pcmBytes / 1024), (unsigned)(s.wireBytes / 1024));
+#if STT_UPLINK_MULAW
+  Serial.printf(", encode avg %u us, max %u us per frame",
+                (unsigned)(s.frames ? s.encodeUsTotal / s.frames : 0), (unsigned)s.encodeUsMax);
+#endif
+  Serial.println();
+}
@@ -0,0 +1,25 @@
+#ifndef AI_RELAY_WEBSOCKET_UPLINK_CODEC_H
+#define AI_RELAY_WEBSOCKET_UPLINK_CODEC_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Wire format of the streaming STT uplink, matching encoding= in stt_ws_path.
+// STT_UPLINK_MULAW sends G.711 mu-law: 8 bits per sample, half the bytes of
+// pcm_s16le, decoded by the server itself. Companding keeps ~37 dB SNR at the
+// AGC target level (~33 dB for speech 20 dB under it; test/uplink_codec_test.cpp).
+//
+// Encodes in place: afterwards the buffer holds the wire bytes (byte i only
+// overwrites the low half of sample i/2, already read). Returns the byte count.
+size_t uplinkEncode(int16_t* pcm, size_t samples);
+
+// Wire bytes for this many samples (uplink savings accounting).
+inline size_t uplinkBytes(size_t samples) { return samples * (STT_UPLINK_MULAW ? 1 : 2); }
+
+// G.711 mu-law of one 16-bit sample (top 14 bits used, as in the standard).
+uint8_t linearToMulaw(int16_t pcm);
+
+// Encoding, frames, wire vs PCM bytes, encode time per frame.
+void uplinkCodecPrintStats();
+
+#endif
@@ -0,0 +1,109 @@
+#include "vad.h"
+#include "agc.h"
+#include "config.h"
+#include <Arduino.h>
+
+// Blocks used to seed the noise floor before any decision is made
+static const uint16_t VAD_INIT_BLOCKS = 10;
+
+// log2(v) in Q8 (integer part from the MSB, 8 fraction bits by linear interpolation)
+int32_t log2Q8(uint64_t v) {
+  if (v == 0) return 0;
+  int p = 63 - __builtin_clzll(v);
+  uint32_t frac = p >= 8 ? (uint32_t)(v >> (p - 8)) & 0xFF : (uint32_t)(v << (8 - p)) & 0xFF;
+  return p * 256 + (int32_t)frac;
+}
+
+void Vad::reset() {
+  dcX_ = dcY_ = 0;
+  hpX_ = hpY_ = 0;
+  lp_ = 0;
+  lastSign_ = 0;
+  floorQ8_ = 0;
+  blocksSeen_ = 0;
+  onsetRun_ = 0;
+  hangLeft_ = 0;
+  active_ = false;
+  lastSpeech_ = false;
+  snrQ8_ = 0;
+  zcr_ = 0;
+  meanAbs_ = 0;
+}
+
+void Vad::pause() {
+  onsetRun_ = 0;
+  hangLeft_ = 0;
+  active_ = false;
+  lastSpeech_ = false;
+}
+
+bool Vad::process(const int16_t* x, size_t n) {
+  if (n == 0) return false;
+  uint64_t eTotal = 0;
+  uint64_t eBand = 0;
+  uint16_t crossings = 0;
+  for (size_t i = 0; i < n; i++) {
+    int32_t s = x[i];
+    // DC blocker, pole 0.995 (Q15)
+    int32_t d = s - dcX_ + (int32_t)(((int64_t)dcY_ * 32604) >> 15);
+    dcX_ = s;
+    dcY_ = d;
+    // One-pole high-pass at ~200 Hz: h = 0.927 * (h1 + d - d1)
+    int32_t h = (int32_t)(((int64_t)(hpY_ + d - hpX_) * 30376) >> 15);
+    hpX_ = d;
+    hpY_ = h;
+    // One-pole low-pass at ~3.4 kHz: l += 0.737 * (h - l)
+    lp_ += (int32_t)(((int64_t)(h - lp_) * 24150) >> 15);
+    eTotal += (uint64_t)((int64_t)d * d);
+    eBand += (uint64_t)((int64_t)lp_ * lp_);
+    int16_t sign = h >= 0 ? 1 : -1;
+    if (lastSign_ != 0 && sign != lastSign_) crossings++;
+    lastSign_ = sign;
+  }
+  meanAbs_ = pcmMeanAbs(x, n);
+  zcr_ = crossings;
+  int32_t energyQ8 = log2Q8(eBand / n + 1);
+  uint32_t shareQ8 = eTotal ? (uint32_t)((eBand * 256) / eTotal) : 0;
+
+  if (blocksSeen_ < VAD_INIT_BLOCKS) {
+    if (blocksSeen_ == 0 || energyQ8 < floorQ8_) floorQ8_ = energyQ8;
+    blocksSeen_++;
+    snrQ8_ = 0;
+    lastSpeech_ = false;
+    return false;
+  }
+  blocksSeen_++;
+  snrQ8_ = energyQ8 - floorQ8_;
+
+  // Well above the floor wins on its own; marginal blocks must also look like voice
+  bool strong = snrQ8_ >= 2 * VAD_SNR_Q8;
+  bool speech = meanAbs_ >= minLevel_ && snrQ8_ >= VAD_SNR_Q8 &&
+                (strong || shareQ8 >= VAD_MIN_BAND_SHARE_Q8) &&
+                (strong || crossings <= VAD_MAX_ZCR_PER_BLOCK);
+
+  if (!speech) {
+    // Follow drops quickly, rises slowly; quiet syllables inside an utterance
+    // (above half the threshold while active) must not drag the floor up
+    int32_t diff = energyQ8 - floorQ8_;
+    if (diff < 0) floorQ8_ += diff / 4;
+    else if (!active_ || snrQ8_ < VAD_SNR_Q8 / 2) floorQ8_ += diff / 16;
+  } else if ((blocksSeen_ & 3) == 0) {
+    floorQ8_++;  // ~3 dB per 10 s, so a noise step misread as speech can't latch forever
+  }
+
+  if (speech) {
+    if (onsetRun_ < 255) onsetRun_++;
+    if (onsetRun_ >= VAD_ONSET_BLOCKS) {
+      active_ = true;
+      hangLeft_ = VAD_HANGOVER_MS / MIC_BLOCK_MS;
+    }
+  } else {
+    onsetRun_ = 0;
+    if (active_) {
+      if (hangLeft_ > 0) hangLeft_--;
+      else active_ = false;
+    }
+  }
+  lastSpeech_ = speech;
+  return speech;
+}
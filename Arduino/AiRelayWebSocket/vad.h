@@ -0,0 +1,54 @@
+#ifndef AI_RELAY_WEBSOCKET_VAD_H
+#define AI_RELAY_WEBSOCKET_VAD_H
+
+#include <Arduino.h>
+
+// log2(v) in Q8 (256 = one doubling of energy, ~3 dB); also used by the echo canceller.
+int32_t log2Q8(uint64_t v);
+
+// Fixed-point voice activity detector, one MIC_BLOCK_MS block (10 ms) at a time.
+// Per block: speech-band (200-3400 Hz) energy against an adaptive noise floor,
+// share of energy inside that band, and zero-crossing rate. active() adds an
+// onset debounce and a hangover on top of the raw per-block decision.
+class Vad {
+ public:
+  Vad() { reset(); }
+
+  void reset();
+  // Returns the raw decision for this block.
+  bool process(const int16_t* block, size_t samples);
+
+  // Gap in the audio (mic skipped while we talk): end any burst, keep the noise floor.
+  void pause();
+
+  bool active() const { return active_; }
+  bool lastBlockSpeech() const { return lastSpeech_; }
+  // Diagnostics of the last block (log2 energy in Q8: 256 = ~3 dB)
+  int32_t snrQ8() const { return snrQ8_; }
+  int32_t floorQ8() const { return floorQ8_; }
+  uint16_t zeroCrossings() const { return zcr_; }
+  uint32_t meanAbs() const { return meanAbs_; }
+
+  // Blocks quieter than this (mean |sample|) never count as speech.
+  void setMinLevel(uint32_t meanAbs) { minLevel_ = meanAbs; }
+
+ private:
+  // Filter state (carried across blocks)
+  int32_t dcX_, dcY_;      // DC blocker
+  int32_t hpX_, hpY_;      // 200 Hz high-pass
+  int32_t lp_;             // 3.4 kHz low-pass
+  int16_t lastSign_;
+
+  int32_t floorQ8_;
+  uint16_t blocksSeen_;
+  uint8_t onsetRun_;
+  uint16_t hangLeft_;
+  bool active_;
+  bool lastSpeech_;
+  int32_t snrQ8_;
+  uint16_t zcr_;
+  uint32_t meanAbs_;
+  uint32_t minLevel_ = 0;
+};
+
+#endif
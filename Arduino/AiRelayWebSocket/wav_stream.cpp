@@ -0,0 +1,66 @@
+#include "wav_stream.h"
+#include "audio_utils.h"
+#include "audio_out.h"
+#include "config.h"
+#include "globals.h"
+#include <Arduino.h>
+
+bool WavStreamPlayer::begin() {
+  if (!audioOutBegin()) return false;  // no output ring: the caller falls back to text
+  headerLen_ = 0;
+  parsed_ = failed_ = false;
+  pcmRemaining_ = 0;
+  queued_ = 0;
+  active_ = true;
+  audioOutSessionBegin();
+  return true;
+}
+
+size_t WavStreamPlayer::write(const uint8_t* data, size_t len) {
+  if (!active_ || failed_) return 0;
+  if (tee_) tee_->write(data, len);
+  if (parsed_) {
+    queuePcm(data, len);
+    return len;
+  }
+  size_t toCopy = (HEADER_BUF - headerLen_) < len ? (HEADER_BUF - headerLen_) : len;
+  memcpy(header_ + headerLen_, data, toCopy);
+  headerLen_ += toCopy;
+  if (!parseWavHeader(header_, headerLen_, &wav_)) {
+    if (headerLen_ >= HEADER_BUF) {
+      Serial.println(header_[0] == 'R' ? "WAV stream: no data chunk" : "WAV stream: invalid WAV");
+      failed_ = true;
+    }
+    return len;
+  }
+  if (wav_.sampleRate == 0 || wav_.sampleRate > 48000 || wav_.channels == 0 || wav_.channels > 2) {
+    Serial.println("WAV stream: unsupported format");
+    failed_ = true;
+    return len;
+  }
+  parsed_ = true;
+  // Streamed WAVs often announce 0 or 0xFFFFFFFF; treat both as "until end of body"
+  pcmRemaining_ = (wav_.dataSize == 0 || wav_.dataSize == 0xFFFFFFFF) ? 0 : wav_.dataSize;
+  audioOutSetFormat(wav_.sampleRate, wav_.channels);
+  if (headerLen_ > wav_.dataOffset) queuePcm(header_ + wav_.dataOffset, headerLen_ - wav_.dataOffset);
+  if (len > toCopy) queuePcm(data + toCopy, len - toCopy);
+  return len;
+}
+
+void WavStreamPlayer::queuePcm(const uint8_t* data, size_t len) {
+  if (pcmRemaining_ == DATA_DONE) return;
+  if (pcmRemaining_ > 0) {
+    if (len > pcmRemaining_) len = pcmRemaining_;  // ignore chunks after "data" (e.g. LIST)
+    pcmRemaining_ -= len;
+    if (pcmRemaining_ == 0) pcmRemaining_ = DATA_DONE;
+  }
+  // Ring full is the only case where the download waits on the speaker
+  queued_ += audioOutWrite(data, len, portMAX_DELAY);
+}
+
+bool WavStreamPlayer::finish() {
+  if (!active_) return false;
+  active_ = false;
+  if (parsed_ && !failed_) audioOutDrain(60000);
+  return parsed_ && queued_ > 0;
+}
@@ -0,0 +1,49 @@
+#ifndef AI_RELAY_WEBSOCKET_WAV_STREAM_H
+#define AI_RELAY_WEBSOCKET_WAV_STREAM_H
+
+#include <Arduino.h>
+#include "audio_utils.h"
+
+// Streaming WAV sink: parses the RIFF header on the fly and queues PCM on
+// the audio output task (audio_out) as bytes arrive. The output ring absorbs
+// network bursts; the download only waits on the speaker when it is full.
+class WavStreamPlayer : public Stream {
+ public:
+  // Opens an output session on the persistent audio_out ring. False if the ring
+  // could not be allocated; nothing is played then.
+  bool begin();
+  // Wait for everything queued to play out. Returns true if any audio played.
+  bool finish();
+
+  // Optional tee of the raw WAV bytes (e.g. to a SPIFFS cache file).
+  void setTee(Print* tee) { tee_ = tee; }
+
+  size_t write(uint8_t b) override { return write(&b, 1); }
+  size_t write(const uint8_t* data, size_t len) override;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+
+  bool headerParsed() const { return parsed_; }
+  bool failed() const { return failed_; }
+  const WavInfo& info() const { return wav_; }
+  size_t bytesQueued() const { return queued_; }
+
+ private:
+  static const size_t HEADER_BUF = 256;
+
+  void queuePcm(const uint8_t* data, size_t len);
+
+  uint8_t header_[HEADER_BUF];
+  size_t headerLen_ = 0;
+  bool active_ = false;
+  bool parsed_ = false;
+  bool failed_ = false;
+  WavInfo wav_;
+  static const size_t DATA_DONE = (size_t)-1;
+  size_t pcmRemaining_ = 0;   // 0 = unknown length (read to end), DATA_DONE = data chunk complete
+  size_t queued_ = 0;
+  Print* tee_ = nullptr;
+};
+
+#endif